@@ -3,17 +3,26 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include <sys/types.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "db/db_impl.h"
 #include "db/version_set.h"
 #include "leveldb/cache.h"
+#include "leveldb/compressor.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/memtablerep.h"
+#include "leveldb/perf_context.h"
+#include "leveldb/persistent_cache.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/statistics.h"
+#include "leveldb/sst_file_writer.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
 #include "util/crc32c.h"
 #include "util/histogram.h"
+#include "util/io_uring.h"
 #include "util/mutexlock.h"
 #include "util/random.h"
 #include "util/testutil.h"
@@ -25,17 +34,31 @@
 //      overwrite     -- overwrite N values in random key order in async mode
 //      fillsync      -- write N/100 values in random key order in sync mode
 //      fill100K      -- write N/1000 100K values in random order in async mode
+//      fillbulk      -- write N values in sequential key order to tables of
+//                       up to --max_file_size bytes with an SstFileWriter
+//                       and ingest them
 //      deleteseq     -- delete N keys in sequential order
 //      deleterandom  -- delete N keys in random order
 //      readseq       -- read N times sequentially
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
 //      readmissing   -- read N missing keys in random order
+//      multireadrandom -- read N times in random order, in MultiGet()
+//                       batches of --multiget_batch_size keys
 //      readhot       -- read N times in random order from 1% section of DB
+//      readzipf      -- read N times, picking keys from a Zipfian
+//                       distribution with exponent --zipf_theta
 //      seekrandom    -- N random seeks
 //      open          -- cost of opening a DB
 //      crc32c        -- repeated crc32c of 4K of data
+//      snappycomp    -- repeated snappy compression of a block of data
+//      snappyuncomp  -- repeated snappy uncompression of a block of data
+//      zstdcomp, zstduncomp, lz4comp, lz4uncomp
+//                    -- as above, for the zstd and lz4 compressors
 //      acquireload   -- load N*1000 times
+//      cachebench    -- N cache lookups of block-sized entries per thread,
+//                       inserting on a miss; the entries looked up fit
+//                       in half of --cache_size
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
@@ -58,6 +81,10 @@ static const char* FLAGS_benchmarks =
     "crc32c,"
     "snappycomp,"
     "snappyuncomp,"
+    "zstdcomp,"
+    "zstduncomp,"
+    "lz4comp,"
+    "lz4uncomp,"
     "acquireload,"
     ;
 
@@ -84,6 +111,21 @@ static bool FLAGS_histogram = false;
 // (initialized to default value by "main")
 static int FLAGS_write_buffer_size = 0;
 
+// Number of memtables that may be held in memory, counting the one being
+// written to, before writes stall on flushes.
+// (initialized to default value by "main")
+static int FLAGS_max_write_buffer_number = 0;
+
+// Data structure that holds the entries of a memtable: "skiplist",
+// "hash_skiplist" or "vector" (Options::memtable_factory).
+static const char* FLAGS_memtable_rep = "skiplist";
+
+// Number of leading bytes of a key that pick its bucket, and number of
+// buckets, for --memtable_rep=hash_skiplist.  Keys are 16 digits, so the
+// default puts up to 100 consecutive keys in each bucket.
+static int FLAGS_memtable_prefix_length = 14;
+static int FLAGS_memtable_buckets = 100000;
+
 // Number of bytes written to each file.
 // (initialized to default value by "main")
 static int FLAGS_max_file_size = 0;
@@ -96,6 +138,32 @@ static int FLAGS_block_size = 0;
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
 
+// Cache implementation of --cache_size and cachebench: "lru" for
+// NewLRUCache(), or "clock" for NewClockCache().
+static const char* FLAGS_cache_type = "lru";
+
+// Number of shards of the clock cache is 2^cache_numshardbits.
+static int FLAGS_cache_numshardbits = 4;
+
+// Fraction of the LRU cache reserved for index and filter blocks.
+static double FLAGS_cache_high_pri_pool_ratio = 0.0;
+
+// If true, keep the index and filter blocks of tables in the block cache.
+static bool FLAGS_cache_index_and_filter_blocks = false;
+
+// If non-NULL, keep blocks evicted from the block cache in a persistent
+// cache in this directory, of at most --persistent_cache_size_mb MB.
+static const char* FLAGS_persistent_cache_path = NULL;
+static int FLAGS_persistent_cache_size_mb = 1024;
+
+// Number of bytes to use as a cache of the values found by point lookups
+// (Options::row_cache).  Zero means no row cache.
+static int FLAGS_row_cache_size = 0;
+
+// Skew of the keys read by readzipf, in (0, 1): the key of rank r is read
+// with probability proportional to 1/r^zipf_theta.
+static double FLAGS_zipf_theta = 0.99;
+
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
@@ -103,6 +171,59 @@ static int FLAGS_open_files = 0;
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// If true, use the blocked bloom filter instead of the builtin one.
+static bool FLAGS_blocked_bloom = false;
+
+// If true, add a hash index to data blocks for point lookups.
+static bool FLAGS_data_block_hash_index = false;
+
+// If true, partition the index and filter blocks of tables.
+static bool FLAGS_partition_index_and_filters = false;
+
+// Maximum number of compactions to run concurrently.
+// (initialized to default value by "main")
+static int FLAGS_max_background_compactions = 0;
+
+// Maximum number of key ranges one compaction is split into.
+// (initialized to default value by "main")
+static int FLAGS_max_subcompactions = 0;
+
+// Readahead limit of the iterators of readseq and readreverse.
+// (initialized to default value by "main")
+static int FLAGS_readahead_size = 0;
+
+// Readahead limit of compaction input iterators.
+// (initialized to default value by "main")
+static int FLAGS_compaction_readahead_size = 0;
+
+// Number of keys looked up by each MultiGet() of multireadrandom.
+static int FLAGS_multiget_batch_size = 32;
+
+// Maximum number of threads one MultiGet() searches tables with.
+// (initialized to default value by "main")
+static int FLAGS_max_multiget_parallelism = 0;
+
+// If true, read tables around the page cache (Options::use_direct_reads).
+static bool FLAGS_use_direct_reads = false;
+
+// If true, compactions read and write tables around the page cache.
+static bool FLAGS_use_direct_io_for_compaction = false;
+
+// If positive, limit the table writes of flushes and compactions to this
+// many bytes per second.
+static int FLAGS_rate_limit = 0;
+
+// If true, let the rate limiter raise its rate as compactions fall behind.
+static bool FLAGS_rate_limit_auto_tune = false;
+
+// If 1, count tickers in Options::statistics and print them after the
+// benchmarks; if 2, also fill its latency histograms.
+static int FLAGS_statistics = 0;
+
+// If 1, count the stages of each thread's operations in its PerfContext and
+// print the sum over all threads after each benchmark; if 2, also time them.
+static int FLAGS_perf_level = 0;
+
 // If true, do not destroy the existing database.  If you set this
 // flag and also specify a benchmark that wants a fresh database, that
 // benchmark will fail.
@@ -111,12 +232,112 @@ static bool FLAGS_use_existing_db = false;
 // If true, reuse existing log/MANIFEST files when re-opening a database.
 static bool FLAGS_reuse_logs = false;
 
+// If true, overlap log writes of one batch group with the memtable
+// insert of the previous one.
+static bool FLAGS_enable_pipelined_write = false;
+
+// If true, let the writers of a group insert into the memtable in parallel
+// (requires --enable_pipelined_write=1).
+static bool FLAGS_allow_concurrent_memtable_write = false;
+
+// Compression used for tables: one of none, snappy, zstd or lz4.
+static const char* FLAGS_compression = "snappy";
+
+// If non-NULL, a comma-separated list of compressions to use for each level
+// (e.g. "lz4,lz4,zstd"), overriding --compression.
+static const char* FLAGS_compression_per_level = NULL;
+
 // Use the db with the following name.
 static const char* FLAGS_db = NULL;
 
+// Env to run against: "posix" for Env::Default(), or "uring" for the Env
+// returned by NewIoUringEnv().
+static const char* FLAGS_env = "posix";
+
 namespace leveldb {
 
 namespace {
+
+Cache* NewBenchCache(size_t capacity) {
+  if (strcmp(FLAGS_cache_type, "clock") == 0) {
+    return NewClockCache(capacity, FLAGS_cache_numshardbits);
+  }
+  return NewLRUCache(capacity, FLAGS_cache_high_pri_pool_ratio);
+}
+
+// Draws ranks in [0,n) whose probabilities follow Zipf's law: rank r with
+// probability proportional to 1/(r+1)^theta.  Uses the method of Gray et
+// al., "Quickly Generating Billion-Record Synthetic Databases", which
+// needs O(n) setup and O(1) per draw.
+class ZipfianGenerator {
+ public:
+  // REQUIRES: n > 0, 0 < theta < 1
+  ZipfianGenerator(int n, double theta)
+      : n_(n), theta_(theta), alpha_(1.0 / (1.0 - theta)) {
+    zetan_ = 0;
+    for (int i = 1; i <= n; i++) {
+      zetan_ += 1.0 / pow(i, theta);
+    }
+    const double zeta2 = 1.0 + 1.0 / pow(2, theta);
+    eta_ = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan_);
+  }
+
+  int Next(Random* rnd) const {
+    const double u = rnd->Next() / 2147483647.0;
+    const double uz = u * zetan_;
+    if (uz < 1.0) {
+      return 0;
+    }
+    if (uz < 1.0 + pow(0.5, theta_)) {
+      return 1;
+    }
+    const int r = static_cast<int>(n_ * pow(eta_ * u - eta_ + 1.0, alpha_));
+    return (r < n_) ? r : n_ - 1;
+  }
+
+ private:
+  const int n_;
+  const double theta_;
+  const double alpha_;
+  double zetan_;
+  double eta_;
+};
+
+// Parse the name of a compression as accepted by --compression.
+bool ParseCompression(const Slice& name, CompressionType* type) {
+  if (name == Slice("none")) {
+    *type = kNoCompression;
+  } else if (name == Slice("snappy")) {
+    *type = kSnappyCompression;
+  } else if (name == Slice("zstd")) {
+    *type = kZstdCompression;
+  } else if (name == Slice("lz4")) {
+    *type = kLZ4Compression;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Parse a comma-separated list of compression names.
+bool ParseCompressionList(const char* list,
+                          std::vector<CompressionType>* types) {
+  types->clear();
+  const char* p = list;
+  while (true) {
+    const char* sep = strchr(p, ',');
+    Slice name = (sep == NULL) ? Slice(p) : Slice(p, sep - p);
+    CompressionType type;
+    if (!ParseCompression(name, &type)) {
+      return false;
+    }
+    types->push_back(type);
+    if (sep == NULL) {
+      return true;
+    }
+    p = sep + 1;
+  }
+}
 leveldb::Env* g_env = NULL;
 
 // Helper for quickly generating random data.
@@ -183,6 +404,7 @@ class Stats {
   int64_t bytes_;
   double last_op_finish_;
   Histogram hist_;
+  PerfContext perf_;
   std::string message_;
 
  public:
@@ -198,10 +420,14 @@ class Stats {
     start_ = g_env->NowMicros();
     finish_ = start_;
     message_.clear();
+    perf_.Reset();
+    SetPerfLevel(static_cast<PerfLevel>(FLAGS_perf_level));
+    GetPerfContext()->Reset();
   }
 
   void Merge(const Stats& other) {
     hist_.Merge(other.hist_);
+    perf_.Add(other.perf_);
     done_ += other.done_;
     bytes_ += other.bytes_;
     seconds_ += other.seconds_;
@@ -215,6 +441,7 @@ class Stats {
   void Stop() {
     finish_ = g_env->NowMicros();
     seconds_ = (finish_ - start_) * 1e-6;
+    perf_ = *GetPerfContext();
   }
 
   void AddMessage(Slice msg) {
@@ -276,6 +503,9 @@ class Stats {
     if (FLAGS_histogram) {
       fprintf(stdout, "Microseconds per op:\n%s\n", hist_.ToString().c_str());
     }
+    if (FLAGS_perf_level > 0) {
+      fprintf(stdout, "PerfContext:\n%s\n", perf_.ToString().c_str());
+    }
     fflush(stdout);
   }
 };
@@ -317,7 +547,13 @@ struct ThreadState {
 class Benchmark {
  private:
   Cache* cache_;
+  Cache* bench_cache_;  // Exercised by cachebench
+  PersistentCache* persistent_cache_;
+  Cache* row_cache_;
+  MemTableRepFactory* memtable_factory_;
   const FilterPolicy* filter_policy_;
+  RateLimiter* rate_limiter_;
+  Statistics* statistics_;
   DB* db_;
   int num_;
   int value_size_;
@@ -363,6 +599,11 @@ class Benchmark {
     } else if (compressed.size() >= sizeof(text)) {
       fprintf(stdout, "WARNING: Snappy compression is not effective\n");
     }
+
+    if (strcmp(FLAGS_env, "uring") == 0 && !IoUring::Supported()) {
+      fprintf(stdout,
+              "WARNING: io_uring is not available; using the posix Env\n");
+    }
   }
 
   void PrintEnvironment() {
@@ -402,10 +643,21 @@ class Benchmark {
 
  public:
   Benchmark()
-  : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : NULL),
-    filter_policy_(FLAGS_bloom_bits >= 0
-                   ? NewBloomFilterPolicy(FLAGS_bloom_bits)
-                   : NULL),
+  : cache_(FLAGS_cache_size >= 0 ? NewBenchCache(FLAGS_cache_size) : NULL),
+    bench_cache_(NULL),
+    persistent_cache_(NULL),
+    row_cache_(FLAGS_row_cache_size > 0 ? NewBenchCache(FLAGS_row_cache_size)
+               : NULL),
+    memtable_factory_(NULL),
+    filter_policy_(FLAGS_bloom_bits < 0 ? NULL
+                   : FLAGS_blocked_bloom
+                   ? NewBlockedBloomFilterPolicy(FLAGS_bloom_bits)
+                   : NewBloomFilterPolicy(FLAGS_bloom_bits)),
+    rate_limiter_(FLAGS_rate_limit > 0
+                  ? NewRateLimiter(FLAGS_rate_limit, FLAGS_rate_limit_auto_tune)
+                  : NULL),
+    statistics_(FLAGS_statistics == 0 ? NULL
+                : NewStatistics(FLAGS_statistics == 2 ? kAll : kExceptTimers)),
     db_(NULL),
     num_(FLAGS_num),
     value_size_(FLAGS_value_size),
@@ -422,12 +674,34 @@ class Benchmark {
     if (!FLAGS_use_existing_db) {
       DestroyDB(FLAGS_db, Options());
     }
+    if (strcmp(FLAGS_memtable_rep, "hash_skiplist") == 0) {
+      memtable_factory_ = NewHashSkipListRepFactory(
+          FLAGS_memtable_prefix_length, FLAGS_memtable_buckets);
+    } else if (strcmp(FLAGS_memtable_rep, "vector") == 0) {
+      memtable_factory_ = NewVectorRepFactory();
+    }
+    if (FLAGS_persistent_cache_path != NULL) {
+      Status s = NewPersistentCache(
+          g_env, FLAGS_persistent_cache_path,
+          static_cast<uint64_t>(FLAGS_persistent_cache_size_mb) << 20,
+          &persistent_cache_);
+      if (!s.ok()) {
+        fprintf(stderr, "persistent cache error: %s\n", s.ToString().c_str());
+        exit(1);
+      }
+    }
   }
 
   ~Benchmark() {
     delete db_;
     delete cache_;
+    delete bench_cache_;
+    delete row_cache_;
+    delete persistent_cache_;  // After the block caches, which feed it
+    delete memtable_factory_;
     delete filter_policy_;
+    delete rate_limiter_;
+    delete statistics_;
   }
 
   void Run() {
@@ -479,6 +753,9 @@ class Benchmark {
         num_ /= 1000;
         write_options_.sync = true;
         method = &Benchmark::WriteRandom;
+      } else if (name == Slice("fillbulk")) {
+        fresh_db = true;
+        method = &Benchmark::BulkLoad;
       } else if (name == Slice("fill100K")) {
         fresh_db = true;
         num_ /= 1000;
@@ -490,12 +767,16 @@ class Benchmark {
         method = &Benchmark::ReadReverse;
       } else if (name == Slice("readrandom")) {
         method = &Benchmark::ReadRandom;
+      } else if (name == Slice("multireadrandom")) {
+        method = &Benchmark::MultiReadRandom;
       } else if (name == Slice("readmissing")) {
         method = &Benchmark::ReadMissing;
       } else if (name == Slice("seekrandom")) {
         method = &Benchmark::SeekRandom;
       } else if (name == Slice("readhot")) {
         method = &Benchmark::ReadHot;
+      } else if (name == Slice("readzipf")) {
+        method = &Benchmark::ReadZipf;
       } else if (name == Slice("readrandomsmall")) {
         reads_ /= 1000;
         method = &Benchmark::ReadRandom;
@@ -512,10 +793,23 @@ class Benchmark {
         method = &Benchmark::Crc32c;
       } else if (name == Slice("acquireload")) {
         method = &Benchmark::AcquireLoad;
+      } else if (name == Slice("cachebench")) {
+        delete bench_cache_;
+        bench_cache_ = NewBenchCache(
+            FLAGS_cache_size >= 0 ? FLAGS_cache_size : 8 << 20);
+        method = &Benchmark::CacheBench;
       } else if (name == Slice("snappycomp")) {
         method = &Benchmark::SnappyCompress;
       } else if (name == Slice("snappyuncomp")) {
         method = &Benchmark::SnappyUncompress;
+      } else if (name == Slice("zstdcomp")) {
+        method = &Benchmark::ZstdCompress;
+      } else if (name == Slice("zstduncomp")) {
+        method = &Benchmark::ZstdUncompress;
+      } else if (name == Slice("lz4comp")) {
+        method = &Benchmark::LZ4Compress;
+      } else if (name == Slice("lz4uncomp")) {
+        method = &Benchmark::LZ4Uncompress;
       } else if (name == Slice("heapprofile")) {
         HeapProfile();
       } else if (name == Slice("stats")) {
@@ -545,6 +839,10 @@ class Benchmark {
         RunBenchmark(num_threads, name, method);
       }
     }
+
+    if (statistics_ != NULL) {
+      fprintf(stdout, "\nSTATISTICS:\n%s", statistics_->ToString().c_str());
+    }
   }
 
  private:
@@ -659,7 +957,37 @@ class Benchmark {
     if (ptr == NULL) exit(1); // Disable unused variable warning.
   }
 
-  void SnappyCompress(ThreadState* thread) {
+  static void DeleteBenchCacheEntry(const Slice& key, void* value) {
+  }
+
+  void CacheBench(ThreadState* thread) {
+    const size_t charge = FLAGS_block_size;
+    const size_t capacity = FLAGS_cache_size >= 0 ? FLAGS_cache_size : 8 << 20;
+    int range = capacity / charge / 2;
+    if (range < 1) range = 1;
+    int found = 0;
+    for (int i = 0; i < reads_; i++) {
+      char key[100];
+      const int k = thread->rand.Next() % range;
+      snprintf(key, sizeof(key), "%016d", k);
+      Cache::Handle* handle = bench_cache_->Lookup(key);
+      if (handle != NULL) {
+        found++;
+      } else {
+        handle = bench_cache_->Insert(key, NULL, charge,
+                                      &DeleteBenchCacheEntry);
+      }
+      bench_cache_->Release(handle);
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%s: %d of %d found)",
+             FLAGS_cache_type, found, reads_);
+    thread->stats.AddMessage(msg);
+  }
+
+  void Compress(ThreadState* thread, CompressionType type) {
+    const Compressor* compressor = GetCompressor(type);
     RandomGenerator gen;
     Slice input = gen.Generate(Options().block_size);
     int64_t bytes = 0;
@@ -667,14 +995,16 @@ class Benchmark {
     bool ok = true;
     std::string compressed;
     while (ok && bytes < 1024 * 1048576) {  // Compress 1G
-      ok = port::Snappy_Compress(input.data(), input.size(), &compressed);
+      ok = compressor->Compress(input, &compressed);
       produced += compressed.size();
       bytes += input.size();
       thread->stats.FinishedSingleOp();
     }
 
     if (!ok) {
-      thread->stats.AddMessage("(snappy failure)");
+      char buf[100];
+      snprintf(buf, sizeof(buf), "(%s failure)", compressor->Name());
+      thread->stats.AddMessage(buf);
     } else {
       char buf[100];
       snprintf(buf, sizeof(buf), "(output: %.1f%%)",
@@ -684,40 +1014,89 @@ class Benchmark {
     }
   }
 
-  void SnappyUncompress(ThreadState* thread) {
+  void Uncompress(ThreadState* thread, CompressionType type) {
+    const Compressor* compressor = GetCompressor(type);
     RandomGenerator gen;
     Slice input = gen.Generate(Options().block_size);
     std::string compressed;
-    bool ok = port::Snappy_Compress(input.data(), input.size(), &compressed);
+    bool ok = compressor->Compress(input, &compressed);
     int64_t bytes = 0;
     char* uncompressed = new char[input.size()];
     while (ok && bytes < 1024 * 1048576) {  // Compress 1G
-      ok =  port::Snappy_Uncompress(compressed.data(), compressed.size(),
-                                    uncompressed);
+      ok = compressor->Uncompress(compressed, uncompressed, input.size());
       bytes += input.size();
       thread->stats.FinishedSingleOp();
     }
     delete[] uncompressed;
 
     if (!ok) {
-      thread->stats.AddMessage("(snappy failure)");
+      char buf[100];
+      snprintf(buf, sizeof(buf), "(%s failure)", compressor->Name());
+      thread->stats.AddMessage(buf);
     } else {
       thread->stats.AddBytes(bytes);
     }
   }
 
+  void SnappyCompress(ThreadState* thread) {
+    Compress(thread, kSnappyCompression);
+  }
+
+  void SnappyUncompress(ThreadState* thread) {
+    Uncompress(thread, kSnappyCompression);
+  }
+
+  void ZstdCompress(ThreadState* thread) {
+    Compress(thread, kZstdCompression);
+  }
+
+  void ZstdUncompress(ThreadState* thread) {
+    Uncompress(thread, kZstdCompression);
+  }
+
+  void LZ4Compress(ThreadState* thread) {
+    Compress(thread, kLZ4Compression);
+  }
+
+  void LZ4Uncompress(ThreadState* thread) {
+    Uncompress(thread, kLZ4Compression);
+  }
+
   void Open() {
     assert(db_ == NULL);
     Options options;
     options.env = g_env;
     options.create_if_missing = !FLAGS_use_existing_db;
     options.block_cache = cache_;
+    options.cache_index_and_filter_blocks = FLAGS_cache_index_and_filter_blocks;
+    options.persistent_cache = persistent_cache_;
+    options.row_cache = row_cache_;
     options.write_buffer_size = FLAGS_write_buffer_size;
+    options.max_write_buffer_number = FLAGS_max_write_buffer_number;
+    options.memtable_factory = memtable_factory_;
     options.max_file_size = FLAGS_max_file_size;
     options.block_size = FLAGS_block_size;
     options.max_open_files = FLAGS_open_files;
     options.filter_policy = filter_policy_;
+    options.partition_index_and_filters = FLAGS_partition_index_and_filters;
+    options.data_block_hash_index = FLAGS_data_block_hash_index;
+    ParseCompression(FLAGS_compression, &options.compression);
+    if (FLAGS_compression_per_level != NULL) {
+      ParseCompressionList(FLAGS_compression_per_level,
+                           &options.compression_per_level);
+    }
     options.reuse_logs = FLAGS_reuse_logs;
+    options.enable_pipelined_write = FLAGS_enable_pipelined_write;
+    options.allow_concurrent_memtable_write =
+        FLAGS_allow_concurrent_memtable_write;
+    options.max_background_compactions = FLAGS_max_background_compactions;
+    options.max_subcompactions = FLAGS_max_subcompactions;
+    options.max_multiget_parallelism = FLAGS_max_multiget_parallelism;
+    options.compaction_readahead_size = FLAGS_compaction_readahead_size;
+    options.use_direct_reads = FLAGS_use_direct_reads;
+    options.use_direct_io_for_compaction = FLAGS_use_direct_io_for_compaction;
+    options.rate_limiter = rate_limiter_;
+    options.statistics = statistics_;
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -771,8 +1150,59 @@ class Benchmark {
     thread->stats.AddBytes(bytes);
   }
 
+  void BulkLoad(ThreadState* thread) {
+    Options options;
+    options.env = g_env;
+    options.block_size = FLAGS_block_size;
+    options.filter_policy = filter_policy_;
+    options.partition_index_and_filters = FLAGS_partition_index_and_filters;
+    options.data_block_hash_index = FLAGS_data_block_hash_index;
+    ParseCompression(FLAGS_compression, &options.compression);
+    IngestOptions ingest_options;
+    ingest_options.move_file = true;
+
+    RandomGenerator gen;
+    SstFileWriter writer(options);
+    std::string fname;
+    int files = 0;
+    int64_t bytes = 0;
+    Status s;
+    for (int i = 0; i < num_ && s.ok(); i++) {
+      if (fname.empty()) {
+        char buf[100];
+        snprintf(buf, sizeof(buf), "%s/bulk-%d-%06d.sst",
+                 FLAGS_db, thread->tid, files++);
+        fname = buf;
+        s = writer.Open(fname);
+      }
+      char key[100];
+      snprintf(key, sizeof(key), "%016d", i);
+      if (s.ok()) {
+        s = writer.Put(key, gen.Generate(value_size_));
+      }
+      bytes += value_size_ + strlen(key);
+      thread->stats.FinishedSingleOp();
+      if (s.ok() &&
+          (writer.FileSize() >= static_cast<uint64_t>(FLAGS_max_file_size) ||
+           i == num_ - 1)) {
+        s = writer.Finish();
+        if (s.ok()) {
+          s = db_->IngestExternalFile(ingest_options, fname);
+        }
+        fname.clear();
+      }
+    }
+    if (!s.ok()) {
+      fprintf(stderr, "ingest error: %s\n", s.ToString().c_str());
+      exit(1);
+    }
+    thread->stats.AddBytes(bytes);
+  }
+
   void ReadSequential(ThreadState* thread) {
-    Iterator* iter = db_->NewIterator(ReadOptions());
+    ReadOptions options;
+    options.readahead_size = FLAGS_readahead_size;
+    Iterator* iter = db_->NewIterator(options);
     int i = 0;
     int64_t bytes = 0;
     for (iter->SeekToFirst(); i < reads_ && iter->Valid(); iter->Next()) {
@@ -785,7 +1215,9 @@ class Benchmark {
   }
 
   void ReadReverse(ThreadState* thread) {
-    Iterator* iter = db_->NewIterator(ReadOptions());
+    ReadOptions options;
+    options.readahead_size = FLAGS_readahead_size;
+    Iterator* iter = db_->NewIterator(options);
     int i = 0;
     int64_t bytes = 0;
     for (iter->SeekToLast(); i < reads_ && iter->Valid(); iter->Prev()) {
@@ -815,6 +1247,38 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  void MultiReadRandom(ThreadState* thread) {
+    ReadOptions options;
+    std::vector<std::string> keys;
+    std::vector<Slice> key_slices;
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    int found = 0;
+    for (int i = 0; i < reads_; i += FLAGS_multiget_batch_size) {
+      const int batch = (reads_ - i < FLAGS_multiget_batch_size)
+                        ? reads_ - i : FLAGS_multiget_batch_size;
+      keys.resize(batch);
+      for (int j = 0; j < batch; j++) {
+        char key[100];
+        const int k = thread->rand.Next() % FLAGS_num;
+        snprintf(key, sizeof(key), "%016d", k);
+        keys[j] = key;
+      }
+      key_slices.assign(keys.begin(), keys.end());
+      db_->MultiGet(options, key_slices, &values, &statuses);
+      // Count every key as an op so that rates compare with readrandom.
+      for (int j = 0; j < batch; j++) {
+        if (statuses[j].ok()) {
+          found++;
+        }
+        thread->stats.FinishedSingleOp();
+      }
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
+    thread->stats.AddMessage(msg);
+  }
+
   void ReadMissing(ThreadState* thread) {
     ReadOptions options;
     std::string value;
@@ -840,6 +1304,28 @@ class Benchmark {
     }
   }
 
+  void ReadZipf(ThreadState* thread) {
+    ReadOptions options;
+    std::string value;
+    int found = 0;
+    ZipfianGenerator zipf(FLAGS_num, FLAGS_zipf_theta);
+    for (int i = 0; i < reads_; i++) {
+      char key[100];
+      // Scatter the hot keys over the key space, and so over the tables.
+      const int rank = zipf.Next(&thread->rand);
+      const int k = static_cast<int>(
+          (static_cast<uint64_t>(rank) * 2654435761u) % FLAGS_num);
+      snprintf(key, sizeof(key), "%016d", k);
+      if (db_->Get(options, key, &value).ok()) {
+        found++;
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d of %d found)", found, reads_);
+    thread->stats.AddMessage(msg);
+  }
+
   void SeekRandom(ThreadState* thread) {
     ReadOptions options;
     int found = 0;
@@ -955,15 +1441,26 @@ class Benchmark {
 
 int main(int argc, char** argv) {
   FLAGS_write_buffer_size = leveldb::Options().write_buffer_size;
+  FLAGS_max_write_buffer_number = leveldb::Options().max_write_buffer_number;
   FLAGS_max_file_size = leveldb::Options().max_file_size;
   FLAGS_block_size = leveldb::Options().block_size;
   FLAGS_open_files = leveldb::Options().max_open_files;
+  FLAGS_max_background_compactions =
+      leveldb::Options().max_background_compactions;
+  FLAGS_max_subcompactions = leveldb::Options().max_subcompactions;
+  FLAGS_max_multiget_parallelism =
+      leveldb::Options().max_multiget_parallelism;
+  FLAGS_readahead_size = leveldb::ReadOptions().readahead_size;
+  FLAGS_compaction_readahead_size =
+      leveldb::Options().compaction_readahead_size;
   std::string default_db_path;
 
   for (int i = 1; i < argc; i++) {
     double d;
     int n;
     char junk;
+    leveldb::CompressionType compression;
+    std::vector<leveldb::CompressionType> compression_list;
     if (leveldb::Slice(argv[i]).starts_with("--benchmarks=")) {
       FLAGS_benchmarks = argv[i] + strlen("--benchmarks=");
     } else if (sscanf(argv[i], "--compression_ratio=%lf%c", &d, &junk) == 1) {
@@ -977,6 +1474,12 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--reuse_logs=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_reuse_logs = n;
+    } else if (sscanf(argv[i], "--enable_pipelined_write=%d%c", &n, &junk) == 1
+               && (n == 0 || n == 1)) {
+      FLAGS_enable_pipelined_write = n;
+    } else if (sscanf(argv[i], "--allow_concurrent_memtable_write=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_allow_concurrent_memtable_write = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
@@ -987,25 +1490,118 @@ int main(int argc, char** argv) {
       FLAGS_value_size = n;
     } else if (sscanf(argv[i], "--write_buffer_size=%d%c", &n, &junk) == 1) {
       FLAGS_write_buffer_size = n;
+    } else if (sscanf(argv[i], "--max_write_buffer_number=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_max_write_buffer_number = n;
     } else if (sscanf(argv[i], "--max_file_size=%d%c", &n, &junk) == 1) {
       FLAGS_max_file_size = n;
     } else if (sscanf(argv[i], "--block_size=%d%c", &n, &junk) == 1) {
       FLAGS_block_size = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
+    } else if (strcmp(argv[i], "--cache_type=lru") == 0 ||
+               strcmp(argv[i], "--cache_type=clock") == 0) {
+      FLAGS_cache_type = argv[i] + 13;
+    } else if (sscanf(argv[i], "--cache_numshardbits=%d%c", &n, &junk) == 1 &&
+               n >= 0 && n < 20) {
+      FLAGS_cache_numshardbits = n;
+    } else if (sscanf(argv[i], "--cache_high_pri_pool_ratio=%lf%c",
+                      &d, &junk) == 1 && d >= 0.0 && d <= 1.0) {
+      FLAGS_cache_high_pri_pool_ratio = d;
+    } else if (sscanf(argv[i], "--cache_index_and_filter_blocks=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_cache_index_and_filter_blocks = n;
+    } else if (strncmp(argv[i], "--persistent_cache_path=", 24) == 0) {
+      FLAGS_persistent_cache_path = argv[i] + 24;
+    } else if (sscanf(argv[i], "--persistent_cache_size_mb=%d%c",
+                      &n, &junk) == 1 && n > 0) {
+      FLAGS_persistent_cache_size_mb = n;
+    } else if (sscanf(argv[i], "--row_cache_size=%d%c", &n, &junk) == 1 &&
+               n >= 0) {
+      FLAGS_row_cache_size = n;
+    } else if (sscanf(argv[i], "--zipf_theta=%lf%c", &d, &junk) == 1 &&
+               d > 0.0 && d < 1.0) {
+      FLAGS_zipf_theta = d;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (sscanf(argv[i], "--blocked_bloom=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_blocked_bloom = n;
+    } else if (sscanf(argv[i], "--partition_index_and_filters=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_partition_index_and_filters = n;
+    } else if (sscanf(argv[i], "--data_block_hash_index=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_data_block_hash_index = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (sscanf(argv[i], "--max_background_compactions=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_max_background_compactions = n;
+    } else if (sscanf(argv[i], "--max_subcompactions=%d%c", &n, &junk) == 1) {
+      FLAGS_max_subcompactions = n;
+    } else if (sscanf(argv[i], "--readahead_size=%d%c", &n, &junk) == 1 &&
+               n >= 0) {
+      FLAGS_readahead_size = n;
+    } else if (sscanf(argv[i], "--compaction_readahead_size=%d%c",
+                      &n, &junk) == 1 && n >= 0) {
+      FLAGS_compaction_readahead_size = n;
+    } else if (sscanf(argv[i], "--use_direct_reads=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_use_direct_reads = n;
+    } else if (sscanf(argv[i], "--use_direct_io_for_compaction=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_use_direct_io_for_compaction = n;
+    } else if (sscanf(argv[i], "--rate_limit=%d%c", &n, &junk) == 1) {
+      FLAGS_rate_limit = n;
+    } else if (sscanf(argv[i], "--rate_limit_auto_tune=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_rate_limit_auto_tune = n;
+    } else if (sscanf(argv[i], "--statistics=%d%c", &n, &junk) == 1 &&
+               n >= 0 && n <= 2) {
+      FLAGS_statistics = n;
+    } else if (sscanf(argv[i], "--perf_level=%d%c", &n, &junk) == 1 &&
+               n >= 0 && n <= 2) {
+      FLAGS_perf_level = n;
+    } else if (sscanf(argv[i], "--multiget_batch_size=%d%c",
+                      &n, &junk) == 1 && n > 0) {
+      FLAGS_multiget_batch_size = n;
+    } else if (sscanf(argv[i], "--max_multiget_parallelism=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_max_multiget_parallelism = n;
+    } else if (strncmp(argv[i], "--compression=", 14) == 0 &&
+               leveldb::ParseCompression(argv[i] + 14, &compression)) {
+      FLAGS_compression = argv[i] + 14;
+    } else if (strncmp(argv[i], "--compression_per_level=", 24) == 0 &&
+               leveldb::ParseCompressionList(argv[i] + 24,
+                                             &compression_list)) {
+      FLAGS_compression_per_level = argv[i] + 24;
+    } else if (strcmp(argv[i], "--memtable_rep=skiplist") == 0 ||
+               strcmp(argv[i], "--memtable_rep=hash_skiplist") == 0 ||
+               strcmp(argv[i], "--memtable_rep=vector") == 0) {
+      FLAGS_memtable_rep = argv[i] + 15;
+    } else if (sscanf(argv[i], "--memtable_prefix_length=%d%c",
+                      &n, &junk) == 1 && n >= 0) {
+      FLAGS_memtable_prefix_length = n;
+    } else if (sscanf(argv[i], "--memtable_buckets=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_memtable_buckets = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
+    } else if (strcmp(argv[i], "--env=posix") == 0 ||
+               strcmp(argv[i], "--env=uring") == 0) {
+      FLAGS_env = argv[i] + 6;
     } else {
       fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
       exit(1);
     }
   }
 
-  leveldb::g_env = leveldb::Env::Default();
+  if (strcmp(FLAGS_env, "uring") == 0) {
+    leveldb::g_env = leveldb::NewIoUringEnv();
+  } else {
+    leveldb::g_env = leveldb::Env::Default();
+  }
 
   // Choose a location for the test database if none given with --db=<path>
   if (FLAGS_db == NULL) {
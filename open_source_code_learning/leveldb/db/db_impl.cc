@@ -22,6 +22,7 @@
 #include "db/write_batch_internal.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/rate_limiter.h"
 #include "leveldb/status.h"
 #include "leveldb/table.h"
 #include "leveldb/table_builder.h"
@@ -32,20 +33,101 @@
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/perf_context_imp.h"
+#include "util/statistics.h"
 
 namespace leveldb {
 
 const int kNumNonTableCacheFiles = 10;
 
+namespace {
+
+static double LoadDebt(const port::AtomicPointer* debt) {
+  return reinterpret_cast<intptr_t>(debt->Acquire_Load()) / 1000.0;
+}
+
+// A WritableFile that waits for a RateLimiter before every Append() to
+// the file it wraps
+class RateLimitedFile : public WritableFile {
+ public:
+  RateLimitedFile(WritableFile* target, RateLimiter* limiter,
+                  const port::AtomicPointer* debt)
+      : target_(target), limiter_(limiter), debt_(debt) { }
+  virtual ~RateLimitedFile() { delete target_; }
+
+  virtual Status Append(const Slice& data) {
+    limiter_->Request(data.size(), LoadDebt(debt_));
+    return target_->Append(data);
+  }
+  virtual Status Close() { return target_->Close(); }
+  virtual Status Flush() { return target_->Flush(); }
+  virtual Status Sync() { return target_->Sync(); }
+
+ private:
+  WritableFile* const target_;
+  RateLimiter* const limiter_;
+  const port::AtomicPointer* const debt_;
+};
+
+// An Env whose writable files are RateLimitedFiles
+class RateLimitedEnv : public EnvWrapper {
+ public:
+  RateLimitedEnv(Env* target, RateLimiter* limiter,
+                 const port::AtomicPointer* debt)
+      : EnvWrapper(target), limiter_(limiter), debt_(debt) { }
+
+  virtual Status NewWritableFile(const std::string& fname,
+                                 WritableFile** result) {
+    return Wrap(target()->NewWritableFile(fname, result), result);
+  }
+
+  virtual Status NewDirectWritableFile(const std::string& fname,
+                                       WritableFile** result) {
+    return Wrap(target()->NewDirectWritableFile(fname, result), result);
+  }
+
+ private:
+  Status Wrap(const Status& s, WritableFile** result) {
+    if (s.ok()) {
+      *result = new RateLimitedFile(*result, limiter_, debt_);
+    }
+    return s;
+  }
+
+  RateLimiter* const limiter_;
+  const port::AtomicPointer* const debt_;
+};
+
+}  // namespace
+
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   Status status;
   WriteBatch* batch;
   bool sync;
   bool done;
+  bool exclusive;  // Leads a group of its own (see IngestExternalFile())
   port::CondVar cv;
 
-  explicit Writer(port::Mutex* mu) : cv(mu) { }
+  // Set by the leader of a pipelined group once this writer should
+  // insert its own batch into the memtable
+  WriteGroup* group;
+
+  explicit Writer(port::Mutex* mu)
+      : exclusive(false), cv(mu), group(NULL) { }
+};
+
+// A batch group whose log record has been written and which waits for its
+// turn to be inserted into the memtable
+struct DBImpl::WriteGroup {
+  Writer* leader;
+  std::vector<Writer*> writers;  // Includes leader
+  SequenceNumber last_sequence;
+  Status status;
+
+  // For options_.allow_concurrent_memtable_write
+  MemTable* mem;                 // Memtable the writers insert into
+  int pending;                   // Writers still inserting
 };
 
 struct DBImpl::CompactionState {
@@ -57,6 +139,17 @@ struct DBImpl::CompactionState {
   // we can drop all entries for the same key with sequence numbers < S.
   SequenceNumber smallest_snapshot;
 
+  // Range of user keys handled by this state: (start, end].  A missing
+  // bound means the range is open on that side.  Both are missing unless
+  // the compaction was split into subcompactions.
+  bool has_start;
+  bool has_end;
+  std::string start;
+  std::string end;
+
+  // Position for Compaction::IsBaseLevelForKey()/ShouldStopBefore()
+  Compaction::Cursor cursor;
+
   // Files produced by compaction
   struct Output {
     uint64_t number;
@@ -75,12 +168,34 @@ struct DBImpl::CompactionState {
 
   explicit CompactionState(Compaction* c)
       : compaction(c),
+        has_start(false),
+        has_end(false),
         outfile(NULL),
         builder(NULL),
         total_bytes(0) {
   }
 };
 
+// Subcompactions of one compaction that are shared out between the
+// thread running the compaction and helpers scheduled on env_.
+struct DBImpl::SubcompactionGroup {
+  DBImpl* db;
+  std::vector<CompactionState*> states;
+
+  // State below is protected by mu
+  port::Mutex mu;
+  port::CondVar cv;              // Signalled when a subcompaction finishes
+  size_t next;                   // Index of the next unclaimed state
+  size_t finished;               // Number of states compacted so far
+  std::vector<Status> status;    // Result for each state
+  std::vector<int64_t> imm_micros;
+  int refs;                      // Owner plus helpers that have not run yet
+
+  SubcompactionGroup(DBImpl* d, size_t n)
+      : db(d), states(n), cv(&mu), next(0), finished(0),
+        status(n), imm_micros(n, 0), refs(1) { }
+};
+
 // Fix user-supplied options to be reasonable
 template <class T,class V>
 static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
@@ -96,8 +211,15 @@ Options SanitizeOptions(const std::string& dbname,
   result.filter_policy = (src.filter_policy != NULL) ? ipolicy : NULL;
   ClipToRange(&result.max_open_files,    64 + kNumNonTableCacheFiles, 50000);
   ClipToRange(&result.write_buffer_size, 64<<10,                      1<<30);
+  ClipToRange(&result.max_write_buffer_number, 2,                     64);
   ClipToRange(&result.max_file_size,     1<<20,                       1<<30);
   ClipToRange(&result.block_size,        1<<10,                       4<<20);
+  ClipToRange(&result.metadata_block_size, 1<<10,                     4<<20);
+  ClipToRange(&result.max_background_compactions, 1,                  64);
+  ClipToRange(&result.max_subcompactions, 1,                          64);
+  ClipToRange(&result.max_multiget_parallelism, 1,                    64);
+  ClipToRange(&result.max_dictionary_bytes, 0,                        1<<20);
+  ClipToRange(&result.dictionary_training_blocks, 1,                  1024);
   if (result.info_log == NULL) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -114,6 +236,18 @@ Options SanitizeOptions(const std::string& dbname,
   return result;
 }
 
+// Returns the options to build a table for "level" with: "options" with
+// the compression for that level taken from compression_per_level.
+static Options TableOptionsForLevel(const Options& options, int level) {
+  Options result = options;
+  if (!options.compression_per_level.empty()) {
+    const size_t n = options.compression_per_level.size();
+    const size_t i = static_cast<size_t>(level);
+    result.compression = options.compression_per_level[i < n ? i : n - 1];
+  }
+  return result;
+}
+
 DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
@@ -127,19 +261,34 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       shutting_down_(NULL),
       bg_cv_(&mutex_),
       mem_(NULL),
-      imm_(NULL),
       logfile_(NULL),
       logfile_number_(0),
       log_(NULL),
       seed_(0),
       tmp_batch_(new WriteBatch),
-      bg_compaction_scheduled_(false),
+      allocated_sequence_(0),
+      bg_compaction_scheduled_(0),
+      flushing_imm_(false),
+      installing_imm_(false),
+      writing_manifest_(false),
       manual_compaction_(NULL) {
   has_imm_.Release_Store(NULL);
+  compaction_debt_.Release_Store(NULL);
+  // Every compaction thread may be joined by up to max_subcompactions - 1
+  // helpers, and MultiGet() by up to max_multiget_parallelism - 1.
+  env_->SetBackgroundThreads(options_.max_background_compactions +
+                             options_.max_subcompactions - 1 +
+                             options_.max_multiget_parallelism - 1);
 
   // Reserve ten files or so for other uses and give the rest to TableCache.
   const int table_cache_size = options_.max_open_files - kNumNonTableCacheFiles;
   table_cache_ = new TableCache(dbname_, &options_, table_cache_size);
+  if (options_.rate_limiter != NULL) {
+    table_env_ = new RateLimitedEnv(env_, options_.rate_limiter,
+                                    &compaction_debt_);
+  } else {
+    table_env_ = env_;
+  }
 
   versions_ = new VersionSet(dbname_, &options_, table_cache_,
                              &internal_comparator_);
@@ -149,7 +298,7 @@ DBImpl::~DBImpl() {
   // Wait for background work to finish
   mutex_.Lock();
   shutting_down_.Release_Store(this);  // Any non-NULL value is ok
-  while (bg_compaction_scheduled_) {
+  while (bg_compaction_scheduled_ > 0) {
     bg_cv_.Wait();
   }
   mutex_.Unlock();
@@ -160,11 +309,16 @@ DBImpl::~DBImpl() {
 
   delete versions_;
   if (mem_ != NULL) mem_->Unref();
-  if (imm_ != NULL) imm_->Unref();
+  for (size_t i = 0; i < imm_.size(); i++) {
+    imm_[i]->Unref();
+  }
   delete tmp_batch_;
   delete log_;
   delete logfile_;
   delete table_cache_;
+  if (table_env_ != env_) {
+    delete table_env_;
+  }
 
   if (owns_info_log_) {
     delete options_.info_log;
@@ -221,6 +375,11 @@ void DBImpl::DeleteObsoleteFiles() {
     // or may not have been committed, so we cannot safely garbage collect.
     return;
   }
+  if (installing_imm_) {
+    // The table built from imm_ is neither pending nor part of a version
+    // yet.  CompactMemTable() collects garbage once it is installed.
+    return;
+  }
 
   // Make a set of all of the live files
   std::set<uint64_t> live = pending_outputs_;
@@ -420,7 +579,8 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     WriteBatchInternal::SetContents(&batch, record);
 
     if (mem == NULL) {
-      mem = new MemTable(internal_comparator_);
+      mem = new MemTable(internal_comparator_, options_.memtable_factory,
+                         env_);
       mem->Ref();
     }
     status = WriteBatchInternal::InsertInto(&batch, mem);
@@ -438,7 +598,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
       compactions++;
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, NULL);
+      status = WriteLevel0Table(mem->NewIterator(), edit, NULL);
       mem->Unref();
       mem = NULL;
       if (!status.ok()) {
@@ -467,7 +627,8 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
         mem = NULL;
       } else {
         // mem can be NULL if lognum exists but was empty.
-        mem_ = new MemTable(internal_comparator_);
+        mem_ = new MemTable(internal_comparator_, options_.memtable_factory,
+                            env_);
         mem_->Ref();
       }
     }
@@ -477,7 +638,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     // mem did not get reused; compact it.
     if (status.ok()) {
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, NULL);
+      status = WriteLevel0Table(mem->NewIterator(), edit, NULL);
     }
     mem->Unref();
   }
@@ -485,21 +646,21 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   return status;
 }
 
-Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
+Status DBImpl::WriteLevel0Table(Iterator* iter, VersionEdit* edit,
                                 Version* base) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
   pending_outputs_.insert(meta.number);
-  Iterator* iter = mem->NewIterator();
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long) meta.number);
 
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, table_env_, TableOptionsForLevel(options_, 0),
+                   table_cache_, iter, &meta);
     mutex_.Lock();
   }
 
@@ -518,7 +679,16 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
     const Slice min_user_key = meta.smallest.user_key();
     const Slice max_user_key = meta.largest.user_key();
     if (base != NULL) {
-      level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
+      // Other background threads may have installed newer versions while
+      // the table was being built, so pick the level against the current
+      // one and stay above any compaction that is still in progress.
+      level = versions_->current()->PickLevelForMemTableOutput(
+          min_user_key, max_user_key);
+      while (level > 0 &&
+             versions_->RangeInCompaction(level, meta.smallest, meta.largest)) {
+        level--;
+      }
+      installing_imm_ = true;
     }
     edit->AddFile(level, meta.number, meta.file_size,
                   meta.smallest, meta.largest);
@@ -528,40 +698,65 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   stats.micros = env_->NowMicros() - start_micros;
   stats.bytes_written = meta.file_size;
   stats_[level].Add(stats);
+  RecordTick(options_.statistics, kFlushWriteBytes, meta.file_size);
+  MeasureTime(options_.statistics, kFlushMicros, stats.micros);
   return s;
 }
 
 void DBImpl::CompactMemTable() {
   mutex_.AssertHeld();
-  assert(imm_ != NULL);
+  assert(!imm_.empty());
+  assert(!flushing_imm_);
+  flushing_imm_ = true;
+  has_imm_.Release_Store(NULL);
 
-  // Save the contents of the memtable as a new Table
+  // Save the contents of the memtables that are waiting as a new Table.
+  // Writers may queue more while it is built; they go to the next one.
+  const size_t n = imm_.size();
+  std::vector<Iterator*> list;
+  for (size_t i = 0; i < n; i++) {
+    list.push_back(imm_[i]->NewIterator());
+  }
   VersionEdit edit;
   Version* base = versions_->current();
   base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
+  Status s = WriteLevel0Table(
+      NewMergingIterator(&internal_comparator_, &list[0], n), &edit, base);
   base->Unref();
 
   if (s.ok() && shutting_down_.Acquire_Load()) {
     s = Status::IOError("Deleting DB during memtable compaction");
   }
 
-  // Replace immutable memtable with the generated Table
+  // Replace the immutable memtables with the generated Table
   if (s.ok()) {
     edit.SetPrevLogNumber(0);
-    edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
-    s = versions_->LogAndApply(&edit, &mutex_);
+    // Earlier logs no longer needed
+    edit.SetLogNumber(imm_log_numbers_[n - 1]);
+    s = LogAndApply(&edit);
   }
+  installing_imm_ = false;
+  flushing_imm_ = false;
 
   if (s.ok()) {
     // Commit to the new state
-    imm_->Unref();
-    imm_ = NULL;
-    has_imm_.Release_Store(NULL);
+    for (size_t i = 0; i < n; i++) {
+      imm_.front()->Unref();
+      imm_.pop_front();
+      imm_log_numbers_.pop_front();
+    }
     DeleteObsoleteFiles();
   } else {
     RecordBackgroundError(s);
   }
+  if (!imm_.empty()) {
+    // Memtables queued during the flush, or left by a failed one
+    has_imm_.Release_Store(imm_.back());
+  }
+
+  // Compactions skipped while the table was being installed may be
+  // picked now.
+  MaybeScheduleCompaction();
 }
 
 void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
@@ -624,16 +819,24 @@ Status DBImpl::TEST_CompactMemTable() {
   if (s.ok()) {
     // Wait until the compaction completes
     MutexLock l(&mutex_);
-    while (imm_ != NULL && bg_error_.ok()) {
+    while (!imm_.empty() && bg_error_.ok()) {
       bg_cv_.Wait();
     }
-    if (imm_ != NULL) {
+    if (!imm_.empty()) {
       s = bg_error_;
     }
   }
   return s;
 }
 
+Status DBImpl::TEST_WaitForCompactions() {
+  MutexLock l(&mutex_);
+  while (bg_compaction_scheduled_ > 0 && bg_error_.ok()) {
+    bg_cv_.Wait();
+  }
+  return bg_error_;
+}
+
 void DBImpl::RecordBackgroundError(const Status& s) {
   mutex_.AssertHeld();
   if (bg_error_.ok()) {
@@ -642,20 +845,45 @@ void DBImpl::RecordBackgroundError(const Status& s) {
   }
 }
 
+Status DBImpl::LogAndApply(VersionEdit* edit) {
+  mutex_.AssertHeld();
+  while (writing_manifest_) {
+    bg_cv_.Wait();
+  }
+  writing_manifest_ = true;
+  Status s = versions_->LogAndApply(edit, &mutex_);
+  writing_manifest_ = false;
+  bg_cv_.SignalAll();
+  return s;
+}
+
+// The debt grows from 0 at kL0_CompactionTrigger level-0 files to 1 at
+// kL0_SlowdownWritesTrigger, where writes start being delayed.
+void DBImpl::UpdateCompactionDebt() {
+  mutex_.AssertHeld();
+  const int excess =
+      versions_->NumLevelFiles(0) - config::kL0_CompactionTrigger;
+  const int range =
+      config::kL0_SlowdownWritesTrigger - config::kL0_CompactionTrigger;
+  intptr_t debt = 1000 * std::max(0, std::min(excess, range)) / range;
+  compaction_debt_.Release_Store(reinterpret_cast<void*>(debt));
+}
+
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
-  if (bg_compaction_scheduled_) {
-    // Already scheduled
+  UpdateCompactionDebt();
+  if (bg_compaction_scheduled_ >= options_.max_background_compactions) {
+    // Already scheduled as many as allowed
   } else if (shutting_down_.Acquire_Load()) {
     // DB is being deleted; no more background compactions
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == NULL &&
+  } else if ((imm_.empty() || flushing_imm_) &&
              manual_compaction_ == NULL &&
              !versions_->NeedsCompaction()) {
     // No work to be done
   } else {
-    bg_compaction_scheduled_ = true;
+    bg_compaction_scheduled_++;
     env_->Schedule(&DBImpl::BGWork, this);
   }
 }
@@ -666,35 +894,51 @@ void DBImpl::BGWork(void* db) {
 
 void DBImpl::BackgroundCall() {
   MutexLock l(&mutex_);
-  assert(bg_compaction_scheduled_);
+  assert(bg_compaction_scheduled_ > 0);
+  bool did_work = false;
   if (shutting_down_.Acquire_Load()) {
     // No more background work when shutting down.
   } else if (!bg_error_.ok()) {
     // No more background work after a background error.
   } else {
-    BackgroundCompaction();
+    did_work = BackgroundCompaction();
   }
 
-  bg_compaction_scheduled_ = false;
+  bg_compaction_scheduled_--;
 
   // Previous compaction may have produced too many files in a level,
-  // so reschedule another compaction if needed.
-  MaybeScheduleCompaction();
+  // so reschedule another compaction if needed.  A call that found
+  // nothing to do leaves this to the calls still running, which would
+  // otherwise keep rescheduling while blocked on their key ranges.
+  if (did_work || bg_compaction_scheduled_ == 0) {
+    MaybeScheduleCompaction();
+  }
   bg_cv_.SignalAll();
 }
 
-void DBImpl::BackgroundCompaction() {
+bool DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();
 
-  if (imm_ != NULL) {
+  if (!imm_.empty() && !flushing_imm_) {
     CompactMemTable();
-    return;
+    return true;
+  }
+
+  if (installing_imm_) {
+    // Wait until the new level-0 table is visible; CompactMemTable()
+    // reschedules once it is.
+    return false;
   }
 
   Compaction* c;
   bool is_manual = (manual_compaction_ != NULL);
   InternalKey manual_end;
   if (is_manual) {
+    if (versions_->NumCompactionsInProgress() > 0) {
+      // Manual compactions run alone.  The compactions in progress will
+      // reschedule when they finish.
+      return false;
+    }
     ManualCompaction* m = manual_compaction_;
     c = versions_->CompactRange(m->level, m->begin, m->end);
     m->done = (c == NULL);
@@ -709,6 +953,11 @@ void DBImpl::BackgroundCompaction() {
         (m->done ? "(end)" : manual_end.DebugString().c_str()));
   } else {
     c = versions_->PickCompaction();
+    if (c == NULL) {
+      return false;
+    }
+    // Let another thread look for a compaction over a disjoint range.
+    MaybeScheduleCompaction();
   }
 
   Status status;
@@ -719,9 +968,8 @@ void DBImpl::BackgroundCompaction() {
     assert(c->num_input_files(0) == 1);
     FileMetaData* f = c->input(0, 0);
     c->edit()->DeleteFile(c->level(), f->number);
-    c->edit()->AddFile(c->level() + 1, f->number, f->file_size,
-                       f->smallest, f->largest);
-    status = versions_->LogAndApply(c->edit(), &mutex_);
+    c->edit()->AddFile(c->level() + 1, *f);
+    status = LogAndApply(c->edit());
     if (!status.ok()) {
       RecordBackgroundError(status);
     }
@@ -766,6 +1014,7 @@ void DBImpl::BackgroundCompaction() {
     }
     manual_compaction_ = NULL;
   }
+  return true;
 }
 
 void DBImpl::CleanupCompaction(CompactionState* compact) {
@@ -803,9 +1052,16 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
 
   // Make the output file
   std::string fname = TableFileName(dbname_, file_number);
-  Status s = env_->NewWritableFile(fname, &compact->outfile);
+  Status s;
+  if (options_.use_direct_io_for_compaction) {
+    s = table_env_->NewDirectWritableFile(fname, &compact->outfile);
+  } else {
+    s = table_env_->NewWritableFile(fname, &compact->outfile);
+  }
   if (s.ok()) {
-    compact->builder = new TableBuilder(options_, compact->outfile);
+    compact->builder = new TableBuilder(
+        TableOptionsForLevel(options_, compact->compaction->level() + 1),
+        compact->outfile);
   }
   return s;
 }
@@ -847,7 +1103,8 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
     // Verify that the table is usable
     Iterator* iter = table_cache_->NewIterator(ReadOptions(),
                                                output_number,
-                                               current_bytes);
+                                               current_bytes,
+                                               0);
     s = iter->status();
     delete iter;
     if (s.ok()) {
@@ -881,7 +1138,7 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
         level + 1,
         out.number, out.file_size, out.smallest, out.largest);
   }
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  return LogAndApply(compact->compaction->edit());
 }
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
@@ -903,13 +1160,150 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     compact->smallest_snapshot = snapshots_.oldest()->number_;
   }
 
-  // Release mutex while we're actually doing the compaction work
-  mutex_.Unlock();
+  std::vector<std::string> boundaries;
+  compact->compaction->GetSubcompactionBoundaries(options_.max_subcompactions,
+                                                  &boundaries);
+  Status status;
+  if (boundaries.empty()) {
+    // Release mutex while we're actually doing the compaction work
+    mutex_.Unlock();
+    status = DoCompactionRange(compact, &imm_micros);
+    mutex_.Lock();
+  } else {
+    // Split the key space into boundaries.size() + 1 ranges.  The outputs
+    // of all ranges are gathered into *compact and installed together.
+    const size_t n = boundaries.size() + 1;
+    SubcompactionGroup* group = new SubcompactionGroup(this, n);
+    for (size_t i = 0; i < n; i++) {
+      CompactionState* sub = new CompactionState(compact->compaction);
+      sub->smallest_snapshot = compact->smallest_snapshot;
+      if (i > 0) {
+        sub->has_start = true;
+        sub->start = boundaries[i - 1];
+      }
+      if (i < boundaries.size()) {
+        sub->has_end = true;
+        sub->end = boundaries[i];
+      }
+      group->states[i] = sub;
+    }
+    Log(options_.info_log, "Compacting in %d subcompactions",
+        static_cast<int>(n));
+    mutex_.Unlock();
+
+    // This thread takes part as well, so helpers that are slow to start
+    // (or never get a free background thread) only cost parallelism.
+    group->refs += static_cast<int>(n - 1);
+    for (size_t i = 0; i + 1 < n; i++) {
+      env_->Schedule(&DBImpl::BGSubcompaction, group);
+    }
+    RunSubcompactions(group);
+
+    group->mu.Lock();
+    while (group->finished < n) {
+      group->cv.Wait();
+    }
+    group->mu.Unlock();
+
+    mutex_.Lock();
+    for (size_t i = 0; i < n; i++) {
+      CompactionState* sub = group->states[i];
+      if (status.ok()) {
+        status = group->status[i];
+      }
+      imm_micros = std::max(imm_micros, group->imm_micros[i]);
+      // Ranges are in key order, so the outputs stay sorted.  Moving them
+      // to *compact also leaves their pending_outputs_ entries to be
+      // cleared by CleanupCompaction(compact).
+      compact->outputs.insert(compact->outputs.end(),
+                              sub->outputs.begin(), sub->outputs.end());
+      compact->total_bytes += sub->total_bytes;
+      sub->outputs.clear();
+      CleanupCompaction(sub);
+      group->states[i] = NULL;
+    }
+    group->mu.Lock();
+    const bool last_ref = (--group->refs == 0);
+    group->mu.Unlock();
+    if (last_ref) {
+      delete group;
+    }
+  }
 
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros - imm_micros;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+    }
+  }
+  for (size_t i = 0; i < compact->outputs.size(); i++) {
+    stats.bytes_written += compact->outputs[i].file_size;
+  }
+
+  stats_[compact->compaction->level() + 1].Add(stats);
+  RecordTick(options_.statistics, kCompactReadBytes, stats.bytes_read);
+  RecordTick(options_.statistics, kCompactWriteBytes, stats.bytes_written);
+  MeasureTime(options_.statistics, kCompactionMicros, stats.micros);
+
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);
+  }
+  if (!status.ok()) {
+    RecordBackgroundError(status);
+  }
+  VersionSet::LevelSummaryStorage tmp;
+  Log(options_.info_log,
+      "compacted to: %s", versions_->LevelSummary(&tmp));
+  return status;
+}
+
+void DBImpl::BGSubcompaction(void* arg) {
+  SubcompactionGroup* group = reinterpret_cast<SubcompactionGroup*>(arg);
+  RunSubcompactions(group);
+  // The owner keeps its reference until it has collected the results, so
+  // a helper only drops the last one once the compaction is over.
+  group->mu.Lock();
+  const bool last_ref = (--group->refs == 0);
+  group->mu.Unlock();
+  if (last_ref) {
+    delete group;
+  }
+}
+
+void DBImpl::RunSubcompactions(SubcompactionGroup* group) {
+  group->mu.Lock();
+  while (group->next < group->states.size()) {
+    const size_t i = group->next++;
+    group->mu.Unlock();
+    int64_t imm_micros = 0;
+    Status s = group->db->DoCompactionRange(group->states[i], &imm_micros);
+    group->mu.Lock();
+    group->status[i] = s;
+    group->imm_micros[i] = imm_micros;
+    group->finished++;
+    group->cv.SignalAll();
+  }
+  group->mu.Unlock();
+}
+
+Status DBImpl::DoCompactionRange(CompactionState* compact,
+                                 int64_t* imm_micros) {
   Iterator* input = versions_->MakeInputIterator(compact->compaction);
-  input->SeekToFirst();
   Status status;
   ParsedInternalKey ikey;
+  if (compact->has_start) {
+    // Skip to the first entry past the start of the range
+    InternalKey start(compact->start, kMaxSequenceNumber, kValueTypeForSeek);
+    input->Seek(start.Encode());
+    while (input->Valid() && ParseInternalKey(input->key(), &ikey) &&
+           user_comparator()->Compare(ikey.user_key,
+                                      Slice(compact->start)) <= 0) {
+      input->Next();
+    }
+  } else {
+    input->SeekToFirst();
+  }
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
@@ -918,23 +1312,28 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     if (has_imm_.NoBarrier_Load() != NULL) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
-      if (imm_ != NULL) {
+      if (!imm_.empty() && !flushing_imm_) {
         CompactMemTable();
         bg_cv_.SignalAll();  // Wakeup MakeRoomForWrite() if necessary
       }
       mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
+      *imm_micros += (env_->NowMicros() - imm_start);
     }
 
     Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
+    if (compact->has_end && ParseInternalKey(key, &ikey) &&
+        user_comparator()->Compare(ikey.user_key, Slice(compact->end)) > 0) {
+      // Past the end of the range
+      break;
+    }
+
+    if (compact->compaction->ShouldStopBefore(key, &compact->cursor) &&
         compact->builder != NULL) {
       status = FinishCompactionOutputFile(compact, input);
       if (!status.ok()) {
         break;
       }
     }
-
     // Handle key/value, add to state, etc.
     bool drop = false;
     if (!ParseInternalKey(key, &ikey)) {
@@ -957,7 +1356,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         drop = true;    // (A)
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
-                 compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+                 compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                                       &compact->cursor)) {
         // For this user key:
         // (1) there is no data in higher levels
         // (2) data in lower levels will have larger sequence numbers
@@ -976,7 +1376,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         "%d smallest_snapshot: %d",
         ikey.user_key.ToString().c_str(),
         (int)ikey.sequence, ikey.type, kTypeValue, drop,
-        compact->compaction->IsBaseLevelForKey(ikey.user_key),
+        compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                               &compact->cursor),
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
@@ -1018,30 +1419,6 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   }
   delete input;
   input = NULL;
-
-  CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
-    }
-  }
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    stats.bytes_written += compact->outputs[i].file_size;
-  }
-
-  mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
-
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);
-  }
-  if (!status.ok()) {
-    RecordBackgroundError(status);
-  }
-  VersionSet::LevelSummaryStorage tmp;
-  Log(options_.info_log,
-      "compacted to: %s", versions_->LevelSummary(&tmp));
   return status;
 }
 
@@ -1049,15 +1426,19 @@ namespace {
 struct IterState {
   port::Mutex* mu;
   Version* version;
-  MemTable* mem;
-  MemTable* imm;
+  std::vector<MemTable*> mems;
 };
 
+static void UnrefMemTables(const std::vector<MemTable*>& mems) {
+  for (size_t i = 0; i < mems.size(); i++) {
+    mems[i]->Unref();
+  }
+}
+
 static void CleanupIteratorState(void* arg1, void* arg2) {
   IterState* state = reinterpret_cast<IterState*>(arg1);
   state->mu->Lock();
-  state->mem->Unref();
-  if (state->imm != NULL) state->imm->Unref();
+  UnrefMemTables(state->mems);
   state->version->Unref();
   state->mu->Unlock();
   delete state;
@@ -1072,12 +1453,10 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
   *latest_snapshot = versions_->LastSequence();
 
   // Collect together all needed child iterators
+  RefMemTables(&cleanup->mems);
   std::vector<Iterator*> list;
-  list.push_back(mem_->NewIterator());
-  mem_->Ref();
-  if (imm_ != NULL) {
-    list.push_back(imm_->NewIterator());
-    imm_->Ref();
+  for (size_t i = 0; i < cleanup->mems.size(); i++) {
+    list.push_back(cleanup->mems[i]->NewIterator());
   }
   versions_->current()->AddIterators(options, &list);
   Iterator* internal_iter =
@@ -1085,8 +1464,6 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
   versions_->current()->Ref();
 
   cleanup->mu = &mutex_;
-  cleanup->mem = mem_;
-  cleanup->imm = imm_;
   cleanup->version = versions_->current();
   internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, NULL);
 
@@ -1095,6 +1472,15 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
   return internal_iter;
 }
 
+void DBImpl::RefMemTables(std::vector<MemTable*>* mems) {
+  mutex_.AssertHeld();
+  mems->push_back(mem_);
+  mems->insert(mems->end(), imm_.rbegin(), imm_.rend());
+  for (size_t i = 0; i < mems->size(); i++) {
+    (*mems)[i]->Ref();
+  }
+}
+
 Iterator* DBImpl::TEST_NewInternalIterator() {
   SequenceNumber ignored;
   uint32_t ignored_seed;
@@ -1109,8 +1495,12 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
 Status DBImpl::Get(const ReadOptions& options,
                    const Slice& key,
                    std::string* value) {
+  Statistics* const statistics = options_.statistics;
+  StopWatch watch(env_, statistics, kDBGetMicros);
   Status s;
+  PerfTimer lock_timer(env_, &PerfContext::db_mutex_lock_nanos);
   MutexLock l(&mutex_);
+  lock_timer.Stop();
   SequenceNumber snapshot;
   if (options.snapshot != NULL) {
     snapshot = reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_;
@@ -1118,11 +1508,9 @@ Status DBImpl::Get(const ReadOptions& options,
     snapshot = versions_->LastSequence();
   }
 
-  MemTable* mem = mem_;
-  MemTable* imm = imm_;
+  std::vector<MemTable*> mems;
+  RefMemTables(&mems);
   Version* current = versions_->current();
-  mem->Ref();
-  if (imm != NULL) imm->Ref();
   current->Ref();
 
   bool have_stat_update = false;
@@ -1131,28 +1519,125 @@ Status DBImpl::Get(const ReadOptions& options,
   // Unlock while reading from files and memtables
   {
     mutex_.Unlock();
-    // First look in the memtable, then in the immutable memtable (if any).
+    // First look in the memtable, then in the immutable memtables from
+    // newest to oldest.
     LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-    } else if (imm != NULL && imm->Get(lkey, value, &s)) {
-      // Done
-    } else {
+    bool done = false;
+    {
+      PerfTimer timer(env_, &PerfContext::get_from_memtable_nanos);
+      size_t i = 0;
+      while (i < mems.size() && !done) {
+        done = mems[i++]->Get(lkey, value, &s);
+      }
+      PerfCount(&PerfContext::get_from_memtable_count, i);
+    }
+    RecordTick(statistics, done ? kMemTableHit : kMemTableMiss);
+    if (!done) {
+      PerfTimer timer(env_, &PerfContext::get_from_output_files_nanos);
       s = current->Get(options, lkey, value, &stats);
       have_stat_update = true;
     }
+    PerfTimer relock_timer(env_, &PerfContext::db_mutex_lock_nanos);
     mutex_.Lock();
   }
+  RecordTick(statistics, kNumberKeysRead);
+  if (s.ok()) {
+    RecordTick(statistics, kBytesRead, value->size());
+  }
 
   if (have_stat_update && current->UpdateStats(stats)) {
     MaybeScheduleCompaction();
   }
-  mem->Unref();
-  if (imm != NULL) imm->Unref();
+  UnrefMemTables(mems);
   current->Unref();
   return s;
 }
 
+void DBImpl::MultiGet(const ReadOptions& options,
+                      const std::vector<Slice>& keys,
+                      std::vector<std::string>* values,
+                      std::vector<Status>* statuses) {
+  const size_t n = keys.size();
+  values->resize(n);
+  statuses->assign(n, Status());
+  if (n == 0) {
+    return;
+  }
+  Statistics* const statistics = options_.statistics;
+  StopWatch watch(env_, statistics, kDBMultiGetMicros);
+
+  MutexLock l(&mutex_);
+  SequenceNumber snapshot;
+  if (options.snapshot != NULL) {
+    snapshot = reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_;
+  } else {
+    snapshot = versions_->LastSequence();
+  }
+
+  std::vector<MemTable*> mems;
+  RefMemTables(&mems);
+  Version* current = versions_->current();
+  current->Ref();
+
+  std::vector<Version::GetStats> stats;
+
+  // Unlock while reading from files and memtables
+  {
+    mutex_.Unlock();
+    // Keys not in any memtable are looked up in the tables together.
+    std::vector<LookupKey*> lkeys(n);
+    std::vector<const LookupKey*> table_keys;
+    std::vector<std::string*> table_values;
+    std::vector<Status*> table_statuses;
+    for (size_t i = 0; i < n; i++) {
+      lkeys[i] = new LookupKey(keys[i], snapshot);
+      std::string* value = &(*values)[i];
+      Status* s = &(*statuses)[i];
+      bool done = false;
+      for (size_t j = 0; j < mems.size() && !done; j++) {
+        done = mems[j]->Get(*lkeys[i], value, s);
+      }
+      if (!done) {
+        table_keys.push_back(lkeys[i]);
+        table_values.push_back(value);
+        table_statuses.push_back(s);
+      }
+    }
+    RecordTick(statistics, kMemTableHit, n - table_keys.size());
+    RecordTick(statistics, kMemTableMiss, table_keys.size());
+    if (!table_keys.empty()) {
+      current->MultiGet(options, table_keys, table_values, table_statuses,
+                        &stats);
+    }
+    for (size_t i = 0; i < n; i++) {
+      delete lkeys[i];
+    }
+    mutex_.Lock();
+  }
+  if (statistics != NULL) {
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < n; i++) {
+      if ((*statuses)[i].ok()) {
+        bytes += (*values)[i].size();
+      }
+    }
+    statistics->RecordTick(kNumberKeysRead, n);
+    statistics->RecordTick(kBytesRead, bytes);
+  }
+
+  bool compaction_needed = false;
+  for (size_t j = 0; j < stats.size(); j++) {
+    if (current->UpdateStats(stats[j])) {
+      compaction_needed = true;
+    }
+  }
+  if (compaction_needed) {
+    MaybeScheduleCompaction();
+  }
+  UnrefMemTables(mems);
+  current->Unref();
+}
+
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
@@ -1162,7 +1647,7 @@ Iterator* DBImpl::NewIterator(const ReadOptions& options) {
       (options.snapshot != NULL
        ? reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_
        : latest_snapshot),
-      seed);
+      seed, env_, options_.statistics);
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1191,7 +1676,20 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
+// Count the entries and bytes of a batch group.
+static void RecordWrite(Statistics* stats, WriteBatch* updates) {
+  if (stats != NULL) {
+    stats->RecordTick(kNumberKeysWritten, WriteBatchInternal::Count(updates));
+    stats->RecordTick(kBytesWritten, WriteBatchInternal::ByteSize(updates));
+  }
+}
+
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
+  StopWatch watch(env_, options_.statistics, kDBWriteMicros);
+  if (options_.enable_pipelined_write) {
+    return PipelinedWrite(options, my_batch);
+  }
+
   Writer w(&mutex_);
   w.batch = my_batch;
   w.sync = options.sync;
@@ -1214,6 +1712,7 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
     WriteBatch* updates = BuildBatchGroup(&last_writer);
     WriteBatchInternal::SetSequence(updates, last_sequence + 1);
     last_sequence += WriteBatchInternal::Count(updates);
+    RecordWrite(options_.statistics, updates);
 
     // Add to log and apply to memtable.  We can release the lock
     // during this phase since &w is currently responsible for logging
@@ -1264,6 +1763,175 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
   return status;
 }
 
+// Like Write(), but the writer at the front of writers_ only appends its
+// group to the log.  It then hands writers_ over to the next leader and
+// queues the group in memtable_groups_, where groups are inserted into
+// mem_ one at a time in sequence order.
+Status DBImpl::PipelinedWrite(const WriteOptions& options,
+                              WriteBatch* my_batch) {
+  Writer w(&mutex_);
+  w.batch = my_batch;
+  w.sync = options.sync;
+  w.done = false;
+
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  while (!w.done && w.group == NULL && &w != writers_.front()) {
+    w.cv.Wait();
+  }
+  if (w.done) {
+    return w.status;
+  }
+  if (w.group != NULL) {
+    // Our group's leader asked us to insert our own batch
+    WriteGroup* group = w.group;
+    mutex_.Unlock();
+    Status s = WriteBatchInternal::InsertConcurrentlyInto(my_batch,
+                                                          group->mem);
+    mutex_.Lock();
+    if (!s.ok() && group->status.ok()) {
+      group->status = s;
+    }
+    if (--group->pending == 0) {
+      group->leader->cv.Signal();
+    }
+    while (!w.done) {
+      w.cv.Wait();
+    }
+    return w.status;
+  }
+
+  // May temporarily unlock and wait.  Also waits for memtable_groups_
+  // to drain before switching to a new memtable.
+  Status status = MakeRoomForWrite(my_batch == NULL);
+  if (!status.ok() || my_batch == NULL) {  // NULL batch is for compactions
+    writers_.pop_front();
+    if (!writers_.empty()) {
+      writers_.front()->cv.Signal();
+    }
+    return status;
+  }
+
+  // Log stage
+  Writer* last_writer = &w;
+  WriteBatch* updates = BuildBatchGroup(&last_writer);
+  const SequenceNumber first_sequence =
+      std::max(versions_->LastSequence(), allocated_sequence_) + 1;
+  WriteBatchInternal::SetSequence(updates, first_sequence);
+  const SequenceNumber last_sequence =
+      first_sequence + WriteBatchInternal::Count(updates) - 1;
+  allocated_sequence_ = last_sequence;
+  RecordWrite(options_.statistics, updates);
+  {
+    mutex_.Unlock();
+    status = log_->AddRecord(WriteBatchInternal::Contents(updates));
+    bool sync_error = false;
+    if (status.ok() && options.sync) {
+      status = logfile_->Sync();
+      if (!status.ok()) {
+        sync_error = true;
+      }
+    }
+    mutex_.Lock();
+    if (sync_error) {
+      // The state of the log file is indeterminate: the log record we
+      // just added may or may not show up when the DB is re-opened.
+      // So we force the DB into a mode where all future writes fail.
+      RecordBackgroundError(status);
+    }
+  }
+  if (updates == tmp_batch_) tmp_batch_->Clear();
+
+  WriteGroup group;
+  group.leader = &w;
+  group.mem = NULL;
+  group.pending = 0;
+  group.last_sequence = last_sequence;
+  group.status = status;
+  while (true) {
+    Writer* ready = writers_.front();
+    writers_.pop_front();
+    group.writers.push_back(ready);
+    if (ready == last_writer) break;
+  }
+  memtable_groups_.push_back(&group);
+
+  // Let the next group use the log while this one waits for mem_
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+
+  // Memtable stage
+  while (memtable_groups_.front() != &group) {
+    w.cv.Wait();
+  }
+  if (group.status.ok()) {
+    // Only the group at the front of memtable_groups_ writes to mem_, and
+    // mem_ is not replaced while the group is queued.
+    MemTable* mem = mem_;
+    SequenceNumber sequence = first_sequence;
+    if (options_.allow_concurrent_memtable_write &&
+        mem->SupportsConcurrentAdds() &&
+        group.writers.size() > 1) {
+      // Hand every follower its sequence numbers and let it insert its
+      // own batch while we insert ours.
+      group.mem = mem;
+      group.pending = 0;
+      for (size_t i = 0; i < group.writers.size(); i++) {
+        Writer* writer = group.writers[i];
+        if (writer->batch != NULL) {
+          WriteBatchInternal::SetSequence(writer->batch, sequence);
+          sequence += WriteBatchInternal::Count(writer->batch);
+          if (writer != &w) {
+            writer->group = &group;
+            group.pending++;
+            writer->cv.Signal();
+          }
+        }
+      }
+      mutex_.Unlock();
+      status = WriteBatchInternal::InsertConcurrentlyInto(my_batch, mem);
+      mutex_.Lock();
+      if (!status.ok() && group.status.ok()) {
+        group.status = status;
+      }
+      while (group.pending > 0) {
+        w.cv.Wait();
+      }
+      status = group.status;
+    } else {
+      mutex_.Unlock();
+      for (size_t i = 0; i < group.writers.size() && status.ok(); i++) {
+        WriteBatch* batch = group.writers[i]->batch;
+        if (batch != NULL) {
+          WriteBatchInternal::SetSequence(batch, sequence);
+          status = WriteBatchInternal::InsertInto(batch, mem);
+          sequence += WriteBatchInternal::Count(batch);
+        }
+      }
+      mutex_.Lock();
+    }
+  }
+  // Sequence numbers become visible in the order they were handed out.
+  versions_->SetLastSequence(last_sequence);
+
+  memtable_groups_.pop_front();
+  for (size_t i = 0; i < group.writers.size(); i++) {
+    Writer* ready = group.writers[i];
+    if (ready != &w) {
+      ready->status = status;
+      ready->done = true;
+      ready->cv.Signal();
+    }
+  }
+  if (!memtable_groups_.empty()) {
+    memtable_groups_.front()->leader->cv.Signal();
+  } else {
+    bg_cv_.SignalAll();  // Wakeup MakeRoomForWrite() if necessary
+  }
+  return status;
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-NULL batch
 WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
@@ -1287,6 +1955,11 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
   ++iter;  // Advance past "first"
   for (; iter != writers_.end(); ++iter) {
     Writer* w = *iter;
+    if (w->exclusive) {
+      // Must not be completed by this group
+      break;
+    }
+
     if (w->sync && !first->sync) {
       // Do not include a sync write into a batch handled by a non-sync write.
       break;
@@ -1313,12 +1986,21 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
   return result;
 }
 
+// Set *start_micros to the time a write started to wait, when it first
+// does, if "stats" counts stalls.
+static void StartStall(Env* env, Statistics* stats, uint64_t* start_micros) {
+  if (stats != NULL && *start_micros == 0) {
+    *start_micros = env->NowMicros();
+  }
+}
+
 // REQUIRES: mutex_ is held
 // REQUIRES: this thread is currently at the front of the writer queue
 Status DBImpl::MakeRoomForWrite(bool force) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
   bool allow_delay = !force;
+  uint64_t stall_start_micros = 0;
   Status s;
   while (true) {
     if (!bg_error_.ok()) {
@@ -1334,6 +2016,7 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // individual write by 1ms to reduce latency variance.  Also,
       // this delay hands over some CPU to the compaction thread in
       // case it is sharing the same core as the writer.
+      StartStall(env_, options_.statistics, &stall_start_micros);
       mutex_.Unlock();
       env_->SleepForMicroseconds(1000);
       allow_delay = false;  // Do not delay a single write more than once
@@ -1342,14 +2025,21 @@ Status DBImpl::MakeRoomForWrite(bool force) {
                (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
       // There is room in current memtable
       break;
-    } else if (imm_ != NULL) {
-      // We have filled up the current memtable, but the previous
-      // one is still being compacted, so we wait.
+    } else if (imm_.size() + 1 >=
+               static_cast<size_t>(options_.max_write_buffer_number)) {
+      // We have filled up the current memtable, but all the previous
+      // ones are still waiting to be compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
+      StartStall(env_, options_.statistics, &stall_start_micros);
       bg_cv_.Wait();
     } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
+      StartStall(env_, options_.statistics, &stall_start_micros);
+      bg_cv_.Wait();
+    } else if (!memtable_groups_.empty()) {
+      // Logged groups are still being inserted into mem_; let them
+      // finish before mem_ becomes immutable.
       bg_cv_.Wait();
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
@@ -1367,14 +2057,23 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       logfile_ = lfile;
       logfile_number_ = new_log_number;
       log_ = new log::Writer(lfile);
-      imm_ = mem_;
-      has_imm_.Release_Store(imm_);
-      mem_ = new MemTable(internal_comparator_);
+      mem_->MarkReadOnly();
+      imm_.push_back(mem_);
+      imm_log_numbers_.push_back(new_log_number);
+      if (!flushing_imm_) {
+        has_imm_.Release_Store(mem_);
+      }
+      mem_ = new MemTable(internal_comparator_, options_.memtable_factory,
+                          env_);
       mem_->Ref();
       force = false;   // Do not force another compaction if have room
       MaybeScheduleCompaction();
     }
   }
+  if (stall_start_micros != 0) {
+    RecordTick(options_.statistics, kStallMicros,
+               env_->NowMicros() - stall_start_micros);
+  }
   return s;
 }
 
@@ -1427,13 +2126,19 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   } else if (in == "sstables") {
     *value = versions_->current()->DebugString();
     return true;
+  } else if (in == "statistics") {
+    if (options_.statistics == NULL) {
+      return false;
+    }
+    *value = options_.statistics->ToString();
+    return true;
   } else if (in == "approximate-memory-usage") {
     size_t total_usage = options_.block_cache->TotalCharge();
     if (mem_) {
       total_usage += mem_->ApproximateMemoryUsage();
     }
-    if (imm_) {
-      total_usage += imm_->ApproximateMemoryUsage();
+    for (size_t i = 0; i < imm_.size(); i++) {
+      total_usage += imm_[i]->ApproximateMemoryUsage();
     }
     char buf[50];
     snprintf(buf, sizeof(buf), "%llu",
@@ -1471,6 +2176,234 @@ void DBImpl::GetApproximateSizes(
   }
 }
 
+// Set *smallest and *largest to the first and last keys of the table in
+// "fname", which must have been written by an SstFileWriter, and
+// *file_size to its size.
+static Status ReadExternalFileRange(const Options& options,
+                                    const std::string& fname,
+                                    InternalKey* smallest,
+                                    InternalKey* largest,
+                                    uint64_t* file_size) {
+  Env* env = options.env;
+  Status s = env->GetFileSize(fname, file_size);
+  RandomAccessFile* file = NULL;
+  Table* table = NULL;
+  if (s.ok()) {
+    s = env->NewRandomAccessFile(fname, &file);
+  }
+  if (s.ok()) {
+    s = Table::Open(options, file, *file_size, &table);
+  }
+  if (s.ok()) {
+    ReadOptions read_options;
+    read_options.verify_checksums = options.paranoid_checks;
+    read_options.fill_cache = false;
+    Iterator* iter = table->NewIterator(read_options);
+    ParsedInternalKey first, last;
+    iter->SeekToFirst();
+    if (!iter->Valid()) {
+      s = iter->status();
+      if (s.ok()) {
+        s = Status::InvalidArgument(fname, "table is empty");
+      }
+    } else if (!ParseInternalKey(iter->key(), &first) ||
+               first.sequence != 0) {
+      s = Status::Corruption(fname, "not written by an SstFileWriter");
+    } else {
+      smallest->DecodeFrom(iter->key());
+      iter->SeekToLast();
+      if (!iter->Valid()) {
+        s = iter->status();
+      } else if (!ParseInternalKey(iter->key(), &last) ||
+                 last.sequence != 0) {
+        s = Status::Corruption(fname, "not written by an SstFileWriter");
+      } else {
+        largest->DecodeFrom(iter->key());
+      }
+    }
+    delete iter;
+  }
+  delete table;
+  if (table == NULL) {
+    delete file;  // Otherwise owned by table
+  }
+  return s;
+}
+
+// Copy the file "src" to "dst", which is synced.
+static Status CopyFile(Env* env, const std::string& src,
+                       const std::string& dst) {
+  SequentialFile* in;
+  Status s = env->NewSequentialFile(src, &in);
+  if (!s.ok()) {
+    return s;
+  }
+  WritableFile* out;
+  s = env->NewWritableFile(dst, &out);
+  if (!s.ok()) {
+    delete in;
+    return s;
+  }
+  const size_t kBufferSize = 1 << 20;
+  char* buffer = new char[kBufferSize];
+  while (s.ok()) {
+    Slice fragment;
+    s = in->Read(kBufferSize, &fragment, buffer);
+    if (!s.ok() || fragment.empty()) {
+      break;
+    }
+    s = out->Append(fragment);
+  }
+  delete[] buffer;
+  if (s.ok()) {
+    s = out->Sync();
+  }
+  if (s.ok()) {
+    s = out->Close();
+  }
+  delete out;
+  delete in;
+  if (!s.ok()) {
+    env->DeleteFile(dst);
+  }
+  return s;
+}
+
+// Returns true iff "mem" holds an entry for a user key in
+// [smallest_user_key, largest_user_key].
+static bool MemTableOverlaps(MemTable* mem, const Comparator* ucmp,
+                             const Slice& smallest_user_key,
+                             const Slice& largest_user_key) {
+  Iterator* iter = mem->NewIterator();
+  InternalKey start(smallest_user_key, kMaxSequenceNumber, kValueTypeForSeek);
+  iter->Seek(start.Encode());
+  const bool overlaps =
+      iter->Valid() &&
+      ucmp->Compare(ExtractUserKey(iter->key()), largest_user_key) <= 0;
+  delete iter;
+  return overlaps;
+}
+
+Status DBImpl::IngestExternalFile(const IngestOptions& options,
+                                  const std::string& fname) {
+  FileMetaData meta;
+  Status s = ReadExternalFileRange(options_, fname, &meta.smallest,
+                                   &meta.largest, &meta.file_size);
+  if (!s.ok()) {
+    return s;
+  }
+  const std::string smallest_user_key = meta.smallest.user_key().ToString();
+  const std::string largest_user_key = meta.largest.user_key().ToString();
+  const Comparator* ucmp = user_comparator();
+
+  // Keep other writes out until the file is installed, so that it is
+  // newer than every write before it and older than every write after.
+  Writer w(&mutex_);
+  w.batch = NULL;
+  w.sync = false;
+  w.done = false;
+  w.exclusive = true;
+
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+  while (!memtable_groups_.empty()) {
+    bg_cv_.Wait();
+  }
+  s = bg_error_;
+
+  // Entries of the memtables for keys in the range of the file are older
+  // than the file, so must reach the levels before it does.
+  if (s.ok()) {
+    bool flush = false;
+    for (size_t i = 0; i < imm_.size(); i++) {
+      if (MemTableOverlaps(imm_[i], ucmp, smallest_user_key,
+                           largest_user_key)) {
+        flush = true;
+      }
+    }
+    if (MemTableOverlaps(mem_, ucmp, smallest_user_key, largest_user_key)) {
+      flush = true;
+      s = MakeRoomForWrite(true /* force compaction */);
+    }
+    if (s.ok() && flush) {
+      while (!imm_.empty() && bg_error_.ok()) {
+        bg_cv_.Wait();
+      }
+      if (!imm_.empty()) {
+        s = bg_error_;
+      }
+    }
+  }
+
+  // The file gets its number only now, so that it sorts after any
+  // level-0 table built from the memtables flushed above.
+  if (s.ok()) {
+    meta.number = versions_->NewFileNumber();
+    pending_outputs_.insert(meta.number);
+    const std::string dst = TableFileName(dbname_, meta.number);
+    mutex_.Unlock();
+    if (options.move_file) {
+      s = env_->RenameFile(fname, dst);
+    } else {
+      s = CopyFile(table_env_, fname, dst);
+    }
+    mutex_.Lock();
+
+    if (s.ok()) {
+      // Place the file in the deepest level it can go to without
+      // overlapping any level above, or a compaction in progress.
+      Version* current = versions_->current();
+      const Slice smallest = smallest_user_key;
+      const Slice largest = largest_user_key;
+      int level = 0;
+      if (!current->OverlapInLevel(0, &smallest, &largest)) {
+        for (int next = 1; next < config::kNumLevels; next++) {
+          if (current->OverlapInLevel(next, &smallest, &largest) ||
+              versions_->RangeInCompaction(next, meta.smallest,
+                                           meta.largest)) {
+            break;
+          }
+          level = next;
+        }
+      }
+
+      const SequenceNumber seq =
+          std::max(versions_->LastSequence(), allocated_sequence_) + 1;
+      meta.smallest = InternalKey(smallest_user_key, seq,
+                                  ExtractValueType(meta.smallest.Encode()));
+      meta.largest = InternalKey(largest_user_key, seq,
+                                 ExtractValueType(meta.largest.Encode()));
+      meta.global_seqno = seq;
+
+      // The file and its sequence number become visible together.
+      VersionEdit edit;
+      edit.AddFile(level, meta);
+      edit.SetLastSequence(seq);
+      s = LogAndApply(&edit);
+      if (s.ok()) {
+        Log(options_.info_log, "Ingested %s as #%llu at level-%d seq %llu",
+            fname.c_str(), static_cast<unsigned long long>(meta.number),
+            level, static_cast<unsigned long long>(seq));
+      } else if (options.move_file) {
+        env_->RenameFile(dst, fname);
+      } else {
+        env_->DeleteFile(dst);
+      }
+    }
+    pending_outputs_.erase(meta.number);
+  }
+
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  MaybeScheduleCompaction();
+  return s;
+}
+
 // Default implementations of convenience methods that subclasses of DB
 // can call if they wish
 Status DB::Put(const WriteOptions& opt, const Slice& key, const Slice& value) {
@@ -1485,6 +2418,32 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+void DB::MultiGet(const ReadOptions& options,
+                  const std::vector<Slice>& keys,
+                  std::vector<std::string>* values,
+                  std::vector<Status>* statuses) {
+  // Read every key from the same snapshot.
+  ReadOptions read_options = options;
+  const Snapshot* snapshot = NULL;
+  if (read_options.snapshot == NULL) {
+    snapshot = GetSnapshot();
+    read_options.snapshot = snapshot;
+  }
+  values->resize(keys.size());
+  statuses->resize(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    (*statuses)[i] = Get(read_options, keys[i], &(*values)[i]);
+  }
+  if (snapshot != NULL) {
+    ReleaseSnapshot(snapshot);
+  }
+}
+
+Status DB::IngestExternalFile(const IngestOptions& options,
+                              const std::string& fname) {
+  return Status::NotSupported("IngestExternalFile");
+}
+
 DB::~DB() { }
 
 Status DB::Open(const Options& options, const std::string& dbname,
@@ -1508,7 +2467,9 @@ Status DB::Open(const Options& options, const std::string& dbname,
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
       impl->log_ = new log::Writer(lfile);
-      impl->mem_ = new MemTable(impl->internal_comparator_);
+      impl->mem_ = new MemTable(impl->internal_comparator_,
+                                 impl->options_.memtable_factory,
+                                 impl->env_);
       impl->mem_->Ref();
     }
   }
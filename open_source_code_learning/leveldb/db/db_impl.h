@@ -7,6 +7,7 @@
 
 #include <deque>
 #include <set>
+#include <vector>
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
@@ -35,12 +36,18 @@ class DBImpl : public DB {
   virtual Status Get(const ReadOptions& options,
                      const Slice& key,
                      std::string* value);
+  virtual void MultiGet(const ReadOptions& options,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses);
   virtual Iterator* NewIterator(const ReadOptions&);
   virtual const Snapshot* GetSnapshot();
   virtual void ReleaseSnapshot(const Snapshot* snapshot);
   virtual bool GetProperty(const Slice& property, std::string* value);
   virtual void GetApproximateSizes(const Range* range, int n, uint64_t* sizes);
   virtual void CompactRange(const Slice* begin, const Slice* end);
+  virtual Status IngestExternalFile(const IngestOptions& options,
+                                    const std::string& fname);
 
   // Extra methods (for testing) that are not in the public DB interface
 
@@ -50,6 +57,9 @@ class DBImpl : public DB {
   // Force current memtable contents to be compacted.
   Status TEST_CompactMemTable();
 
+  // Wait until no background compaction is scheduled or running.
+  Status TEST_WaitForCompactions();
+
   // Return an internal iterator over the current state of the database.
   // The keys of this iterator are internal keys (see format.h).
   // The returned iterator should be deleted when no longer needed.
@@ -67,7 +77,9 @@ class DBImpl : public DB {
  private:
   friend class DB;
   struct CompactionState;
+  struct SubcompactionGroup;
   struct Writer;
+  struct WriteGroup;
 
   Iterator* NewInternalIterator(const ReadOptions&,
                                 SequenceNumber* latest_snapshot,
@@ -95,23 +107,45 @@ class DBImpl : public DB {
                         VersionEdit* edit, SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
+  // Build a level-0 table from the memtable entries of "iter", which is
+  // deleted.
+  Status WriteLevel0Table(Iterator* iter, VersionEdit* edit, Version* base)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Ref mem_ and the memtables of imm_ and append them to *mems, newest
+  // first.  The caller must unref them, with mutex_ held.
+  void RefMemTables(std::vector<MemTable*>* mems)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   WriteBatch* BuildBatchGroup(Writer** last_writer);
+  // Write() for options_.enable_pipelined_write
+  Status PipelinedWrite(const WriteOptions& options, WriteBatch* my_batch);
 
   void RecordBackgroundError(const Status& s);
 
+  // Apply *edit through versions_->LogAndApply(), first waiting for any
+  // other background thread that is currently writing the MANIFEST.
+  Status LogAndApply(VersionEdit* edit) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  void UpdateCompactionDebt() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   static void BGWork(void* db);
   void BackgroundCall();
-  void  BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Returns false if there was nothing this thread could do.
+  bool BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Merge the inputs of compact->compaction whose user keys fall in the
+  // range recorded in *compact.  Adds the time spent compacting imm_ in
+  // the meantime to *imm_micros.
+  Status DoCompactionRange(CompactionState* compact, int64_t* imm_micros);
+  // Claim and run subcompactions of *group until none are left.
+  static void RunSubcompactions(SubcompactionGroup* group);
+  static void BGSubcompaction(void* group);
 
   Status OpenCompactionOutputFile(CompactionState* compact);
   Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
@@ -130,6 +164,10 @@ class DBImpl : public DB {
   // table_cache_ provides its own synchronization
   TableCache* table_cache_;
 
+  // Env that flushes and compactions create tables with: env_, or one
+  // whose files pass their writes through options_.rate_limiter.
+  Env* table_env_;
+
   // Lock over the persistent DB state.  Non-NULL iff successfully acquired.
   FileLock* db_lock_;
 
@@ -138,25 +176,57 @@ class DBImpl : public DB {
   port::AtomicPointer shutting_down_;
   port::CondVar bg_cv_;          // Signalled when background work finishes
   MemTable* mem_;
-  MemTable* imm_;                // Memtable being compacted
-  port::AtomicPointer has_imm_;  // So bg thread can detect non-NULL imm_
+  // Full memtables waiting to be written to level-0, oldest first.  Holds
+  // at most options_.max_write_buffer_number - 1 of them.
+  std::deque<MemTable*> imm_;
+  // imm_log_numbers_[i] is the number of the log started when imm_[i]
+  // was switched out.  Earlier logs only hold the writes of imm_[0..i].
+  std::deque<uint64_t> imm_log_numbers_;
+  // Non-NULL iff imm_ is non-empty and no thread is flushing it, so
+  // compactions can tell without mutex_ that a flush is needed.
+  port::AtomicPointer has_imm_;
   WritableFile* logfile_;
   uint64_t logfile_number_;
   log::Writer* log_;
   uint32_t seed_;                // For sampling.
 
+  // Compaction debt (see RateLimiter::Request) in thousandths, for the
+  // files of table_env_ to read without holding mutex_
+  port::AtomicPointer compaction_debt_;
+
   // Queue of writers.
   std::deque<Writer*> writers_;
   WriteBatch* tmp_batch_;
 
+  // Groups that have been logged but not yet inserted into mem_, in
+  // sequence order (pipelined writes only).  mem_ is not replaced
+  // while this is non-empty.
+  std::deque<WriteGroup*> memtable_groups_;
+
+  // Last sequence number handed out to a logged group.  May run ahead
+  // of versions_->LastSequence() while groups wait in memtable_groups_.
+  SequenceNumber allocated_sequence_;
+
   SnapshotList snapshots_;
 
   // Set of table files to protect from deletion because they are
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_;
 
-  // Has a background compaction been scheduled or is running?
-  bool bg_compaction_scheduled_;
+  // Number of background compactions scheduled or running.  At most
+  // options_.max_background_compactions.
+  int bg_compaction_scheduled_;
+
+  // Is a background thread writing memtables of imm_ to a table?
+  bool flushing_imm_;
+
+  // Has the level for the table built from imm_ been picked without the
+  // table being installed yet?  New compactions must not be picked until
+  // then because they could not see the table.
+  bool installing_imm_;
+
+  // Is a background thread inside versions_->LogAndApply()?
+  bool writing_manifest_;
 
   // Information for a manual compaction
   struct ManualCompaction {
@@ -12,7 +12,9 @@
 #include "port/port.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/perf_context_imp.h"
 #include "util/random.h"
+#include "util/statistics.h"
 
 namespace leveldb {
 
@@ -49,7 +51,7 @@ class DBIter: public Iterator {
   };
 
   DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+         uint32_t seed, Env* env, Statistics* statistics)
       : db_(db),
         user_comparator_(cmp),
         iter_(iter),
@@ -57,7 +59,9 @@ class DBIter: public Iterator {
         direction_(kForward),
         valid_(false),
         rnd_(seed),
-        bytes_counter_(RandomPeriod()) {
+        bytes_counter_(RandomPeriod()),
+        env_(env),
+        statistics_(statistics) {
   }
   virtual ~DBIter() {
     delete iter_;
@@ -122,6 +126,9 @@ class DBIter: public Iterator {
   Random rnd_;
   ssize_t bytes_counter_;
 
+  Env* const env_;
+  Statistics* const statistics_;
+
   // No copying allowed
   DBIter(const DBIter&);
   void operator=(const DBIter&);
@@ -174,6 +181,7 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   // Loop until we hit an acceptable entry to yield
   assert(iter_->Valid());
   assert(direction_ == kForward);
+  PerfTimer timer(env_, &PerfContext::find_next_user_entry_nanos);
   do {
     ParsedInternalKey ikey;
     if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
@@ -183,11 +191,13 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
           // they are hidden by this deletion.
           SaveKey(ikey.user_key, skip);
           skipping = true;
+          PerfCount(&PerfContext::internal_delete_skipped_count);
           break;
         case kTypeValue:
           if (skipping &&
               user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
             // Entry hidden
+            PerfCount(&PerfContext::internal_key_skipped_count);
           } else {
             valid_ = true;
             saved_key_.clear();
@@ -272,12 +282,17 @@ void DBIter::FindPrevUserEntry() {
 }
 
 void DBIter::Seek(const Slice& target) {
+  RecordTick(statistics_, kNumberDBSeek);
+  StopWatch watch(env_, statistics_, kDBSeekMicros);
   direction_ = kForward;
   ClearSavedValue();
   saved_key_.clear();
   AppendInternalKey(
       &saved_key_, ParsedInternalKey(target, sequence_, kValueTypeForSeek));
-  iter_->Seek(saved_key_);
+  {
+    PerfTimer timer(env_, &PerfContext::seek_internal_seek_nanos);
+    iter_->Seek(saved_key_);
+  }
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
   } else {
@@ -310,8 +325,11 @@ Iterator* NewDBIterator(
     const Comparator* user_key_comparator,
     Iterator* internal_iter,
     SequenceNumber sequence,
-    uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+    uint32_t seed,
+    Env* env,
+    Statistics* statistics) {
+  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed,
+                    env, statistics);
 }
 
 }  // namespace leveldb
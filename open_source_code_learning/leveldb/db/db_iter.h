@@ -12,16 +12,21 @@
 namespace leveldb {
 
 class DBImpl;
+class Env;
+class Statistics;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  Seeks are recorded in "statistics" if it
+// is non-NULL.
 extern Iterator* NewDBIterator(
     DBImpl* db,
     const Comparator* user_key_comparator,
     Iterator* internal_iter,
     SequenceNumber sequence,
-    uint32_t seed);
+    uint32_t seed,
+    Env* env,
+    Statistics* statistics);
 
 }  // namespace leveldb
 
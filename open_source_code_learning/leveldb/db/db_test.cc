@@ -10,6 +10,9 @@
 #include "db/write_batch_internal.h"
 #include "leveldb/cache.h"
 #include "leveldb/env.h"
+#include "leveldb/memtablerep.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/statistics.h"
 #include "leveldb/table.h"
 #include "util/hash.h"
 #include "util/logging.h"
@@ -113,7 +116,8 @@ class SpecialEnv : public EnvWrapper {
   port::AtomicPointer manifest_write_error_;
 
   bool count_random_reads_;
-  AtomicCounter random_read_counter_;
+  AtomicCounter random_read_counter_;     // Reads, including MultiRead()'s
+  AtomicCounter multi_read_counter_;      // MultiRead() calls
 
   explicit SpecialEnv(Env* base) : EnvWrapper(base) {
     delay_data_sync_.Release_Store(NULL);
@@ -203,9 +207,12 @@ class SpecialEnv : public EnvWrapper {
      private:
       RandomAccessFile* target_;
       AtomicCounter* counter_;
+      AtomicCounter* multi_read_counter_;
      public:
-      CountingFile(RandomAccessFile* target, AtomicCounter* counter)
-          : target_(target), counter_(counter) {
+      CountingFile(RandomAccessFile* target, AtomicCounter* counter,
+                   AtomicCounter* multi_read_counter)
+          : target_(target), counter_(counter),
+            multi_read_counter_(multi_read_counter) {
       }
       virtual ~CountingFile() { delete target_; }
       virtual Status Read(uint64_t offset, size_t n, Slice* result,
@@ -213,11 +220,16 @@ class SpecialEnv : public EnvWrapper {
         counter_->Increment();
         return target_->Read(offset, n, result, scratch);
       }
+      virtual void MultiRead(ReadRequest* reqs, int n) const {
+        multi_read_counter_->Increment();
+        counter_->IncrementBy(n);
+        target_->MultiRead(reqs, n);
+      }
     };
 
     Status s = target()->NewRandomAccessFile(f, r);
     if (s.ok() && count_random_reads_) {
-      *r = new CountingFile(*r, &random_read_counter_);
+      *r = new CountingFile(*r, &random_read_counter_, &multi_read_counter_);
     }
     return s;
   }
@@ -226,6 +238,9 @@ class SpecialEnv : public EnvWrapper {
 class DBTest {
  private:
   const FilterPolicy* filter_policy_;
+  Cache* row_cache_;
+  MemTableRepFactory* hash_skiplist_factory_;
+  MemTableRepFactory* vector_factory_;
 
   // Sequence of option configurations to try
   enum OptionConfig {
@@ -233,6 +248,15 @@ class DBTest {
     kReuse,
     kFilter,
     kUncompressed,
+    kParallelCompaction,
+    kSubcompactions,
+    kPipelinedWrite,
+    kConcurrentMemtableWrite,
+    kDataBlockHashIndex,
+    kRowCache,
+    kMultipleWriteBuffers,
+    kHashSkipList,
+    kVectorRep,
     kEnd
   };
   int option_config_;
@@ -247,6 +271,9 @@ class DBTest {
   DBTest() : option_config_(kDefault),
              env_(new SpecialEnv(Env::Default())) {
     filter_policy_ = NewBloomFilterPolicy(10);
+    row_cache_ = NewLRUCache(1 << 20);
+    hash_skiplist_factory_ = NewHashSkipListRepFactory(1, 16);
+    vector_factory_ = NewVectorRepFactory();
     dbname_ = test::TmpDir() + "/db_test";
     DestroyDB(dbname_, Options());
     db_ = NULL;
@@ -258,6 +285,9 @@ class DBTest {
     DestroyDB(dbname_, Options());
     delete env_;
     delete filter_policy_;
+    delete row_cache_;
+    delete hash_skiplist_factory_;
+    delete vector_factory_;
   }
 
   // Switch to a fresh database with the next option configuration to
@@ -286,6 +316,35 @@ class DBTest {
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kParallelCompaction:
+        options.max_background_compactions = 4;
+        break;
+      case kSubcompactions:
+        options.max_background_compactions = 2;
+        options.max_subcompactions = 4;
+        break;
+      case kPipelinedWrite:
+        options.enable_pipelined_write = true;
+        break;
+      case kConcurrentMemtableWrite:
+        options.enable_pipelined_write = true;
+        options.allow_concurrent_memtable_write = true;
+        break;
+      case kDataBlockHashIndex:
+        options.data_block_hash_index = true;
+        break;
+      case kRowCache:
+        options.row_cache = row_cache_;
+        break;
+      case kMultipleWriteBuffers:
+        options.max_write_buffer_number = 4;
+        break;
+      case kHashSkipList:
+        options.memtable_factory = hash_skiplist_factory_;
+        break;
+      case kVectorRep:
+        options.memtable_factory = vector_factory_;
+        break;
       default:
         break;
     }
@@ -348,6 +407,32 @@ class DBTest {
     return result;
   }
 
+  // Return the results of a MultiGet() of "keys", each formatted as by
+  // Get() and separated by commas.
+  std::string MultiGet(const std::vector<std::string>& keys,
+                       const Snapshot* snapshot = NULL) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    std::vector<Slice> key_slices(keys.begin(), keys.end());
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    db_->MultiGet(options, key_slices, &values, &statuses);
+    std::string result;
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (i > 0) {
+        result += ",";
+      }
+      if (statuses[i].IsNotFound()) {
+        result += "NOT_FOUND";
+      } else if (!statuses[i].ok()) {
+        result += statuses[i].ToString();
+      } else {
+        result += values[i];
+      }
+    }
+    return result;
+  }
+
   // Return a string that contains all key,value pairs in order,
   // formatted like "(k1->v1)(k2->v2)".
   std::string Contents() {
@@ -671,6 +756,41 @@ TEST(DBTest, GetPicksCorrectFile) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, MultiGet) {
+  do {
+    std::vector<std::string> keys;
+    keys.push_back("x");
+    keys.push_back("a");
+    keys.push_back("missing");
+    keys.push_back("b");
+    keys.push_back("c");
+    keys.push_back("d");
+    keys.push_back("a");
+    ASSERT_EQ("NOT_FOUND,NOT_FOUND,NOT_FOUND,NOT_FOUND,NOT_FOUND,NOT_FOUND,"
+              "NOT_FOUND", MultiGet(keys));
+
+    // Spread the keys over the tables of a non-level-0 level, a table
+    // written from the memtable and the memtable itself.
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(Put("b", "vb"));
+    ASSERT_OK(Put("c", "vc"));
+    Compact("a", "c");
+    ASSERT_OK(Put("x", "vx"));
+    Compact("x", "y");
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_OK(Put("b", "vb2"));
+    ASSERT_OK(Delete("c"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_OK(Put("d", "vd"));
+    ASSERT_OK(Delete("x"));
+
+    ASSERT_EQ("NOT_FOUND,va,NOT_FOUND,vb2,NOT_FOUND,vd,va", MultiGet(keys));
+    ASSERT_EQ("vx,va,NOT_FOUND,vb,vc,NOT_FOUND,va", MultiGet(keys, snapshot));
+    db_->ReleaseSnapshot(snapshot);
+    ASSERT_EQ("", MultiGet(std::vector<std::string>()));
+  } while (ChangeOptions());
+}
+
 TEST(DBTest, GetEncountersEmptyLevel) {
   do {
     // Arrange for the following to happen:
@@ -964,6 +1084,363 @@ static std::string Key(int i) {
   return std::string(buf);
 }
 
+TEST(DBTest, MultiGetParallel) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;
+  options.max_multiget_parallelism = 4;
+  Reopen(&options);
+
+  // Fill several tables of a non-level-0 level, then overwrite and delete
+  // some of the keys in level-0 and the memtable.
+  Random rnd(301);
+  const int kNumKeys = 4000;
+  std::vector<std::string> keys;
+  for (int i = 0; i < kNumKeys; i++) {
+    keys.push_back(Key(i));
+    ASSERT_OK(Put(Key(i), RandomString(&rnd, 1000)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_GT(TotalTableFiles() - NumTableFilesAtLevel(0), 2);
+  for (int i = 0; i < kNumKeys; i += 7) {
+    ASSERT_OK(Put(Key(i), "v" + Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < kNumKeys; i += 11) {
+    ASSERT_OK(Delete(Key(i)));
+  }
+  keys.push_back("missing");
+
+  // Ask for the keys in a scrambled order.
+  for (size_t i = keys.size() - 1; i > 0; i--) {
+    std::swap(keys[i], keys[rnd.Uniform(i + 1)]);
+  }
+  std::string expected;
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (i > 0) {
+      expected += ",";
+    }
+    expected += Get(keys[i]);
+  }
+  ASSERT_EQ(expected, MultiGet(keys));
+}
+
+TEST(DBTest, MultiGetBatchesBlockReads) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  env_->count_random_reads_ = true;
+  Reopen(&options);
+
+  // Give each key a data block of its own in a single table.
+  Random rnd(301);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 20; i++) {
+    keys.push_back(Key(i));
+    ASSERT_OK(Put(Key(i), RandomString(&rnd, 5000)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(TotalTableFiles(), 1);
+
+  // Open the table first.  The default Env mmaps tables, whose blocks
+  // are not cached, so the MultiGet() reads all 20 blocks.
+  Reopen(&options);
+  Get(Key(0));
+  env_->random_read_counter_.Reset();
+  env_->multi_read_counter_.Reset();
+  const std::string result = MultiGet(keys);
+  ASSERT_EQ(1, env_->multi_read_counter_.Read());
+  ASSERT_EQ(20, env_->random_read_counter_.Read());
+
+  std::string expected;
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (i > 0) {
+      expected += ",";
+    }
+    expected += Get(keys[i]);
+  }
+  ASSERT_EQ(expected, result);
+  env_->count_random_reads_ = false;
+}
+
+TEST(DBTest, RowCache) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.row_cache = NewLRUCache(1 << 20);
+  env_->count_random_reads_ = true;
+  Reopen(&options);
+
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_OK(Put("bar", "b"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("v1", Get("foo"));
+  env_->random_read_counter_.Reset();
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ(0, env_->random_read_counter_.Read());
+  ASSERT_EQ("b", Get("bar"));
+  ASSERT_GE(env_->random_read_counter_.Read(), 1);
+
+  // Newer entries are in new files, which have rows of their own.
+  ASSERT_OK(Put("foo", "v2"));
+  ASSERT_EQ("v2", Get("foo"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("v2", Get("foo"));
+  ASSERT_OK(Delete("foo"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  env_->random_read_counter_.Reset();
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_EQ(0, env_->random_read_counter_.Read());
+
+  // A row is not used by reads at snapshots older than its entry.
+  ASSERT_OK(Put("baz", "v1"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Put("baz", "v2"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("v2", Get("baz"));
+  ASSERT_EQ("v1", Get("baz", snapshot));
+  db_->ReleaseSnapshot(snapshot);
+
+  env_->count_random_reads_ = false;
+  Close();
+  delete options.row_cache;
+}
+
+namespace {
+struct WriteBufferState {
+  DB* db;
+  int num_keys;
+  port::AtomicPointer done;
+};
+
+static void WriteBufferThreadBody(void* arg) {
+  WriteBufferState* state = reinterpret_cast<WriteBufferState*>(arg);
+  for (int i = 0; i < state->num_keys; i++) {
+    ASSERT_OK(state->db->Put(WriteOptions(), Key(i), std::string(1000, 'x')));
+  }
+  state->done.Release_Store(state);
+}
+}  // namespace
+
+TEST(DBTest, MultipleWriteBuffers) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.write_buffer_size = 100000;
+  options.max_write_buffer_number = 4;
+  Reopen(&options);
+
+  // Writes fill over two memtables while the first flush is held
+  // up, which do not stall with four allowed.
+  env_->delay_data_sync_.Release_Store(env_);
+  WriteBufferState state;
+  state.db = db_;
+  state.num_keys = 200;
+  state.done.Release_Store(NULL);
+  env_->StartThread(&WriteBufferThreadBody, &state);
+  for (int i = 0; i < 10000 && state.done.Acquire_Load() == NULL; i++) {
+    DelayMilliseconds(1);
+  }
+  const bool stalled = (state.done.Acquire_Load() == NULL);
+  if (!stalled) {
+    // Reads see the memtables that wait to be flushed.
+    for (int i = 0; i < state.num_keys; i++) {
+      ASSERT_EQ(std::string(1000, 'x'), Get(Key(i)));
+    }
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      count++;
+    }
+    delete iter;
+    ASSERT_EQ(state.num_keys, count);
+  }
+  env_->delay_data_sync_.Release_Store(NULL);
+  while (state.done.Acquire_Load() == NULL) {
+    DelayMilliseconds(1);
+  }
+  ASSERT_TRUE(!stalled);
+
+  // Memtables that were waiting together were flushed to one table.
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LT(TotalTableFiles(), 4);
+  for (int i = 0; i < state.num_keys; i++) {
+    ASSERT_EQ(std::string(1000, 'x'), Get(Key(i)));
+  }
+}
+
+TEST(DBTest, DirectIO) {
+  for (int direct_reads = 0; direct_reads < 2; direct_reads++) {
+    Options options = CurrentOptions();
+    options.write_buffer_size = 100000;
+    options.use_direct_reads = (direct_reads == 1);
+    options.use_direct_io_for_compaction = true;
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+
+    // Write the keys out of order, so that the tables overlap and have
+    // to be compacted.
+    Random rnd(301);
+    std::vector<std::string> values(500);
+    for (int i = 0; i < 500; i++) {
+      const int k = (i * 7) % 500;
+      values[k] = RandomString(&rnd, 1000 + rnd.Uniform(3000));
+      ASSERT_OK(Put(Key(k), values[k]));
+    }
+    dbfull()->TEST_CompactMemTable();
+    dbfull()->TEST_CompactRange(0, NULL, NULL);
+    ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+    ASSERT_GT(NumTableFilesAtLevel(1), 0);
+
+    Reopen(&options);
+    for (int i = 0; i < 500; i++) {
+      ASSERT_EQ(values[i], Get(Key(i)));
+    }
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ASSERT_EQ(values[count], iter->value().ToString());
+      count++;
+    }
+    ASSERT_OK(iter->status());
+    ASSERT_EQ(500, count);
+    delete iter;
+  }
+}
+
+namespace {
+class CountingRateLimiter : public RateLimiter {
+ public:
+  port::Mutex mu_;
+  int64_t bytes_;
+  double max_debt_;
+
+  CountingRateLimiter() : bytes_(0), max_debt_(0) { }
+
+  virtual void Request(int64_t bytes, double debt) {
+    MutexLock l(&mu_);
+    bytes_ += bytes;
+    max_debt_ = std::max(max_debt_, debt);
+  }
+  virtual int64_t GetBytesPerSecond() const { return 1; }
+  virtual void SetBytesPerSecond(int64_t bytes_per_second) { }
+
+  int64_t Bytes() {
+    MutexLock l(&mu_);
+    return bytes_;
+  }
+};
+
+// Return the total size of the table files in "dbname".
+static int64_t TableBytes(Env* env, const std::string& dbname) {
+  std::vector<std::string> files;
+  env->GetChildren(dbname, &files);
+  int64_t result = 0;
+  uint64_t number;
+  FileType type;
+  for (size_t i = 0; i < files.size(); i++) {
+    uint64_t size;
+    if (ParseFileName(files[i], &number, &type) && type == kTableFile &&
+        env->GetFileSize(dbname + "/" + files[i], &size).ok()) {
+      result += size;
+    }
+  }
+  return result;
+}
+}  // namespace
+
+TEST(DBTest, RateLimiter) {
+  CountingRateLimiter limiter;
+  Options options = CurrentOptions();
+  options.rate_limiter = &limiter;
+  Reopen(&options);
+
+  // Log writes are not limited.
+  Random rnd(301);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), RandomString(&rnd, 1000)));
+  }
+  ASSERT_EQ(0, limiter.Bytes());
+
+  // Flushes and compactions are.
+  dbfull()->TEST_CompactMemTable();
+  const int64_t flushed = TableBytes(env_, dbname_);
+  ASSERT_GT(flushed, 100000);
+  ASSERT_EQ(flushed, limiter.Bytes());
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), RandomString(&rnd, 1000)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  const int64_t flushed_twice = TableBytes(env_, dbname_);
+  ASSERT_GT(flushed_twice, flushed);
+  ASSERT_EQ(flushed_twice, limiter.Bytes());
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ(1, TotalTableFiles());
+  ASSERT_EQ(flushed_twice + TableBytes(env_, dbname_), limiter.Bytes());
+  ASSERT_EQ(0, limiter.max_debt_);
+
+  Close();
+}
+
+TEST(DBTest, Statistics) {
+  Statistics* stats = NewStatistics();
+  Cache* cache = NewLRUCache(1 << 20);
+  Options options = CurrentOptions();
+  options.statistics = stats;
+  const FilterPolicy* filter_policy = NewBloomFilterPolicy(10);
+  options.block_cache = cache;
+  options.filter_policy = filter_policy;
+  options.row_cache = NULL;
+  Reopen(&options);
+
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), "v"));
+  }
+  ASSERT_EQ(100, stats->GetTickerCount(kNumberKeysWritten));
+  ASSERT_EQ("v", Get(Key(1)));
+  ASSERT_EQ(1, stats->GetTickerCount(kMemTableHit));
+  ASSERT_EQ(0, stats->GetTickerCount(kFlushWriteBytes));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_GT(stats->GetTickerCount(kFlushWriteBytes), 0);
+
+  // The first read from the table misses the block cache.  Whether the
+  // second hits depends on the block being cachable, which mmap-ed
+  // uncompressed blocks are not.
+  ASSERT_EQ("v", Get(Key(1)));
+  ASSERT_EQ("v", Get(Key(1)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(1) + "x"));
+  ASSERT_EQ(3, stats->GetTickerCount(kMemTableMiss));
+  ASSERT_EQ(2, stats->GetTickerCount(kGetHitL0) +
+               stats->GetTickerCount(kGetHitL1) +
+               stats->GetTickerCount(kGetHitL2AndUp));
+  ASSERT_GT(stats->GetTickerCount(kBlockCacheMiss), 0);
+  ASSERT_EQ(2, stats->GetTickerCount(kBloomFilterTruePositive));
+  ASSERT_EQ(3, stats->GetTickerCount(kBloomFilterUseful) +
+               stats->GetTickerCount(kBloomFilterPositive));
+  ASSERT_EQ(4, stats->GetTickerCount(kNumberKeysRead));
+  ASSERT_EQ(3, stats->GetTickerCount(kBytesRead));
+
+  // Latencies are only measured at kAll
+  HistogramData data;
+  stats->GetHistogramData(kDBGetMicros, &data);
+  ASSERT_EQ(0, data.count);
+  stats->SetStatsLevel(kAll);
+  ASSERT_EQ("v", Get(Key(2)));
+  stats->GetHistogramData(kDBGetMicros, &data);
+  ASSERT_EQ(1, data.count);
+
+  std::string property;
+  ASSERT_TRUE(db_->GetProperty("leveldb.statistics", &property));
+  ASSERT_NE(std::string::npos,
+            property.find("leveldb.number.keys.written COUNT : 100\n"));
+  ASSERT_NE(std::string::npos, property.find("leveldb.db.get.micros P50"));
+
+  stats->Reset();
+  ASSERT_EQ(0, stats->GetTickerCount(kNumberKeysWritten));
+
+  Close();
+  delete filter_policy;
+  delete cache;
+  delete stats;
+}
+
 TEST(DBTest, MinorCompactionsHappen) {
   Options options = CurrentOptions();
   options.write_buffer_size = 10000;
@@ -1039,6 +1516,52 @@ TEST(DBTest, CompactionsGenerateMultipleFiles) {
   }
 }
 
+TEST(DBTest, SubcompactionsCoverWholeKeyRange) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000000;        // Large write buffer
+  options.max_subcompactions = 4;
+  Reopen(&options);
+
+  Random rnd(301);
+
+  // Build several level-1 files
+  std::vector<std::string> values;
+  for (int i = 0; i < 80; i++) {
+    values.push_back(RandomString(&rnd, 100000));
+    ASSERT_OK(Put(Key(i), values[i]));
+  }
+  Reopen(&options);
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_GT(NumTableFilesAtLevel(1), 1);
+
+  // Overwrite and delete keys spread over all of them, then merge the
+  // new level-0 file into level-1 again; the compaction has enough
+  // inputs to be split.
+  for (int i = 0; i < 80; i += 3) {
+    values[i] = RandomString(&rnd, 1000);
+    ASSERT_OK(Put(Key(i), values[i]));
+  }
+  for (int i = 1; i < 80; i += 5) {
+    ASSERT_OK(Delete(Key(i)));
+    values[i] = "NOT_FOUND";
+  }
+  Reopen(&options);
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+  ASSERT_GT(NumTableFilesAtLevel(1), 1);
+  for (int i = 0; i < 80; i++) {
+    ASSERT_EQ(Get(Key(i)), values[i]);
+  }
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  delete iter;
+  ASSERT_EQ(count, 80 - 16);
+}
+
 TEST(DBTest, RepeatedWritesToSameKey) {
   Options options = CurrentOptions();
   options.env = env_;
@@ -1265,6 +1788,9 @@ TEST(DBTest, HiddenValuesAreRemoved) {
   do {
     Random rnd(301);
     FillLevels("a", "z");
+    // FillLevels leaves enough level-0 files to trigger a compaction.
+    // Let it finish so it cannot run while the snapshot below is held.
+    ASSERT_OK(dbfull()->TEST_WaitForCompactions());
 
     std::string big = RandomString(&rnd, 50000);
     Put("foo", big);
@@ -1972,8 +2498,16 @@ class ModelDB: public DB {
   }
   virtual Status Get(const ReadOptions& options,
                      const Slice& key, std::string* value) {
-    assert(false);      // Not implemented
-    return Status::NotFound(key);
+    const KVMap* map = &map_;
+    if (options.snapshot != NULL) {
+      map = &(reinterpret_cast<const ModelSnapshot*>(options.snapshot)->map_);
+    }
+    KVMap::const_iterator it = map->find(key.ToString());
+    if (it == map->end()) {
+      return Status::NotFound(key);
+    }
+    *value = it->second;
+    return Status::OK();
   }
   virtual Iterator* NewIterator(const ReadOptions& options) {
     if (options.snapshot == NULL) {
@@ -2105,6 +2639,41 @@ static bool CompareIterators(int step,
   return ok;
 }
 
+// Look up a batch of random keys with MultiGet() in both databases.  The
+// model answers through the default implementation, which calls Get().
+static bool CompareMultiGet(int step,
+                            Random* rnd,
+                            DB* model,
+                            DB* db,
+                            const Snapshot* model_snap,
+                            const Snapshot* db_snap) {
+  std::vector<std::string> key_strings;
+  for (int i = 0; i < 100; i++) {
+    key_strings.push_back(RandomKey(rnd));
+  }
+  std::vector<Slice> keys(key_strings.begin(), key_strings.end());
+  std::vector<std::string> mvalues, dbvalues;
+  std::vector<Status> mstatuses, dbstatuses;
+  ReadOptions options;
+  options.snapshot = model_snap;
+  model->MultiGet(options, keys, &mvalues, &mstatuses);
+  options.snapshot = db_snap;
+  db->MultiGet(options, keys, &dbvalues, &dbstatuses);
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (mstatuses[i].ok() != dbstatuses[i].ok() ||
+        mstatuses[i].IsNotFound() != dbstatuses[i].IsNotFound() ||
+        (mstatuses[i].ok() && mvalues[i] != dbvalues[i])) {
+      fprintf(stderr, "step %d: MultiGet mismatch for key '%s': %s vs. %s\n",
+              step,
+              EscapeString(keys[i]).c_str(),
+              mstatuses[i].ToString().c_str(),
+              dbstatuses[i].ToString().c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
 TEST(DBTest, Randomized) {
   Random rnd(test::RandomSeed());
   do {
@@ -2158,6 +2727,9 @@ TEST(DBTest, Randomized) {
       if ((step % 100) == 0) {
         ASSERT_TRUE(CompareIterators(step, &model, db_, NULL, NULL));
         ASSERT_TRUE(CompareIterators(step, &model, db_, model_snap, db_snap));
+        ASSERT_TRUE(CompareMultiGet(step, &rnd, &model, db_, NULL, NULL));
+        ASSERT_TRUE(CompareMultiGet(step, &rnd, &model, db_,
+                                    model_snap, db_snap));
         // Save a snapshot from each DB this time that we'll use next
         // time we compare things, to make sure the current state is
         // preserved with the snapshot
@@ -102,6 +102,10 @@ void InternalKeyComparator::FindShortSuccessor(std::string* key) const {
   }
 }
 
+Slice InternalKeyComparator::PointLookupKey(const Slice& key) const {
+  return user_comparator_->PointLookupKey(ExtractUserKey(key));
+}
+
 const char* InternalFilterPolicy::Name() const {
   return user_policy_->Name();
 }
@@ -144,6 +144,7 @@ class InternalKeyComparator : public Comparator {
       std::string* start,
       const Slice& limit) const;
   virtual void FindShortSuccessor(std::string* key) const;
+  virtual Slice PointLookupKey(const Slice& key) const;
 
   const Comparator* user_comparator() const { return user_comparator_; }
 
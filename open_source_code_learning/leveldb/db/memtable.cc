@@ -7,7 +7,9 @@
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "port/port.h"
 #include "util/coding.h"
+#include "util/perf_context_imp.h"
 
 namespace leveldb {
 
@@ -18,17 +20,34 @@ static Slice GetLengthPrefixedSlice(const char* data) {
   return Slice(p, len);
 }
 
-MemTable::MemTable(const InternalKeyComparator& cmp)
+static port::OnceType once = LEVELDB_ONCE_INIT;
+static MemTableRepFactory* default_factory;
+
+static void InitDefaultFactory() {
+  default_factory = NewSkipListRepFactory();
+}
+
+MemTable::MemTable(const InternalKeyComparator& cmp,
+                   MemTableRepFactory* factory,
+                   Env* env)
     : comparator_(cmp), //InternalKeyComparator来初始化comparator_
-      refs_(0), //引用次数初始化为0
-      table_(comparator_, &arena_) { //skiplist表初始化
+      env_(env != NULL ? env : Env::Default()),
+      refs_(0) { //引用次数初始化为0
+  if (factory == NULL) {
+    port::InitOnce(&once, InitDefaultFactory);
+    factory = default_factory;
+  }
+  rep_ = factory->CreateMemTableRep(comparator_, &arena_);
 }
 
 MemTable::~MemTable() {
   assert(refs_ == 0);
+  delete rep_;
 }
 
-size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
+size_t MemTable::ApproximateMemoryUsage() {
+  return arena_.MemoryUsage() + rep_->ApproximateMemoryUsage();
+}
 
 int MemTable::KeyComparator::operator()(const char* aptr, const char* bptr)
     const {
@@ -50,24 +69,32 @@ static const char* EncodeKey(std::string* scratch, const Slice& target) {
 
 class MemTableIterator: public Iterator {
  public:
-  explicit MemTableIterator(MemTable::Table* table) : iter_(table) { }
-
-  virtual bool Valid() const { return iter_.Valid(); }
-  virtual void Seek(const Slice& k) { iter_.Seek(EncodeKey(&tmp_, k)); }
-  virtual void SeekToFirst() { iter_.SeekToFirst(); }
-  virtual void SeekToLast() { iter_.SeekToLast(); }
-  virtual void Next() { iter_.Next(); }
-  virtual void Prev() { iter_.Prev(); }
-  virtual Slice key() const { return GetLengthPrefixedSlice(iter_.key()); }
+  MemTableIterator(MemTableRep::Iterator* iter, Env* env)
+      : iter_(iter), env_(env) { }
+
+  virtual ~MemTableIterator() { delete iter_; }
+
+  virtual bool Valid() const { return iter_->Valid(); }
+  virtual void Seek(const Slice& k) {
+    PerfCount(&PerfContext::seek_on_memtable_count);
+    PerfTimer timer(env_, &PerfContext::seek_on_memtable_nanos);
+    iter_->Seek(EncodeKey(&tmp_, k));
+  }
+  virtual void SeekToFirst() { iter_->SeekToFirst(); }
+  virtual void SeekToLast() { iter_->SeekToLast(); }
+  virtual void Next() { iter_->Next(); }
+  virtual void Prev() { iter_->Prev(); }
+  virtual Slice key() const { return GetLengthPrefixedSlice(iter_->key()); }
   virtual Slice value() const {
-    Slice key_slice = GetLengthPrefixedSlice(iter_.key());
+    Slice key_slice = GetLengthPrefixedSlice(iter_->key());
     return GetLengthPrefixedSlice(key_slice.data() + key_slice.size());
   }
 
   virtual Status status() const { return Status::OK(); }
 
  private:
-  MemTable::Table::Iterator iter_;
+  MemTableRep::Iterator* iter_;
+  Env* const env_;
   std::string tmp_;       // For passing to EncodeKey
 
   // No copying allowed
@@ -76,12 +103,12 @@ class MemTableIterator: public Iterator {
 };
 
 Iterator* MemTable::NewIterator() {
-  return new MemTableIterator(&table_);
+  return new MemTableIterator(rep_->NewIterator(), env_);
 }
 
-void MemTable::Add(SequenceNumber s, ValueType type,
-                   const Slice& key,
-                   const Slice& value) {
+const char* MemTable::EncodeEntry(SequenceNumber s, ValueType type,
+                                  const Slice& key, const Slice& value,
+                                  bool concurrently) {
   // Format of an entry is concatenation of:
   //  key_size     : varint32 of internal_key.size()
   //  key bytes    : char[internal_key.size()]
@@ -93,7 +120,8 @@ void MemTable::Add(SequenceNumber s, ValueType type,
   const size_t encoded_len =
       VarintLength(internal_key_size) + internal_key_size +
       VarintLength(val_size) + val_size;  //skiplist节点键的长度
-  char* buf = arena_.Allocate(encoded_len);  //分配键值内存
+  char* buf = concurrently ? arena_.AllocateConcurrently(encoded_len)
+                           : arena_.Allocate(encoded_len);  //分配键值内存
   char* p = EncodeVarint32(buf, internal_key_size);  //键长度存于buf中
   memcpy(p, key.data(), key_size);  //键的内容存入buf中
   p += key_size;  //指针向后移动key_size个字节
@@ -102,14 +130,25 @@ void MemTable::Add(SequenceNumber s, ValueType type,
   p = EncodeVarint32(p, val_size);  //值的长度
   memcpy(p, value.data(), val_size);  //值得内容
   assert((p + val_size) - buf == encoded_len);
-  table_.Insert(buf);  //插入到skiplist中
+  return buf;
+}
+
+void MemTable::Add(SequenceNumber s, ValueType type,
+                   const Slice& key,
+                   const Slice& value) {
+  rep_->Insert(EncodeEntry(s, type, key, value, false));  //插入到skiplist中
+}
+
+void MemTable::AddConcurrently(SequenceNumber s, ValueType type,
+                               const Slice& key,
+                               const Slice& value) {
+  rep_->InsertConcurrently(EncodeEntry(s, type, key, value, true));
 }
 
 bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
   Slice memkey = key.memtable_key();  //获取memtable_key
-  Table::Iterator iter(&table_);  //获取skiplist的迭代器
-  iter.Seek(memkey.data());  //迭代器查找
-  if (iter.Valid()) {
+  const char* entry = rep_->FindGreaterOrEqual(memkey.data());  //查找
+  if (entry != NULL) {
     // entry format is:
     //    klength  varint32
     //    userkey  char[klength]
@@ -119,7 +158,6 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
     // Check that it belongs to same user key.  We do not check the
     // sequence number since the Seek() call above should have skipped
     // all entries with overly large sequence numbers.
-    const char* entry = iter.key();
     uint32_t key_length;
     const char* key_ptr = GetVarint32Ptr(entry, entry+5, &key_length);
     if (comparator_.comparator.user_comparator()->Compare(
@@ -8,20 +8,25 @@
 #include <string>
 #include "leveldb/db.h"
 #include "db/dbformat.h"
-#include "db/skiplist.h"
+#include "leveldb/memtablerep.h"
 #include "util/arena.h"
 
 namespace leveldb {
 
+class Env;
 class InternalKeyComparator;
 class Mutex;
-class MemTableIterator;
 
 class MemTable {
  public:
   // MemTables are reference counted.  The initial reference count
-  // is zero and the caller must call Ref() at least once.
-  explicit MemTable(const InternalKeyComparator& comparator);
+  // is zero and the caller must call Ref() at least once.  Entries are
+  // kept in a rep made by "factory", or in a skiplist if it is NULL.
+  // Iterators time their seeks for the PerfContext with the clock of
+  // "env", or of Env::Default() if it is NULL.
+  explicit MemTable(const InternalKeyComparator& comparator,
+                    MemTableRepFactory* factory = NULL,
+                    Env* env = NULL);
 
   // Increase reference count.
   void Ref() { ++refs_; }
@@ -54,6 +59,22 @@ class MemTable {
            const Slice& key,
            const Slice& value);
 
+  // Like Add(), but may be called by several threads at once.  Must not
+  // run concurrently with Add().
+  // REQUIRES: SupportsConcurrentAdds()
+  void AddConcurrently(SequenceNumber seq, ValueType type,
+                       const Slice& key,
+                       const Slice& value);
+
+  // Returns true iff AddConcurrently() may be used.
+  bool SupportsConcurrentAdds() const {
+    return rep_->SupportsConcurrentInserts();
+  }
+
+  // Called once nothing more will be added, when the memtable starts to
+  // wait to be written to level-0.
+  void MarkReadOnly() { rep_->MarkReadOnly(); }
+
   // If memtable contains a value for key, store it in *value and return true.
   // If memtable contains a deletion for key, store a NotFound() error
   // in *status and return true.
@@ -63,20 +84,23 @@ class MemTable {
  private:
   ~MemTable();  // Private since only Unref() should be used to delete it
 
-  struct KeyComparator {
+  struct KeyComparator : public MemTableRep::KeyComparator {
     const InternalKeyComparator comparator;
     explicit KeyComparator(const InternalKeyComparator& c) : comparator(c) { }
-    int operator()(const char* a, const char* b) const;
+    virtual int operator()(const char* a, const char* b) const;
   };
-  friend class MemTableIterator;
-  friend class MemTableBackwardIterator;
 
-  typedef SkipList<const char*, KeyComparator> Table;
+  // Encode an entry into memory from arena_, allocating with the
+  // thread-safe arena calls iff "concurrently" is true.
+  const char* EncodeEntry(SequenceNumber seq, ValueType type,
+                          const Slice& key, const Slice& value,
+                          bool concurrently);
 
   KeyComparator comparator_;
+  Env* const env_;
   int refs_;
   Arena arena_;
-  Table table_;
+  MemTableRep* rep_;
 
   // No copying allowed
   MemTable(const MemTable&);
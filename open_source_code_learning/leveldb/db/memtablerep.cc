@@ -0,0 +1,492 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/memtablerep.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <new>
+#include <vector>
+#include "db/skiplist.h"
+#include "leveldb/slice.h"
+#include "port/port.h"
+#include "util/coding.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+MemTableRep::KeyComparator::~KeyComparator() { }
+
+MemTableRep::Iterator::~Iterator() { }
+
+MemTableRep::~MemTableRep() { }
+
+void MemTableRep::InsertConcurrently(const char* entry) {
+  // Callers check SupportsConcurrentInserts() first
+  assert(false);
+  Insert(entry);
+}
+
+MemTableRepFactory::~MemTableRepFactory() { }
+
+MemTableAllocator::~MemTableAllocator() { }
+
+namespace {
+
+typedef SkipList<const char*, const MemTableRep::KeyComparator&> EntryList;
+
+// Adapts a KeyComparator for the algorithms of <algorithm>
+struct EntryLess {
+  const MemTableRep::KeyComparator& cmp;
+  explicit EntryLess(const MemTableRep::KeyComparator& c) : cmp(c) { }
+  bool operator()(const char* a, const char* b) const {
+    return cmp(a, b) < 0;
+  }
+};
+
+class SkipListIterator : public MemTableRep::Iterator {
+ public:
+  explicit SkipListIterator(const EntryList* list) : iter_(list) { }
+
+  virtual bool Valid() const { return iter_.Valid(); }
+  virtual const char* key() const { return iter_.key(); }
+  virtual void Next() { iter_.Next(); }
+  virtual void Prev() { iter_.Prev(); }
+  virtual void Seek(const char* target) { iter_.Seek(target); }
+  virtual void SeekToFirst() { iter_.SeekToFirst(); }
+  virtual void SeekToLast() { iter_.SeekToLast(); }
+
+ private:
+  EntryList::Iterator iter_;
+};
+
+// Iterates over a sorted vector of entries, which it deletes when done
+// if "owned" is true.
+class VectorIterator : public MemTableRep::Iterator {
+ public:
+  VectorIterator(const MemTableRep::KeyComparator& cmp,
+                 const std::vector<const char*>* entries, bool owned)
+      : cmp_(cmp),
+        entries_(entries),
+        owned_(owned),
+        pos_(entries->size()) {
+  }
+
+  virtual ~VectorIterator() {
+    if (owned_) {
+      delete entries_;
+    }
+  }
+
+  virtual bool Valid() const { return pos_ < entries_->size(); }
+  virtual const char* key() const {
+    assert(Valid());
+    return (*entries_)[pos_];
+  }
+  virtual void Next() {
+    assert(Valid());
+    pos_++;
+  }
+  virtual void Prev() {
+    assert(Valid());
+    if (pos_ == 0) {
+      pos_ = entries_->size();  // Marks as invalid
+    } else {
+      pos_--;
+    }
+  }
+  virtual void Seek(const char* target) {
+    pos_ = std::lower_bound(entries_->begin(), entries_->end(), target,
+                            EntryLess(cmp_)) - entries_->begin();
+  }
+  virtual void SeekToFirst() { pos_ = 0; }
+  virtual void SeekToLast() {
+    pos_ = entries_->empty() ? 0 : entries_->size() - 1;
+  }
+
+ private:
+  const MemTableRep::KeyComparator& cmp_;
+  const std::vector<const char*>* const entries_;
+  const bool owned_;
+  size_t pos_;
+};
+
+class SkipListRep : public MemTableRep {
+ public:
+  SkipListRep(const KeyComparator& cmp, MemTableAllocator* allocator)
+      : list_(cmp, allocator) { }
+
+  virtual void Insert(const char* entry) { list_.Insert(entry); }
+
+  virtual bool SupportsConcurrentInserts() const { return true; }
+
+  virtual void InsertConcurrently(const char* entry) {
+    list_.InsertConcurrently(entry);
+  }
+
+  virtual const char* FindGreaterOrEqual(const char* key) {
+    EntryList::Iterator iter(&list_);
+    iter.Seek(key);
+    return iter.Valid() ? iter.key() : NULL;
+  }
+
+  virtual Iterator* NewIterator() { return new SkipListIterator(&list_); }
+
+ private:
+  EntryList list_;
+};
+
+// Merges the skiplists of the buckets of a HashSkipListRep, keeping the
+// bucket iterators in a heap ordered by their current entries: the
+// smallest on top while moving forward, the largest while moving back.
+// Only the buckets that were non-empty when it was created are visited.
+class BucketMergingIterator : public MemTableRep::Iterator {
+ public:
+  BucketMergingIterator(const MemTableRep::KeyComparator& cmp,
+                        const std::vector<const EntryList*>& buckets)
+      : cmp_(cmp), direction_(kForward) {
+    for (size_t i = 0; i < buckets.size(); i++) {
+      children_.push_back(new EntryList::Iterator(buckets[i]));
+    }
+  }
+
+  virtual ~BucketMergingIterator() {
+    for (size_t i = 0; i < children_.size(); i++) {
+      delete children_[i];
+    }
+  }
+
+  virtual bool Valid() const { return !heap_.empty(); }
+
+  virtual const char* key() const {
+    assert(Valid());
+    return heap_.front()->key();
+  }
+
+  virtual void Next() {
+    assert(Valid());
+    if (direction_ != kForward) {
+      // Every other child is before key(); move them all after it.  The
+      // entries are distinct, so only the current child lands on key().
+      const char* target = key();
+      for (size_t i = 0; i < children_.size(); i++) {
+        EntryList::Iterator* child = children_[i];
+        child->Seek(target);
+        if (child->Valid() && cmp_(child->key(), target) == 0) {
+          child->Next();
+        }
+      }
+      BuildHeap(kForward);
+      return;
+    }
+    EntryList::Iterator* child = heap_.front();
+    std::pop_heap(heap_.begin(), heap_.end(), After(cmp_));
+    child->Next();
+    if (child->Valid()) {
+      std::push_heap(heap_.begin(), heap_.end(), After(cmp_));
+    } else {
+      heap_.pop_back();
+    }
+  }
+
+  virtual void Prev() {
+    assert(Valid());
+    if (direction_ != kReverse) {
+      // Move every child to its last entry before key().
+      const char* target = key();
+      for (size_t i = 0; i < children_.size(); i++) {
+        EntryList::Iterator* child = children_[i];
+        child->Seek(target);
+        if (child->Valid()) {
+          child->Prev();
+        } else {
+          child->SeekToLast();
+        }
+      }
+      BuildHeap(kReverse);
+      return;
+    }
+    EntryList::Iterator* child = heap_.front();
+    std::pop_heap(heap_.begin(), heap_.end(), Before(cmp_));
+    child->Prev();
+    if (child->Valid()) {
+      std::push_heap(heap_.begin(), heap_.end(), Before(cmp_));
+    } else {
+      heap_.pop_back();
+    }
+  }
+
+  virtual void Seek(const char* target) {
+    for (size_t i = 0; i < children_.size(); i++) {
+      children_[i]->Seek(target);
+    }
+    BuildHeap(kForward);
+  }
+
+  virtual void SeekToFirst() {
+    for (size_t i = 0; i < children_.size(); i++) {
+      children_[i]->SeekToFirst();
+    }
+    BuildHeap(kForward);
+  }
+
+  virtual void SeekToLast() {
+    for (size_t i = 0; i < children_.size(); i++) {
+      children_[i]->SeekToLast();
+    }
+    BuildHeap(kReverse);
+  }
+
+ private:
+  enum Direction {
+    kForward,
+    kReverse
+  };
+
+  // Heap orders for std::make_heap(), which keeps the greatest element
+  // on top.
+  struct After {
+    const MemTableRep::KeyComparator& cmp;
+    explicit After(const MemTableRep::KeyComparator& c) : cmp(c) { }
+    bool operator()(const EntryList::Iterator* a,
+                    const EntryList::Iterator* b) const {
+      return cmp(a->key(), b->key()) > 0;
+    }
+  };
+  struct Before {
+    const MemTableRep::KeyComparator& cmp;
+    explicit Before(const MemTableRep::KeyComparator& c) : cmp(c) { }
+    bool operator()(const EntryList::Iterator* a,
+                    const EntryList::Iterator* b) const {
+      return cmp(a->key(), b->key()) < 0;
+    }
+  };
+
+  void BuildHeap(Direction direction) {
+    direction_ = direction;
+    heap_.clear();
+    for (size_t i = 0; i < children_.size(); i++) {
+      if (children_[i]->Valid()) {
+        heap_.push_back(children_[i]);
+      }
+    }
+    if (direction == kForward) {
+      std::make_heap(heap_.begin(), heap_.end(), After(cmp_));
+    } else {
+      std::make_heap(heap_.begin(), heap_.end(), Before(cmp_));
+    }
+  }
+
+  const MemTableRep::KeyComparator& cmp_;
+  std::vector<EntryList::Iterator*> children_;
+  std::vector<EntryList::Iterator*> heap_;  // The valid children
+  Direction direction_;
+
+  // No copying allowed
+  BucketMergingIterator(const BucketMergingIterator&);
+  void operator=(const BucketMergingIterator&);
+};
+
+// Returns the user key of an entry or of an encoded internal key.
+static Slice EntryUserKey(const char* entry) {
+  uint32_t len;
+  const char* p = GetVarint32Ptr(entry, entry + 5, &len);
+  assert(len >= 8);
+  return Slice(p, len - 8);
+}
+
+class HashSkipListRep : public MemTableRep {
+ public:
+  HashSkipListRep(const KeyComparator& cmp, MemTableAllocator* allocator,
+                  size_t prefix_length, size_t bucket_count)
+      : cmp_(cmp),
+        allocator_(allocator),
+        prefix_length_(prefix_length),
+        bucket_count_(bucket_count),
+        buckets_(new port::AtomicPointer[bucket_count]) {
+    for (size_t i = 0; i < bucket_count_; i++) {
+      buckets_[i].NoBarrier_Store(NULL);
+    }
+  }
+
+  // The buckets live in allocator_, and need no destructor to run.
+  virtual ~HashSkipListRep() {
+    delete[] buckets_;
+  }
+
+  virtual void Insert(const char* entry) {
+    port::AtomicPointer* slot = Slot(entry);
+    EntryList* bucket = reinterpret_cast<EntryList*>(slot->NoBarrier_Load());
+    if (bucket == NULL) {
+      char* mem = allocator_->AllocateAligned(sizeof(EntryList));
+      bucket = new (mem) EntryList(cmp_, allocator_);
+      // Readers that see the bucket must see it initialized
+      slot->Release_Store(bucket);
+    }
+    bucket->Insert(entry);
+  }
+
+  virtual const char* FindGreaterOrEqual(const char* key) {
+    EntryList* bucket =
+        reinterpret_cast<EntryList*>(Slot(key)->Acquire_Load());
+    if (bucket == NULL) {
+      return NULL;
+    }
+    EntryList::Iterator iter(bucket);
+    iter.Seek(key);
+    return iter.Valid() ? iter.key() : NULL;
+  }
+
+  // The bucket array is not counted: it does not grow with the entries,
+  // and counting it would make memtables with many buckets flush early.
+  virtual size_t ApproximateMemoryUsage() { return 0; }
+
+  virtual Iterator* NewIterator() {
+    std::vector<const EntryList*> buckets;
+    for (size_t i = 0; i < bucket_count_; i++) {
+      EntryList* bucket =
+          reinterpret_cast<EntryList*>(buckets_[i].Acquire_Load());
+      if (bucket != NULL) {
+        buckets.push_back(bucket);
+      }
+    }
+    return new BucketMergingIterator(cmp_, buckets);
+  }
+
+ private:
+  port::AtomicPointer* Slot(const char* entry) const {
+    Slice user_key = EntryUserKey(entry);
+    const size_t n = std::min(user_key.size(), prefix_length_);
+    return &buckets_[Hash(user_key.data(), n, 0) % bucket_count_];
+  }
+
+  const KeyComparator& cmp_;
+  MemTableAllocator* const allocator_;
+  const size_t prefix_length_;
+  const size_t bucket_count_;
+  port::AtomicPointer* const buckets_;
+};
+
+class VectorRep : public MemTableRep {
+ public:
+  explicit VectorRep(const KeyComparator& cmp)
+      : cmp_(cmp), sorted_(0), read_only_(false) {
+  }
+
+  virtual void Insert(const char* entry) {
+    MutexLock l(&mutex_);
+    assert(!read_only_);
+    entries_.push_back(entry);
+  }
+
+  virtual const char* FindGreaterOrEqual(const char* key) {
+    MutexLock l(&mutex_);
+    Sort();
+    std::vector<const char*>::const_iterator iter =
+        std::lower_bound(entries_.begin(), entries_.end(), key,
+                         EntryLess(cmp_));
+    return (iter == entries_.end()) ? NULL : *iter;
+  }
+
+  virtual void MarkReadOnly() {
+    MutexLock l(&mutex_);
+    Sort();
+    read_only_ = true;
+  }
+
+  virtual size_t ApproximateMemoryUsage() {
+    MutexLock l(&mutex_);
+    return entries_.capacity() * sizeof(const char*);
+  }
+
+  virtual Iterator* NewIterator() {
+    MutexLock l(&mutex_);
+    Sort();
+    if (read_only_) {
+      return new VectorIterator(cmp_, &entries_, false);
+    } else {
+      // Later inserts may reallocate entries_, so iterate over a copy
+      return new VectorIterator(
+          cmp_, new std::vector<const char*>(entries_), true);
+    }
+  }
+
+ private:
+  // Merge the entries appended since the last call into the sorted ones.
+  // REQUIRES: mutex_ held
+  void Sort() {
+    if (sorted_ < entries_.size()) {
+      std::vector<const char*>::iterator mid = entries_.begin() + sorted_;
+      std::sort(mid, entries_.end(), EntryLess(cmp_));
+      std::inplace_merge(entries_.begin(), mid, entries_.end(),
+                         EntryLess(cmp_));
+      sorted_ = entries_.size();
+    }
+  }
+
+  const KeyComparator& cmp_;
+  port::Mutex mutex_;
+  std::vector<const char*> entries_;
+  size_t sorted_;    // entries_[0,sorted_-1] are in order
+  bool read_only_;
+};
+
+class SkipListRepFactory : public MemTableRepFactory {
+ public:
+  virtual const char* Name() const { return "leveldb.SkipListRep"; }
+
+  virtual MemTableRep* CreateMemTableRep(
+      const MemTableRep::KeyComparator& cmp, MemTableAllocator* allocator) {
+    return new SkipListRep(cmp, allocator);
+  }
+};
+
+class HashSkipListRepFactory : public MemTableRepFactory {
+ public:
+  HashSkipListRepFactory(size_t prefix_length, size_t bucket_count)
+      : prefix_length_(prefix_length),
+        bucket_count_(bucket_count) {
+    assert(bucket_count > 0);
+  }
+
+  virtual const char* Name() const { return "leveldb.HashSkipListRep"; }
+
+  virtual MemTableRep* CreateMemTableRep(
+      const MemTableRep::KeyComparator& cmp, MemTableAllocator* allocator) {
+    return new HashSkipListRep(cmp, allocator, prefix_length_,
+                               bucket_count_);
+  }
+
+ private:
+  const size_t prefix_length_;
+  const size_t bucket_count_;
+};
+
+class VectorRepFactory : public MemTableRepFactory {
+ public:
+  virtual const char* Name() const { return "leveldb.VectorRep"; }
+
+  virtual MemTableRep* CreateMemTableRep(
+      const MemTableRep::KeyComparator& cmp, MemTableAllocator* allocator) {
+    return new VectorRep(cmp);
+  }
+};
+
+}  // namespace
+
+MemTableRepFactory* NewSkipListRepFactory() {
+  return new SkipListRepFactory;
+}
+
+MemTableRepFactory* NewHashSkipListRepFactory(size_t prefix_length,
+                                              size_t bucket_count) {
+  return new HashSkipListRepFactory(prefix_length, bucket_count);
+}
+
+MemTableRepFactory* NewVectorRepFactory() {
+  return new VectorRepFactory;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,357 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/memtablerep.h"
+
+#include <map>
+#include <vector>
+#include "db/dbformat.h"
+#include "db/memtable.h"
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "util/logging.h"
+#include "util/random.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+// Keys share their first bytes in groups, so that a hash rep keyed on a
+// short prefix puts many of them in one bucket.
+static std::string Key(int i) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "%c%c%05d", 'a' + i % 3, 'a' + i % 7, i);
+  return buf;
+}
+
+// A rep that uses only the public interface, as a user's rep would: a
+// sorted linked list whose nodes come from the memtable's allocator.
+class ListRep : public MemTableRep {
+ public:
+  ListRep(const KeyComparator& cmp, MemTableAllocator* allocator)
+      : cmp_(cmp), allocator_(allocator), head_(NULL) { }
+
+  virtual void Insert(const char* entry) {
+    Node* node =
+        reinterpret_cast<Node*>(allocator_->AllocateAligned(sizeof(Node)));
+    node->entry = entry;
+    Node** prev = &head_;
+    while (*prev != NULL && cmp_((*prev)->entry, entry) < 0) {
+      prev = &(*prev)->next;
+    }
+    node->next = *prev;
+    *prev = node;
+  }
+
+  virtual const char* FindGreaterOrEqual(const char* key) {
+    Node* node = LowerBound(key);
+    return node != NULL ? node->entry : NULL;
+  }
+
+  virtual Iterator* NewIterator() { return new ListIterator(this); }
+
+ private:
+  struct Node {
+    const char* entry;
+    Node* next;
+  };
+
+  class ListIterator : public Iterator {
+   public:
+    explicit ListIterator(ListRep* rep) : rep_(rep), node_(NULL) { }
+
+    virtual bool Valid() const { return node_ != NULL; }
+    virtual const char* key() const { return node_->entry; }
+    virtual void Next() { node_ = node_->next; }
+    virtual void Prev() {
+      Node* prev = NULL;
+      for (Node* n = rep_->head_; n != node_; n = n->next) {
+        prev = n;
+      }
+      node_ = prev;
+    }
+    virtual void Seek(const char* target) { node_ = rep_->LowerBound(target); }
+    virtual void SeekToFirst() { node_ = rep_->head_; }
+    virtual void SeekToLast() {
+      node_ = rep_->head_;
+      while (node_ != NULL && node_->next != NULL) {
+        node_ = node_->next;
+      }
+    }
+
+   private:
+    ListRep* const rep_;
+    Node* node_;
+  };
+
+  Node* LowerBound(const char* key) const {
+    Node* node = head_;
+    while (node != NULL && cmp_(node->entry, key) < 0) {
+      node = node->next;
+    }
+    return node;
+  }
+
+  const KeyComparator& cmp_;
+  MemTableAllocator* const allocator_;
+  Node* head_;
+};
+
+class ListRepFactory : public MemTableRepFactory {
+ public:
+  virtual const char* Name() const { return "ListRep"; }
+
+  virtual MemTableRep* CreateMemTableRep(
+      const MemTableRep::KeyComparator& cmp, MemTableAllocator* allocator) {
+    return new ListRep(cmp, allocator);
+  }
+};
+
+class MemTableRepTest {
+ public:
+  std::vector<MemTableRepFactory*> factories_;
+  InternalKeyComparator icmp_;
+
+  MemTableRepTest() : icmp_(BytewiseComparator()) {
+    factories_.push_back(NewSkipListRepFactory());
+    factories_.push_back(NewHashSkipListRepFactory(2, 4));
+    factories_.push_back(NewHashSkipListRepFactory(0, 1));
+    factories_.push_back(NewHashSkipListRepFactory(100, 1000));
+    factories_.push_back(NewVectorRepFactory());
+    factories_.push_back(new ListRepFactory);
+  }
+
+  ~MemTableRepTest() {
+    for (size_t i = 0; i < factories_.size(); i++) {
+      delete factories_[i];
+    }
+  }
+
+  std::string Get(MemTable* mem, const std::string& key,
+                  SequenceNumber seq) {
+    LookupKey lkey(key, seq);
+    std::string value;
+    Status s;
+    if (!mem->Get(lkey, &value, &s)) {
+      return "MISSING";
+    } else if (s.IsNotFound()) {
+      return "DELETED";
+    }
+    return value;
+  }
+
+  // Return the entries of "mem" as "key@seq=value" strings, checking that
+  // backward iteration yields the same ones in reverse.
+  std::string Contents(MemTable* mem) {
+    std::vector<std::string> forward;
+    Iterator* iter = mem->NewIterator();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      forward.push_back(Entry(iter));
+    }
+    size_t matched = 0;
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      ASSERT_LT(matched, forward.size());
+      ASSERT_EQ(Entry(iter), forward[forward.size() - matched - 1]);
+      matched++;
+    }
+    ASSERT_EQ(matched, forward.size());
+    delete iter;
+
+    std::string result;
+    for (size_t i = 0; i < forward.size(); i++) {
+      result += forward[i];
+      result += ",";
+    }
+    return result;
+  }
+
+  static std::string Entry(Iterator* iter) {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(iter->key(), &ikey)) {
+      return "CORRUPTED";
+    }
+    char buf[50];
+    snprintf(buf, sizeof(buf), "@%llu=",
+             static_cast<unsigned long long>(ikey.sequence));
+    return ikey.user_key.ToString() + buf +
+        (ikey.type == kTypeDeletion ? "DEL" : iter->value().ToString());
+  }
+};
+
+TEST(MemTableRepTest, AddAndGet) {
+  for (size_t f = 0; f < factories_.size(); f++) {
+    MemTable* mem = new MemTable(icmp_, factories_[f]);
+    mem->Ref();
+    ASSERT_EQ("MISSING", Get(mem, Key(1), 100));
+
+    mem->Add(1, kTypeValue, Key(1), "v1");
+    mem->Add(2, kTypeValue, Key(2), "v2");
+    mem->Add(3, kTypeValue, Key(1), "v3");
+    mem->Add(4, kTypeDeletion, Key(2), "");
+    ASSERT_EQ("MISSING", Get(mem, Key(1), 0));
+    ASSERT_EQ("v1", Get(mem, Key(1), 2));
+    ASSERT_EQ("v3", Get(mem, Key(1), 100));
+    ASSERT_EQ("v2", Get(mem, Key(2), 3));
+    ASSERT_EQ("DELETED", Get(mem, Key(2), 4));
+    ASSERT_EQ("MISSING", Get(mem, Key(3), 100));
+    // Same bucket as Key(1) for short prefixes
+    ASSERT_EQ("MISSING", Get(mem, Key(1) + "x", 100));
+    ASSERT_EQ("MISSING", Get(mem, "", 100));
+
+    // Adds after reads are found too
+    mem->Add(5, kTypeValue, Key(3), "v5");
+    mem->Add(6, kTypeValue, "", "v6");
+    ASSERT_EQ("v5", Get(mem, Key(3), 100));
+    ASSERT_EQ("v6", Get(mem, "", 100));
+    ASSERT_EQ("v3", Get(mem, Key(1), 100));
+
+    ASSERT_EQ("@6=v6," + Key(3) + "@5=v5," +
+              Key(1) + "@3=v3," + Key(1) + "@1=v1," +
+              Key(2) + "@4=DEL," + Key(2) + "@2=v2,",
+              Contents(mem));
+    mem->Unref();
+  }
+}
+
+TEST(MemTableRepTest, Random) {
+  for (size_t f = 0; f < factories_.size(); f++) {
+    MemTable* mem = new MemTable(icmp_, factories_[f]);
+    mem->Ref();
+    Random rnd(301 + f);
+    std::map<std::string, std::string> model;
+    SequenceNumber seq = 0;
+    for (int i = 0; i < 2000; i++) {
+      const std::string key = Key(rnd.Uniform(500));
+      if (rnd.OneIn(10)) {
+        mem->Add(++seq, kTypeDeletion, key, "");
+        model[key] = "DELETED";
+      } else {
+        std::string value = NumberToString(seq);
+        mem->Add(++seq, kTypeValue, key, value);
+        model[key] = value;
+      }
+      if (rnd.OneIn(50)) {
+        const std::string probe = Key(rnd.Uniform(500));
+        std::string expected = model.count(probe) ? model[probe] : "MISSING";
+        ASSERT_EQ(expected, Get(mem, probe, seq));
+      }
+    }
+    mem->MarkReadOnly();
+    for (int i = 0; i < 500; i++) {
+      std::string expected = model.count(Key(i)) ? model[Key(i)] : "MISSING";
+      ASSERT_EQ(expected, Get(mem, Key(i), seq));
+    }
+
+    // Iteration visits every entry in order
+    Iterator* iter = mem->NewIterator();
+    int count = 0;
+    std::string last;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      if (count > 0) {
+        ASSERT_LT(icmp_.Compare(last, iter->key()), 0);
+      }
+      last = iter->key().ToString();
+      count++;
+    }
+    ASSERT_EQ(2000, count);
+
+    // Seek lands on the newest entry of a key
+    for (std::map<std::string, std::string>::iterator it = model.begin();
+         it != model.end(); ++it) {
+      iter->Seek(LookupKey(it->first, seq).internal_key());
+      ASSERT_TRUE(iter->Valid());
+      ParsedInternalKey ikey;
+      ASSERT_TRUE(ParseInternalKey(iter->key(), &ikey));
+      ASSERT_EQ(it->first, ikey.user_key.ToString());
+      if (it->second == "DELETED") {
+        ASSERT_EQ(kTypeDeletion, ikey.type);
+      } else {
+        ASSERT_EQ(it->second, iter->value().ToString());
+      }
+    }
+    delete iter;
+    mem->Unref();
+  }
+}
+
+TEST(MemTableRepTest, IteratorOutlivesAdds) {
+  for (size_t f = 0; f < factories_.size(); f++) {
+    MemTable* mem = new MemTable(icmp_, factories_[f]);
+    mem->Ref();
+    for (int i = 0; i < 100; i += 2) {
+      mem->Add(i + 1, kTypeValue, Key(i), "v");
+    }
+    Iterator* iter = mem->NewIterator();
+    // Enough to make a vector reallocate
+    for (int i = 1; i < 1000; i += 2) {
+      mem->Add(i + 1, kTypeValue, Key(i), "v");
+    }
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      count++;
+    }
+    ASSERT_GE(count, 50);
+    delete iter;
+    mem->Unref();
+  }
+}
+
+TEST(MemTableRepTest, MixedDirections) {
+  for (size_t f = 0; f < factories_.size(); f++) {
+    MemTable* mem = new MemTable(icmp_, factories_[f]);
+    mem->Ref();
+    Random rnd(401 + f);
+    for (int i = 0; i < 300; i++) {
+      mem->Add(i + 1, kTypeValue, Key(rnd.Uniform(200)), "v");
+    }
+    std::vector<std::string> keys;
+    Iterator* iter = mem->NewIterator();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      keys.push_back(iter->key().ToString());
+    }
+    ASSERT_EQ(300, keys.size());
+
+    // Compare a random walk with the position "pos" in "keys", where
+    // keys.size() stands for an invalid iterator.
+    size_t pos = keys.size();
+    for (int i = 0; i < 2000; i++) {
+      const int op = rnd.Uniform(pos < keys.size() ? 5 : 3);
+      if (op == 0) {
+        iter->SeekToFirst();
+        pos = 0;
+      } else if (op == 1) {
+        iter->SeekToLast();
+        pos = keys.size() - 1;
+      } else if (op == 2) {
+        const std::string target =
+            LookupKey(Key(rnd.Uniform(200)), rnd.Uniform(300)).internal_key()
+                .ToString();
+        iter->Seek(target);
+        pos = 0;
+        while (pos < keys.size() && icmp_.Compare(keys[pos], target) < 0) {
+          pos++;
+        }
+      } else if (op == 3) {
+        iter->Next();
+        pos++;
+      } else {
+        iter->Prev();
+        pos = (pos == 0) ? keys.size() : pos - 1;
+      }
+      if (pos < keys.size()) {
+        ASSERT_TRUE(iter->Valid());
+        ASSERT_EQ(keys[pos], iter->key().ToString());
+      } else {
+        ASSERT_TRUE(!iter->Valid());
+      }
+    }
+    delete iter;
+    mem->Unref();
+  }
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -7,6 +7,11 @@
 // (2) We scan every table to compute
 //     (a) smallest/largest for the table
 //     (b) largest sequence number in the table
+//     A table added by DB::IngestExternalFile() stores its keys with
+//     sequence number zero; its global sequence number lives only in the
+//     MANIFEST.  We take it from any old MANIFEST records that survive,
+//     or else give the table a new sequence number above all others, in
+//     file number order.
 // (3) We generate descriptor contents:
 //      - log number is set to zero
 //      - next-file-number is set to 1 + largest file number we found
@@ -24,6 +29,8 @@
 //   Store per-table metadata (smallest, largest, largest-seq#, ...)
 //   in the table's meta section to speed up ScanTable.
 
+#include <algorithm>
+#include <map>
 #include "db/builder.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
@@ -95,8 +102,13 @@ class Repairer {
   struct TableInfo {
     FileMetaData meta;
     SequenceNumber max_sequence;
+    bool unsequenced;  // Non-empty, all keys at sequence zero
   };
 
+  static bool ByFileNumber(const TableInfo& a, const TableInfo& b) {
+    return a.meta.number < b.meta.number;
+  }
+
   std::string const dbname_;
   Env* const env_;
   InternalKeyComparator const icmp_;
@@ -111,6 +123,7 @@ class Repairer {
   std::vector<uint64_t> table_numbers_;
   std::vector<uint64_t> logs_;
   std::vector<TableInfo> tables_;
+  std::map<uint64_t, SequenceNumber> global_seqnos_;  // Of ingested tables
   uint64_t next_file_number_;
 
   Status FindFiles() {
@@ -197,7 +210,7 @@ class Repairer {
     std::string scratch;
     Slice record;
     WriteBatch batch;
-    MemTable* mem = new MemTable(icmp_);
+    MemTable* mem = new MemTable(icmp_, options_.memtable_factory, env_);
     mem->Ref();
     int counter = 0;
     while (reader.ReadRecord(&record, &scratch)) {
@@ -242,9 +255,79 @@ class Repairer {
   }
 
   void ExtractMetaData() {
+    for (size_t i = 0; i < manifests_.size(); i++) {
+      ReadGlobalSeqnos(dbname_ + "/" + manifests_[i]);
+    }
     for (size_t i = 0; i < table_numbers_.size(); i++) {
       ScanTable(table_numbers_[i]);
     }
+    SequenceTables();
+  }
+
+  // Record in global_seqnos_ the global sequence numbers of the ingested
+  // tables named by the readable records of the MANIFEST "fname".
+  void ReadGlobalSeqnos(const std::string& fname) {
+    struct LogReporter : public log::Reader::Reporter {
+      Logger* info_log;
+      const char* fname;
+      virtual void Corruption(size_t bytes, const Status& s) {
+        Log(info_log, "%s: dropping %d bytes; %s",
+            fname, static_cast<int>(bytes), s.ToString().c_str());
+      }
+    };
+
+    SequentialFile* file;
+    Status status = env_->NewSequentialFile(fname, &file);
+    if (!status.ok()) {
+      return;
+    }
+    LogReporter reporter;
+    reporter.info_log = options_.info_log;
+    reporter.fname = fname.c_str();
+    log::Reader reader(file, &reporter, true/*checksum*/,
+                       0/*initial_offset*/);
+    Slice record;
+    std::string scratch;
+    while (reader.ReadRecord(&record, &scratch)) {
+      VersionEdit edit;
+      if (!edit.DecodeFrom(record).ok()) {
+        continue;
+      }
+      for (size_t i = 0; i < edit.new_files().size(); i++) {
+        const FileMetaData& f = edit.new_files()[i].second;
+        if (f.global_seqno != 0) {
+          global_seqnos_[f.number] = f.global_seqno;
+        }
+      }
+    }
+    delete file;
+  }
+
+  // Give each ingested table whose global sequence number was not found
+  // a new one, newer than every key of the other tables.
+  void SequenceTables() {
+    std::sort(tables_.begin(), tables_.end(), ByFileNumber);
+    SequenceNumber max_sequence = 0;
+    for (size_t i = 0; i < tables_.size(); i++) {
+      max_sequence = std::max(max_sequence, tables_[i].max_sequence);
+    }
+    for (size_t i = 0; i < tables_.size(); i++) {
+      TableInfo* t = &tables_[i];
+      if (!t->unsequenced) {
+        continue;
+      }
+      const SequenceNumber seq = ++max_sequence;
+      t->meta.global_seqno = seq;
+      t->max_sequence = seq;
+      t->meta.smallest = InternalKey(
+          t->meta.smallest.user_key(), seq,
+          ExtractValueType(t->meta.smallest.Encode()));
+      t->meta.largest = InternalKey(
+          t->meta.largest.user_key(), seq,
+          ExtractValueType(t->meta.largest.Encode()));
+      Log(options_.info_log, "Table #%llu: no sequence number, using %llu",
+          (unsigned long long) t->meta.number, (unsigned long long) seq);
+    }
   }
 
   Iterator* NewTableIterator(const FileMetaData& meta) {
@@ -252,12 +335,18 @@ class Repairer {
     // on checksum verification.
     ReadOptions r;
     r.verify_checksums = options_.paranoid_checks;
-    return table_cache_->NewIterator(r, meta.number, meta.file_size);
+    return table_cache_->NewIterator(r, meta.number, meta.file_size,
+                                     meta.global_seqno);
   }
 
   void ScanTable(uint64_t number) {
     TableInfo t;
     t.meta.number = number;
+    std::map<uint64_t, SequenceNumber>::const_iterator ingested =
+        global_seqnos_.find(number);
+    if (ingested != global_seqnos_.end()) {
+      t.meta.global_seqno = ingested->second;
+    }
     std::string fname = TableFileName(dbname_, number);
     Status status = env_->GetFileSize(fname, &t.meta.file_size);
     if (!status.ok()) {
@@ -306,6 +395,7 @@ class Repairer {
       status = iter->status();
     }
     delete iter;
+    t.unsequenced = !empty && t.max_sequence == 0;
     Log(options_.info_log, "Table #%llu: %d entries %s",
         (unsigned long long) t.meta.number,
         counter,
@@ -359,6 +449,8 @@ class Repairer {
     file = NULL;
 
     if (counter > 0 && s.ok()) {
+      // The copy holds the sequence numbers the iterator produced.
+      t.meta.global_seqno = 0;
       std::string orig = TableFileName(dbname_, t.meta.number);
       s = env_->RenameFile(copy, orig);
       if (s.ok()) {
@@ -395,8 +487,7 @@ class Repairer {
     for (size_t i = 0; i < tables_.size(); i++) {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
-      edit_.AddFile(0, t.meta.number, t.meta.file_size,
-                    t.meta.smallest, t.meta.largest);
+      edit_.AddFile(0, t.meta);
     }
 
     //fprintf(stderr, "NewDescriptor:\n%s\n", edit_.DebugString().c_str());
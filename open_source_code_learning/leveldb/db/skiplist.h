@@ -8,10 +8,11 @@
 // Thread safety
 // -------------
 //
-// Writes require external synchronization, most likely a mutex.
-// Reads require a guarantee that the SkipList will not be destroyed
-// while the read is in progress.  Apart from that, reads progress
-// without any internal locking or synchronization.
+// Writes require external synchronization, most likely a mutex, unless
+// every writer uses InsertConcurrently().  Reads require a guarantee that
+// the SkipList will not be destroyed while the read is in progress.  Apart
+// from that, reads progress without any internal locking or
+// synchronization.
 //
 // Invariants:
 //
@@ -21,22 +22,20 @@
 //
 // (2) The contents of a Node except for the next/prev pointers are
 // immutable after the Node has been linked into the SkipList.
-// Only Insert() modifies the list, and it is careful to initialize
-// a node and use release-stores to publish the nodes in one or
-// more lists.
+// Only Insert() and InsertConcurrently() modify the list, and they are
+// careful to initialize a node and use release-stores (or CAS) to
+// publish the nodes in one or more lists.
 //
 // ... prev vs. next pointer ordering ...
 
 #include <assert.h>
 #include <stdlib.h>
+#include "leveldb/memtablerep.h"
 #include "port/port.h"
-#include "util/arena.h"
 #include "util/random.h"
 
 namespace leveldb {
 
-class Arena;
-
 template<typename Key, class Comparator>
 
 //跳跃链表是一种数据结构，允许快速查询一个有序连续元素的数据链表。快速查询是通过维护一个多层次的链表，且每一层链表中的元素是前一层链表元素的子集。
@@ -54,16 +53,24 @@ class SkipList {
 
  public:
   // Create a new SkipList object that will use "cmp" for comparing keys,
-  // and will allocate memory using "*arena".  Objects allocated in the arena
-  // must remain allocated for the lifetime of the skiplist object.
+  // and will allocate memory using "*arena", usually an Arena.  Objects
+  // allocated in the arena must remain allocated for the lifetime of the
+  // skiplist object.
   // 创建一个skiplist，cmp是比较函数，利用arena分配内存
-  explicit SkipList(Comparator cmp, Arena* arena);
+  explicit SkipList(Comparator cmp, MemTableAllocator* arena);
 
   // Insert key into the list.
   // REQUIRES: nothing that compares equal to key is currently in the list.
   // 插入新值到skiplist中
   void Insert(const Key& key);
 
+  // Like Insert(), but may be called by several threads at once.  Links
+  // are published with CAS and nodes come from
+  // MemTableAllocator::AllocateAlignedConcurrently().  Must not run concurrently
+  // with Insert().
+  // REQUIRES: nothing that compares equal to key is currently in the list.
+  void InsertConcurrently(const Key& key);
+
   // Returns true iff an entry that compares equal to key is in the list.
   // 判断key是否存在
   bool Contains(const Key& key) const;
@@ -121,7 +128,7 @@ class SkipList {
 
   // Immutable after construction
   Comparator const compare_;  //key值的比较函数，一旦初始化就不能变化了
-  Arena* const arena_;    // Arena used for allocations of nodes
+  MemTableAllocator* const arena_;  // Used for allocations of nodes
 
   Node* const head_;  //skiplist的头结点
 
@@ -143,9 +150,15 @@ class SkipList {
   //产生随机的level层数，只有执行Insert()时才会被调用
   Random rnd_;  
 
+  // Generator state shared by InsertConcurrently() callers; advanced
+  // with CAS.
+  port::AtomicPointer concurrent_rnd_;
+
   //新建一个level为height，值为key的节点
   Node* NewNode(const Key& key, int height);
+  Node* NewNodeConcurrently(const Key& key, int height);
   int RandomHeight();  //随机产生一个level层数值
+  int RandomHeightConcurrently();
   //比较两个key是否相等
   bool Equal(const Key& a, const Key& b) const { return (compare_(a, b) == 0); }
 
@@ -161,6 +174,11 @@ class SkipList {
   //找到key对应的Node或者key后面紧邻的Node
   Node* FindGreaterOrEqual(const Key& key, Node** prev) const;
 
+  // Starting at "before", which must come before key, find the nodes
+  // between which key belongs at "level".
+  void FindSpliceForLevel(const Key& key, Node* before, int level,
+                          Node** prev, Node** next) const;
+
   // Return the latest node with a key < key.
   // Return head_ if there is no such node.
   // 找到key前面紧邻的Node，如果skiplist为空，则返回头节点
@@ -209,6 +227,13 @@ struct SkipList<Key,Comparator>::Node {
     next_[n].NoBarrier_Store(x);
   }
 
+  // Link x at level n iff the link still points to "expected".  Acts as
+  // a release-store on success.
+  bool CASNext(int n, Node* expected, Node* x) {
+    assert(n >= 0);
+    return next_[n].CompareAndSwap(expected, x);
+  }
+
  private:
   // Array of length equal to the node height.  next_[0] is lowest level link.
   port::AtomicPointer next_[1];
@@ -222,6 +247,14 @@ SkipList<Key,Comparator>::NewNode(const Key& key, int height) {
   return new (mem) Node(key);
 }
 
+template<typename Key, class Comparator>
+typename SkipList<Key,Comparator>::Node*
+SkipList<Key,Comparator>::NewNodeConcurrently(const Key& key, int height) {
+  char* mem = arena_->AllocateAlignedConcurrently(
+      sizeof(Node) + sizeof(port::AtomicPointer) * (height - 1));
+  return new (mem) Node(key);
+}
+
 template<typename Key, class Comparator>
 inline SkipList<Key,Comparator>::Iterator::Iterator(const SkipList* list) {
   list_ = list;
@@ -287,6 +320,30 @@ int SkipList<Key,Comparator>::RandomHeight() {
   return height;
 }
 
+template<typename Key, class Comparator>
+int SkipList<Key,Comparator>::RandomHeightConcurrently() {
+  // Draw one value from the shared generator, retrying if another
+  // inserter advanced it first, and spend two bits of it per level.
+  uint32_t r;
+  while (true) {
+    void* old_state = concurrent_rnd_.NoBarrier_Load();
+    Random rnd(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(old_state)));
+    r = rnd.Next();
+    if (concurrent_rnd_.CompareAndSwap(
+            old_state, reinterpret_cast<void*>(static_cast<uintptr_t>(r)))) {
+      break;
+    }
+  }
+  int height = 1;
+  while (height < kMaxHeight && (r & 3) == 0) {
+    height++;
+    r >>= 2;
+  }
+  assert(height > 0);
+  assert(height <= kMaxHeight);
+  return height;
+}
+
 template<typename Key, class Comparator>
 bool SkipList<Key,Comparator>::KeyIsAfterNode(const Key& key, Node* n) const {
   // NULL n is considered infinite
@@ -315,6 +372,24 @@ typename SkipList<Key,Comparator>::Node* SkipList<Key,Comparator>::FindGreaterOr
   }
 }
 
+template<typename Key, class Comparator>
+void SkipList<Key,Comparator>::FindSpliceForLevel(const Key& key,
+                                                  Node* before, int level,
+                                                  Node** prev,
+                                                  Node** next) const {
+  Node* x = before;
+  while (true) {
+    Node* n = x->Next(level);
+    if (KeyIsAfterNode(key, n)) {
+      x = n;
+    } else {
+      *prev = x;
+      *next = n;
+      return;
+    }
+  }
+}
+
 template<typename Key, class Comparator>
 typename SkipList<Key,Comparator>::Node*
 SkipList<Key,Comparator>::FindLessThan(const Key& key) const {
@@ -357,12 +432,13 @@ typename SkipList<Key,Comparator>::Node* SkipList<Key,Comparator>::FindLast()
 }
 
 template<typename Key, class Comparator>
-SkipList<Key,Comparator>::SkipList(Comparator cmp, Arena* arena)
+SkipList<Key,Comparator>::SkipList(Comparator cmp, MemTableAllocator* arena)
     : compare_(cmp),
       arena_(arena),
       head_(NewNode(0 /* any key will do */, kMaxHeight)),
       max_height_(reinterpret_cast<void*>(1)),
-      rnd_(0xdeadbeef) {
+      rnd_(0xdeadbeef),
+      concurrent_rnd_(reinterpret_cast<void*>(0xdeadbeef)) {
   for (int i = 0; i < kMaxHeight; i++) {
     head_->SetNext(i, NULL);
   }
@@ -404,6 +480,51 @@ void SkipList<Key,Comparator>::Insert(const Key& key) {
   }
 }
 
+template<typename Key, class Comparator>
+void SkipList<Key,Comparator>::InsertConcurrently(const Key& key) {
+  const int height = RandomHeightConcurrently();
+
+  // Raise max_height_ first.  As in Insert(), readers that see the new
+  // height before the new links simply find NULL at the top of head_.
+  while (true) {
+    const int max_height = GetMaxHeight();
+    if (height <= max_height ||
+        max_height_.CompareAndSwap(reinterpret_cast<void*>(max_height),
+                                   reinterpret_cast<void*>(height))) {
+      break;
+    }
+  }
+
+  // Find where key goes at every level the new node will be linked at,
+  // descending from the top of the list.
+  Node* prev[kMaxHeight + 1];
+  Node* next[kMaxHeight + 1];
+  const int top = GetMaxHeight();
+  prev[top] = head_;
+  for (int i = top - 1; i >= 0; i--) {
+    FindSpliceForLevel(key, prev[i + 1], i, &prev[i], &next[i]);
+  }
+
+  // Our data structure does not allow duplicate insertion
+  assert(next[0] == NULL || !Equal(key, next[0]->key));
+
+  // Link bottom-up so the node is in the level-0 list (and so visible to
+  // readers) before any index level points at it.  If another inserter
+  // changed prev[i] in the meantime, the splice at that level is
+  // recomputed from prev[i], which still comes before key because nodes
+  // are never removed.
+  Node* x = NewNodeConcurrently(key, height);
+  for (int i = 0; i < height; i++) {
+    while (true) {
+      x->NoBarrier_SetNext(i, next[i]);
+      if (prev[i]->CASNext(i, next[i], x)) {
+        break;
+      }
+      FindSpliceForLevel(key, prev[i], i, &prev[i], &next[i]);
+    }
+  }
+}
+
 template<typename Key, class Comparator>
 bool SkipList<Key,Comparator>::Contains(const Key& key) const {
   Node* x = FindGreaterOrEqual(key, NULL);
@@ -4,9 +4,11 @@
 
 #include "db/skiplist.h"
 #include <set>
+#include <vector>
 #include "leveldb/env.h"
 #include "util/arena.h"
 #include "util/hash.h"
+#include "util/mutexlock.h"
 #include "util/random.h"
 #include "util/testharness.h"
 
@@ -122,7 +124,7 @@ TEST(SkipTest, InsertAndLookup) {
   }
 }
 
-// We want to make sure that with a single writer and multiple
+// We want to make sure that with one or more writers and multiple
 // concurrent readers (with no synchronization other than when a
 // reader's iterator is created), the reader always observes all the
 // data that was present in the skip list when the iterator was
@@ -206,8 +208,9 @@ class ConcurrentTest {
 
   Arena arena_;
 
-  // SkipList is not protected by mu_.  We just use a single writer
-  // thread to modify it.
+  // SkipList is not protected by mu_.  We either use a single writer
+  // thread to modify it, or several that use InsertConcurrently() on
+  // disjoint sets of keys.
   SkipList<Key, Comparator> list_;
 
  public:
@@ -222,6 +225,19 @@ class ConcurrentTest {
     current_.Set(k, g);
   }
 
+  // Like WriteStep(), but may run in several threads at once provided
+  // each passes a different "id" in [0..num_writers-1].  A writer only
+  // touches keys k with k % num_writers == id, so the generation of
+  // every key still has a single writer.
+  void ConcurrentWriteStep(Random* rnd, int id, int num_writers) {
+    assert(num_writers <= static_cast<int>(K));
+    const uint32_t k = id + num_writers * (rnd->Next() % (K / num_writers));
+    const intptr_t g = current_.Get(k) + 1;
+    const Key key = MakeKey(k, g);
+    list_.InsertConcurrently(key);
+    current_.Set(k, g);
+  }
+
   void ReadStep(Random* rnd) {
     // Remember the initial committed state of the skiplist.
     State initial_state;
@@ -371,6 +387,94 @@ TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
 TEST(SkipTest, Concurrent4) { RunConcurrent(4); }
 TEST(SkipTest, Concurrent5) { RunConcurrent(5); }
 
+struct WriterState {
+  TestState* state;
+  int id;
+  int num_writers;
+  int steps;
+  port::Mutex* mu;
+  port::CondVar* cv;
+  int* running;
+};
+
+static void ConcurrentWriter(void* arg) {
+  WriterState* w = reinterpret_cast<WriterState*>(arg);
+  Random rnd(w->state->seed_ + 1000 + w->id);
+  for (int i = 0; i < w->steps; i++) {
+    w->state->t_.ConcurrentWriteStep(&rnd, w->id, w->num_writers);
+  }
+  MutexLock l(w->mu);
+  (*w->running)--;
+  w->cv->Signal();
+}
+
+// Like RunConcurrent(), but with "num_writers" threads inserting at the
+// same time as the reader.
+static void RunConcurrentWriters(int run, int num_writers) {
+  const int seed = test::RandomSeed() + (run * 100);
+  const int N = 20;
+  const int kSize = 10000;
+  for (int i = 0; i < N; i++) {
+    if ((i % 5) == 0) {
+      fprintf(stderr, "Run %d of %d\n", i, N);
+    }
+    TestState state(seed + 1);
+    Env::Default()->Schedule(ConcurrentReader, &state);
+    state.Wait(TestState::RUNNING);
+
+    port::Mutex mu;
+    port::CondVar cv(&mu);
+    int running = num_writers;
+    std::vector<WriterState> writers(num_writers);
+    for (int id = 0; id < num_writers; id++) {
+      writers[id].state = &state;
+      writers[id].id = id;
+      writers[id].num_writers = num_writers;
+      writers[id].steps = kSize;
+      writers[id].mu = &mu;
+      writers[id].cv = &cv;
+      writers[id].running = &running;
+      Env::Default()->StartThread(ConcurrentWriter, &writers[id]);
+    }
+    {
+      MutexLock l(&mu);
+      while (running > 0) {
+        cv.Wait();
+      }
+    }
+    state.quit_flag_.Release_Store(&state);  // Any non-NULL arg will do
+    state.Wait(TestState::DONE);
+  }
+}
+
+TEST(SkipTest, ConcurrentWriters2) { RunConcurrentWriters(1, 2); }
+TEST(SkipTest, ConcurrentWriters4) { RunConcurrentWriters(2, 4); }
+
+TEST(SkipTest, InsertConcurrentlyWithoutThreads) {
+  const int N = 2000;
+  const int R = 5000;
+  Random rnd(1000);
+  std::set<Key> keys;
+  Arena arena;
+  Comparator cmp;
+  SkipList<Key, Comparator> list(cmp, &arena);
+  for (int i = 0; i < N; i++) {
+    Key key = rnd.Next() % R;
+    if (keys.insert(key).second) {
+      list.InsertConcurrently(key);
+    }
+  }
+
+  SkipList<Key, Comparator>::Iterator iter(&list);
+  iter.SeekToFirst();
+  for (std::set<Key>::iterator it = keys.begin(); it != keys.end(); ++it) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(*it, iter.key());
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -0,0 +1,139 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/sst_file_writer.h"
+
+#include "db/dbformat.h"
+#include "leveldb/env.h"
+#include "leveldb/table_builder.h"
+
+namespace leveldb {
+
+// Tables hold internal keys, as those written by a DB do.  Every entry gets
+// sequence number zero, which DB::IngestExternalFile() replaces with one
+// of its own when the table is read (see FileMetaData::global_seqno).
+struct SstFileWriter::Rep {
+  const InternalKeyComparator icmp;
+  const InternalFilterPolicy ipolicy;
+  Options options;
+  std::string fname;
+  WritableFile* file;
+  TableBuilder* builder;
+  uint64_t file_size;
+  std::string last_key;  // User key of the last entry added
+  bool has_last_key;
+
+  explicit Rep(const Options& opt)
+      : icmp(opt.comparator),
+        ipolicy(opt.filter_policy),
+        options(opt),
+        file(NULL),
+        builder(NULL),
+        file_size(0),
+        has_last_key(false) {
+    options.comparator = &icmp;
+    options.filter_policy = (opt.filter_policy != NULL) ? &ipolicy : NULL;
+  }
+
+  // Abandon the table being written and delete its file.
+  void Discard() {
+    if (builder != NULL) {
+      builder->Abandon();
+      delete builder;
+      builder = NULL;
+    }
+    if (file != NULL) {
+      file->Close();
+      delete file;
+      file = NULL;
+      options.env->DeleteFile(fname);
+    }
+  }
+};
+
+SstFileWriter::SstFileWriter(const Options& options)
+    : rep_(new Rep(options)) {
+}
+
+SstFileWriter::~SstFileWriter() {
+  rep_->Discard();
+  delete rep_;
+}
+
+Status SstFileWriter::Open(const std::string& fname) {
+  Rep* r = rep_;
+  if (r->file != NULL) {
+    return Status::InvalidArgument("table is already open", r->fname);
+  }
+  Status s = r->options.env->NewWritableFile(fname, &r->file);
+  if (!s.ok()) {
+    r->file = NULL;
+    return s;
+  }
+  r->fname = fname;
+  r->builder = new TableBuilder(r->options, r->file);
+  r->file_size = 0;
+  r->last_key.clear();
+  r->has_last_key = false;
+  return s;
+}
+
+Status SstFileWriter::Put(const Slice& key, const Slice& value) {
+  return Add(key, value, false);
+}
+
+Status SstFileWriter::Delete(const Slice& key) {
+  return Add(key, Slice(), true);
+}
+
+Status SstFileWriter::Add(const Slice& key, const Slice& value,
+                          bool deletion) {
+  Rep* r = rep_;
+  if (r->builder == NULL) {
+    return Status::InvalidArgument("table is not open");
+  }
+  if (r->has_last_key &&
+      r->icmp.user_comparator()->Compare(key, r->last_key) <= 0) {
+    return Status::InvalidArgument("keys must be added in increasing order",
+                                   key);
+  }
+  InternalKey ikey(key, 0, deletion ? kTypeDeletion : kTypeValue);
+  r->builder->Add(ikey.Encode(), value);
+  r->last_key.assign(key.data(), key.size());
+  r->has_last_key = true;
+  return r->builder->status();
+}
+
+Status SstFileWriter::Finish() {
+  Rep* r = rep_;
+  if (r->builder == NULL) {
+    return Status::InvalidArgument("table is not open");
+  }
+  if (r->builder->NumEntries() == 0) {
+    r->Discard();
+    return Status::InvalidArgument("table is empty");
+  }
+  Status s = r->builder->Finish();
+  if (s.ok()) {
+    r->file_size = r->builder->FileSize();
+    s = r->file->Sync();
+  }
+  if (s.ok()) {
+    s = r->file->Close();
+  }
+  delete r->builder;
+  r->builder = NULL;
+  delete r->file;
+  r->file = NULL;
+  if (!s.ok()) {
+    r->options.env->DeleteFile(r->fname);
+  }
+  return s;
+}
+
+uint64_t SstFileWriter::FileSize() const {
+  return (rep_->builder != NULL) ? rep_->builder->FileSize() : rep_->file_size;
+}
+
+}  // namespace leveldb
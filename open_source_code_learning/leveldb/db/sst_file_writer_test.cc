@@ -0,0 +1,363 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/sst_file_writer.h"
+
+#include "db/db_impl.h"
+#include "db/filename.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
+#include "util/logging.h"
+#include "util/testharness.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+static std::string Key(int i) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "key%06d", i);
+  return std::string(buf);
+}
+
+class SstFileWriterTest {
+ public:
+  std::string dbname_;
+  std::string sst_dir_;
+  Env* env_;
+  const FilterPolicy* filter_policy_;
+  Options options_;
+  DB* db_;
+
+  SstFileWriterTest() : env_(Env::Default()), db_(NULL) {
+    dbname_ = test::TmpDir() + "/sst_file_writer_test";
+    sst_dir_ = test::TmpDir() + "/sst_file_writer_test_files";
+    filter_policy_ = NewBloomFilterPolicy(10);
+    options_.filter_policy = filter_policy_;
+    DestroyDB(dbname_, options_);
+    env_->CreateDir(sst_dir_);
+    options_.create_if_missing = true;
+    Reopen();
+  }
+
+  ~SstFileWriterTest() {
+    delete db_;
+    DestroyDB(dbname_, Options());
+    std::vector<std::string> files;
+    env_->GetChildren(sst_dir_, &files);
+    for (size_t i = 0; i < files.size(); i++) {
+      env_->DeleteFile(sst_dir_ + "/" + files[i]);
+    }
+    env_->DeleteDir(sst_dir_);
+    delete filter_policy_;
+  }
+
+  DBImpl* dbfull() { return reinterpret_cast<DBImpl*>(db_); }
+
+  void Reopen() {
+    delete db_;
+    db_ = NULL;
+    ASSERT_OK(DB::Open(options_, dbname_, &db_));
+  }
+
+  // Write a table of keys [first,last] with values "<prefix><i>" to a new
+  // file and return its name.  Every key divisible by "delete_every" is
+  // a deletion instead, if "delete_every" is non-zero.
+  std::string WriteFile(int first, int last, const std::string& prefix,
+                        int delete_every = 0) {
+    static int file_count = 0;
+    char buf[100];
+    snprintf(buf, sizeof(buf), "/%d.sst", file_count++);
+    std::string fname = sst_dir_ + buf;
+    SstFileWriter writer(options_);
+    ASSERT_OK(writer.Open(fname));
+    for (int i = first; i <= last; i++) {
+      if (delete_every != 0 && i % delete_every == 0) {
+        ASSERT_OK(writer.Delete(Key(i)));
+      } else {
+        ASSERT_OK(writer.Put(Key(i), prefix + NumberToString(i)));
+      }
+    }
+    ASSERT_OK(writer.Finish());
+    ASSERT_GT(writer.FileSize(), 0);
+    return fname;
+  }
+
+  Status Ingest(const std::string& fname, bool move_file = false) {
+    IngestOptions options;
+    options.move_file = move_file;
+    return db_->IngestExternalFile(options, fname);
+  }
+
+  std::string Get(const std::string& k, const Snapshot* snapshot = NULL) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    std::string result;
+    Status s = db_->Get(options, k, &result);
+    if (s.IsNotFound()) {
+      result = "NOT_FOUND";
+    } else if (!s.ok()) {
+      result = s.ToString();
+    }
+    return result;
+  }
+
+  int NumTableFilesAtLevel(int level) {
+    std::string property;
+    ASSERT_TRUE(
+        db_->GetProperty("leveldb.num-files-at-level" + NumberToString(level),
+                         &property));
+    return atoi(property.c_str());
+  }
+
+  // Check that iterating over the database agrees with Get().
+  void CheckIterator(int expected_count) {
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ASSERT_EQ(Get(iter->key().ToString()), iter->value().ToString());
+      count++;
+    }
+    ASSERT_OK(iter->status());
+    ASSERT_EQ(expected_count, count);
+    delete iter;
+  }
+};
+
+TEST(SstFileWriterTest, RejectsBadInput) {
+  const std::string fname = sst_dir_ + "/bad.sst";
+  SstFileWriter writer(options_);
+  ASSERT_TRUE(writer.Put("a", "v").IsInvalidArgument());  // Not open
+  ASSERT_OK(writer.Open(fname));
+  ASSERT_OK(writer.Put("b", "v"));
+  ASSERT_TRUE(writer.Put("b", "v").IsInvalidArgument());
+  ASSERT_TRUE(writer.Put("a", "v").IsInvalidArgument());
+  ASSERT_OK(writer.Put("c", "v"));
+  ASSERT_OK(writer.Finish());
+
+  // An empty table is not kept
+  const std::string empty = sst_dir_ + "/empty.sst";
+  ASSERT_OK(writer.Open(empty));
+  ASSERT_TRUE(writer.Finish().IsInvalidArgument());
+  ASSERT_TRUE(!env_->FileExists(empty));
+
+  // Neither is one that is never finished
+  const std::string unfinished = sst_dir_ + "/unfinished.sst";
+  {
+    SstFileWriter other(options_);
+    ASSERT_OK(other.Open(unfinished));
+    ASSERT_OK(other.Put("a", "v"));
+  }
+  ASSERT_TRUE(!env_->FileExists(unfinished));
+
+  ASSERT_TRUE(!Ingest(sst_dir_ + "/missing.sst").ok());
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+}
+
+TEST(SstFileWriterTest, IngestIntoEmptyDB) {
+  ASSERT_OK(Ingest(WriteFile(0, 99, "v")));
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ("v" + NumberToString(i), Get(Key(i)));
+  }
+  ASSERT_EQ("NOT_FOUND", Get(Key(100)));
+  CheckIterator(100);
+
+  // Nothing overlaps the file, so it goes to the last level
+  ASSERT_EQ(1, NumTableFilesAtLevel(config::kNumLevels - 1));
+
+  // Later writes and ingested files win
+  ASSERT_OK(db_->Put(WriteOptions(), Key(5), "put"));
+  ASSERT_OK(Ingest(WriteFile(10, 19, "w", 2)));
+  ASSERT_EQ("put", Get(Key(5)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(10)));
+  ASSERT_EQ("w11", Get(Key(11)));
+  ASSERT_EQ("v20", Get(Key(20)));
+  CheckIterator(95);
+
+  std::vector<Slice> keys;
+  const std::string k5 = Key(5), k10 = Key(10), k11 = Key(11), k20 = Key(20);
+  keys.push_back(k5);
+  keys.push_back(k10);
+  keys.push_back(k11);
+  keys.push_back(k20);
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  db_->MultiGet(ReadOptions(), keys, &values, &statuses);
+  ASSERT_EQ("put", values[0]);
+  ASSERT_TRUE(statuses[1].IsNotFound());
+  ASSERT_EQ("w11", values[2]);
+  ASSERT_EQ("v20", values[3]);
+}
+
+TEST(SstFileWriterTest, IngestOverMemTable) {
+  for (int i = 0; i < 50; i++) {
+    ASSERT_OK(db_->Put(WriteOptions(), Key(i), "old"));
+  }
+  ASSERT_OK(Ingest(WriteFile(20, 29, "new", 5)));
+  ASSERT_EQ("old", Get(Key(19)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(20)));
+  ASSERT_EQ("new21", Get(Key(21)));
+  ASSERT_EQ("old", Get(Key(30)));
+  CheckIterator(48);
+
+  // The memtable was flushed to a table first
+  int files = 0;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    files += NumTableFilesAtLevel(level);
+  }
+  ASSERT_EQ(2, files);
+
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("NOT_FOUND", Get(Key(20)));
+  ASSERT_EQ("new21", Get(Key(21)));
+  CheckIterator(48);
+}
+
+TEST(SstFileWriterTest, IngestOverLevels) {
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(db_->Put(WriteOptions(), Key(i), "old"));
+  }
+  db_->CompactRange(NULL, NULL);
+  ASSERT_OK(Ingest(WriteFile(40, 59, "new")));
+  ASSERT_EQ("old", Get(Key(39)));
+  ASSERT_EQ("new40", Get(Key(40)));
+  ASSERT_EQ("new59", Get(Key(59)));
+  ASSERT_EQ("old", Get(Key(60)));
+  CheckIterator(100);
+
+  // Keys outside of every existing file
+  ASSERT_OK(Ingest(WriteFile(200, 210, "far")));
+  ASSERT_EQ("far205", Get(Key(205)));
+  CheckIterator(111);
+
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("new40", Get(Key(40)));
+  ASSERT_EQ("far205", Get(Key(205)));
+  CheckIterator(111);
+}
+
+TEST(SstFileWriterTest, Snapshots) {
+  ASSERT_OK(db_->Put(WriteOptions(), Key(1), "old"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Ingest(WriteFile(0, 9, "new")));
+  ASSERT_EQ("new1", Get(Key(1)));
+  ASSERT_EQ("new2", Get(Key(2)));
+  ASSERT_EQ("old", Get(Key(1), snapshot));
+  ASSERT_EQ("NOT_FOUND", Get(Key(2), snapshot));
+
+  ReadOptions options;
+  options.snapshot = snapshot;
+  Iterator* iter = db_->NewIterator(options);
+  iter->SeekToFirst();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(Key(1), iter->key().ToString());
+  ASSERT_EQ("old", iter->value().ToString());
+  iter->Next();
+  ASSERT_TRUE(!iter->Valid());
+  delete iter;
+
+  // Compactions keep what the snapshot sees
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("old", Get(Key(1), snapshot));
+  ASSERT_EQ("NOT_FOUND", Get(Key(2), snapshot));
+  db_->ReleaseSnapshot(snapshot);
+  ASSERT_EQ("new1", Get(Key(1)));
+}
+
+TEST(SstFileWriterTest, SurvivesReopen) {
+  ASSERT_OK(db_->Put(WriteOptions(), Key(0), "old"));
+  ASSERT_OK(Ingest(WriteFile(0, 9, "a")));
+  ASSERT_OK(Ingest(WriteFile(5, 14, "b")));
+  ASSERT_OK(db_->Put(WriteOptions(), Key(7), "put"));
+  Reopen();
+  ASSERT_EQ("a0", Get(Key(0)));
+  ASSERT_EQ("a4", Get(Key(4)));
+  ASSERT_EQ("b5", Get(Key(5)));
+  ASSERT_EQ("put", Get(Key(7)));
+  ASSERT_EQ("b14", Get(Key(14)));
+  CheckIterator(15);
+
+  // Sequence numbers given out after reopening are newer still
+  ASSERT_OK(db_->Put(WriteOptions(), Key(8), "put"));
+  ASSERT_EQ("put", Get(Key(8)));
+  db_->CompactRange(NULL, NULL);
+  Reopen();
+  ASSERT_EQ("put", Get(Key(8)));
+  ASSERT_EQ("b9", Get(Key(9)));
+  CheckIterator(15);
+}
+
+TEST(SstFileWriterTest, MoveFile) {
+  const std::string fname = WriteFile(0, 9, "v");
+  ASSERT_OK(Ingest(fname, true));
+  ASSERT_TRUE(!env_->FileExists(fname));
+  ASSERT_EQ("v3", Get(Key(3)));
+
+  const std::string copied = WriteFile(10, 19, "v");
+  ASSERT_OK(Ingest(copied));
+  ASSERT_TRUE(env_->FileExists(copied));
+  ASSERT_EQ("v13", Get(Key(13)));
+  Reopen();
+  CheckIterator(20);
+}
+
+TEST(SstFileWriterTest, Repair) {
+  ASSERT_OK(db_->Put(WriteOptions(), Key(0), "old"));
+  ASSERT_OK(db_->Put(WriteOptions(), Key(5), "old"));
+  db_->CompactRange(NULL, NULL);
+  ASSERT_OK(Ingest(WriteFile(0, 9, "a")));
+  ASSERT_OK(Ingest(WriteFile(5, 14, "b")));
+  ASSERT_OK(db_->Put(WriteOptions(), Key(7), "put"));
+  delete db_;
+  db_ = NULL;
+  ASSERT_OK(RepairDB(dbname_, options_));
+  Reopen();
+  for (int i = 0; i < 2; i++) {
+    ASSERT_EQ("a0", Get(Key(0)));
+    ASSERT_EQ("a4", Get(Key(4)));
+    ASSERT_EQ("b5", Get(Key(5)));
+    ASSERT_EQ("put", Get(Key(7)));
+    ASSERT_EQ("b14", Get(Key(14)));
+    CheckIterator(15);
+    db_->CompactRange(NULL, NULL);
+  }
+}
+
+TEST(SstFileWriterTest, RepairWithoutManifest) {
+  ASSERT_OK(db_->Put(WriteOptions(), Key(0), "old"));
+  db_->CompactRange(NULL, NULL);
+  ASSERT_OK(Ingest(WriteFile(0, 9, "a")));
+  delete db_;
+  db_ = NULL;
+
+  // Without the MANIFEST, the ingested table is newer than the others.
+  std::vector<std::string> files;
+  ASSERT_OK(env_->GetChildren(dbname_, &files));
+  uint64_t number;
+  FileType type;
+  for (size_t i = 0; i < files.size(); i++) {
+    if (ParseFileName(files[i], &number, &type) && type == kDescriptorFile) {
+      ASSERT_OK(env_->DeleteFile(dbname_ + "/" + files[i]));
+    }
+  }
+  ASSERT_OK(RepairDB(dbname_, options_));
+  Reopen();
+  ASSERT_EQ("a0", Get(Key(0)));
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("a0", Get(Key(0)));
+  CheckIterator(10);
+
+  // Writes after the repair are newer still.
+  ASSERT_OK(db_->Put(WriteOptions(), Key(1), "put"));
+  db_->CompactRange(NULL, NULL);
+  Reopen();
+  ASSERT_EQ("put", Get(Key(1)));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
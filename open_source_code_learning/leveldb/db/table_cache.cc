@@ -4,10 +4,13 @@
 
 #include "db/table_cache.h"
 
+#include <vector>
 #include "db/filename.h"
 #include "leveldb/env.h"
 #include "leveldb/table.h"
 #include "util/coding.h"
+#include "util/perf_context_imp.h"
+#include "util/statistics.h"
 
 namespace leveldb {
 
@@ -35,53 +38,173 @@ TableCache::TableCache(const std::string& dbname,
     : env_(options->env),
       dbname_(dbname),
       options_(options),
-      cache_(NewLRUCache(entries)) {
+      cache_(NewLRUCache(entries)),
+      row_cache_id_(options->row_cache != NULL ? options->row_cache->NewId()
+                                               : 0) {
 }
 
 TableCache::~TableCache() {
   delete cache_;
 }
 
+Status TableCache::OpenTable(uint64_t file_number, uint64_t file_size,
+                             bool direct, RandomAccessFile** file,
+                             Table** table) {
+  *file = NULL;
+  *table = NULL;
+  std::string fname = TableFileName(dbname_, file_number);
+  Status s = direct ? env_->NewDirectRandomAccessFile(fname, file)
+                    : env_->NewRandomAccessFile(fname, file);
+  if (!s.ok()) {
+    std::string old_fname = SSTTableFileName(dbname_, file_number);
+    Status old_s = direct ? env_->NewDirectRandomAccessFile(old_fname, file)
+                          : env_->NewRandomAccessFile(old_fname, file);
+    if (old_s.ok()) {
+      s = Status::OK();
+    }
+  }
+  if (s.ok()) {
+    s = Table::Open(*options_, *file, file_size, table);
+  }
+
+  if (!s.ok()) {
+    assert(*table == NULL);
+    delete *file;
+    *file = NULL;
+  }
+  return s;
+}
+
 Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
                              Cache::Handle** handle) {
+  PerfTimer timer(options_->env, &PerfContext::find_table_nanos);
   Status s;
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
   Slice key(buf, sizeof(buf));
   *handle = cache_->Lookup(key);
   if (*handle == NULL) {
-    std::string fname = TableFileName(dbname_, file_number);
+    RecordTick(options_->statistics, kTableCacheMiss);
+    PerfCount(&PerfContext::table_open_count);
     RandomAccessFile* file = NULL;
     Table* table = NULL;
-    s = env_->NewRandomAccessFile(fname, &file);
-    if (!s.ok()) {
-      std::string old_fname = SSTTableFileName(dbname_, file_number);
-      if (env_->NewRandomAccessFile(old_fname, &file).ok()) {
-        s = Status::OK();
-      }
+    {
+      StopWatch watch(env_, options_->statistics, kTableOpenMicros);
+      s = OpenTable(file_number, file_size, options_->use_direct_reads,
+                    &file, &table);
     }
+    // We do not cache error results so that if the error is transient,
+    // or somebody repairs the file, we recover automatically.
     if (s.ok()) {
-      s = Table::Open(*options_, file, file_size, &table);
-    }
-
-    if (!s.ok()) {
-      assert(table == NULL);
-      delete file;
-      // We do not cache error results so that if the error is transient,
-      // or somebody repairs the file, we recover automatically.
-    } else {
       TableAndFile* tf = new TableAndFile;
       tf->file = file;
       tf->table = table;
       *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
     }
+  } else {
+    RecordTick(options_->statistics, kTableCacheHit);
   }
   return s;
 }
 
+static SequenceNumber SequenceOf(const Slice& internal_key) {
+  return DecodeFixed64(internal_key.data() + internal_key.size() - 8) >> 8;
+}
+
+// Store "key" in *result with its sequence number replaced by "seq".
+static void SetGlobalSeqno(const Slice& key, SequenceNumber seq,
+                           std::string* result) {
+  result->assign(key.data(), key.size());
+  if (key.size() >= 8) {
+    const uint64_t tag = DecodeFixed64(key.data() + key.size() - 8);
+    EncodeFixed64(&(*result)[key.size() - 8], (seq << 8) | (tag & 0xff));
+  }
+}
+
+// The options of a DB hold its InternalKeyComparator.
+static const Comparator* UserComparator(const Options* options) {
+  return static_cast<const InternalKeyComparator*>(
+      options->comparator)->user_comparator();
+}
+
+namespace {
+// Presents the entries of an ingested table, which are stored with
+// sequence number zero, as having sequence number "seq".  Ingested tables
+// hold one entry per user key, so their order is unchanged.
+class GlobalSeqnoIterator : public Iterator {
+ public:
+  GlobalSeqnoIterator(Iterator* iter, SequenceNumber seq,
+                      const Comparator* ucmp)
+      : iter_(iter), seq_(seq), ucmp_(ucmp) { }
+
+  virtual ~GlobalSeqnoIterator() { delete iter_; }
+
+  virtual bool Valid() const { return iter_->Valid(); }
+  virtual void SeekToFirst() { iter_->SeekToFirst(); Update(); }
+  virtual void SeekToLast() { iter_->SeekToLast(); Update(); }
+  virtual void Next() { iter_->Next(); Update(); }
+  virtual void Prev() { iter_->Prev(); Update(); }
+  virtual void Seek(const Slice& target) {
+    if (target.size() < 8) {
+      iter_->Seek(target);
+    } else {
+      const Slice user_key = ExtractUserKey(target);
+      InternalKey start(user_key, kMaxSequenceNumber, kValueTypeForSeek);
+      iter_->Seek(start.Encode());
+      // The entry for the target's user key sorts before the target if it
+      // is newer.
+      const SequenceNumber target_seq =
+          DecodeFixed64(target.data() + target.size() - 8) >> 8;
+      if (iter_->Valid() && seq_ > target_seq &&
+          ucmp_->Compare(ExtractUserKey(iter_->key()), user_key) == 0) {
+        iter_->Next();
+      }
+    }
+    Update();
+  }
+  virtual Slice key() const { return key_; }
+  virtual Slice value() const { return iter_->value(); }
+  virtual Status status() const { return iter_->status(); }
+
+ private:
+  void Update() {
+    if (iter_->Valid()) {
+      SetGlobalSeqno(iter_->key(), seq_, &key_);
+    }
+  }
+
+  Iterator* const iter_;
+  const SequenceNumber seq_;
+  const Comparator* const ucmp_;
+  std::string key_;
+};
+
+// Wraps the callback of TableCache::Get() to pass it keys with the global
+// sequence number of an ingested table, unless that is newer than the
+// lookup.
+struct GlobalSeqnoSaver {
+  void* arg;
+  void (*saver)(void*, const Slice&, const Slice&);
+  SequenceNumber seq;
+  SequenceNumber lookup_seq;
+};
+}
+
+static void SaveGlobalSeqno(void* arg, const Slice& found_key,
+                            const Slice& found_value) {
+  GlobalSeqnoSaver* g = reinterpret_cast<GlobalSeqnoSaver*>(arg);
+  if (g->seq > g->lookup_seq) {
+    return;
+  }
+  std::string key;
+  SetGlobalSeqno(found_key, g->seq, &key);
+  (*g->saver)(g->arg, key, found_value);
+}
+
 Iterator* TableCache::NewIterator(const ReadOptions& options,
                                   uint64_t file_number,
                                   uint64_t file_size,
+                                  SequenceNumber global_seqno,
                                   Table** tableptr) {
   if (tableptr != NULL) {
     *tableptr = NULL;
@@ -96,23 +219,236 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
   Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
   Iterator* result = table->NewIterator(options);
   result->RegisterCleanup(&UnrefEntry, cache_, handle);
+  if (global_seqno != 0) {
+    result = new GlobalSeqnoIterator(
+        result, global_seqno, UserComparator(options_));
+  }
   if (tableptr != NULL) {
     *tableptr = table;
   }
   return result;
 }
 
+static void DeleteTableAndFile(void* arg1, void* arg2) {
+  TableAndFile* tf = reinterpret_cast<TableAndFile*>(arg1);
+  delete tf->table;
+  delete tf->file;
+  delete tf;
+}
+
+Iterator* TableCache::NewCompactionIterator(const ReadOptions& options,
+                                            uint64_t file_number,
+                                            uint64_t file_size,
+                                            SequenceNumber global_seqno) {
+  if (!options_->use_direct_io_for_compaction || options_->use_direct_reads) {
+    return NewIterator(options, file_number, file_size, global_seqno);
+  }
+
+  TableAndFile* tf = new TableAndFile;
+  Status s = OpenTable(file_number, file_size, true, &tf->file, &tf->table);
+  if (!s.ok()) {
+    delete tf;
+    return NewErrorIterator(s);
+  }
+  Iterator* result = tf->table->NewIterator(options);
+  result->RegisterCleanup(&DeleteTableAndFile, tf, NULL);
+  if (global_seqno != 0) {
+    result = new GlobalSeqnoIterator(
+        result, global_seqno, UserComparator(options_));
+  }
+  return result;
+}
+
+namespace {
+// Wraps the callback of TableCache::Get() to record the entry it is
+// passed if that is for "user_key".
+struct RowSaver {
+  void* arg;
+  void (*saver)(void*, const Slice&, const Slice&);
+  Slice user_key;
+  std::string row;  // Length-prefixed internal key, then the value
+};
+}
+
+static void SaveRow(void* arg, const Slice& found_key,
+                    const Slice& found_value) {
+  RowSaver* r = reinterpret_cast<RowSaver*>(arg);
+  if (found_key.size() >= 8 && ExtractUserKey(found_key) == r->user_key) {
+    r->row.clear();
+    PutLengthPrefixedSlice(&r->row, found_key);
+    r->row.append(found_value.data(), found_value.size());
+  }
+  (*r->saver)(r->arg, found_key, found_value);
+}
+
+static void DeleteRow(const Slice& key, void* value) {
+  delete reinterpret_cast<std::string*>(value);
+}
+
+namespace {
+// Wraps the callback of TableCache::Get() to note whether the table had
+// an entry for "user_key", i.e. whether a filter that let the lookup
+// through was right to.
+struct MatchSaver {
+  void* arg;
+  void (*saver)(void*, const Slice&, const Slice&);
+  Slice user_key;
+  bool matched;
+};
+}
+
+static void SaveMatch(void* arg, const Slice& found_key,
+                      const Slice& found_value) {
+  MatchSaver* m = reinterpret_cast<MatchSaver*>(arg);
+  if (found_key.size() >= 8 && ExtractUserKey(found_key) == m->user_key) {
+    m->matched = true;
+  }
+  (*m->saver)(m->arg, found_key, found_value);
+}
+
 Status TableCache::Get(const ReadOptions& options,
                        uint64_t file_number,
                        uint64_t file_size,
+                       SequenceNumber global_seqno,
                        const Slice& k,
                        void* arg,
                        void (*saver)(void*, const Slice&, const Slice&)) {
+  if (global_seqno > SequenceOf(k)) {
+    // The whole table is newer than the lookup
+    return Status::OK();
+  }
+
+  // A row holds the newest entry of the table for its user key, which is
+  // the one a seek finds unless "k" is older than that entry.
+  Cache* row_cache = options_->row_cache;
+  std::string row_key;
+  if (row_cache != NULL) {
+    const Slice user_key = ExtractUserKey(k);
+    PutFixed64(&row_key, row_cache_id_);
+    PutFixed64(&row_key, file_number);
+    row_key.append(user_key.data(), user_key.size());
+    Cache::Handle* row_handle = row_cache->Lookup(row_key);
+    RecordTick(options_->statistics,
+               row_handle != NULL ? kRowCacheHit : kRowCacheMiss);
+    if (row_handle != NULL) {
+      Slice row(*reinterpret_cast<std::string*>(row_cache->Value(row_handle)));
+      Slice found_key;
+      const bool hit = GetLengthPrefixedSlice(&row, &found_key) &&
+                       SequenceOf(found_key) <= SequenceOf(k);
+      if (hit) {
+        (*saver)(arg, found_key, row);
+      }
+      row_cache->Release(row_handle);
+      if (hit) {
+        return Status::OK();
+      }
+    }
+  }
+
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    void* get_arg = arg;
+    void (*get_saver)(void*, const Slice&, const Slice&) = saver;
+    RowSaver r;
+    if (row_cache != NULL && options.snapshot == NULL) {
+      r.arg = get_arg;
+      r.saver = get_saver;
+      r.user_key = ExtractUserKey(k);
+      get_arg = &r;
+      get_saver = &SaveRow;
+    }
+    GlobalSeqnoSaver g;
+    if (global_seqno != 0) {
+      g.arg = get_arg;
+      g.saver = get_saver;
+      g.seq = global_seqno;
+      g.lookup_seq = SequenceOf(k);
+      get_arg = &g;
+      get_saver = &SaveGlobalSeqno;
+    }
+    Statistics* stats = options_->statistics;
+    MatchSaver m;
+    m.matched = false;
+    if (stats != NULL && options_->filter_policy != NULL) {
+      m.arg = get_arg;
+      m.saver = get_saver;
+      m.user_key = ExtractUserKey(k);
+      get_arg = &m;
+      get_saver = &SaveMatch;
+    }
+    s = t->InternalGet(options, k, get_arg, get_saver);
+    if (m.matched) {
+      RecordTick(stats, kBloomFilterTruePositive);
+    }
+    if (s.ok() && !r.row.empty()) {
+      std::string* row = new std::string;
+      row->swap(r.row);
+      row_cache->Release(row_cache->Insert(
+          row_key, row, row_key.size() + row->size(), &DeleteRow));
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::MultiGet(const ReadOptions& options,
+                            uint64_t file_number,
+                            uint64_t file_size,
+                            SequenceNumber global_seqno,
+                            int n,
+                            const Slice* keys,
+                            void* const* args,
+                            void (*saver)(void*, const Slice&, const Slice&)) {
   Cache::Handle* handle = NULL;
   Status s = FindTable(file_number, file_size, &handle);
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-    s = t->InternalGet(options, k, arg, saver);
+    void* const* get_args = args;
+    void (*get_saver)(void*, const Slice&, const Slice&) = saver;
+    std::vector<GlobalSeqnoSaver> savers;
+    std::vector<void*> saver_args;
+    if (global_seqno != 0) {
+      savers.resize(n);
+      saver_args.resize(n);
+      for (int i = 0; i < n; i++) {
+        savers[i].arg = get_args[i];
+        savers[i].saver = get_saver;
+        savers[i].seq = global_seqno;
+        savers[i].lookup_seq = SequenceOf(keys[i]);
+        saver_args[i] = &savers[i];
+      }
+      get_args = &saver_args[0];
+      get_saver = &SaveGlobalSeqno;
+    }
+    Statistics* stats = options_->statistics;
+    const bool count_matches = stats != NULL && options_->filter_policy != NULL;
+    std::vector<MatchSaver> matchers;
+    std::vector<void*> matcher_args;
+    if (count_matches) {
+      matchers.resize(n);
+      matcher_args.resize(n);
+      for (int i = 0; i < n; i++) {
+        matchers[i].arg = get_args[i];
+        matchers[i].saver = get_saver;
+        matchers[i].user_key = ExtractUserKey(keys[i]);
+        matchers[i].matched = false;
+        matcher_args[i] = &matchers[i];
+      }
+      get_args = &matcher_args[0];
+      get_saver = &SaveMatch;
+    }
+    s = t->InternalMultiGet(options, n, keys, get_args, get_saver);
+    if (count_matches) {
+      uint64_t matched = 0;
+      for (int i = 0; i < n; i++) {
+        if (matchers[i].matched) {
+          matched++;
+        }
+      }
+      RecordTick(stats, kBloomFilterTruePositive, matched);
+    }
     cache_->Release(handle);
   }
   return s;
@@ -24,26 +24,55 @@ class TableCache {
   ~TableCache();
 
   // Return an iterator for the specified file number (the corresponding
-  // file length must be exactly "file_size" bytes).  If "tableptr" is
-  // non-NULL, also sets "*tableptr" to point to the Table object
-  // underlying the returned iterator, or NULL if no Table object underlies
-  // the returned iterator.  The returned "*tableptr" object is owned by
-  // the cache and should not be deleted, and is valid for as long as the
-  // returned iterator is live.
+  // file length must be exactly "file_size" bytes).  If "global_seqno" is
+  // non-zero, the keys of the file, which are stored with sequence number
+  // zero, carry "global_seqno" instead (see FileMetaData::global_seqno).
+  // If "tableptr" is non-NULL, also sets "*tableptr" to point to the Table
+  // object underlying the returned iterator, or NULL if no Table object
+  // underlies the returned iterator.  The returned "*tableptr" object is
+  // owned by the cache and should not be deleted, and is valid for as long
+  // as the returned iterator is live.
   Iterator* NewIterator(const ReadOptions& options,
                         uint64_t file_number,
                         uint64_t file_size,
+                        SequenceNumber global_seqno,
                         Table** tableptr = NULL);
 
+  // Like NewIterator(), for a compaction to read its input from.  If
+  // Options::use_direct_io_for_compaction is set (and use_direct_reads is
+  // not), the iterator reads through its own Table over a file opened
+  // with Env::NewDirectRandomAccessFile(), both deleted with the iterator.
+  Iterator* NewCompactionIterator(const ReadOptions& options,
+                                  uint64_t file_number,
+                                  uint64_t file_size,
+                                  SequenceNumber global_seqno);
+
   // If a seek to internal key "k" in specified file finds an entry,
-  // call (*handle_result)(arg, found_key, found_value).
+  // call (*handle_result)(arg, found_key, found_value).  "global_seqno" is
+  // as for NewIterator(); a file whose keys are newer than "k" is skipped.
+  // With Options::row_cache set, the entry may come from the row cache,
+  // and entries for the user key of "k" found by reads without a snapshot
+  // are added to it.
+  // REQUIRES: reads without a snapshot look "k" up at the latest sequence
   Status Get(const ReadOptions& options,
              uint64_t file_number,
              uint64_t file_size,
+             SequenceNumber global_seqno,
              const Slice& k,
              void* arg,
              void (*handle_result)(void*, const Slice&, const Slice&));
 
+  // Like Get() for each of the internal keys keys[0,n-1], which must be
+  // sorted, passing args[i] to (*handle_result) for keys[i].
+  Status MultiGet(const ReadOptions& options,
+                  uint64_t file_number,
+                  uint64_t file_size,
+                  SequenceNumber global_seqno,
+                  int n,
+                  const Slice* keys,
+                  void* const* args,
+                  void (*handle_result)(void*, const Slice&, const Slice&));
+
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
@@ -52,7 +81,10 @@ class TableCache {
   const std::string dbname_;
   const Options* options_;
   Cache* cache_;
+  const uint64_t row_cache_id_;  // Prefix of our keys in options_->row_cache
 
+  Status OpenTable(uint64_t file_number, uint64_t file_size, bool direct,
+                   RandomAccessFile** file, Table** table);
   Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
 };
 
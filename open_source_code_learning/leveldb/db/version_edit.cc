@@ -20,7 +20,8 @@ enum Tag {
   kDeletedFile          = 6,
   kNewFile              = 7,
   // 8 was used for large value refs
-  kPrevLogNumber        = 9
+  kPrevLogNumber        = 9,
+  kNewIngestedFile      = 10
 };
 
 void VersionEdit::Clear() {
@@ -84,12 +85,15 @@ void VersionEdit::EncodeTo(std::string* dst) const {
   //把增加的字符串的标识和f属性加入到序列化字符串中
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    PutVarint32(dst, f.global_seqno == 0 ? kNewFile : kNewIngestedFile);
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (f.global_seqno != 0) {
+      PutVarint64(dst, f.global_seqno);
+    }
   }
 }
 
@@ -189,6 +193,7 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         break;
 
       case kNewFile:
+        f.global_seqno = 0;
         if (GetLevel(&input, &level) &&
             GetVarint64(&input, &f.number) &&
             GetVarint64(&input, &f.file_size) &&
@@ -200,6 +205,20 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         }
         break;
 
+      case kNewIngestedFile:
+        if (GetLevel(&input, &level) &&
+            GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest) &&
+            GetVarint64(&input, &f.global_seqno) &&
+            f.global_seqno != 0) {
+          new_files_.push_back(std::make_pair(level, f));
+        } else {
+          msg = "new-ingested-file entry";
+        }
+        break;
+
       default:
         msg = "unknown tag";
         break;
@@ -266,6 +285,10 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.global_seqno != 0) {
+      r.append(" global seq ");
+      AppendNumberTo(&r, f.global_seqno);
+    }
   }
   r.append("\n}\n");
   return r;
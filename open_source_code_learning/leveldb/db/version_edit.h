@@ -25,7 +25,13 @@ struct FileMetaData {
   InternalKey smallest; //SSTable文件的最小key值  // Smallest internal key served by table
   InternalKey largest; //SSTable文件的最大key值  // Largest internal key served by table
 
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) { }
+  // If non-zero, the file was ingested by DB::IngestExternalFile(): its
+  // keys are stored with sequence number zero and are read as having this
+  // sequence number instead.  "smallest" and "largest" carry it already.
+  SequenceNumber global_seqno;
+
+  FileMetaData()
+      : refs(0), allowed_seeks(1 << 30), file_size(0), global_seqno(0) { }
 };
 
 class VersionEdit {
@@ -74,11 +80,24 @@ class VersionEdit {
     new_files_.push_back(std::make_pair(level, f));
   }
 
+  // Add the file described by "f", including its global_seqno, at the
+  // specified level.
+  // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
+  void AddFile(int level, const FileMetaData& f) {
+    AddFile(level, f.number, f.file_size, f.smallest, f.largest);
+    new_files_.back().second.global_seqno = f.global_seqno;
+  }
+
   // Delete the specified "file" from the specified "level".
   void DeleteFile(int level, uint64_t file) {
     deleted_files_.insert(std::make_pair(level, file));
   }
 
+  // The files added by this edit, as (level, file) pairs.
+  const std::vector< std::pair<int, FileMetaData> >& new_files() const {
+    return new_files_;
+  }
+
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(const Slice& src);
 
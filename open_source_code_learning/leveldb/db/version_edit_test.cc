@@ -28,6 +28,13 @@ TEST(VersionEditTest, EncodeDecode) {
     edit.AddFile(3, kBig + 300 + i, kBig + 400 + i,
                  InternalKey("foo", kBig + 500 + i, kTypeValue),
                  InternalKey("zoo", kBig + 600 + i, kTypeDeletion));
+    FileMetaData f;
+    f.number = kBig + 350 + i;
+    f.file_size = kBig + 450 + i;
+    f.smallest = InternalKey("bar", kBig + 550 + i, kTypeValue);
+    f.largest = InternalKey("baz", kBig + 550 + i, kTypeValue);
+    f.global_seqno = kBig + 550 + i;
+    edit.AddFile(2, f);
     edit.DeleteFile(4, kBig + 700 + i);
     edit.SetCompactPointer(i, InternalKey("x", kBig + 900 + i, kTypeValue));
   }
@@ -12,6 +12,7 @@
 #include "db/memtable.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
+#include "leveldb/statistics.h"
 #include "leveldb/table_builder.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
@@ -198,6 +199,7 @@ class Version::LevelFileNumIterator : public Iterator {
     assert(Valid());
     EncodeFixed64(value_buf_, (*flist_)[index_]->number);
     EncodeFixed64(value_buf_+8, (*flist_)[index_]->file_size);
+    EncodeFixed64(value_buf_+16, (*flist_)[index_]->global_seqno);
     return Slice(value_buf_, sizeof(value_buf_));
   }
   virtual Status status() const { return Status::OK(); }
@@ -206,21 +208,38 @@ class Version::LevelFileNumIterator : public Iterator {
   const std::vector<FileMetaData*>* const flist_;
   uint32_t index_;
 
-  // Backing store for value().  Holds the file number and size.
-  mutable char value_buf_[16];
+  // Backing store for value().  Holds the file number, size and global
+  // sequence number.
+  mutable char value_buf_[24];
 };
 
 static Iterator* GetFileIterator(void* arg,
                                  const ReadOptions& options,
                                  const Slice& file_value) {
   TableCache* cache = reinterpret_cast<TableCache*>(arg);
-  if (file_value.size() != 16) {
+  if (file_value.size() != 24) {
     return NewErrorIterator(
         Status::Corruption("FileReader invoked with unexpected value"));
   } else {
     return cache->NewIterator(options,
                               DecodeFixed64(file_value.data()),
-                              DecodeFixed64(file_value.data() + 8));
+                              DecodeFixed64(file_value.data() + 8),
+                              DecodeFixed64(file_value.data() + 16));
+  }
+}
+
+static Iterator* GetCompactionFileIterator(void* arg,
+                                           const ReadOptions& options,
+                                           const Slice& file_value) {
+  TableCache* cache = reinterpret_cast<TableCache*>(arg);
+  if (file_value.size() != 24) {
+    return NewErrorIterator(
+        Status::Corruption("FileReader invoked with unexpected value"));
+  } else {
+    return cache->NewCompactionIterator(options,
+                                        DecodeFixed64(file_value.data()),
+                                        DecodeFixed64(file_value.data() + 8),
+                                        DecodeFixed64(file_value.data() + 16));
   }
 }
 
@@ -237,7 +256,8 @@ void Version::AddIterators(const ReadOptions& options,
   for (size_t i = 0; i < files_[0].size(); i++) {
     iters->push_back(
         vset_->table_cache_->NewIterator(
-            options, files_[0][i]->number, files_[0][i]->file_size));
+            options, files_[0][i]->number, files_[0][i]->file_size,
+            files_[0][i]->global_seqno));
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
@@ -329,6 +349,14 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key,
   }
 }
 
+// Count a lookup that found an entry for its key at "level".
+static void RecordGetHit(Statistics* stats, int level) {
+  if (stats != NULL) {
+    stats->RecordTick(level == 0 ? kGetHitL0 :
+                      level == 1 ? kGetHitL1 : kGetHitL2AndUp, 1);
+  }
+}
+
 Status Version::Get(const ReadOptions& options,
                     const LookupKey& k,
                     std::string* value,
@@ -406,7 +434,7 @@ Status Version::Get(const ReadOptions& options,
       saver.user_key = user_key;
       saver.value = value;
       s = vset_->table_cache_->Get(options, f->number, f->file_size,
-                                   ikey, &saver, SaveValue);
+                                   f->global_seqno, ikey, &saver, SaveValue);
       if (!s.ok()) {
         return s;
       }
@@ -414,8 +442,10 @@ Status Version::Get(const ReadOptions& options,
         case kNotFound:
           break;      // Keep searching in other files
         case kFound:
+          RecordGetHit(vset_->options_->statistics, level);
           return s;
         case kDeleted:
+          RecordGetHit(vset_->options_->statistics, level);
           s = Status::NotFound(Slice());  // Use empty error message for speed
           return s;
         case kCorrupt:
@@ -428,6 +458,273 @@ Status Version::Get(const ReadOptions& options,
   return Status::NotFound(Slice());  // Use an empty error message for speed
 }
 
+namespace {
+// Keys of one round of Version::MultiGet() that are looked up in one table.
+struct MultiGetTask {
+  FileMetaData* file;
+  size_t start;               // Index of the first key in MultiGetRound
+  size_t count;               // Number of keys
+  Status status;
+};
+
+// The tables searched in one round of Version::MultiGet().  Keys are
+// sorted, so the keys of each table are stored next to each other.
+struct MultiGetRound {
+  std::vector<size_t> keys;   // Indices into the caller's keys
+  std::vector<Slice> ikeys;   // Their internal keys
+  std::vector<void*> savers;  // Saver for each key
+  std::vector<MultiGetTask> tasks;
+};
+
+// Tasks of one round that are shared out between the thread running
+// Version::MultiGet() and helpers scheduled on the Env.
+struct MultiGetGroup {
+  const ReadOptions* options;
+  TableCache* table_cache;
+  MultiGetRound* round;
+  const size_t num_tasks;
+
+  // State below is protected by mu
+  port::Mutex mu;
+  port::CondVar cv;              // Signalled when a task finishes
+  size_t next;                   // Index of the next unclaimed task
+  size_t finished;               // Number of tasks run so far
+  int refs;                      // Owner plus helpers that have not run yet
+
+  MultiGetGroup(const ReadOptions* o, TableCache* t, MultiGetRound* r)
+      : options(o), table_cache(t), round(r), num_tasks(r->tasks.size()),
+        cv(&mu), next(0), finished(0), refs(1) { }
+};
+
+// Orders key indices by the internal keys they refer to.
+struct LookupKeyOrder {
+  const InternalKeyComparator* icmp;
+  const std::vector<const LookupKey*>* keys;
+  bool operator()(size_t a, size_t b) const {
+    return icmp->Compare((*keys)[a]->internal_key(),
+                         (*keys)[b]->internal_key()) < 0;
+  }
+};
+}  // namespace
+
+static void RunMultiGetTask(const ReadOptions& options,
+                            TableCache* table_cache,
+                            MultiGetRound* round, size_t t) {
+  MultiGetTask* task = &round->tasks[t];
+  FileMetaData* f = task->file;
+  task->status = table_cache->MultiGet(
+      options, f->number, f->file_size, f->global_seqno,
+      static_cast<int>(task->count),
+      &round->ikeys[task->start], &round->savers[task->start], SaveValue);
+}
+
+static void ShareMultiGetTasks(MultiGetGroup* group) {
+  group->mu.Lock();
+  while (group->next < group->num_tasks) {
+    const size_t t = group->next++;
+    group->mu.Unlock();
+    RunMultiGetTask(*group->options, group->table_cache, group->round, t);
+    group->mu.Lock();
+    group->finished++;
+    group->cv.SignalAll();
+  }
+  group->mu.Unlock();
+}
+
+static void ReleaseMultiGetGroup(MultiGetGroup* group) {
+  group->mu.Lock();
+  const bool last_ref = (--group->refs == 0);
+  group->mu.Unlock();
+  if (last_ref) {
+    delete group;
+  }
+}
+
+static void BGMultiGet(void* arg) {
+  MultiGetGroup* group = reinterpret_cast<MultiGetGroup*>(arg);
+  // Helpers that start after the owner has claimed every task find
+  // nothing to do and never touch the owner's (possibly gone) state.
+  ShareMultiGetTasks(group);
+  ReleaseMultiGetGroup(group);
+}
+
+void Version::MultiGet(const ReadOptions& options,
+                       const std::vector<const LookupKey*>& keys,
+                       const std::vector<std::string*>& values,
+                       const std::vector<Status*>& statuses,
+                       std::vector<GetStats>* stats) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  const size_t n = keys.size();
+  stats->resize(n);
+
+  std::vector<Saver> savers(n);
+  std::vector<FileMetaData*> last_file_read(n);
+  std::vector<int> last_file_read_level(n, -1);
+  std::vector<bool> found(n, false);
+  std::vector<size_t> pending(n);
+  for (size_t i = 0; i < n; i++) {
+    (*stats)[i].seek_file = NULL;
+    (*stats)[i].seek_file_level = -1;
+    last_file_read[i] = NULL;
+    savers[i].ucmp = ucmp;
+    savers[i].user_key = keys[i]->user_key();
+    savers[i].value = values[i];
+    pending[i] = i;
+    // Statuses stay OK until the end, as NotFound() allocates.
+    *statuses[i] = Status();
+  }
+  // Tables are searched with sorted keys so that keys in the same data
+  // block are adjacent.
+  LookupKeyOrder order;
+  order.icmp = &vset_->icmp_;
+  order.keys = &keys;
+  std::sort(pending.begin(), pending.end(), order);
+
+  // As in Get(), a key is searched level-by-level, and from newest to
+  // oldest file within level-0, until some file has an entry for it.
+  MultiGetRound round;
+  round.keys.reserve(n);
+  round.ikeys.reserve(n);
+  round.savers.reserve(n);
+  std::vector<FileMetaData*> tmp;
+  for (int level = 0; level < config::kNumLevels && !pending.empty();
+       level++) {
+    const size_t num_files = files_[level].size();
+    if (num_files == 0) continue;
+
+    // Level-0 files may overlap each other, so they are searched one per
+    // round.  Other levels are searched in one round with a task per file.
+    if (level == 0) {
+      tmp = files_[0];
+      std::sort(tmp.begin(), tmp.end(), NewestFirst);
+    }
+    const size_t rounds = (level == 0) ? tmp.size() : 1;
+    for (size_t r = 0; r < rounds && !pending.empty(); r++) {
+      round.keys.clear();
+      round.ikeys.clear();
+      round.savers.clear();
+      round.tasks.clear();
+      for (size_t p = 0; p < pending.size(); p++) {
+        const size_t i = pending[p];
+        const Slice user_key = keys[i]->user_key();
+        FileMetaData* f;
+        if (level == 0) {
+          f = tmp[r];
+          if (ucmp->Compare(user_key, f->smallest.user_key()) < 0 ||
+              ucmp->Compare(user_key, f->largest.user_key()) > 0) {
+            continue;
+          }
+        } else {
+          uint32_t index = FindFile(vset_->icmp_, files_[level],
+                                    keys[i]->internal_key());
+          if (index >= num_files) continue;
+          f = files_[level][index];
+          if (ucmp->Compare(user_key, f->smallest.user_key()) < 0) {
+            // All of "f" is past any data for user_key
+            continue;
+          }
+        }
+
+        GetStats* st = &(*stats)[i];
+        if (last_file_read[i] != NULL && st->seek_file == NULL) {
+          // We have had more than one seek for this read.  Charge the 1st
+          // file.
+          st->seek_file = last_file_read[i];
+          st->seek_file_level = last_file_read_level[i];
+        }
+        last_file_read[i] = f;
+        last_file_read_level[i] = level;
+
+        if (round.tasks.empty() || round.tasks.back().file != f) {
+          MultiGetTask task;
+          task.file = f;
+          task.start = round.keys.size();
+          task.count = 0;
+          round.tasks.push_back(task);
+        }
+        round.tasks.back().count++;
+        savers[i].state = kNotFound;
+        round.keys.push_back(i);
+        round.ikeys.push_back(keys[i]->internal_key());
+        round.savers.push_back(&savers[i]);
+      }
+      if (round.tasks.empty()) continue;
+
+      const size_t num_tasks = round.tasks.size();
+      const size_t parallelism = vset_->options_->max_multiget_parallelism;
+      const size_t helpers = std::min(num_tasks, parallelism) - 1;
+      if (helpers == 0) {
+        for (size_t t = 0; t < num_tasks; t++) {
+          RunMultiGetTask(options, vset_->table_cache_, &round, t);
+        }
+      } else {
+        // This thread takes part as well, so helpers that are slow to
+        // start only cost parallelism.
+        MultiGetGroup* group =
+            new MultiGetGroup(&options, vset_->table_cache_, &round);
+        group->refs += static_cast<int>(helpers);
+        for (size_t h = 0; h < helpers; h++) {
+          vset_->env_->Schedule(&BGMultiGet, group);
+        }
+        ShareMultiGetTasks(group);
+        group->mu.Lock();
+        while (group->finished < num_tasks) {
+          group->cv.Wait();
+        }
+        group->mu.Unlock();
+        ReleaseMultiGetGroup(group);
+      }
+
+      // Settle the keys that were found, deleted or hit an error; the
+      // rest are searched for in later rounds.
+      std::vector<bool> settled(n, false);
+      for (size_t t = 0; t < num_tasks; t++) {
+        const MultiGetTask& task = round.tasks[t];
+        for (size_t k = task.start; k < task.start + task.count; k++) {
+          const size_t i = round.keys[k];
+          if (!task.status.ok()) {
+            *statuses[i] = task.status;
+            settled[i] = true;
+            continue;
+          }
+          switch (savers[i].state) {
+            case kNotFound:
+              break;      // Keep searching in other files
+            case kFound:
+              RecordGetHit(vset_->options_->statistics, level);
+              found[i] = true;
+              settled[i] = true;
+              break;
+            case kDeleted:
+              RecordGetHit(vset_->options_->statistics, level);
+              settled[i] = true;
+              break;
+            case kCorrupt:
+              *statuses[i] = Status::Corruption("corrupted key for ",
+                                                savers[i].user_key);
+              settled[i] = true;
+              break;
+          }
+        }
+      }
+      size_t remaining = 0;
+      for (size_t p = 0; p < pending.size(); p++) {
+        if (!settled[pending[p]]) {
+          pending[remaining++] = pending[p];
+        }
+      }
+      pending.resize(remaining);
+    }
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    if (!found[i] && statuses[i]->ok()) {
+      // Use an empty error message for speed
+      *statuses[i] = Status::NotFound(Slice());
+    }
+  }
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
   if (f != NULL) {
@@ -830,7 +1127,9 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
   }
 
   edit->SetNextFile(next_file_number_);
-  edit->SetLastSequence(last_sequence_);
+  if (!edit->has_last_sequence_ || edit->last_sequence_ < last_sequence_) {
+    edit->SetLastSequence(last_sequence_);
+  }
 
   Version* v = new Version(this);
   {
@@ -888,6 +1187,9 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
     AppendVersion(v);
     log_number_ = edit->log_number_;
     prev_log_number_ = edit->prev_log_number_;
+    if (edit->last_sequence_ > last_sequence_) {
+      last_sequence_ = edit->last_sequence_;
+    }
   } else {
     delete v;
     if (!new_manifest_file.empty()) {
@@ -1093,6 +1395,7 @@ void VersionSet::Finalize(Version* v) {
           static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
     }
 
+    v->level_scores_[level] = score;
     if (score > best_score) {
       best_level = level;
       best_score = score;
@@ -1123,8 +1426,7 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
   for (int level = 0; level < config::kNumLevels; level++) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
-      const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, *files[i]);
     }
   }
 
@@ -1175,7 +1477,8 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
         // approximate offset of "ikey" within the table.
         Table* tableptr;
         Iterator* iter = table_cache_->NewIterator(
-            ReadOptions(), files[i]->number, files[i]->file_size, &tableptr);
+            ReadOptions(), files[i]->number, files[i]->file_size,
+            files[i]->global_seqno, &tableptr);
         if (tableptr != NULL) {
           result += tableptr->ApproximateOffsetOf(ikey.Encode());
         }
@@ -1263,6 +1566,7 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   ReadOptions options;
   options.verify_checksums = options_->paranoid_checks;
   options.fill_cache = false;
+  options.readahead_size = options_->compaction_readahead_size;
 
   // Level-0 files have to be merged together.  For other levels,
   // we will make a concatenating iterator per level.
@@ -1275,14 +1579,15 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
       if (c->level() + which == 0) {
         const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
-          list[num++] = table_cache_->NewIterator(
-              options, files[i]->number, files[i]->file_size);
+          list[num++] = table_cache_->NewCompactionIterator(
+              options, files[i]->number, files[i]->file_size,
+              files[i]->global_seqno);
         }
       } else {
         // Create concatenating iterator for the files from this level
         list[num++] = NewTwoLevelIterator(
             new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
-            &GetFileIterator, table_cache_, options);
+            &GetCompactionFileIterator, table_cache_, options);
       }
     }
   }
@@ -1293,39 +1598,40 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
 }
 
 Compaction* VersionSet::PickCompaction() {
-  Compaction* c;
-  int level;
+  int level = -1;
 
   // We prefer compactions triggered by too much data in a level over
-  // the compactions triggered by seeks.
-  const bool size_compaction = (current_->compaction_score_ >= 1);
-  const bool seek_compaction = (current_->file_to_compact_ != NULL);
-  if (size_compaction) {
-    level = current_->compaction_level_;
-    assert(level >= 0);
-    assert(level+1 < config::kNumLevels);
-    c = new Compaction(options_, level);
-
-    // Pick the first file that comes after compact_pointer_[level]
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
-        break;
-      }
+  // the compactions triggered by seeks.  Levels are tried from the
+  // highest score down, so that a compaction in progress on the best
+  // level does not keep the other levels that need one waiting.
+  std::vector<std::pair<double, int> > levels;
+  for (int i = 0; i < config::kNumLevels - 1; i++) {
+    if (current_->level_scores_[i] >= 1) {
+      levels.push_back(std::make_pair(-current_->level_scores_[i], i));
+    }
+  }
+  std::sort(levels.begin(), levels.end());
+  std::vector<FileMetaData*> inputs;
+  for (size_t i = 0; i < levels.size(); i++) {
+    if (PickFileToCompact(levels[i].second, &inputs)) {
+      level = levels[i].second;
+      break;
     }
-    if (c->inputs_[0].empty()) {
-      // Wrap-around to the beginning of the key space
-      c->inputs_[0].push_back(current_->files_[level][0]);
+  }
+
+  if (level < 0 && current_->file_to_compact_ != NULL) {
+    inputs.push_back(current_->file_to_compact_);
+    if (InputsInCompaction(current_->file_to_compact_level_, inputs)) {
+      return NULL;
     }
-  } else if (seek_compaction) {
     level = current_->file_to_compact_level_;
-    c = new Compaction(options_, level);
-    c->inputs_[0].push_back(current_->file_to_compact_);
-  } else {
+  }
+  if (level < 0) {
     return NULL;
   }
+  assert(level+1 < config::kNumLevels);
+  Compaction* c = new Compaction(options_, level);
+  c->inputs_[0] = inputs;
 
   c->input_version_ = current_;
   c->input_version_->Ref();
@@ -1346,6 +1652,67 @@ Compaction* VersionSet::PickCompaction() {
   return c;
 }
 
+bool VersionSet::PickFileToCompact(int level,
+                                   std::vector<FileMetaData*>* inputs) {
+  const std::vector<FileMetaData*>& files = current_->files_[level];
+  size_t start = 0;
+  while (start < files.size() && !compact_pointer_[level].empty() &&
+         icmp_.Compare(files[start]->largest.Encode(),
+                       compact_pointer_[level]) <= 0) {
+    start++;
+  }
+  for (size_t i = 0; i < files.size(); i++) {
+    inputs->clear();
+    inputs->push_back(files[(start + i) % files.size()]);
+    if (!InputsInCompaction(level, *inputs)) {
+      return true;
+    }
+  }
+  inputs->clear();
+  return false;
+}
+
+bool VersionSet::RangeInCompaction(int level,
+                                   const InternalKey& smallest,
+                                   const InternalKey& largest) const {
+  const Comparator* ucmp = icmp_.user_comparator();
+  for (std::set<Compaction*>::const_iterator it =
+           compactions_in_progress_.begin();
+       it != compactions_in_progress_.end(); ++it) {
+    const Compaction* c = *it;
+    if (c->level_ != level && c->level_ + 1 != level) {
+      continue;
+    }
+    if (ucmp->Compare(smallest.user_key(), c->largest_.user_key()) <= 0 &&
+        ucmp->Compare(largest.user_key(), c->smallest_.user_key()) >= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool VersionSet::InputsInCompaction(
+    int level, const std::vector<FileMetaData*>& inputs) {
+  if (compactions_in_progress_.empty()) {
+    return false;
+  }
+  InternalKey smallest, largest;
+  GetRange(inputs, &smallest, &largest);
+  std::vector<FileMetaData*> expanded0;
+  if (level == 0) {
+    // Level-0 inputs are later widened to all overlapping files.
+    current_->GetOverlappingInputs(0, &smallest, &largest, &expanded0);
+    GetRange(expanded0, &smallest, &largest);
+  } else {
+    expanded0 = inputs;
+  }
+  std::vector<FileMetaData*> inputs1;
+  current_->GetOverlappingInputs(level + 1, &smallest, &largest, &inputs1);
+  GetRange2(expanded0, inputs1, &smallest, &largest);
+  return RangeInCompaction(level, smallest, largest) ||
+         RangeInCompaction(level + 1, smallest, largest);
+}
+
 void VersionSet::SetupOtherInputs(Compaction* c) {
   const int level = c->level();
   InternalKey smallest, largest;
@@ -1367,7 +1734,8 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
     const int64_t expanded0_size = TotalFileSize(expanded0);
     if (expanded0.size() > c->inputs_[0].size() &&
         inputs1_size + expanded0_size <
-            ExpandedCompactionByteSizeLimit(options_)) {
+            ExpandedCompactionByteSizeLimit(options_) &&
+        !InputsInCompaction(level, expanded0)) {
       InternalKey new_start, new_limit;
       GetRange(expanded0, &new_start, &new_limit);
       std::vector<FileMetaData*> expanded1;
@@ -1405,6 +1773,12 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   // key range next time.
   compact_pointer_[level] = largest.Encode().ToString();
   c->edit_.SetCompactPointer(level, largest);
+
+  // Record the compaction as in progress until it is deleted.
+  c->smallest_ = all_start;
+  c->largest_ = all_limit;
+  c->vset_ = this;
+  compactions_in_progress_.insert(c);
 }
 
 Compaction* VersionSet::CompactRange(
@@ -1444,17 +1818,24 @@ Compaction* VersionSet::CompactRange(
 
 Compaction::Compaction(const Options* options, int level)
     : level_(level),
+      vset_(NULL),
       max_output_file_size_(MaxFileSizeForLevel(options, level)),
-      input_version_(NULL),
-      grandparent_index_(0),
-      seen_key_(false),
-      overlapped_bytes_(0) {
+      input_version_(NULL) {
+}
+
+Compaction::Cursor::Cursor()
+    : grandparent_index(0),
+      seen_key(false),
+      overlapped_bytes(0) {
   for (int i = 0; i < config::kNumLevels; i++) {
-    level_ptrs_[i] = 0;
+    level_ptrs[i] = 0;
   }
 }
 
 Compaction::~Compaction() {
+  if (vset_ != NULL) {
+    vset_->compactions_in_progress_.erase(this);
+  }
   if (input_version_ != NULL) {
     input_version_->Unref();
   }
@@ -1478,13 +1859,14 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
   }
 }
 
-bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
+bool Compaction::IsBaseLevelForKey(const Slice& user_key,
+                                   Cursor* cursor) const {
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
   for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
-    for (; level_ptrs_[lvl] < files.size(); ) {
-      FileMetaData* f = files[level_ptrs_[lvl]];
+    for (; cursor->level_ptrs[lvl] < files.size(); ) {
+      FileMetaData* f = files[cursor->level_ptrs[lvl]];
       if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
         // We've advanced far enough
         if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
@@ -1493,35 +1875,107 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
         }
         break;
       }
-      level_ptrs_[lvl]++;
+      cursor->level_ptrs[lvl]++;
     }
   }
   return true;
 }
 
-bool Compaction::ShouldStopBefore(const Slice& internal_key) {
+bool Compaction::ShouldStopBefore(const Slice& internal_key,
+                                  Cursor* cursor) const {
   const VersionSet* vset = input_version_->vset_;
   // Scan to find earliest grandparent file that contains key.
   const InternalKeyComparator* icmp = &vset->icmp_;
-  while (grandparent_index_ < grandparents_.size() &&
+  while (cursor->grandparent_index < grandparents_.size() &&
       icmp->Compare(internal_key,
-                    grandparents_[grandparent_index_]->largest.Encode()) > 0) {
-    if (seen_key_) {
-      overlapped_bytes_ += grandparents_[grandparent_index_]->file_size;
+                    grandparents_[cursor->grandparent_index]->largest.Encode())
+          > 0) {
+    if (cursor->seen_key) {
+      cursor->overlapped_bytes +=
+          grandparents_[cursor->grandparent_index]->file_size;
     }
-    grandparent_index_++;
+    cursor->grandparent_index++;
   }
-  seen_key_ = true;
+  cursor->seen_key = true;
 
-  if (overlapped_bytes_ > MaxGrandParentOverlapBytes(vset->options_)) {
+  if (cursor->overlapped_bytes > MaxGrandParentOverlapBytes(vset->options_)) {
     // Too much overlap for current output; start new output
-    overlapped_bytes_ = 0;
+    cursor->overlapped_bytes = 0;
     return true;
   } else {
     return false;
   }
 }
 
+namespace {
+struct BoundaryCandidate {
+  Slice user_key;
+  uint64_t bytes;  // Input bytes ending at user_key
+};
+
+struct BoundaryCandidateComparator {
+  const Comparator* user_cmp;
+  bool operator()(const BoundaryCandidate& a,
+                  const BoundaryCandidate& b) const {
+    return user_cmp->Compare(a.user_key, b.user_key) < 0;
+  }
+};
+}  // namespace
+
+void Compaction::GetSubcompactionBoundaries(
+    int max_ranges, std::vector<std::string>* boundaries) const {
+  boundaries->clear();
+  if (max_ranges <= 1 || num_input_files(0) + num_input_files(1) < 2) {
+    return;
+  }
+
+  // Every input file contributes its largest user key as a candidate
+  // split point, weighted by the file's size.
+  const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
+  std::vector<BoundaryCandidate> candidates;
+  uint64_t total_bytes = 0;
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      BoundaryCandidate c;
+      c.user_key = inputs_[which][i]->largest.user_key();
+      c.bytes = inputs_[which][i]->file_size;
+      candidates.push_back(c);
+      total_bytes += c.bytes;
+    }
+  }
+  BoundaryCandidateComparator cmp;
+  cmp.user_cmp = user_cmp;
+  std::sort(candidates.begin(), candidates.end(), cmp);
+
+  // Walk the candidates in key order and cut whenever the bytes seen so
+  // far pass the next multiple of total_bytes / max_ranges.  The largest
+  // candidate is never used since nothing lies beyond it.
+  uint64_t seen_bytes = 0;
+  int next_cut = 1;
+  for (size_t i = 0; i + 1 < candidates.size() && next_cut < max_ranges; i++) {
+    seen_bytes += candidates[i].bytes;
+    if (!boundaries->empty() &&
+        user_cmp->Compare(candidates[i].user_key,
+                          Slice(boundaries->back())) == 0) {
+      continue;
+    }
+    if (seen_bytes * max_ranges >= total_bytes * next_cut) {
+      boundaries->push_back(candidates[i].user_key.ToString());
+      while (next_cut < max_ranges &&
+             seen_bytes * max_ranges >= total_bytes * next_cut) {
+        next_cut++;
+      }
+    }
+  }
+  // A final boundary equal to the largest key would leave the last range
+  // empty.
+  while (!boundaries->empty() &&
+         user_cmp->Compare(Slice(boundaries->back()),
+                           candidates.back().user_key) >= 0) {
+    boundaries->pop_back();
+  }
+}
+
 void Compaction::ReleaseInputs() {
   if (input_version_ != NULL) {
     input_version_->Unref();
@@ -88,6 +88,17 @@ class Version {
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
              GetStats* stats);
 
+  // Like Get() for each keys[i], storing the value in *values[i],
+  // the status in *statuses[i] and the stats in (*stats)[i].  Each
+  // table is searched once for all the keys it may hold, and the tables
+  // of a level are searched by up to Options::max_multiget_parallelism
+  // threads at a time.
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, const std::vector<const LookupKey*>& keys,
+                const std::vector<std::string*>& values,
+                const std::vector<Status*>& statuses,
+                std::vector<GetStats>* stats);
+
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
   // REQUIRES: lock is held
@@ -171,12 +182,20 @@ class Version {
   double compaction_score_;
   int compaction_level_;
 
+  // The compaction score of every level that can be compacted, so that
+  // PickCompaction() can fall back to other levels when the inputs of
+  // the best one are busy.
+  double level_scores_[config::kNumLevels - 1];
+
   explicit Version(VersionSet* vset)
       : vset_(vset), next_(this), prev_(this), refs_(0),
         file_to_compact_(NULL),
         file_to_compact_level_(-1),
         compaction_score_(-1),
         compaction_level_(-1) {
+    for (int level = 0; level < config::kNumLevels - 1; level++) {
+      level_scores_[level] = -1;
+    }
   }
 
   ~Version();
@@ -199,6 +218,8 @@ class VersionSet {
   // Apply *edit to the current version to form a new descriptor that
   // is both saved to persistent state and installed as the new
   // current version.  Will release *mu while actually writing to the file.
+  // If *edit sets a last sequence beyond LastSequence(), it becomes the
+  // last sequence once the new version is installed.
   // REQUIRES: *mu is held on entry.
   // REQUIRES: no other thread concurrently calls LogAndApply()
   Status LogAndApply(VersionEdit* edit, port::Mutex* mu)
@@ -251,9 +272,11 @@ class VersionSet {
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
   // Pick level and inputs for a new compaction.
-  // Returns NULL if there is no compaction to be done.
+  // Returns NULL if there is no compaction to be done, or if every
+  // candidate overlaps a compaction that is still in progress.
   // Otherwise returns a pointer to a heap-allocated object that
   // describes the compaction.  Caller should delete the result.
+  // The compaction counts as in progress until it is deleted.
   Compaction* PickCompaction();
 
   // Return a compaction object for compacting the range [begin,end] in
@@ -269,6 +292,18 @@ class VersionSet {
   // file at a level >= 1.
   int64_t MaxNextLevelOverlappingBytes();
 
+  // Returns true iff a compaction in progress reads from or writes to
+  // "level" somewhere in the user key range of [smallest,largest].
+  bool RangeInCompaction(int level,
+                         const InternalKey& smallest,
+                         const InternalKey& largest) const;
+
+  // Return the number of compactions that have been handed out by
+  // PickCompaction() or CompactRange() and not deleted yet.
+  int NumCompactionsInProgress() const {
+    return compactions_in_progress_.size();
+  }
+
   // Create an iterator that reads over the compaction inputs for "*c".
   // The caller should delete the iterator when no longer needed.
   Iterator* MakeInputIterator(Compaction* c);
@@ -315,6 +350,15 @@ class VersionSet {
 
   void SetupOtherInputs(Compaction* c);
 
+  // Pick the first file of "level" after compact_pointer_[level] whose
+  // compaction would not collide with one in progress, wrapping around
+  // to the beginning of the key space.  Returns false if there is none.
+  bool PickFileToCompact(int level, std::vector<FileMetaData*>* inputs);
+
+  // Returns true iff compacting "inputs" from "level" into "level+1"
+  // would touch a key range used by a compaction in progress.
+  bool InputsInCompaction(int level, const std::vector<FileMetaData*>& inputs);
+
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
 
@@ -345,6 +389,10 @@ class VersionSet {
   // 为了尽量均匀compact每个level，会将每次的compact的end-key作为下一次compact的start-key
   std::string compact_pointer_[config::kNumLevels];
 
+  // Compactions handed out and not deleted yet.  Background threads may
+  // run several of them at once as long as their key ranges are disjoint.
+  std::set<Compaction*> compactions_in_progress_;
+
   // No copying allowed
   VersionSet(const VersionSet&);
   void operator=(const VersionSet&);
@@ -385,14 +433,48 @@ class Compaction {
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
+  // Per-output position used by IsBaseLevelForKey() and ShouldStopBefore().
+  // Both calls rely on keys being presented in increasing order, so every
+  // stream of keys that is compacted independently (e.g. a subcompaction)
+  // needs its own Cursor.
+  struct Cursor {
+    //记录compact时grandparents_中已经overlap的index
+    size_t grandparent_index;  // Index in grandparents_
+    //记录是否已经有key检查overlap
+    bool seen_key;             // Some output key has been seen
+    //记录overlap的累积大小
+    int64_t overlapped_bytes;  // Bytes of overlap between current output
+                               // and grandparent files
+
+    // level_ptrs holds indices into input_version_->levels_: our state
+    // is that we are positioned at one of the file ranges for each
+    // higher level than the ones involved in this compaction (i.e. for
+    // all L >= level_ + 2).
+    // level_ptrs[i]记录了input_version_->levels[i]中，上次比较结束的SSTable的容器下标
+    // compact时，key的遍历是顺序的，所以每次检查从上次检查结束的地方开始
+    size_t level_ptrs[config::kNumLevels];
+
+    Cursor();
+  };
+
   // Returns true if the information we have available guarantees that
   // the compaction is producing data in "level+1" for which no data exists
   // in levels greater than "level+1".
-  bool IsBaseLevelForKey(const Slice& user_key);
+  bool IsBaseLevelForKey(const Slice& user_key, Cursor* cursor) const;
 
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
-  bool ShouldStopBefore(const Slice& internal_key);
+  bool ShouldStopBefore(const Slice& internal_key, Cursor* cursor) const;
+
+  // Split the user key space of the inputs into at most "max_ranges"
+  // ranges of roughly equal input size.  Boundaries are taken from the
+  // largest keys of input files and stored in increasing order in
+  // *boundaries; range i covers the user keys in
+  // (boundaries[i-1], boundaries[i]], with the first and last ranges
+  // unbounded.  Leaves *boundaries empty if the compaction should not
+  // be split.
+  void GetSubcompactionBoundaries(int max_ranges,
+                                  std::vector<std::string>* boundaries) const;
 
   // Release the input version for the compaction, once the compaction
   // is successful.
@@ -405,6 +487,7 @@ class Compaction {
   Compaction(const Options* options, int level);
 
   int level_; //要compact的level
+  VersionSet* vset_; // Non-NULL while listed as in progress in vset_
   uint64_t max_output_file_size_; //生成sstable的最大size(kTargetFileSize)
   Version* input_version_; //compact时当前的version
   VersionEdit edit_; //记录compact过程中的操作
@@ -414,6 +497,10 @@ class Compaction {
   // inputs_[1]为level-n+1的SSTable文件信息
   std::vector<FileMetaData*> inputs_[2];      // The two sets of inputs
 
+  // Range of keys covered by all inputs; set by SetupOtherInputs()
+  InternalKey smallest_;
+  InternalKey largest_;
+
   // State used to check for number of of overlapping grandparent files
   // (parent == level_ + 1, grandparent == level_ + 2)
   // 位于level-n+2，且与compact的key-range有overlap的SSTable
@@ -422,23 +509,6 @@ class Compaction {
   // 为了避免这种情况，compact过程中需要检查与level-n+2中产生的overlap的size并与
   // 阈值 kMaxGrandParentOverlapBytes做比较，以便提前中止compact。
   std::vector<FileMetaData*> grandparents_;
-  //记录compact时grandparents_中已经overlap的index
-  size_t grandparent_index_;  // Index in grandparent_starts_
-  //记录是否已经有key检查overlap
-  bool seen_key_;             // Some output key has been seen
-  //记录overlap的累积大小
-  int64_t overlapped_bytes_;  // Bytes of overlap between current output
-                              // and grandparent files
-
-  // State for implementing IsBaseLevelForKey
-
-  // level_ptrs_ holds indices into input_version_->levels_: our state
-  // is that we are positioned at one of the file ranges for each
-  // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  // level_ptrs_[i]记录了input_version_->levels[i]中，上次比较结束的SSTable的容器下标
-  // compact时，key的遍历是顺序的，所以每次检查从上次检查结束的地方开始
-  size_t level_ptrs_[config::kNumLevels];
 };
 
 }  // namespace leveldb
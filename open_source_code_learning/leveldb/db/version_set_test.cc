@@ -3,6 +3,8 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "db/version_set.h"
+#include "db/table_cache.h"
+#include "leveldb/db.h"
 #include "util/logging.h"
 #include "util/testharness.h"
 #include "util/testutil.h"
@@ -172,6 +174,120 @@ TEST(FindFileTest, OverlappingFiles) {
   ASSERT_TRUE(Overlaps("600", "700"));
 }
 
+class CompactionPickerTest {
+ public:
+  std::string dbname_;
+  Options options_;
+  InternalKeyComparator icmp_;
+  TableCache* table_cache_;
+  VersionSet* vset_;
+  port::Mutex mu_;
+
+  CompactionPickerTest() : icmp_(BytewiseComparator()) {
+    dbname_ = test::TmpDir() + "/compaction_picker_test";
+    DestroyDB(dbname_, options_);
+    options_.create_if_missing = true;
+    DB* db = NULL;
+    ASSERT_OK(DB::Open(options_, dbname_, &db));
+    delete db;
+    table_cache_ = new TableCache(dbname_, &options_, 10);
+    vset_ = new VersionSet(dbname_, &options_, table_cache_, &icmp_);
+    bool save_manifest;
+    ASSERT_OK(vset_->Recover(&save_manifest));
+  }
+
+  ~CompactionPickerTest() {
+    delete vset_;
+    delete table_cache_;
+    DestroyDB(dbname_, options_);
+  }
+
+  // Add a table holding keys "smallest".."largest" to "level".  The
+  // table is never read, so it does not have to exist.
+  void Add(VersionEdit* edit, int level, const char* smallest,
+           const char* largest, uint64_t file_size) {
+    edit->AddFile(level, vset_->NewFileNumber(), file_size,
+                  InternalKey(smallest, 100, kTypeValue),
+                  InternalKey(largest, 100, kTypeValue));
+  }
+
+  void Apply(VersionEdit* edit) {
+    mu_.Lock();
+    ASSERT_OK(vset_->LogAndApply(edit, &mu_));
+    mu_.Unlock();
+  }
+
+  bool InCompaction(int level, const char* smallest, const char* largest) {
+    return vset_->RangeInCompaction(level,
+                                    InternalKey(smallest, 100, kTypeValue),
+                                    InternalKey(largest, 100, kTypeValue));
+  }
+};
+
+TEST(CompactionPickerTest, RangeInCompaction) {
+  // Level-1 is over its 10MB limit.
+  VersionEdit edit;
+  Add(&edit, 1, "a", "c", 8 << 20);
+  Add(&edit, 1, "m", "p", 8 << 20);
+  Add(&edit, 2, "b", "d", 1 << 20);
+  Apply(&edit);
+  ASSERT_TRUE(! InCompaction(1, "a", "z"));
+
+  Compaction* c = vset_->PickCompaction();
+  ASSERT_TRUE(c != NULL);
+  ASSERT_EQ(1, c->level());
+  ASSERT_EQ(1, c->num_input_files(0));
+  ASSERT_EQ(1, c->num_input_files(1));
+  // The compaction covers "a".."d" on levels 1 and 2.
+  ASSERT_TRUE(InCompaction(1, "a", "a"));
+  ASSERT_TRUE(InCompaction(2, "d", "e"));
+  ASSERT_TRUE(! InCompaction(1, "e", "z"));
+  ASSERT_TRUE(! InCompaction(0, "a", "d"));
+  ASSERT_TRUE(! InCompaction(3, "a", "d"));
+
+  // The other level-1 table may be compacted at the same time, but the
+  // first one may not be picked again.
+  Compaction* c2 = vset_->PickCompaction();
+  ASSERT_TRUE(c2 != NULL);
+  ASSERT_EQ(1, c2->level());
+  ASSERT_EQ(1, c2->num_input_files(0));
+  ASSERT_EQ("m", c2->input(0, 0)->smallest.user_key().ToString());
+  ASSERT_TRUE(vset_->PickCompaction() == NULL);
+
+  delete c;
+  ASSERT_TRUE(! InCompaction(2, "a", "d"));
+  ASSERT_TRUE(InCompaction(1, "n", "n"));
+  delete c2;
+  ASSERT_TRUE(! InCompaction(1, "a", "z"));
+}
+
+TEST(CompactionPickerTest, FallBackToOtherLevels) {
+  // Level-0 has the highest score, level-2 also needs a compaction.
+  VersionEdit edit;
+  for (int i = 0; i < 8; i++) {
+    Add(&edit, 0, "a", "c", 1 << 20);
+  }
+  Add(&edit, 1, "b", "e", 1 << 20);
+  Add(&edit, 2, "x", "z", 150 << 20);
+  Apply(&edit);
+
+  // A level-0 compaction takes every level-0 table.
+  Compaction* c0 = vset_->PickCompaction();
+  ASSERT_TRUE(c0 != NULL);
+  ASSERT_EQ(0, c0->level());
+  ASSERT_EQ(8, c0->num_input_files(0));
+  ASSERT_EQ(1, c0->num_input_files(1));
+
+  // Level-2 does not overlap it and is picked next.
+  Compaction* c2 = vset_->PickCompaction();
+  ASSERT_TRUE(c2 != NULL);
+  ASSERT_EQ(2, c2->level());
+  ASSERT_TRUE(vset_->PickCompaction() == NULL);
+
+  delete c2;
+  delete c0;
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -41,6 +41,11 @@ class WriteBatchInternal {
 
   static Status InsertInto(const WriteBatch* batch, MemTable* memtable);
 
+  // Like InsertInto(), but uses MemTable::AddConcurrently() so other
+  // threads may insert into "memtable" at the same time.
+  static Status InsertConcurrentlyInto(const WriteBatch* batch,
+                                       MemTable* memtable);
+
   static void Append(WriteBatch* dst, const WriteBatch* src);
 };
 
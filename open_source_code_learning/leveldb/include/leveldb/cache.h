@@ -10,10 +10,11 @@
 // length strings, may use the length of the string as the charge for
 // the string.
 //
-// A builtin cache implementation with a least-recently-used eviction
-// policy is provided.  Clients may use their own implementations if
-// they want something more sophisticated (like scan-resistance, a
-// custom eviction policy, variable cache sizing, etc.)
+// Builtin cache implementations with a least-recently-used eviction
+// policy and with its CLOCK approximation are provided.  Clients may
+// use their own implementations if they want something more
+// sophisticated (like a custom eviction policy, variable cache sizing,
+// etc.)
 
 #ifndef STORAGE_LEVELDB_INCLUDE_CACHE_H_
 #define STORAGE_LEVELDB_INCLUDE_CACHE_H_
@@ -30,6 +31,25 @@ class LEVELDB_EXPORT Cache;
 // of Cache uses a least-recently-used eviction policy.
 LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity);
 
+// Like NewLRUCache(capacity), but reserves high_pri_pool_ratio of the
+// capacity for entries inserted with Cache::kHighPriority, which are
+// only evicted before other entries once they overflow that pool.
+// REQUIRES: 0 <= high_pri_pool_ratio <= 1
+LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio);
+
+// Create a new cache with a fixed size capacity, split into
+// 2^num_shard_bits independently locked shards.  This implementation
+// approximates least-recently-used eviction with the CLOCK algorithm,
+// which lets Lookup() and Release() run without taking a lock, so it
+// scales better than NewLRUCache() when many threads hit the same
+// entries.  Priorities only set how many sweeps of the clock an entry
+// survives without being looked up: none for kLowPriority, one for
+// kNormalPriority and two for kHighPriority; there is no high priority
+// pool.  It requires 64-bit pointers and falls back to NewLRUCache()
+// elsewhere.
+// REQUIRES: 0 <= num_shard_bits < 20
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity, int num_shard_bits);
+
 class LEVELDB_EXPORT Cache {
  public:
   Cache() { }
@@ -41,6 +61,19 @@ class LEVELDB_EXPORT Cache {
   // Opaque handle to an entry stored in the cache.
   struct Handle { };
 
+  // How readily an entry is evicted relative to the others.
+  enum Priority {
+    // Evicted after all others, up to the high priority pool of the cache.
+    // Used for index and filter blocks.
+    kHighPriority,
+    // Evicted in least-recently-used order.
+    kNormalPriority,
+    // Evicted before all others unless it is looked up again, so that
+    // entries read just once, like the blocks of a scan, do not push
+    // others out.
+    kLowPriority
+  };
+
   // Insert a mapping from key->value into the cache and assign it
   // the specified charge against the total cache capacity.
   //
@@ -53,6 +86,18 @@ class LEVELDB_EXPORT Cache {
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) = 0;
 
+  // Like Insert() above, with a hint of how readily to evict the entry.
+  // The default implementation ignores "priority".
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         Priority priority);
+
+  // Return true if Insert() above evicts kLowPriority entries before the
+  // others.  Tables do not put blocks read with ReadOptions::fill_cache
+  // unset into a cache that returns false.  Default implementation
+  // returns false.
+  virtual bool SupportsPriorities() const { return false; }
+
   // If the cache has no mapping for "key", returns NULL.
   //
   // Else return a handle that corresponds to the mapping.  The caller
@@ -56,6 +56,16 @@ class LEVELDB_EXPORT Comparator {
   // i.e., an implementation of this method that does nothing is correct.
   // 作用类似上面的，但无上端限制
   virtual void FindShortSuccessor(std::string* key) const = 0;
+
+  // Returns the part of "key" that identifies it for point lookups: a
+  // lookup for a key never returns an entry with a different result, and
+  // keys with the same result are adjacent in the order of this
+  // comparator.  Used by data block hash indexes (see
+  // Options::data_block_hash_index).  The result may refer to "key".
+  //
+  // The default returns "key" itself, which is correct as long as only
+  // byte-wise identical keys compare equal.
+  virtual Slice PointLookupKey(const Slice& key) const;
 };
 
 // Return a builtin comparator that uses lexicographic byte-wise
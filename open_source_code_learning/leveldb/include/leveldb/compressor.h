@@ -0,0 +1,107 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Registry of block compressors.  Every block in a table records the
+// compression it was written with in the type byte of its trailer, and
+// readers look the compressor up by that byte, so one table may mix
+// blocks written with different compressors.  Applications may register
+// compressors of their own with RegisterCompressor().
+
+#ifndef STORAGE_LEVELDB_INCLUDE_COMPRESSOR_H_
+#define STORAGE_LEVELDB_INCLUDE_COMPRESSOR_H_
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+// A dictionary shared by the data blocks of a table, prepared by the
+// compressor that uses it.  A table stores at most one dictionary, so it
+// only applies to blocks of the type it was created for.
+class LEVELDB_EXPORT CompressionDict {
+ public:
+  explicit CompressionDict(unsigned char type) : type_(type) { }
+  virtual ~CompressionDict();
+
+  // The type of the blocks this dictionary applies to.
+  unsigned char type() const { return type_; }
+
+ private:
+  unsigned char type_;
+
+  // No copying allowed
+  CompressionDict(const CompressionDict&);
+  void operator=(const CompressionDict&);
+};
+
+class LEVELDB_EXPORT Compressor {
+ public:
+  virtual ~Compressor();
+
+  // The byte stored in the trailer of blocks written by this compressor.
+  virtual unsigned char type() const = 0;
+
+  // The name of the compressor, used in benchmark output.
+  virtual const char* Name() const = 0;
+
+  // Store the compressed form of "input" in *output.  Returns false if
+  // the compressor is not supported by this build.
+  virtual bool Compress(const Slice& input, std::string* output) const = 0;
+
+  // Store the length of the uncompressed form of "input" in *result.
+  // Returns false if "input" does not look like valid compressed data.
+  virtual bool GetUncompressedLength(const Slice& input,
+                                     size_t* result) const = 0;
+
+  // Uncompress "input" into output[0,length-1], where "length" is the
+  // value returned by GetUncompressedLength().  Returns false on error.
+  virtual bool Uncompress(const Slice& input, char* output,
+                          size_t length) const = 0;
+
+  // The remaining methods are only overridden by compressors that support
+  // dictionaries.
+
+  // Train a dictionary of at most "max_bytes" from "samples" and store it
+  // in *dict.  Returns false if dictionaries are not supported or no
+  // useful dictionary could be built.
+  virtual bool TrainDictionary(const std::vector<Slice>& samples,
+                               size_t max_bytes, std::string* dict) const;
+
+  // Prepare "dict" for compressing, respectively uncompressing, blocks.
+  // Returns NULL if dictionaries are not supported.  The result does not
+  // refer to "dict" after this call returns.
+  virtual CompressionDict* NewCompressionDict(const Slice& dict) const;
+  virtual CompressionDict* NewUncompressionDict(const Slice& dict) const;
+
+  // Like Compress() and Uncompress(), using "dict" when it is non-NULL.
+  // "dict" must come from this compressor's NewCompressionDict(),
+  // respectively NewUncompressionDict(), and blocks compressed with a
+  // dictionary must be uncompressed with the same one.
+  virtual bool CompressWithDict(const Slice& input,
+                                const CompressionDict* dict,
+                                std::string* output) const;
+  virtual bool UncompressWithDict(const Slice& input,
+                                  const CompressionDict* dict,
+                                  char* output, size_t length) const;
+};
+
+// Return the compressor for blocks whose trailer holds "type", or NULL if
+// there is none.  kNoCompression never has a compressor.
+LEVELDB_EXPORT const Compressor* GetCompressor(unsigned char type);
+
+// Register "compressor" for blocks whose trailer holds compressor->type(),
+// replacing any built-in compressor for that byte.  Custom compressors
+// should use a byte that no CompressionType uses, and are selected by
+// setting Options::compression to that byte cast to a CompressionType.
+// Tables written with one can only be read by processes that register
+// it too.  Must be called before any table is built or opened, and
+// "compressor" must remain live while the process runs.
+LEVELDB_EXPORT void RegisterCompressor(const Compressor* compressor);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_COMPRESSOR_H_
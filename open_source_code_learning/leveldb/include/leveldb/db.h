@@ -7,6 +7,8 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <string>
+#include <vector>
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
@@ -20,6 +22,7 @@ static const int kMinorVersion = 20;
 struct Options;
 struct ReadOptions;
 struct WriteOptions;
+struct IngestOptions;
 class WriteBatch;
 
 // Abstract handle to particular state of a DB.
@@ -84,6 +87,20 @@ class LEVELDB_EXPORT DB {
   virtual Status Get(const ReadOptions& options,
                      const Slice& key, std::string* value) = 0;
 
+  // Look up every keys[i] as Get() would, storing the status in
+  // (*statuses)[i] and, if it is OK, the value in (*values)[i].  Both
+  // vectors are resized to keys.size().  All keys are read from the same
+  // snapshot: options.snapshot if set, else the current state.
+  //
+  // Unlike a loop over Get(), the implementation may sort the keys,
+  // search each table once for all the keys it may hold, read a data
+  // block once for all the keys in it and read different tables in
+  // parallel (see Options::max_multiget_parallelism).
+  virtual void MultiGet(const ReadOptions& options,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -116,6 +133,8 @@ class LEVELDB_EXPORT DB {
   //     about the internal operation of the DB.
   //  "leveldb.sstables" - returns a multi-line string that describes all
   //     of the sstables that make up the db contents.
+  //  "leveldb.statistics" - returns a multi-line string with the tickers
+  //     and histograms of Options::statistics, if that is set.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
@@ -143,6 +162,16 @@ class LEVELDB_EXPORT DB {
   //    db->CompactRange(NULL, NULL);
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
 
+  // Add the table in file "fname", written by an SstFileWriter with the
+  // same comparator as this database, to the database.  Its entries
+  // become visible at once, atomically, as if written by a single Write()
+  // newer than any before, but are neither logged nor inserted into the
+  // memtable: the file is placed in the deepest level it does not
+  // overlap.  Fails if the file is empty or was not written by an
+  // SstFileWriter.
+  virtual Status IngestExternalFile(const IngestOptions& options,
+                                    const std::string& fname);
+
  private:
   // No copying allowed
   DB(const DB&);
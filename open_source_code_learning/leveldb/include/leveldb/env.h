@@ -87,6 +87,20 @@ class LEVELDB_EXPORT Env {
   virtual Status NewAppendableFile(const std::string& fname,
                                    WritableFile** result);
 
+  // Like NewRandomAccessFile() and NewWritableFile(), but the returned
+  // file bypasses the operating system's page cache where possible, so
+  // that reading or writing a large file once does not evict data that
+  // is read often.  Reads of such a file are never served from mmap.
+  //
+  // The default implementations call NewRandomAccessFile() and
+  // NewWritableFile().  EnvWrapper does not forward these to its target,
+  // so that a wrapper that intercepts NewRandomAccessFile() or
+  // NewWritableFile() still sees every file.
+  virtual Status NewDirectRandomAccessFile(const std::string& fname,
+                                           RandomAccessFile** result);
+  virtual Status NewDirectWritableFile(const std::string& fname,
+                                       WritableFile** result);
+
   // Returns true iff the named file exists.
   virtual bool FileExists(const std::string& fname) = 0;
 
@@ -143,6 +157,13 @@ class LEVELDB_EXPORT Env {
       void (*function)(void* arg),
       void* arg) = 0;
 
+  // Allow up to "number" functions passed to Schedule() to run
+  // concurrently.  Implementations may grow their pool of background
+  // threads lazily but never shrink it, so a smaller value than the
+  // current pool size is ignored.  The default implementation does
+  // nothing.
+  virtual void SetBackgroundThreads(int number);
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -160,6 +181,11 @@ class LEVELDB_EXPORT Env {
   // useful for computing deltas of time.
   virtual uint64_t NowMicros() = 0;
 
+  // Returns the number of nano-seconds since some fixed point in time. Only
+  // useful for computing deltas of time.  The default implementation
+  // multiplies NowMicros() by 1000.
+  virtual uint64_t NowNanos();
+
   // Sleep/delay the thread for the prescribed number of micro-seconds.
   virtual void SleepForMicroseconds(int micros) = 0;
 
@@ -218,6 +244,37 @@ class LEVELDB_EXPORT RandomAccessFile {
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const = 0;
 
+  // Hint that "[offset, offset+n)" is likely to be read soon, so that
+  // the implementation may start reading it in the background.  Must not
+  // block on the data being read.  The default implementation does
+  // nothing.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual void Prefetch(uint64_t offset, size_t n) const;
+
+  // One read of a MultiRead() batch.  The caller fills in the first
+  // three fields; MultiRead() sets "result" and "status" as Read() would.
+  struct ReadRequest {
+    uint64_t offset;
+    size_t n;
+    char* scratch;
+    Slice result;
+    Status status;
+  };
+
+  // Perform the reads of "reqs[0,n-1]", possibly in parallel.  The
+  // default implementation calls Read() for each request in turn.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual void MultiRead(ReadRequest* reqs, int n) const;
+
+  // If the file can be told apart from every other file, including ones
+  // that later take its name or the place it had on disk, store bytes
+  // that identify it in *id and return true.  Caches that outlive the
+  // process key their entries by this.  The default implementation
+  // returns false.
+  virtual bool GetUniqueId(std::string* id) const;
+
  private:
   // No copying allowed
   RandomAccessFile(const RandomAccessFile&);
@@ -285,6 +342,15 @@ LEVELDB_EXPORT Status WriteStringToFile(Env* env, const Slice& data,
 LEVELDB_EXPORT Status ReadFileToString(Env* env, const std::string& fname,
                                        std::string* data);
 
+// Return a new Env that reads and writes files through io_uring:
+// RandomAccessFile::MultiRead() submits a whole batch of reads at once,
+// and WritableFile::Sync() submits the buffered data linked with the
+// fdatasync.  Everything else is done by Env::Default().  On platforms
+// or kernels without io_uring (Linux 5.6 or later) the result behaves
+// exactly like Env::Default().  The caller must delete the result when
+// it is no longer needed.
+LEVELDB_EXPORT Env* NewIoUringEnv();
+
 // An implementation of Env that forwards all calls to another Env.
 // May be useful to clients who wish to override just part of the
 // functionality of another Env.
@@ -330,6 +396,9 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) {
     return target_->Schedule(f, a);
   }
+  void SetBackgroundThreads(int n) {
+    return target_->SetBackgroundThreads(n);
+  }
   void StartThread(void (*f)(void*), void* a) {
     return target_->StartThread(f, a);
   }
@@ -342,6 +411,9 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   uint64_t NowMicros() {
     return target_->NowMicros();
   }
+  uint64_t NowNanos() {
+    return target_->NowNanos();
+  }
   void SleepForMicroseconds(int micros) {
     target_->SleepForMicroseconds(micros);
   }
@@ -65,6 +65,18 @@ class LEVELDB_EXPORT FilterPolicy {
 // FilterPolicy (like NewBloomFilterPolicy) that does not ignore
 // trailing spaces in keys.
 LEVELDB_EXPORT const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
+
+// Return a new filter policy that uses a blocked bloom filter with
+// approximately the specified number of bits per key.  All the bits of a
+// key lie in one 64-byte block, so each lookup touches a single cache line
+// (two if the filter is not aligned) instead of one per probe, at the cost
+// of a slightly higher false positive rate than NewBloomFilterPolicy() for
+// the same bits_per_key.  Filters created by the two policies are not
+// interchangeable.
+//
+// The same caveats as for NewBloomFilterPolicy() apply.
+LEVELDB_EXPORT const FilterPolicy* NewBlockedBloomFilterPolicy(
+    int bits_per_key);
 }
 
 #endif  // STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
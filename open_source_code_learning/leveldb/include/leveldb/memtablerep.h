@@ -0,0 +1,172 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A MemTableRep is the data structure that holds the entries of a
+// memtable.  The memtable encodes each entry into memory it owns and
+// hands the rep a pointer to it; the rep only has to keep the pointers
+// in an order it can search.  Options::memtable_factory picks the rep
+// a DB uses for its memtables.
+//
+// Each entry is the concatenation of:
+//    key_size     : varint32 of internal_key.size()
+//    key bytes    : char[internal_key.size()]
+//    value_size   : varint32 of value.size()
+//    value bytes  : char[value.size()]
+// where an internal key is the user key followed by 8 bytes holding its
+// sequence number and type.
+//
+// Insert() is called by one thread at a time, and may run concurrently
+// with any number of readers.  InsertConcurrently() may also run in
+// several threads at once, but not concurrently with Insert().
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MEMTABLEREP_H_
+#define STORAGE_LEVELDB_INCLUDE_MEMTABLEREP_H_
+
+#include <stddef.h>
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+// Memory for a rep that lives as long as its memtable and counts
+// towards the memtable's size (Options::write_buffer_size).
+class LEVELDB_EXPORT MemTableAllocator {
+ public:
+  MemTableAllocator() { }
+  virtual ~MemTableAllocator();
+
+  // Return "bytes" bytes with the alignment of malloc().
+  // REQUIRES: bytes > 0, no other allocation is in progress
+  virtual char* AllocateAligned(size_t bytes) = 0;
+
+  // Like AllocateAligned(), but may be called by several threads at
+  // once, as InsertConcurrently() may.  Must not run concurrently with
+  // AllocateAligned().
+  virtual char* AllocateAlignedConcurrently(size_t bytes) = 0;
+
+ private:
+  // No copying allowed
+  MemTableAllocator(const MemTableAllocator&);
+  void operator=(const MemTableAllocator&);
+};
+
+class LEVELDB_EXPORT MemTableRep {
+ public:
+  // Orders entries by their internal keys.
+  class KeyComparator {
+   public:
+    virtual ~KeyComparator();
+
+    // Three-way comparison of the entries "a" and "b".
+    virtual int operator()(const char* a, const char* b) const = 0;
+  };
+
+  // Iteration over the entries of a rep in the order of its comparator.
+  class Iterator {
+   public:
+    Iterator() { }
+    virtual ~Iterator();
+
+    virtual bool Valid() const = 0;
+
+    // REQUIRES: Valid()
+    virtual const char* key() const = 0;
+    virtual void Next() = 0;
+    virtual void Prev() = 0;
+
+    // Position at the first entry >= "target", which is an entry or an
+    // encoded internal key without a value.
+    virtual void Seek(const char* target) = 0;
+    virtual void SeekToFirst() = 0;
+    virtual void SeekToLast() = 0;
+
+   private:
+    // No copying allowed
+    Iterator(const Iterator&);
+    void operator=(const Iterator&);
+  };
+
+  MemTableRep() { }
+  virtual ~MemTableRep();
+
+  // Insert "entry", which stays valid for the lifetime of the rep.
+  // REQUIRES: nothing that compares equal to entry is in the rep.
+  virtual void Insert(const char* entry) = 0;
+
+  // Returns true iff InsertConcurrently() is supported.
+  virtual bool SupportsConcurrentInserts() const { return false; }
+
+  // Like Insert(), but may be called by several threads at once.
+  // REQUIRES: SupportsConcurrentInserts()
+  virtual void InsertConcurrently(const char* entry);
+
+  // Return the first entry >= "key", an encoded internal key without a
+  // value, or NULL if there is none.  Reps that partition their entries
+  // may only search the entries that could have the same user key as
+  // "key", and return NULL or an entry with a different user key when
+  // none of them is >= "key".
+  virtual const char* FindGreaterOrEqual(const char* key) = 0;
+
+  // Called once no more entries will be inserted.
+  virtual void MarkReadOnly() { }
+
+  // Memory used by the rep itself, beyond what it allocates from the
+  // memtable's MemTableAllocator.
+  virtual size_t ApproximateMemoryUsage() { return 0; }
+
+  // Return an iterator over all entries.  It sees the entries inserted
+  // before it was created, and may or may not see later ones.  The
+  // caller must delete it before the rep is destroyed.
+  virtual Iterator* NewIterator() = 0;
+
+ private:
+  // No copying allowed
+  MemTableRep(const MemTableRep&);
+  void operator=(const MemTableRep&);
+};
+
+class LEVELDB_EXPORT MemTableRepFactory {
+ public:
+  MemTableRepFactory() { }
+  virtual ~MemTableRepFactory();
+
+  // The name of the rep, for the info log.
+  virtual const char* Name() const = 0;
+
+  // Create a rep that orders entries with "cmp" and may allocate memory
+  // that lives as long as the memtable from "allocator".  Both outlive
+  // the rep.
+  virtual MemTableRep* CreateMemTableRep(
+      const MemTableRep::KeyComparator& cmp,
+      MemTableAllocator* allocator) = 0;
+
+ private:
+  // No copying allowed
+  MemTableRepFactory(const MemTableRepFactory&);
+  void operator=(const MemTableRepFactory&);
+};
+
+// A skiplist over all entries.  This is the default, and the only rep
+// that supports Options::allow_concurrent_memtable_write.
+LEVELDB_EXPORT MemTableRepFactory* NewSkipListRepFactory();
+
+// A hash table of "bucket_count" skiplists, each holding the entries whose
+// user keys begin with the same "prefix_length" bytes (or are shorter and
+// equal).  Point lookups search only one bucket, which is much smaller
+// than the whole memtable when many prefixes are in use, but iterating
+// over the memtable, as range scans and flushes do, merges all of the
+// non-empty buckets.  Suits workloads whose reads are mostly Get()s.
+// REQUIRES: bucket_count > 0
+LEVELDB_EXPORT MemTableRepFactory* NewHashSkipListRepFactory(
+    size_t prefix_length, size_t bucket_count);
+
+// An unsorted vector that inserts by appending and sorts its entries
+// when they are first read after an insert.  Inserts are the cheapest of
+// any rep, but reads that interleave with writes each pay for merging
+// the new entries in.  Suits bulk loads that are not read until they
+// are done.
+LEVELDB_EXPORT MemTableRepFactory* NewVectorRepFactory();
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MEMTABLEREP_H_
@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <stddef.h>
+#include <vector>
 #include "leveldb/export.h"
 
 namespace leveldb {
@@ -15,7 +16,11 @@ class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class MemTableRepFactory;
+class PersistentCache;
+class RateLimiter;
 class Snapshot;
+class Statistics;
 
 // DB contents are stored in a set of blocks, each of which holds a
 // sequence of key,value pairs.  Each block may be compressed before
@@ -25,7 +30,9 @@ enum CompressionType {
   // NOTE: do not change the values of existing entries, as these are
   // part of the persistent format on disk.
   kNoCompression     = 0x0,
-  kSnappyCompression = 0x1
+  kSnappyCompression = 0x1,
+  kZstdCompression   = 0x2,
+  kLZ4Compression    = 0x3
 };
 
 // leveldb启动时的一些配置，通过Options传入。
@@ -80,8 +87,9 @@ struct LEVELDB_EXPORT Options {
   // on disk) before converting to a sorted on-disk file.
   //
   // Larger values increase performance, especially during bulk loads.
-  // Up to two write buffers may be held in memory at the same time,
-  // so you may wish to adjust this parameter to control memory usage.
+  // Up to max_write_buffer_number write buffers may be held in memory at
+  // the same time, so you may wish to adjust this parameter to control
+  // memory usage.
   // Also, a larger write buffer will result in a longer recovery time
   // the next time the database is opened.
   //
@@ -89,6 +97,28 @@ struct LEVELDB_EXPORT Options {
   // memtable的最大size
   size_t write_buffer_size;
 
+  // Maximum number of write buffers held in memory: the one being
+  // written to, and full ones waiting to be written to level-0.  Writes
+  // stall only when all of them are full, so raising this absorbs bursts
+  // that fill write buffers faster than they are flushed.  Write buffers
+  // that are waiting when a flush starts are merged into one table.
+  //
+  // Default: 2
+  int max_write_buffer_number;
+
+  // If non-NULL, use the specified factory to create the data structure
+  // that holds the entries of each write buffer (see memtablerep.h).
+  // If NULL, leveldb uses a skiplist.  Must outlive the DB.
+  //
+  // The hash skiplist rep (NewHashSkipListRepFactory) reports no memory
+  // of its own beyond the entries, so its bucket array does not count
+  // towards write_buffer_size.  Its iterators merge the skiplists of all
+  // non-empty buckets, so each DB::NewIterator() and IngestExternalFile()
+  // overlap check visits every bucket, and every seek seeks each of
+  // them.
+  // Default: NULL
+  MemTableRepFactory* memtable_factory;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
   // one open file per 2MB of working set).
@@ -106,6 +136,36 @@ struct LEVELDB_EXPORT Options {
   // 传入的block数据的cache管理
   Cache* block_cache;
 
+  // If true, the index and filter blocks of tables are kept in block_cache
+  // at Cache::kHighPriority, and count against its capacity, instead of
+  // staying in memory for as long as a table is open.  Create block_cache
+  // with NewLRUCache(capacity, high_pri_pool_ratio) to reserve part of it
+  // for them.
+  //
+  // Default: false
+  bool cache_index_and_filter_blocks;
+
+  // If non-NULL, data blocks that block_cache evicts are kept in this
+  // second, slower cache (e.g. on a local SSD), and blocks that are not
+  // in block_cache are looked up in it before being read from the table.
+  // Only data blocks that pass through block_cache take part, i.e. not
+  // those of tables read through mmap(), not those read with
+  // ReadOptions::fill_cache set to false, and not the index and filter
+  // blocks kept by cache_index_and_filter_blocks.  Must outlive the DB
+  // and block_cache.
+  //
+  // Default: NULL
+  PersistentCache* persistent_cache;
+
+  // If non-NULL, use the specified cache for the results of point lookups
+  // (DB::Get) in tables, keyed by table file and user key, so that a hit
+  // costs a single cache lookup instead of an index and block search.
+  // An entry is charged the size of its key and value.  Entries of tables
+  // that compactions delete are never looked up again, and age out.
+  //
+  // Default: NULL
+  Cache* row_cache;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -123,6 +183,21 @@ struct LEVELDB_EXPORT Options {
   // block中对key做前缀压缩的区间长度
   int block_restart_interval;
 
+  // If true, each data block gets a small hash index from keys (see
+  // Comparator::PointLookupKey) to the restart interval holding them.
+  // Get() then finds its key in a block with a single hash probe instead
+  // of a binary search over the restart points; iterators are unaffected.
+  // The index costs about 1.3 bytes per distinct key, and is left out of
+  // blocks with more than 253 restart points.  Tables written with this
+  // option can not be read by versions of leveldb that predate it.
+  //
+  // Note: with a custom comparator that treats keys that are not
+  // byte-wise identical as equal, the comparator must override
+  // PointLookupKey() accordingly, or Get() may miss keys.
+  //
+  // Default: false
+  bool data_block_hash_index;
+
   // Leveldb will write up to this amount of bytes to a file before
   // switching to a new one.
   // Most clients should leave this parameter alone.  However if your
@@ -150,9 +225,41 @@ struct LEVELDB_EXPORT Options {
   // worth switching to kNoCompression.  Even if the input data is
   // incompressible, the kSnappyCompression implementation will
   // efficiently detect that and will switch to uncompressed mode.
+  // kZstdCompression gives smaller tables at a higher cpu cost, and
+  // kLZ4Compression decompresses faster than snappy.  A compression that
+  // this build does not support is treated like kNoCompression.  Other
+  // compressors can be plugged in with RegisterCompressor() (see
+  // compressor.h).
   // 压缩数据使用的压缩类型（默认支持snappy）
   CompressionType compression;
 
+  // If non-empty, the compression to use for tables written to each
+  // level, overriding "compression".  Levels past the end of the vector
+  // use its last entry.  Tables written by memtable compactions use the
+  // entry for level 0.  For example {kLZ4Compression, kLZ4Compression,
+  // kZstdCompression} keeps the frequently rewritten upper levels cheap
+  // to compress while the bulk of the data in the lower levels is small.
+  //
+  // Default: empty
+  std::vector<CompressionType> compression_per_level;
+
+  // If non-zero, the data blocks of each table are compressed with a
+  // dictionary of at most this many bytes, trained on the first blocks of
+  // the table and stored in the table next to its filter.  This brings
+  // the compression of small, similar values (e.g. short JSON records)
+  // close to that of compressing the whole file, while blocks can still
+  // be read on their own.  Only compressions that support dictionaries
+  // (currently kZstdCompression) use it.  A few KB to 16KB is typical.
+  //
+  // Default: 0 (no dictionary)
+  size_t max_dictionary_bytes;
+
+  // Number of data blocks the dictionary is trained on.  While a table is
+  // being built these blocks are held in memory before being written.
+  //
+  // Default: 32
+  int dictionary_training_blocks;
+
   // EXPERIMENTAL: If true, append to existing MANIFEST and log files
   // when a database is opened.  This can significantly speed up open.
   //
@@ -166,6 +273,103 @@ struct LEVELDB_EXPORT Options {
   // Default: NULL
   const FilterPolicy* filter_policy;
 
+  // If true, the index of each new table, and its filter if
+  // "filter_policy" is set, are split into partitions of about
+  // metadata_block_size bytes.  Only a small top-level index over the
+  // partitions stays in memory while a table is open; partitions are read
+  // on demand and cached in block_cache along with data blocks.  This
+  // bounds the memory used by many large open tables at the cost of an
+  // extra block lookup per read.  Tables written with this option can not
+  // be read by versions of leveldb that predate it.
+  //
+  // Default: false
+  bool partition_index_and_filters;
+
+  // Approximate size of index and filter partitions.  Only used when
+  // partition_index_and_filters is true.
+  //
+  // Default: 4K
+  size_t metadata_block_size;
+
+  // Maximum number of compactions that may run at the same time in
+  // background threads of "env".  Compactions only run concurrently when
+  // they cover disjoint key ranges.  DB::Open() grows the background
+  // thread pool of "env" (see Env::SetBackgroundThreads) to match.
+  //
+  // Default: 1
+  int max_background_compactions;
+
+  // Maximum number of key ranges a single compaction is split into.
+  // Each range is compacted by its own background thread and all
+  // outputs are installed together once every range has finished.
+  // Values above 1 let one large compaction use several cores.
+  //
+  // Default: 1
+  int max_subcompactions;
+
+  // If true, a batch group that has been appended to the log is inserted
+  // into the memtable while the next group is already being logged.
+  // Groups still become visible to readers in sequence order.
+  //
+  // Default: false
+  bool enable_pipelined_write;
+
+  // If true, the writers of a batch group insert their own batches into
+  // the memtable in parallel instead of leaving it all to the group's
+  // leader.  Only has an effect together with enable_pipelined_write,
+  // and with a memtable_factory whose reps support concurrent inserts,
+  // as the default skiplist does.
+  //
+  // Default: false
+  bool allow_concurrent_memtable_write;
+
+  // Maximum number of threads DB::MultiGet() uses to search the tables of
+  // one level for a batch of keys.  The calling thread is joined by up to
+  // max_multiget_parallelism - 1 helpers from the background thread pool
+  // of "env", which DB::Open() grows to match.  Values above 1 help when
+  // the tables are read from a device that serves reads in parallel.
+  //
+  // Default: 1
+  int max_multiget_parallelism;
+
+  // ReadOptions::readahead_size of the iterators compactions read their
+  // inputs with.  Zero disables readahead for compactions.
+  //
+  // Default: 2MB
+  size_t compaction_readahead_size;
+
+  // If true, tables are read with Env::NewDirectRandomAccessFile(),
+  // which bypasses the operating system's page cache, so that blocks
+  // that are not in block_cache are read from the device.  Set
+  // block_cache large enough to hold the blocks that are read often.
+  //
+  // Default: false
+  bool use_direct_reads;
+
+  // If true, compactions read their inputs and write their outputs with
+  // Env::NewDirectRandomAccessFile() and Env::NewDirectWritableFile(),
+  // so that the data they stream through does not evict the page cache
+  // that reads depend on.
+  //
+  // Default: false
+  bool use_direct_io_for_compaction;
+
+  // If non-NULL, compactions and memtable flushes write tables no faster
+  // than this limiter allows (see leveldb/rate_limiter.h).  One limiter
+  // may be shared by several DBs to bound their combined rate.
+  //
+  // Default: NULL
+  RateLimiter* rate_limiter;
+
+  // If non-NULL, the DB counts events such as block cache hits and
+  // filter probes in this object, and with its level at kAll also
+  // records the latency of reads, writes, flushes and compactions (see
+  // leveldb/statistics.h).  Returned by the "leveldb.statistics"
+  // property.
+  //
+  // Default: NULL
+  Statistics* statistics;
+
   // Create an Options object with default values for all fields.
   Options();
 };
@@ -179,7 +383,11 @@ struct LEVELDB_EXPORT ReadOptions {
   bool verify_checksums;
 
   // Should the data read for this iteration be cached in memory?
-  // Callers may wish to set this field to false for bulk scans.
+  // Callers may wish to set this field to false for bulk scans.  If
+  // false and the block cache supports priorities (see
+  // Cache::SupportsPriorities), blocks read are still added to it, but at
+  // Cache::kLowPriority, so that they are evicted before the blocks read
+  // normally unless they are read again.  Other caches are left alone.
   // Default: true
   // 读到的block是否加入block cache
   bool fill_cache;
@@ -192,10 +400,19 @@ struct LEVELDB_EXPORT ReadOptions {
   // 指定读取的SnapShot
   const Snapshot* snapshot;
 
+  // Once an iterator has read a few consecutive blocks of a table, it
+  // asks the file to prefetch the blocks that follow (see
+  // RandomAccessFile::Prefetch) in windows that double in size up to
+  // this many bytes.  Zero disables readahead.  Compactions use
+  // Options::compaction_readahead_size instead.
+  // Default: 256KB
+  size_t readahead_size;
+
   ReadOptions()
       : verify_checksums(false),
         fill_cache(true),
-        snapshot(NULL) {
+        snapshot(NULL),
+        readahead_size(256 * 1024) {
   }
 };
 
@@ -224,6 +441,19 @@ struct LEVELDB_EXPORT WriteOptions {
   }
 };
 
+// Options that control DB::IngestExternalFile()
+struct LEVELDB_EXPORT IngestOptions {
+  // If true, the file is renamed into the database directory instead of
+  // copied, which requires it to be on the same file system.  The file
+  // no longer exists under its old name once ingestion succeeds.
+  // Default: false
+  bool move_file;
+
+  IngestOptions()
+      : move_file(false) {
+  }
+};
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
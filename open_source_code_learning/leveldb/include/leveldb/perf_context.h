@@ -0,0 +1,87 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PerfContext breaks down where the calling thread spent a Get() or an
+// iterator Seek(): memtable search, table cache lookups, filter probes,
+// block reads and decompression, and waiting for the DB mutex.  Unlike
+// Options::statistics, which adds up every thread of every operation, it
+// belongs to one thread, so that a caller can reset it before a single
+// slow operation and read it back afterwards:
+//
+//   leveldb::SetPerfLevel(leveldb::kEnableTime);
+//   leveldb::GetPerfContext()->Reset();
+//   db->Get(leveldb::ReadOptions(), key, &value);
+//   ... leveldb::GetPerfContext()->ToString() ...
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+#define STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+
+#include <stdint.h>
+#include <string>
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+enum PerfLevel {
+  // Record nothing.  The default.
+  kDisable = 0,
+
+  // Record the counters only
+  kEnableCount = 1,
+
+  // Also read the clock around each stage to fill the *_nanos timers
+  kEnableTime = 2
+};
+
+// The level of the calling thread.  Other threads are not affected.
+LEVELDB_EXPORT void SetPerfLevel(PerfLevel level);
+LEVELDB_EXPORT PerfLevel GetPerfLevel();
+
+struct LEVELDB_EXPORT PerfContext {
+  // Set every counter and timer to zero.
+  void Reset();
+
+  // Add the counters and timers of "other" to this one.
+  void Add(const PerfContext& other);
+
+  // "name = value" for each field, separated by ", ".  Fields that are
+  // zero are left out if "exclude_zero" is true.
+  std::string ToString(bool exclude_zero = true) const;
+
+  // Get()
+  uint64_t db_mutex_lock_nanos;          // Waiting to acquire the DB mutex
+  uint64_t get_from_memtable_count;      // Memtables searched
+  uint64_t get_from_memtable_nanos;
+  uint64_t get_from_output_files_nanos;  // Searching tables of all levels
+
+  // Tables
+  uint64_t find_table_nanos;             // TableCache lookups, incl. opens
+  uint64_t table_open_count;             // Tables missing from TableCache
+  uint64_t filter_probe_nanos;
+  uint64_t filter_useful_count;          // Lookups ruled out by a filter
+  uint64_t filter_positive_count;        // Lookups a filter let through
+
+  // Blocks
+  uint64_t block_cache_hit_count;
+  uint64_t block_read_count;             // Blocks read from files
+  uint64_t block_read_byte;
+  uint64_t block_read_nanos;
+  uint64_t block_decompress_count;
+  uint64_t block_decompress_nanos;
+
+  // Iterator Seek()
+  uint64_t seek_on_memtable_count;       // Memtable iterators positioned
+  uint64_t seek_on_memtable_nanos;
+  uint64_t seek_internal_seek_nanos;     // Positioning every child iterator
+  uint64_t find_next_user_entry_nanos;   // Skipping to a visible entry
+  uint64_t internal_key_skipped_count;   // Entries hidden or overwritten
+  uint64_t internal_delete_skipped_count;  // Deletion markers passed
+};
+
+// The PerfContext of the calling thread.
+LEVELDB_EXPORT PerfContext* GetPerfContext();
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
@@ -0,0 +1,61 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PersistentCache is a second tier behind Options::block_cache, kept on
+// a device that is faster than the one the tables live on (e.g. a local
+// SSD in front of network-attached storage).  Blocks that block_cache
+// evicts are handed to it, and reads that miss in block_cache look in it
+// before reading the table.  It has internal synchronization and may be
+// shared by several DBs.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
+#define STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
+
+#include <stdint.h>
+#include <string>
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Env;
+
+class LEVELDB_EXPORT PersistentCache {
+ public:
+  PersistentCache() { }
+
+  // Blocks inserted but not yet stored are written out before the cache
+  // is destroyed.
+  virtual ~PersistentCache();
+
+  // Store a copy of "block" under "key".  May return before the block is
+  // stored, and may drop it, e.g. if stores are falling behind.
+  virtual void Insert(const Slice& key, const Slice& block) = 0;
+
+  // If a block is stored under "key", copy it to *block and return true.
+  // Else return false.
+  virtual bool Lookup(const Slice& key, std::string* block) = 0;
+
+ private:
+  // No copying allowed
+  PersistentCache(const PersistentCache&);
+  void operator=(const PersistentCache&);
+};
+
+// Open a PersistentCache that keeps up to about "capacity" bytes of blocks
+// in log files in the directory "dirname" of "env", which is created if
+// it does not exist.  Blocks stored there by an earlier instance are
+// available again once this returns.  Blocks are written by a background
+// thread, and once the logs exceed "capacity" the oldest is dropped.
+// Each block is checksummed, and one that fails to verify is treated as
+// missing.  On success stores the cache in *result; the caller should
+// delete it when it is no longer needed.
+LEVELDB_EXPORT Status NewPersistentCache(Env* env, const std::string& dirname,
+                                         uint64_t capacity,
+                                         PersistentCache** result);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
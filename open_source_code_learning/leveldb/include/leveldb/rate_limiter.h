@@ -0,0 +1,53 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A RateLimiter bounds the rate at which the background work of a DB
+// (compactions and memtable flushes) writes tables, so that it does not
+// take all of the device's bandwidth from foreground reads.  It has
+// internal synchronization and may be shared by several DBs, which then
+// share its rate.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+#define STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+
+#include <stdint.h>
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT RateLimiter {
+ public:
+  RateLimiter() { }
+  virtual ~RateLimiter();
+
+  // Block until "bytes" more bytes may be written.
+  //
+  // "debt" tells how far the writer's DB has fallen behind on
+  // compactions: 0 while level-0 holds no more files than trigger a
+  // compaction, rising to 1 when there are enough that foreground writes
+  // are being slowed down.  Limiters may raise their rate with it.
+  virtual void Request(int64_t bytes, double debt) = 0;
+
+  // The rate writes are limited to while there is no debt.
+  virtual int64_t GetBytesPerSecond() const = 0;
+  virtual void SetBytesPerSecond(int64_t bytes_per_second) = 0;
+
+ private:
+  // No copying allowed
+  RateLimiter(const RateLimiter&);
+  void operator=(const RateLimiter&);
+};
+
+// Create a token bucket limiter that lets through "bytes_per_second"
+// bytes per second.  If "auto_tune" is true, the rate rises with the
+// debt passed to Request(), up to eight times "bytes_per_second", and
+// writes with a debt of 1 are not limited at all, so that the limiter
+// never holds compactions back far enough to stop foreground writes.
+// REQUIRES: bytes_per_second > 0
+LEVELDB_EXPORT RateLimiter* NewRateLimiter(int64_t bytes_per_second,
+                                           bool auto_tune);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
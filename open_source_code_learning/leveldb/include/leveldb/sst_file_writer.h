@@ -0,0 +1,72 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// SstFileWriter writes a table of sorted key/value pairs outside of any
+// database, for DB::IngestExternalFile() to add to one without passing
+// its contents through the log, the memtable and compactions.
+//
+// Multiple threads can invoke const methods on an SstFileWriter without
+// external synchronization, but if any of the threads may call a
+// non-const method, all threads accessing the same SstFileWriter must use
+// external synchronization.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+#define STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+
+#include <stdint.h>
+#include <string>
+#include "leveldb/export.h"
+#include "leveldb/options.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT SstFileWriter {
+ public:
+  // Write tables with the comparator, filter policy, block size and
+  // compression of "options", which should match the options of the
+  // database the tables will be ingested into.  The comparator must be
+  // the same.
+  explicit SstFileWriter(const Options& options);
+
+  // Deletes an unfinished file.
+  ~SstFileWriter();
+
+  // Create the file "fname" and start writing a table to it.
+  // REQUIRES: Open() has not been called, or Finish() has returned.
+  Status Open(const std::string& fname);
+
+  // Add an entry that sets "key" to "value".
+  // REQUIRES: key is after any previously added key according to
+  // the comparator.
+  Status Put(const Slice& key, const Slice& value);
+
+  // Add an entry that deletes "key" from the database the table is
+  // ingested into.
+  // REQUIRES: key is after any previously added key according to
+  // the comparator.
+  Status Delete(const Slice& key);
+
+  // Finish writing the table and close the file.  A table must hold at
+  // least one entry to be ingested.
+  Status Finish();
+
+  // Number of bytes written so far, or the size of the file once
+  // Finish() has returned.
+  uint64_t FileSize() const;
+
+ private:
+  struct Rep;
+  Rep* rep_;
+
+  Status Add(const Slice& key, const Slice& value, bool deletion);
+
+  // No copying allowed
+  SstFileWriter(const SstFileWriter&);
+  void operator=(const SstFileWriter&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
@@ -0,0 +1,151 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A Statistics object counts events on the hot paths of a DB (tickers)
+// and records the latency distribution of its operations (histograms).
+// Set Options::statistics to collect them; DB::GetProperty() returns them
+// as "leveldb.statistics".  A Statistics object has internal
+// synchronization and may be shared by several DBs, which then add up.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_STATISTICS_H_
+#define STORAGE_LEVELDB_INCLUDE_STATISTICS_H_
+
+#include <stdint.h>
+#include <string>
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+enum Tickers {
+  // Blocks found in Options::block_cache, and blocks that had to be read
+  kBlockCacheHit = 0,
+  kBlockCacheMiss,
+
+  // Blocks found in Options::persistent_cache, and blocks missing from it
+  kPersistentCacheHit,
+  kPersistentCacheMiss,
+
+  // Lookups in a table that its filter ruled out, saving a block read;
+  // lookups it let through; and those of them that found their key.  The
+  // difference of the last two counts the false positives.
+  kBloomFilterUseful,
+  kBloomFilterPositive,
+  kBloomFilterTruePositive,
+
+  // Lookups in a table answered by Options::row_cache, and those that
+  // missed it
+  kRowCacheHit,
+  kRowCacheMiss,
+
+  // Tables found open in the table cache, and tables that had to be opened
+  kTableCacheHit,
+  kTableCacheMiss,
+
+  // Keys looked up by Get() and MultiGet() that a memtable had an entry
+  // for, and keys it had none for
+  kMemTableHit,
+  kMemTableMiss,
+
+  // Keys looked up by Get() and MultiGet() that had an entry in a table
+  // at level 0, at level 1, and at a deeper level
+  kGetHitL0,
+  kGetHitL1,
+  kGetHitL2AndUp,
+
+  // Keys looked up by Get() and MultiGet(), and bytes of values found
+  kNumberKeysRead,
+  kBytesRead,
+
+  // Entries written by Write(), and bytes of the batches holding them
+  kNumberKeysWritten,
+  kBytesWritten,
+
+  // Seeks of the iterators returned by DB::NewIterator()
+  kNumberDBSeek,
+
+  // Bytes of tables written by memtable flushes, and bytes of tables read
+  // and written by compactions.  "leveldb.stats" has them per level.
+  kFlushWriteBytes,
+  kCompactReadBytes,
+  kCompactWriteBytes,
+
+  // Microseconds writes were delayed or stopped waiting for flushes and
+  // compactions
+  kStallMicros,
+
+  kTickerCount
+};
+
+enum Histograms {
+  kDBGetMicros = 0,
+  kDBMultiGetMicros,
+  kDBWriteMicros,
+  kDBSeekMicros,
+  kTableOpenMicros,
+  kFlushMicros,
+  kCompactionMicros,
+
+  kHistogramCount
+};
+
+enum StatsLevel {
+  // Count tickers only.  Cheap enough to leave on in production.
+  kExceptTimers = 0,
+
+  // Also read the clock around operations to fill the histograms
+  kAll = 1
+};
+
+struct LEVELDB_EXPORT HistogramData {
+  uint64_t count;
+  double sum;
+  double average;
+  double median;
+  double percentile95;
+  double percentile99;
+  double max;
+};
+
+class LEVELDB_EXPORT Statistics {
+ public:
+  Statistics() { }
+  virtual ~Statistics();
+
+  virtual void RecordTick(Tickers ticker, uint64_t count) = 0;
+  virtual uint64_t GetTickerCount(Tickers ticker) const = 0;
+
+  // Add a value to a histogram.  Only called while GetStatsLevel()
+  // returns kAll.
+  virtual void MeasureTime(Histograms histogram, uint64_t micros) = 0;
+  virtual void GetHistogramData(Histograms histogram,
+                                HistogramData* data) const = 0;
+
+  virtual StatsLevel GetStatsLevel() const = 0;
+  virtual void SetStatsLevel(StatsLevel level) = 0;
+
+  // Clear every ticker and histogram.
+  virtual void Reset() = 0;
+
+  // One line for each ticker and each non-empty histogram.
+  virtual std::string ToString() const = 0;
+
+  // The name of a ticker or histogram in ToString(),
+  // e.g. "leveldb.block.cache.hit".
+  static const char* TickerName(Tickers ticker);
+  static const char* HistogramName(Histograms histogram);
+
+ private:
+  // No copying allowed
+  Statistics(const Statistics&);
+  void operator=(const Statistics&);
+};
+
+// Create a Statistics object that starts at "level".  Tickers are kept
+// in per-thread shards of atomic counters, so that threads recording
+// them do not contend for cache lines.
+LEVELDB_EXPORT Statistics* NewStatistics(StatsLevel level = kExceptTimers);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_STATISTICS_H_
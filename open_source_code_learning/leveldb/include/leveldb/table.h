@@ -6,13 +6,16 @@
 #define STORAGE_LEVELDB_INCLUDE_TABLE_H_
 
 #include <stdint.h>
+#include "leveldb/cache.h"
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 
 namespace leveldb {
 
 class Block;
+struct BlockContents;
 class BlockHandle;
+class CompressionDict;
 class Footer;
 struct Options;
 class RandomAccessFile;
@@ -63,6 +66,31 @@ class LEVELDB_EXPORT Table {
   explicit Table(Rep* rep) { rep_ = rep; }
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
 
+  // Like BlockReader(), but "arg" is the readahead state of one iterator,
+  // which prefetches ahead of blocks that are read in file order.
+  static Iterator* ReadaheadBlockReader(void*, const ReadOptions&,
+                                        const Slice&);
+  static Iterator* NewBlockIterator(Table* table, const ReadOptions& options,
+                                    const Slice& index_value,
+                                    bool point_lookup);
+  static Iterator* IndexPartitionReader(void*, const ReadOptions&,
+                                        const Slice&);
+  Status GetBlock(const ReadOptions& options, const BlockHandle& handle,
+                  const CompressionDict* dict, Cache::Priority priority,
+                  Block** block, Cache::Handle** cache_handle) const;
+  bool ReadPersistedBlock(const BlockHandle& handle,
+                          BlockContents* contents) const;
+  Block* InsertBlock(const Slice& cache_key, const BlockHandle& handle,
+                     const BlockContents& contents, Cache::Priority priority,
+                     Cache::Handle** cache_handle) const;
+
+  // Set iters[i] to NewBlockIterator(table, options, index_values[i],
+  // true) for each of the n index values.  The blocks that are not in
+  // the block cache are read with a single RandomAccessFile::MultiRead().
+  static void NewBlockIterators(Table* table, const ReadOptions& options,
+                                int n, const Slice* index_values,
+                                Iterator** iters);
+
   // Calls (*handle_result)(arg, ...) with the entry found after a call
   // to Seek(key).  May not make such a call if filter policy says
   // that key is not present.
@@ -72,9 +100,27 @@ class LEVELDB_EXPORT Table {
       void* arg,
       void (*handle_result)(void* arg, const Slice& k, const Slice& v));
 
+  // Like InternalGet() for each of keys[0,n-1], which must be sorted,
+  // passing args[i] for keys[i].  Keys that fall in the same data block
+  // share a single read of that block, and the blocks are read with a
+  // single RandomAccessFile::MultiRead().
+  Status InternalMultiGet(
+      const ReadOptions&, int n, const Slice* keys, void* const* args,
+      void (*handle_result)(void* arg, const Slice& k, const Slice& v));
 
   void ReadMeta(const Footer& footer);
   void ReadFilter(const Slice& filter_handle_value);
+  void ReadCompressionDict(const Slice& dict_handle_value);
+  Iterator* NewIndexBlockIterator(const ReadOptions& options) const;
+  Iterator* NewIndexIterator(const ReadOptions& options) const;
+  BlockContents* GetFilterBlock(const ReadOptions& options,
+                                const BlockHandle& handle,
+                                Cache::Handle** cache_handle) const;
+  void ReleaseFilterBlock(BlockContents* contents,
+                          Cache::Handle* cache_handle) const;
+  bool PartitionMayMatch(const ReadOptions& options,
+                         const Slice& partition_value,
+                         const Slice& key) const;
 
   // No copying allowed
   Table(const Table&);
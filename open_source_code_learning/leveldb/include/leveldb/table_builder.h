@@ -22,6 +22,7 @@ namespace leveldb {
 
 class BlockBuilder;
 class BlockHandle;
+class CompressionDict;
 class WritableFile;
 
 class LEVELDB_EXPORT TableBuilder {
@@ -71,14 +72,21 @@ class LEVELDB_EXPORT TableBuilder {
   // Number of calls to Add() so far.
   uint64_t NumEntries() const;
 
-  // Size of the file generated so far.  If invoked after a successful
-  // Finish() call, returns the size of the final generated file.
+  // Size of the file generated so far, including the uncompressed size of
+  // data blocks held back to train a compression dictionary.  If invoked
+  // after a successful Finish() call, returns the size of the final
+  // generated file.
   uint64_t FileSize() const;
 
  private:
   bool ok() const { return status().ok(); }
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
+  void CompressAndWriteBlock(const Slice& raw, const CompressionDict* dict,
+                             BlockHandle* handle);
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
+  void WriteBufferedBlocks();
+  void AddIndexEntry(const std::string& key, const BlockHandle& handle);
+  void FlushIndexPartition();
 
   struct Rep;
   Rep* rep_;
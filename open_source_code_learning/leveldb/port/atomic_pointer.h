@@ -140,6 +140,13 @@ class AtomicPointer {
     MemoryBarrier();
     rep_ = v;
   }
+  inline bool CompareAndSwap(void* expected, void* v) {
+#if defined(OS_WIN)
+    return InterlockedCompareExchangePointer(&rep_, v, expected) == expected;
+#else
+    return __sync_bool_compare_and_swap(&rep_, expected, v);
+#endif
+  }
 };
 
 // AtomicPointer based on <cstdatomic>
@@ -162,6 +169,9 @@ class AtomicPointer {
   inline void NoBarrier_Store(void* v) {
     rep_.store(v, std::memory_order_relaxed);
   }
+  inline bool CompareAndSwap(void* expected, void* v) {
+    return rep_.compare_exchange_strong(expected, v);
+  }
 };
 
 // Atomic pointer based on sparc memory barriers
@@ -192,6 +202,9 @@ class AtomicPointer {
   }
   inline void* NoBarrier_Load() const { return rep_; }
   inline void NoBarrier_Store(void* v) { rep_ = v; }
+  inline bool CompareAndSwap(void* expected, void* v) {
+    return __sync_bool_compare_and_swap(&rep_, expected, v);
+  }
 };
 
 // Atomic pointer based on ia64 acq/rel
@@ -222,6 +235,9 @@ class AtomicPointer {
   }
   inline void* NoBarrier_Load() const { return rep_; }
   inline void NoBarrier_Store(void* v) { rep_ = v; }
+  inline bool CompareAndSwap(void* expected, void* v) {
+    return __sync_bool_compare_and_swap(&rep_, expected, v);
+  }
 };
 
 // We have neither MemoryBarrier(), nor <atomic>
@@ -230,6 +246,72 @@ class AtomicPointer {
 
 #endif
 
+// AtomicCounter: a 64-bit integer whose loads, stores and additions do
+// not tear, and impose no ordering on other memory accesses.
+#if defined(OS_WIN)
+class AtomicCounter {
+ private:
+  volatile LONGLONG rep_;
+ public:
+  AtomicCounter() { }
+  explicit AtomicCounter(uint64_t v) : rep_(v) { }
+  inline uint64_t NoBarrier_Load() const {
+    return InterlockedCompareExchange64(
+        const_cast<volatile LONGLONG*>(&rep_), 0, 0);
+  }
+  inline void NoBarrier_Store(uint64_t v) {
+    InterlockedExchange64(&rep_, v);
+  }
+  inline uint64_t NoBarrier_FetchAdd(uint64_t delta) {
+    return InterlockedExchangeAdd64(&rep_, delta);
+  }
+};
+
+#elif defined(LEVELDB_ATOMIC_PRESENT)
+class AtomicCounter {
+ private:
+  std::atomic<uint64_t> rep_;
+ public:
+  AtomicCounter() { }
+  explicit AtomicCounter(uint64_t v) : rep_(v) { }
+  inline uint64_t NoBarrier_Load() const {
+    return rep_.load(std::memory_order_relaxed);
+  }
+  inline void NoBarrier_Store(uint64_t v) {
+    rep_.store(v, std::memory_order_relaxed);
+  }
+  inline uint64_t NoBarrier_FetchAdd(uint64_t delta) {
+    return rep_.fetch_add(delta, std::memory_order_relaxed);
+  }
+};
+
+#elif defined(__GNUC__)
+class AtomicCounter {
+ private:
+  uint64_t rep_;
+ public:
+  AtomicCounter() { }
+  explicit AtomicCounter(uint64_t v) : rep_(v) { }
+  // A plain load may tear on 32-bit platforms
+  inline uint64_t NoBarrier_Load() const {
+    return __sync_add_and_fetch(const_cast<uint64_t*>(&rep_), 0);
+  }
+  inline void NoBarrier_Store(uint64_t v) {
+    uint64_t old = rep_;
+    while (!__sync_bool_compare_and_swap(&rep_, old, v)) {
+      old = rep_;
+    }
+  }
+  inline uint64_t NoBarrier_FetchAdd(uint64_t delta) {
+    return __sync_fetch_and_add(&rep_, delta);
+  }
+};
+
+#else
+#error Please implement AtomicCounter for this platform.
+
+#endif
+
 #undef LEVELDB_HAVE_MEMORY_BARRIER
 #undef ARCH_CPU_X86_FAMILY
 #undef ARCH_CPU_ARM_FAMILY
@@ -70,6 +70,11 @@ typedef intptr_t OnceType;
 #define LEVELDB_ONCE_INIT 0
 extern void InitOnce(port::OnceType*, void (*initializer)());
 
+// Storage class of a variable with one instance per thread, e.g.
+//      static LEVELDB_THREAD_LOCAL int counter = 0;
+// Only for types without constructors or destructors.
+#define LEVELDB_THREAD_LOCAL __thread
+
 // A type that holds a pointer that can be read or written atomically
 // (i.e., without word-tearing.)
 class AtomicPointer {
@@ -97,6 +102,34 @@ class AtomicPointer {
 
   // Set va as the stored pointer with no ordering guarantees.
   void NoBarrier_Store(void* v);
+
+  // If the stored pointer equals "expected", replace it with v and
+  // return true.  Otherwise leave it unchanged and return false.  No
+  // memory access by this thread may be reordered across this call.
+  bool CompareAndSwap(void* expected, void* v);
+};
+
+// A 64-bit integer that can be read, written and added to atomically,
+// with no ordering guarantees for other memory accesses.  For counters
+// that many threads update, such as those of Statistics.
+class AtomicCounter {
+ private:
+  uint64_t rep_;
+ public:
+  // Initialize to arbitrary value
+  AtomicCounter();
+
+  // Initialize to hold v
+  explicit AtomicCounter(uint64_t v) : rep_(v) { }
+
+  // Read the stored value.
+  uint64_t NoBarrier_Load() const;
+
+  // Set v as the stored value.
+  void NoBarrier_Store(uint64_t v);
+
+  // Add "delta" to the stored value and return the value before.
+  uint64_t NoBarrier_FetchAdd(uint64_t delta);
 };
 
 // ------------------ Compression -------------------
@@ -122,6 +155,37 @@ extern bool Snappy_GetUncompressedLength(const char* input, size_t length,
 extern bool Snappy_Uncompress(const char* input_data, size_t input_length,
                               char* output);
 
+// Store the zstd compression of "input[0,input_length-1]" in *output.
+// The result records its uncompressed size.  Returns false if zstd is not
+// supported by this port.
+extern bool Zstd_Compress(const char* input, size_t input_length,
+                          std::string* output);
+
+// If input[0,input_length-1] looks like a zstd frame that records its
+// uncompressed size, store that size in *result and return true.  Else
+// return false.
+extern bool Zstd_GetUncompressedLength(const char* input, size_t length,
+                                       size_t* result);
+
+// Attempt to zstd uncompress input[0,input_length-1] into
+// output[0,output_length-1].  Returns true only if the input is valid and
+// uncompresses to exactly output_length bytes.
+extern bool Zstd_Uncompress(const char* input, size_t input_length,
+                            char* output, size_t output_length);
+
+// Store the lz4 block compression of "input[0,input_length-1]" in
+// *output.  Unlike the other formats the result does not record its
+// uncompressed size; callers must store it themselves.  Returns false if
+// lz4 is not supported by this port.
+extern bool LZ4_Compress(const char* input, size_t input_length,
+                         std::string* output);
+
+// Attempt to lz4 uncompress input[0,input_length-1] into
+// output[0,output_length-1].  Returns true only if the input is valid and
+// uncompresses to exactly output_length bytes.
+extern bool LZ4_Uncompress(const char* input, size_t input_length,
+                           char* output, size_t output_length);
+
 // ------------------ Miscellaneous -------------------
 
 // If heap profiling is not supported, returns false.
@@ -135,6 +199,14 @@ extern bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg);
 // the newly extended CRC value (which may also be zero).
 uint32_t AcceleratedCRC32C(uint32_t crc, const char* buf, size_t size);
 
+// Check the first "k" (at most 16) bits selected by "hash" in the 64-byte
+// blocked bloom filter block at "block" (see util/bloom.cc for the
+// layout).
+//
+// Returns -1 if the probe cannot be accelerated, else 1 if all the bits
+// are set and 0 otherwise.
+int AcceleratedBloomProbe(const char* block, uint32_t hash, int k);
+
 }  // namespace port
 }  // namespace leveldb
 
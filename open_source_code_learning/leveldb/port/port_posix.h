@@ -39,12 +39,15 @@
 #endif
 
 #include <pthread.h>
-#if defined(HAVE_CRC32C)
-#include <crc32c/crc32c.h>
-#endif  // defined(HAVE_CRC32C)
 #ifdef HAVE_SNAPPY
 #include <snappy.h>
 #endif  // defined(HAVE_SNAPPY)
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif  // defined(HAVE_ZSTD)
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif  // defined(HAVE_LZ4)
 #include <stdint.h>
 #include <string>
 #include "port/atomic_pointer.h"
@@ -107,6 +110,8 @@ typedef pthread_once_t OnceType;
 #define LEVELDB_ONCE_INIT PTHREAD_ONCE_INIT
 extern void InitOnce(OnceType* once, void (*initializer)());
 
+#define LEVELDB_THREAD_LOCAL __thread
+
 inline bool Snappy_Compress(const char* input, size_t length,
                             ::std::string* output) {
 #ifdef HAVE_SNAPPY
@@ -138,18 +143,88 @@ inline bool Snappy_Uncompress(const char* input, size_t length,
 #endif  // defined(HAVE_SNAPPY)
 }
 
-inline bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg) {
+inline bool Zstd_Compress(const char* input, size_t length,
+                          ::std::string* output) {
+#ifdef HAVE_ZSTD
+  output->resize(ZSTD_compressBound(length));
+  size_t outlen = ZSTD_compress(&(*output)[0], output->size(), input, length,
+                                ZSTD_CLEVEL_DEFAULT);
+  if (ZSTD_isError(outlen)) {
+    return false;
+  }
+  output->resize(outlen);
+  return true;
+#endif  // defined(HAVE_ZSTD)
+
+  return false;
+}
+
+inline bool Zstd_GetUncompressedLength(const char* input, size_t length,
+                                       size_t* result) {
+#ifdef HAVE_ZSTD
+  unsigned long long size = ZSTD_getFrameContentSize(input, length);
+  if (size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR) {
+    return false;
+  }
+  *result = static_cast<size_t>(size);
+  return true;
+#else
   return false;
+#endif  // defined(HAVE_ZSTD)
 }
 
-inline uint32_t AcceleratedCRC32C(uint32_t crc, const char* buf, size_t size) {
-#if defined(HAVE_CRC32C)
-  return ::crc32c::Extend(crc, reinterpret_cast<const uint8_t*>(buf), size);
+inline bool Zstd_Uncompress(const char* input, size_t length,
+                            char* output, size_t output_length) {
+#ifdef HAVE_ZSTD
+  size_t n = ZSTD_decompress(output, output_length, input, length);
+  return !ZSTD_isError(n) && n == output_length;
 #else
-  return 0;
-#endif  // defined(HAVE_CRC32C)
+  return false;
+#endif  // defined(HAVE_ZSTD)
 }
 
+inline bool LZ4_Compress(const char* input, size_t length,
+                         ::std::string* output) {
+#ifdef HAVE_LZ4
+  if (length > LZ4_MAX_INPUT_SIZE) {
+    return false;
+  }
+  output->resize(LZ4_compressBound(static_cast<int>(length)));
+  int outlen = LZ4_compress_default(input, &(*output)[0],
+                                    static_cast<int>(length),
+                                    static_cast<int>(output->size()));
+  if (outlen <= 0) {
+    return false;
+  }
+  output->resize(outlen);
+  return true;
+#endif  // defined(HAVE_LZ4)
+
+  return false;
+}
+
+inline bool LZ4_Uncompress(const char* input, size_t length,
+                           char* output, size_t output_length) {
+#ifdef HAVE_LZ4
+  int n = LZ4_decompress_safe(input, output, static_cast<int>(length),
+                              static_cast<int>(output_length));
+  return n >= 0 && static_cast<size_t>(n) == output_length;
+#else
+  return false;
+#endif  // defined(HAVE_LZ4)
+}
+
+inline bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg) {
+  return false;
+}
+
+// Defined in port_posix_sse.cc.  Returns 0 if neither the crc32c library
+// nor SSE4.2 is available.
+uint32_t AcceleratedCRC32C(uint32_t crc, const char* buf, size_t size);
+
+// Defined in port_posix_avx2.cc.  Returns -1 if AVX2 is not available.
+int AcceleratedBloomProbe(const char* block, uint32_t hash, int k);
+
 }  // namespace port
 }  // namespace leveldb
 
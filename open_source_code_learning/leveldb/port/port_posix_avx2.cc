@@ -0,0 +1,111 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Accelerated probing of blocked bloom filters.  This file is compiled
+// with PLATFORM_AVX2FLAGS (-mavx2 where the compiler supports it) and
+// checks the CPU at runtime before using any AVX2 instruction; see
+// port_posix_sse.cc for the same arrangement for crc32c.
+
+#include "port/port.h"
+
+#include <stdint.h>
+
+#if defined(LEVELDB_PLATFORM_POSIX_AVX2)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__GNUC__)
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+#endif
+
+namespace leveldb {
+namespace port {
+
+#if defined(LEVELDB_PLATFORM_POSIX_AVX2)
+
+namespace {
+
+// Must match kBlockedBloomSalts in util/bloom.cc.
+static const uint32_t kSalts[16] = {
+  0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+  0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u,
+  0x1b873593u, 0xcc9e2d51u, 0x85ebca6bu, 0xc2b2ae35u,
+  0x27d4eb2fu, 0x165667b1u, 0x9e3779b1u, 0x61c88647u,
+};
+
+static bool HasAVX2() {
+#if defined(_MSC_VER)
+  int cpu_info[4];
+  __cpuid(cpu_info, 0);
+  if (cpu_info[0] < 7) return false;
+  __cpuidex(cpu_info, 7, 0);
+  return (cpu_info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__)
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid_max(0, NULL) < 7) return false;
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  return (ebx & (1 << 5)) != 0;
+#else
+  return false;
+#endif
+}
+
+// Check probes [8*group, 8*group+7] of "hash", limited to the first "k"
+// probes, against the block held in "lo" (words 0-7) and "hi" (words
+// 8-15).  Each lane handles one probe: it fetches the word the probe
+// selects from whichever half holds it and tests the selected bit.
+static inline bool CheckProbes(__m256i lo, __m256i hi, __m256i hash,
+                               int group, int k) {
+  const __m256i salts = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(kSalts + 8 * group));
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i used = _mm256_cmpgt_epi32(_mm256_set1_epi32(k - 8 * group),
+                                          lanes);
+  const __m256i product = _mm256_mullo_epi32(hash, salts);
+  // Top 4 bits pick the word; permutevar8x32 only looks at the low 3 bits
+  // of each index, and bit 3 picks the half.
+  const __m256i word = _mm256_srli_epi32(product, 28);
+  const __m256i in_hi = _mm256_cmpgt_epi32(word, _mm256_set1_epi32(7));
+  const __m256i value = _mm256_blendv_epi8(
+      _mm256_permutevar8x32_epi32(lo, word),
+      _mm256_permutevar8x32_epi32(hi, word), in_hi);
+  // The next 5 bits pick the bit within the word.
+  const __m256i bit = _mm256_and_si256(_mm256_srli_epi32(product, 23),
+                                       _mm256_set1_epi32(31));
+  const __m256i mask = _mm256_and_si256(
+      _mm256_sllv_epi32(_mm256_set1_epi32(1), bit), used);
+  return _mm256_testc_si256(value, mask) != 0;
+}
+
+}  // namespace
+
+#endif  // defined(LEVELDB_PLATFORM_POSIX_AVX2)
+
+int AcceleratedBloomProbe(const char* block, uint32_t hash, int k) {
+#if defined(LEVELDB_PLATFORM_POSIX_AVX2)
+  static bool has_avx2 = HasAVX2();
+  if (!has_avx2) {
+    return -1;
+  }
+  // Filters are not aligned, so a block may straddle two cache lines.
+  const __m256i h = _mm256_set1_epi32(static_cast<int>(hash));
+  const __m256i lo = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(block));
+  const __m256i hi = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(block + 32));
+  if (!CheckProbes(lo, hi, h, 0, k)) {
+    return 0;
+  }
+  if (k <= 8) {
+    return 1;
+  }
+  return CheckProbes(lo, hi, h, 1, k) ? 1 : 0;
+#else
+  return -1;
+#endif
+}
+
+}  // namespace port
+}  // namespace leveldb
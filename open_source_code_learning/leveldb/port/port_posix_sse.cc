@@ -0,0 +1,181 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Accelerated crc32c.  This file is compiled with PLATFORM_SSEFLAGS
+// (-msse4.2 where the compiler supports it) so that it may use the SSE4.2
+// crc32 instruction; the CPU is checked at runtime before it is used.
+// Other translation units are built without the flag, so nothing outside
+// the checked path here can end up using SSE4.2 instructions.
+
+#include "port/port.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(HAVE_CRC32C)
+#include <crc32c/crc32c.h>
+#elif defined(LEVELDB_PLATFORM_POSIX_SSE)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__GNUC__)
+#include <cpuid.h>
+#endif
+#include <nmmintrin.h>
+#endif
+
+namespace leveldb {
+namespace port {
+
+#if !defined(HAVE_CRC32C) && defined(LEVELDB_PLATFORM_POSIX_SSE)
+
+namespace {
+
+// Large buffers are processed as three interleaved streams so that the
+// 3-cycle latency of the crc32 instruction is hidden: the streams are
+// independent until their results are combined.  Two stream lengths are
+// used so that both table blocks (~4KB) and large log records benefit.
+static const size_t kLongStream = 8192;
+static const size_t kShortStream = 256;
+
+// Combining streams relies on crc32c (without the initial and final
+// inversion) being linear: crc(c, A || B) == Shift(crc(c, A), |B|) ^
+// crc(0, B), where Shift() appends |B| zero bytes.  A shift by a fixed
+// length is a linear map on 32 bits, stored here as four byte tables.
+struct ShiftTable {
+  uint32_t t[4][256];
+};
+
+static ShiftTable long_shift;
+static ShiftTable short_shift;
+static OnceType shift_tables_once = LEVELDB_ONCE_INIT;
+
+static inline uint32_t Shift(const ShiftTable& table, uint32_t crc) {
+  return table.t[0][crc & 0xff] ^ table.t[1][(crc >> 8) & 0xff] ^
+         table.t[2][(crc >> 16) & 0xff] ^ table.t[3][crc >> 24];
+}
+
+static uint32_t ExtendZeros(uint32_t crc, size_t n) {
+  uint64_t l = crc;
+  for (size_t i = 0; i < n; i += 8) {
+    l = _mm_crc32_u64(l, 0);
+  }
+  return static_cast<uint32_t>(l);
+}
+
+static void InitShiftTable(ShiftTable* table, size_t n) {
+  for (int k = 0; k < 4; k++) {
+    for (uint32_t b = 0; b < 256; b++) {
+      table->t[k][b] = ExtendZeros(b << (8 * k), n);
+    }
+  }
+}
+
+static void InitShiftTables() {
+  InitShiftTable(&long_shift, kLongStream);
+  InitShiftTable(&short_shift, kShortStream);
+}
+
+static inline uint64_t LE_LOAD64(const uint8_t* p) {
+  uint64_t word;
+  memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+// Consume "n" bytes at *p as three streams of n bytes each, updating *l.
+static inline void ExtendThreeStreams(const ShiftTable& table, size_t n,
+                                      const uint8_t** p, uint32_t* l) {
+  const uint8_t* p0 = *p;
+  const uint8_t* p1 = p0 + n;
+  const uint8_t* p2 = p1 + n;
+  uint64_t c0 = *l;
+  uint64_t c1 = 0;
+  uint64_t c2 = 0;
+  for (size_t i = 0; i < n; i += 8) {
+    c0 = _mm_crc32_u64(c0, LE_LOAD64(p0 + i));
+    c1 = _mm_crc32_u64(c1, LE_LOAD64(p1 + i));
+    c2 = _mm_crc32_u64(c2, LE_LOAD64(p2 + i));
+  }
+  uint32_t crc = Shift(table, static_cast<uint32_t>(c0)) ^
+                 static_cast<uint32_t>(c1);
+  *l = Shift(table, crc) ^ static_cast<uint32_t>(c2);
+  *p = p2 + n;
+}
+
+static bool HasSSE42() {
+#if defined(_MSC_VER)
+  int cpu_info[4];
+  __cpuid(cpu_info, 1);
+  return (cpu_info[2] & (1 << 20)) != 0;
+#elif defined(__GNUC__)
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+  return (ecx & (1 << 20)) != 0;
+#else
+  return false;
+#endif
+}
+
+}  // namespace
+
+#endif  // !defined(HAVE_CRC32C) && defined(LEVELDB_PLATFORM_POSIX_SSE)
+
+// For further improvements see Intel publication at:
+// http://download.intel.com/design/intarch/papers/323405.pdf
+uint32_t AcceleratedCRC32C(uint32_t crc, const char* buf, size_t size) {
+#if defined(HAVE_CRC32C)
+  return ::crc32c::Extend(crc, reinterpret_cast<const uint8_t*>(buf), size);
+#elif defined(LEVELDB_PLATFORM_POSIX_SSE)
+  static bool has_sse42 = HasSSE42();
+  if (!has_sse42) {
+    return 0;
+  }
+  InitOnce(&shift_tables_once, &InitShiftTables);
+
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
+  const uint8_t* e = p + size;
+  uint32_t l = crc ^ 0xffffffffu;
+
+#define STEP1 do {                              \
+    l = _mm_crc32_u8(l, *p++);                  \
+} while (0)
+#define STEP8 do {                              \
+    l = static_cast<uint32_t>(                  \
+        _mm_crc32_u64(l, LE_LOAD64(p)));        \
+    p += 8;                                     \
+} while (0)
+
+  // Point x at first 8-byte aligned byte in the buffer.  This might be
+  // past the end of the buffer.
+  const uintptr_t pval = reinterpret_cast<uintptr_t>(p);
+  const uint8_t* x = reinterpret_cast<const uint8_t*>(((pval + 7) >> 3) << 3);
+  if (x <= e) {
+    // Process bytes until p is 8-byte aligned
+    while (p != x) {
+      STEP1;
+    }
+  }
+  while (static_cast<size_t>(e - p) >= 3 * kLongStream) {
+    ExtendThreeStreams(long_shift, kLongStream, &p, &l);
+  }
+  while (static_cast<size_t>(e - p) >= 3 * kShortStream) {
+    ExtendThreeStreams(short_shift, kShortStream, &p, &l);
+  }
+  // Process the remaining 8 bytes at a time
+  while ((e - p) >= 8) {
+    STEP8;
+  }
+  // Process the last few bytes
+  while (p != e) {
+    STEP1;
+  }
+#undef STEP8
+#undef STEP1
+  return l ^ 0xffffffffu;
+#else
+  return 0;
+#endif
+}
+
+}  // namespace port
+}  // namespace leveldb
@@ -9,31 +9,48 @@
 #include <vector>
 #include <algorithm>
 #include "leveldb/comparator.h"
+#include "table/block_builder.h"
 #include "table/format.h"
 #include "util/coding.h"
 #include "util/logging.h"
 
 namespace leveldb {
 
-inline uint32_t Block::NumRestarts() const {
-  assert(size_ >= sizeof(uint32_t));
-  return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
-}
-
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
+      num_restarts_(0),
+      hash_buckets_(NULL),
+      num_buckets_(0),
       owned_(contents.heap_allocated) {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
-  } else {
-    size_t max_restarts_allowed = (size_-sizeof(uint32_t)) / sizeof(uint32_t);
-    if (NumRestarts() > max_restarts_allowed) {
-      // The size is too small for NumRestarts()
+    return;
+  }
+  num_restarts_ = DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+  size_t limit = size_ - sizeof(uint32_t);  // End of the restart array
+  if (num_restarts_ & kBlockHashIndexFlag) {
+    num_restarts_ &= ~kBlockHashIndexFlag;
+    if (limit < sizeof(uint32_t)) {
       size_ = 0;
-    } else {
-      restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+      return;
+    }
+    num_buckets_ = DecodeFixed32(data_ + limit - sizeof(uint32_t));
+    limit -= sizeof(uint32_t);
+    if (num_buckets_ == 0 || num_buckets_ > limit ||
+        num_restarts_ > kMaxHashIndexRestarts) {
+      size_ = 0;
+      return;
     }
+    limit -= num_buckets_;
+    hash_buckets_ = data_ + limit;
+  }
+  size_t max_restarts_allowed = limit / sizeof(uint32_t);
+  if (num_restarts_ > max_restarts_allowed) {
+    // The size is too small for num_restarts_
+    size_ = 0;
+  } else {
+    restart_offset_ = limit - num_restarts_ * sizeof(uint32_t);
   }
 }
 
@@ -79,6 +96,8 @@ class Block::Iter : public Iterator {
   const char* const data_;      // underlying block contents
   uint32_t const restarts_;     // Offset of restart array (list of fixed32)
   uint32_t const num_restarts_; // Number of uint32_t entries in restart array
+  const char* const hash_buckets_;  // Hash index used by Seek(), or NULL
+  uint32_t const num_buckets_;
 
   // current_ is offset in data_ of current entry.  >= restarts_ if !Valid
   uint32_t current_;
@@ -115,11 +134,15 @@ class Block::Iter : public Iterator {
   Iter(const Comparator* comparator,
        const char* data,
        uint32_t restarts,
-       uint32_t num_restarts)
+       uint32_t num_restarts,
+       const char* hash_buckets,
+       uint32_t num_buckets)
       : comparator_(comparator),
         data_(data),
         restarts_(restarts),
         num_restarts_(num_restarts),
+        hash_buckets_(hash_buckets),
+        num_buckets_(num_buckets),
         current_(restarts_),
         restart_index_(num_restarts_) {
     assert(num_restarts_ > 0);
@@ -163,6 +186,10 @@ class Block::Iter : public Iterator {
   }
 
   virtual void Seek(const Slice& target) {
+    if (hash_buckets_ != NULL && SeekWithHashIndex(target)) {
+      return;
+    }
+
     // Binary search in restart array to find the last restart point
     // with a key < target
     uint32_t left = 0;
@@ -215,6 +242,38 @@ class Block::Iter : public Iterator {
   }
 
  private:
+  // Look up the restart interval of target's lookup key in the hash index
+  // and scan from there.  Returns false if the bucket is shared by keys in
+  // different intervals, in which case the caller must binary search.
+  bool SeekWithHashIndex(const Slice& target) {
+    const uint32_t bucket = BlockBuilder::HashIndexBucket(
+        comparator_->PointLookupKey(target), num_buckets_);
+    const uint8_t restart =
+        reinterpret_cast<const uint8_t*>(hash_buckets_)[bucket];
+    if (restart == kHashIndexCollision) {
+      return false;
+    }
+    if (restart == kHashIndexNoEntry) {
+      // No entry has target's lookup key
+      current_ = restarts_;
+      restart_index_ = num_restarts_;
+      return true;
+    }
+    if (restart >= num_restarts_) {
+      CorruptionError();
+      return true;
+    }
+
+    // All entries before the interval are smaller than target, so the
+    // first entry >= target is found by scanning forward, possibly past
+    // the end of the interval.
+    SeekToRestartPoint(restart);
+    while (ParseNextKey() && Compare(key_, target) < 0) {
+      // Keep skipping
+    }
+    return true;
+  }
+
   void CorruptionError() {
     current_ = restarts_;
     restart_index_ = num_restarts_;
@@ -253,15 +312,15 @@ class Block::Iter : public Iterator {
   }
 };
 
-Iterator* Block::NewIterator(const Comparator* cmp) {
+Iterator* Block::NewIterator(const Comparator* cmp, bool point_lookup) {
   if (size_ < sizeof(uint32_t)) {
     return NewErrorIterator(Status::Corruption("bad block contents"));
   }
-  const uint32_t num_restarts = NumRestarts();
-  if (num_restarts == 0) {
+  if (num_restarts_ == 0) {
     return NewEmptyIterator();
   } else {
-    return new Iter(cmp, data_, restart_offset_, num_restarts);
+    return new Iter(cmp, data_, restart_offset_, num_restarts_,
+                    point_lookup ? hash_buckets_ : NULL, num_buckets_);
   }
 }
 
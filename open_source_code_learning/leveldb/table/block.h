@@ -22,14 +22,27 @@ class Block {
   ~Block();
 
   size_t size() const { return size_; }
-  Iterator* NewIterator(const Comparator* comparator);
 
- private:
-  uint32_t NumRestarts() const;
+  // The contents the block was built from, or an empty slice if they
+  // could not be parsed.
+  Slice contents() const { return Slice(data_, size_); }
+
+  // If "point_lookup" is true and the block has a hash index, Seek(target)
+  // uses the index instead of a binary search.  Such an iterator is only
+  // positioned like a normal one if the block has a key with the same
+  // Comparator::PointLookupKey() as target; otherwise it may be left at
+  // any entry or invalid.  Meant for Get()-style lookups, which ignore
+  // entries for other keys.
+  Iterator* NewIterator(const Comparator* comparator,
+                        bool point_lookup = false);
 
+ private:
   const char* data_;
   size_t size_;
+  uint32_t num_restarts_;
   uint32_t restart_offset_;     // Offset in data_ of restart array
+  const char* hash_buckets_;    // Hash index, or NULL if there is none
+  uint32_t num_buckets_;
   bool owned_;                  // Block owns data_[]
 
   // No copying allowed
@@ -25,6 +25,18 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// If Options::data_block_hash_index is set, a hash index is placed between
+// the restart array and num_restarts, and the top bit of num_restarts is
+// set (kBlockHashIndexFlag):
+//     restarts: uint32[num_restarts]
+//     buckets: uint8[num_buckets]
+//     num_buckets: uint32
+//     num_restarts | kBlockHashIndexFlag: uint32
+// A key's bucket is Hash(PointLookupKey(key)) % num_buckets.  It holds
+// the index of the restart interval with the first entry for that lookup
+// key, kHashIndexNoEntry if no key maps to the bucket, or
+// kHashIndexCollision if keys in different intervals do.
 
 #include "table/block_builder.h"
 
@@ -32,15 +44,30 @@
 #include <assert.h>
 #include "leveldb/comparator.h"
 #include "leveldb/table_builder.h"
+#include "table/format.h"
 #include "util/coding.h"
+#include "util/hash.h"
 
 namespace leveldb {
 
+// Buckets per distinct lookup key.  Fewer buckets make collisions, which
+// fall back to binary search, more likely.
+static const double kHashIndexBucketsPerKey = 1.33;
+
+static const uint32_t kHashIndexSeed = 0x5ec1d6b3;
+
+uint32_t BlockBuilder::HashIndexBucket(const Slice& lookup_key,
+                                       uint32_t num_buckets) {
+  return Hash(lookup_key.data(), lookup_key.size(), kHashIndexSeed) %
+         num_buckets;
+}
+
 BlockBuilder::BlockBuilder(const Options* options)
     : options_(options),
       restarts_(),
       counter_(0),
-      finished_(false) {
+      finished_(false),
+      hash_index_(options->data_block_hash_index) {
   assert(options->block_restart_interval >= 1);
   restarts_.push_back(0);       // First restart point is at offset 0
 }
@@ -52,13 +79,21 @@ void BlockBuilder::Reset() {
   counter_ = 0;  //两个Restart节点之间的记录数清零
   finished_ = false; //当前块写未结束
   last_key_.clear();  //last_key清零
+  hash_index_ = options_->data_block_hash_index;
+  lookup_keys_.clear();
 }
 
 size_t BlockBuilder::CurrentSizeEstimate() const {
   //数据容量大小 + Restart数组大小 + Restart数组大小值的大小
-  return (buffer_.size() +                        // Raw data buffer
-          restarts_.size() * sizeof(uint32_t) +   // Restart array
-          sizeof(uint32_t));                      // Restart array length
+  size_t estimate = (buffer_.size() +                 // Raw data buffer
+                     restarts_.size() * sizeof(uint32_t) +  // Restart array
+                     sizeof(uint32_t));                 // Restart array length
+  if (hash_index_) {
+    estimate += static_cast<size_t>(lookup_keys_.size() *
+                                    kHashIndexBucketsPerKey) +
+                sizeof(uint32_t);
+  }
+  return estimate;
 }
 
 Slice BlockBuilder::Finish() {
@@ -67,8 +102,27 @@ Slice BlockBuilder::Finish() {
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
   }
+  uint32_t num_restarts = restarts_.size();
+  if (hash_index_ && !lookup_keys_.empty() &&
+      restarts_.size() <= kMaxHashIndexRestarts) {
+    uint32_t num_buckets = static_cast<uint32_t>(
+        lookup_keys_.size() * kHashIndexBucketsPerKey) | 1;
+    std::string buckets(num_buckets, static_cast<char>(kHashIndexNoEntry));
+    for (size_t i = 0; i < lookup_keys_.size(); i++) {
+      char* bucket = &buckets[lookup_keys_[i].first % num_buckets];
+      const char restart = static_cast<char>(lookup_keys_[i].second);
+      if (*bucket == static_cast<char>(kHashIndexNoEntry)) {
+        *bucket = restart;
+      } else if (*bucket != restart) {
+        *bucket = static_cast<char>(kHashIndexCollision);
+      }
+    }
+    buffer_.append(buckets);
+    PutFixed32(&buffer_, num_buckets);
+    num_restarts |= kBlockHashIndexFlag;
+  }
   //将Restart数组大小添加到buffer_的Restart数组后面
-  PutFixed32(&buffer_, restarts_.size());
+  PutFixed32(&buffer_, num_restarts);
   finished_ = true; //这次数据块写结束
   return Slice(buffer_); //返回数据块的内容
 }
@@ -94,6 +148,19 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
     restarts_.push_back(buffer_.size());
     counter_ = 0;
   }
+
+  // Record the restart interval of the first entry of each lookup key.
+  // Entries with the same lookup key are adjacent.
+  if (hash_index_) {
+    const Comparator* cmp = options_->comparator;
+    const Slice lookup_key = cmp->PointLookupKey(key);
+    if (buffer_.empty() ||
+        lookup_key != cmp->PointLookupKey(last_key_piece)) {
+      lookup_keys_.push_back(std::make_pair(
+          Hash(lookup_key.data(), lookup_key.size(), kHashIndexSeed),
+          static_cast<uint32_t>(restarts_.size() - 1)));
+    }
+  }
   //当前记录和上条记录非共享部分的长度
   const size_t non_shared = key.size() - shared;
 
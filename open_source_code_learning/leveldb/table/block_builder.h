@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_TABLE_BLOCK_BUILDER_H_
 #define STORAGE_LEVELDB_TABLE_BLOCK_BUILDER_H_
 
+#include <utility>
 #include <vector>
 
 #include <stdint.h>
@@ -45,6 +46,11 @@ class BlockBuilder {
     return buffer_.empty();
   }
 
+  // The hash index bucket of a key whose PointLookupKey() is "lookup_key"
+  // in an index of "num_buckets" buckets.
+  static uint32_t HashIndexBucket(const Slice& lookup_key,
+                                  uint32_t num_buckets);
+
  private:
   const Options*        options_;  //option类
   std::string           buffer_;  //这个块的所有数据   // Destination buffer
@@ -52,6 +58,9 @@ class BlockBuilder {
   int                   counter_;  //两个Restart之间记录的条数 // Number of entries emitted since restart
   bool                  finished_;  //是否写完一个块    // Has Finish() been called?
   std::string           last_key_;  //每次写记录的上一条记录
+  bool                  hash_index_;  // Append a hash index to the block?
+  // Hash and restart interval of the first entry of each lookup key
+  std::vector<std::pair<uint32_t, uint32_t> > lookup_keys_;
 
   // No copying allowed
   BlockBuilder(const BlockBuilder&);
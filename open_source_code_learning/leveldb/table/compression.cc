@@ -0,0 +1,344 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/compression.h"
+
+#include <assert.h>
+#if defined(HAVE_ZSTD)
+#include <zdict.h>
+#include <zstd.h>
+#endif  // defined(HAVE_ZSTD)
+#include "port/port.h"
+#include "util/coding.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+CompressionDict::~CompressionDict() { }
+
+Compressor::~Compressor() { }
+
+bool Compressor::TrainDictionary(const std::vector<Slice>& samples,
+                                 size_t max_bytes, std::string* dict) const {
+  return false;
+}
+
+CompressionDict* Compressor::NewCompressionDict(const Slice& dict) const {
+  return NULL;
+}
+
+CompressionDict* Compressor::NewUncompressionDict(const Slice& dict) const {
+  return NULL;
+}
+
+bool Compressor::CompressWithDict(const Slice& input,
+                                  const CompressionDict* dict,
+                                  std::string* output) const {
+  assert(dict == NULL);
+  return Compress(input, output);
+}
+
+bool Compressor::UncompressWithDict(const Slice& input,
+                                    const CompressionDict* dict,
+                                    char* output, size_t length) const {
+  assert(dict == NULL);
+  return Uncompress(input, output, length);
+}
+
+namespace {
+
+class SnappyCompressor : public Compressor {
+ public:
+  virtual unsigned char type() const { return kSnappyCompression; }
+
+  virtual const char* Name() const { return "snappy"; }
+
+  virtual bool Compress(const Slice& input, std::string* output) const {
+    return port::Snappy_Compress(input.data(), input.size(), output);
+  }
+
+  virtual bool GetUncompressedLength(const Slice& input,
+                                     size_t* result) const {
+    return port::Snappy_GetUncompressedLength(input.data(), input.size(),
+                                              result);
+  }
+
+  virtual bool Uncompress(const Slice& input, char* output,
+                          size_t length) const {
+    return port::Snappy_Uncompress(input.data(), input.size(), output);
+  }
+};
+
+#if defined(HAVE_ZSTD)
+
+// Decompression contexts are large and expensive to create, so a few are
+// kept for reuse by readers of tables with a dictionary.  They are not
+// tied to a dictionary.
+static const size_t kMaxPooledContexts = 16;
+static port::OnceType context_pool_once = LEVELDB_ONCE_INIT;
+static port::Mutex* context_pool_mu;
+static std::vector<ZSTD_DCtx*>* context_pool;
+
+static void InitContextPool() {
+  context_pool_mu = new port::Mutex;
+  context_pool = new std::vector<ZSTD_DCtx*>;
+}
+
+static ZSTD_DCtx* AcquireContext() {
+  port::InitOnce(&context_pool_once, InitContextPool);
+  {
+    MutexLock l(context_pool_mu);
+    if (!context_pool->empty()) {
+      ZSTD_DCtx* ctx = context_pool->back();
+      context_pool->pop_back();
+      return ctx;
+    }
+  }
+  return ZSTD_createDCtx();
+}
+
+static void ReleaseContext(ZSTD_DCtx* ctx) {
+  {
+    MutexLock l(context_pool_mu);
+    if (context_pool->size() < kMaxPooledContexts) {
+      context_pool->push_back(ctx);
+      return;
+    }
+  }
+  ZSTD_freeDCtx(ctx);
+}
+
+// Digested form of a dictionary, used by the single thread that builds a
+// table.
+class ZstdCompressionDict : public CompressionDict {
+ public:
+  explicit ZstdCompressionDict(const Slice& dict)
+      : CompressionDict(kZstdCompression),
+        cdict_(ZSTD_createCDict(dict.data(), dict.size(),
+                                ZSTD_CLEVEL_DEFAULT)),
+        cctx_(ZSTD_createCCtx()) {
+  }
+
+  virtual ~ZstdCompressionDict() {
+    ZSTD_freeCCtx(cctx_);
+    ZSTD_freeCDict(cdict_);
+  }
+
+  bool ok() const { return cdict_ != NULL && cctx_ != NULL; }
+
+  bool Compress(const Slice& input, std::string* output) const {
+    output->resize(ZSTD_compressBound(input.size()));
+    size_t outlen = ZSTD_compress_usingCDict(cctx_, &(*output)[0],
+                                             output->size(), input.data(),
+                                             input.size(), cdict_);
+    if (ZSTD_isError(outlen)) {
+      return false;
+    }
+    output->resize(outlen);
+    return true;
+  }
+
+ private:
+  ZSTD_CDict* cdict_;
+  ZSTD_CCtx* cctx_;
+};
+
+// Digested form of a dictionary, shared by all readers of a table.
+class ZstdUncompressionDict : public CompressionDict {
+ public:
+  explicit ZstdUncompressionDict(const Slice& dict)
+      : CompressionDict(kZstdCompression),
+        ddict_(ZSTD_createDDict(dict.data(), dict.size())) {
+  }
+
+  virtual ~ZstdUncompressionDict() {
+    ZSTD_freeDDict(ddict_);
+  }
+
+  bool ok() const { return ddict_ != NULL; }
+
+  bool Uncompress(const Slice& input, char* output, size_t length) const {
+    ZSTD_DCtx* ctx = AcquireContext();
+    if (ctx == NULL) {
+      return false;
+    }
+    size_t n = ZSTD_decompress_usingDDict(ctx, output, length, input.data(),
+                                          input.size(), ddict_);
+    ReleaseContext(ctx);
+    return !ZSTD_isError(n) && n == length;
+  }
+
+ private:
+  ZSTD_DDict* ddict_;
+};
+
+#endif  // defined(HAVE_ZSTD)
+
+class ZstdCompressor : public Compressor {
+ public:
+  virtual unsigned char type() const { return kZstdCompression; }
+
+  virtual const char* Name() const { return "zstd"; }
+
+  virtual bool Compress(const Slice& input, std::string* output) const {
+    return port::Zstd_Compress(input.data(), input.size(), output);
+  }
+
+  virtual bool GetUncompressedLength(const Slice& input,
+                                     size_t* result) const {
+    return port::Zstd_GetUncompressedLength(input.data(), input.size(),
+                                            result);
+  }
+
+  virtual bool Uncompress(const Slice& input, char* output,
+                          size_t length) const {
+    return port::Zstd_Uncompress(input.data(), input.size(), output, length);
+  }
+
+  virtual bool TrainDictionary(const std::vector<Slice>& samples,
+                               size_t max_bytes, std::string* dict) const {
+#if defined(HAVE_ZSTD)
+    if (samples.empty() || max_bytes == 0) {
+      return false;
+    }
+    std::string buffer;
+    std::vector<size_t> sizes;
+    for (size_t i = 0; i < samples.size(); i++) {
+      buffer.append(samples[i].data(), samples[i].size());
+      sizes.push_back(samples[i].size());
+    }
+    dict->resize(max_bytes);
+    size_t n = ZDICT_trainFromBuffer(&(*dict)[0], max_bytes, buffer.data(),
+                                     &sizes[0],
+                                     static_cast<unsigned>(sizes.size()));
+    if (ZDICT_isError(n)) {
+      dict->clear();
+      return false;
+    }
+    dict->resize(n);
+    return true;
+#else
+    return false;
+#endif  // defined(HAVE_ZSTD)
+  }
+
+  virtual CompressionDict* NewCompressionDict(const Slice& dict) const {
+#if defined(HAVE_ZSTD)
+    ZstdCompressionDict* result = new ZstdCompressionDict(dict);
+    if (result->ok()) {
+      return result;
+    }
+    delete result;
+#endif  // defined(HAVE_ZSTD)
+    return NULL;
+  }
+
+  virtual CompressionDict* NewUncompressionDict(const Slice& dict) const {
+#if defined(HAVE_ZSTD)
+    ZstdUncompressionDict* result = new ZstdUncompressionDict(dict);
+    if (result->ok()) {
+      return result;
+    }
+    delete result;
+#endif  // defined(HAVE_ZSTD)
+    return NULL;
+  }
+
+  virtual bool CompressWithDict(const Slice& input,
+                                const CompressionDict* dict,
+                                std::string* output) const {
+#if defined(HAVE_ZSTD)
+    if (dict != NULL) {
+      return static_cast<const ZstdCompressionDict*>(dict)->Compress(input,
+                                                                     output);
+    }
+#endif  // defined(HAVE_ZSTD)
+    return Compress(input, output);
+  }
+
+  virtual bool UncompressWithDict(const Slice& input,
+                                  const CompressionDict* dict,
+                                  char* output, size_t length) const {
+#if defined(HAVE_ZSTD)
+    if (dict != NULL) {
+      return static_cast<const ZstdUncompressionDict*>(dict)->Uncompress(
+          input, output, length);
+    }
+#endif  // defined(HAVE_ZSTD)
+    return Uncompress(input, output, length);
+  }
+};
+
+// LZ4 blocks do not record their uncompressed length, so it is stored as
+// a varint32 prefix:
+//    uncompressed_length: varint32
+//    lz4_block: char[]
+class LZ4Compressor : public Compressor {
+ public:
+  virtual unsigned char type() const { return kLZ4Compression; }
+
+  virtual const char* Name() const { return "lz4"; }
+
+  virtual bool Compress(const Slice& input, std::string* output) const {
+    if (input.size() > 0xffffffffu) {
+      return false;
+    }
+    std::string block;
+    if (!port::LZ4_Compress(input.data(), input.size(), &block)) {
+      return false;
+    }
+    output->clear();
+    PutVarint32(output, static_cast<uint32_t>(input.size()));
+    output->append(block);
+    return true;
+  }
+
+  virtual bool GetUncompressedLength(const Slice& input,
+                                     size_t* result) const {
+    Slice in = input;
+    uint32_t length;
+    if (!GetVarint32(&in, &length)) {
+      return false;
+    }
+    *result = length;
+    return true;
+  }
+
+  virtual bool Uncompress(const Slice& input, char* output,
+                          size_t length) const {
+    Slice in = input;
+    uint32_t expected;
+    if (!GetVarint32(&in, &expected) || expected != length) {
+      return false;
+    }
+    return port::LZ4_Uncompress(in.data(), in.size(), output, length);
+  }
+};
+
+}  // namespace
+
+static port::OnceType once = LEVELDB_ONCE_INIT;
+static const Compressor* compressors[256];
+
+static void InitBuiltinCompressors() {
+  static const SnappyCompressor snappy;
+  static const ZstdCompressor zstd;
+  static const LZ4Compressor lz4;
+  compressors[snappy.type()] = &snappy;
+  compressors[zstd.type()] = &zstd;
+  compressors[lz4.type()] = &lz4;
+}
+
+const Compressor* GetCompressor(unsigned char type) {
+  port::InitOnce(&once, InitBuiltinCompressors);
+  return compressors[type];
+}
+
+void RegisterCompressor(const Compressor* compressor) {
+  assert(compressor->type() != kNoCompression);
+  port::InitOnce(&once, InitBuiltinCompressors);
+  compressors[compressor->type()] = compressor;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,23 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Table format details of block compression.  The compressors themselves
+// are in leveldb/compressor.h.
+
+#ifndef STORAGE_LEVELDB_TABLE_COMPRESSION_H_
+#define STORAGE_LEVELDB_TABLE_COMPRESSION_H_
+
+#include "leveldb/compressor.h"
+#include "leveldb/options.h"
+
+namespace leveldb {
+
+// Name of the meta block that holds the compression dictionary of a
+// table.  The block contains the type of the blocks that use the
+// dictionary followed by the dictionary itself.
+static const char kCompressionDictBlockName[] = "compression.dictionary";
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_COMPRESSION_H_
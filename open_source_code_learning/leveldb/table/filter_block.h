@@ -49,6 +49,36 @@ class FilterBlockBuilder {
   void operator=(const FilterBlockBuilder&);
 };
 
+// A FilterPartitionBuilder is used instead of a FilterBlockBuilder when
+// a table's filter is partitioned along with its index (see
+// Options::partition_index_and_filters).  Each partition is a single
+// filter over the keys of the data blocks that one index partition
+// covers.
+//
+// The sequence of calls to FilterPartitionBuilder must match the regexp:
+//      (AddKey* Finish)*
+class FilterPartitionBuilder {
+ public:
+  explicit FilterPartitionBuilder(const FilterPolicy*);
+
+  void AddKey(const Slice& key);
+
+  // Returns the filter over the keys added since the previous call to
+  // Finish().  The result is valid until the next call to AddKey().
+  Slice Finish();
+
+ private:
+  const FilterPolicy* policy_;
+  std::string keys_;             // Flattened key contents
+  std::vector<size_t> start_;    // Starting index in keys_ of each key
+  std::string result_;           // Filter returned by the last Finish()
+  std::vector<Slice> tmp_keys_;  // policy_->CreateFilter() argument
+
+  // No copying allowed
+  FilterPartitionBuilder(const FilterPartitionBuilder&);
+  void operator=(const FilterPartitionBuilder&);
+};
+
 class FilterBlockReader {
  public:
  // REQUIRES: "contents" and *policy must stay live while *this is live.
@@ -121,6 +121,23 @@ TEST(FilterBlockTest, MultiChunk) {
   ASSERT_TRUE(! reader.KeyMayMatch(9000, "bar"));
 }
 
+TEST(FilterBlockTest, Partitions) {
+  FilterPartitionBuilder builder(&policy_);
+  builder.AddKey("foo");
+  builder.AddKey("bar");
+  const std::string first = builder.Finish().ToString();
+  builder.AddKey("box");
+  const std::string second = builder.Finish().ToString();
+  const std::string empty = builder.Finish().ToString();
+
+  ASSERT_TRUE(policy_.KeyMayMatch("foo", first));
+  ASSERT_TRUE(policy_.KeyMayMatch("bar", first));
+  ASSERT_TRUE(! policy_.KeyMayMatch("box", first));
+  ASSERT_TRUE(policy_.KeyMayMatch("box", second));
+  ASSERT_TRUE(! policy_.KeyMayMatch("foo", second));
+  ASSERT_TRUE(! policy_.KeyMayMatch("foo", empty));
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
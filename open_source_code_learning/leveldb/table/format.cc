@@ -4,11 +4,14 @@
 
 #include "table/format.h"
 
+#include <vector>
 #include "leveldb/env.h"
 #include "port/port.h"
 #include "table/block.h"
+#include "table/compression.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
+#include "util/perf_context_imp.h"
 
 namespace leveldb {
 
@@ -62,24 +65,16 @@ Status Footer::DecodeFrom(Slice* input) {
   return result;
 }
 
-Status ReadBlock(RandomAccessFile* file,
-                 const ReadOptions& options,
-                 const BlockHandle& handle,
-                 BlockContents* result) {
-  result->data = Slice();
-  result->cachable = false;
-  result->heap_allocated = false;
-
-  // Read the block contents as well as the type/crc footer.
-  // See table_builder.cc for the code that built this structure.
+// Check and uncompress a block that was read into "buf", of which the
+// read returned "contents".  Takes ownership of "buf".
+static Status DecodeBlock(Env* env,
+                          const ReadOptions& options,
+                          const BlockHandle& handle,
+                          const CompressionDict* dict,
+                          char* buf,
+                          const Slice& contents,
+                          BlockContents* result) {
   size_t n = static_cast<size_t>(handle.size());
-  char* buf = new char[n + kBlockTrailerSize];
-  Slice contents;
-  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
-  if (!s.ok()) {
-    delete[] buf;
-    return s;
-  }
   if (contents.size() != n + kBlockTrailerSize) {
     delete[] buf;
     return Status::Corruption("truncated block read");
@@ -92,7 +87,7 @@ Status ReadBlock(RandomAccessFile* file,
     const uint32_t actual = crc32c::Value(data, n + 1);
     if (actual != crc) {
       delete[] buf;
-      s = Status::Corruption("block checksum mismatch");
+      Status s = Status::Corruption("block checksum mismatch");
       return s;
     }
   }
@@ -115,14 +110,29 @@ Status ReadBlock(RandomAccessFile* file,
 
       // Ok
       break;
-    case kSnappyCompression: {
+    default: {
+      const Compressor* compressor =
+          GetCompressor(static_cast<unsigned char>(data[n]));
+      if (compressor == NULL) {
+        delete[] buf;
+        return Status::Corruption("bad block type");
+      }
+      const Slice compressed(data, n);
       size_t ulength = 0;
-      if (!port::Snappy_GetUncompressedLength(data, n, &ulength)) {
+      if (!compressor->GetUncompressedLength(compressed, &ulength)) {
         delete[] buf;
         return Status::Corruption("corrupted compressed block contents");
       }
       char* ubuf = new char[ulength];
-      if (!port::Snappy_Uncompress(data, n, ubuf)) {
+      if (dict != NULL && dict->type() != compressor->type()) {
+        dict = NULL;
+      }
+      PerfCount(&PerfContext::block_decompress_count);
+      PerfTimer timer(env, &PerfContext::block_decompress_nanos);
+      const bool ok =
+          compressor->UncompressWithDict(compressed, dict, ubuf, ulength);
+      timer.Stop();
+      if (!ok) {
         delete[] buf;
         delete[] ubuf;
         return Status::Corruption("corrupted compressed block contents");
@@ -133,12 +143,69 @@ Status ReadBlock(RandomAccessFile* file,
       result->cachable = true;
       break;
     }
-    default:
-      delete[] buf;
-      return Status::Corruption("bad block type");
   }
 
   return Status::OK();
 }
 
+Status ReadBlock(RandomAccessFile* file,
+                 Env* env,
+                 const ReadOptions& options,
+                 const BlockHandle& handle,
+                 const CompressionDict* dict,
+                 BlockContents* result) {
+  result->data = Slice();
+  result->cachable = false;
+  result->heap_allocated = false;
+
+  // Read the block contents as well as the type/crc footer.
+  // See table_builder.cc for the code that built this structure.
+  size_t n = static_cast<size_t>(handle.size());
+  char* buf = new char[n + kBlockTrailerSize];
+  Slice contents;
+  PerfCount(&PerfContext::block_read_count);
+  PerfCount(&PerfContext::block_read_byte, n + kBlockTrailerSize);
+  PerfTimer timer(env, &PerfContext::block_read_nanos);
+  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
+  timer.Stop();
+  if (!s.ok()) {
+    delete[] buf;
+    return s;
+  }
+  return DecodeBlock(env, options, handle, dict, buf, contents, result);
+}
+
+void ReadBlocks(RandomAccessFile* file,
+                Env* env,
+                const ReadOptions& options,
+                const BlockHandle* handles,
+                int n,
+                const CompressionDict* dict,
+                BlockContents* results,
+                Status* statuses) {
+  std::vector<RandomAccessFile::ReadRequest> reqs(n);
+  for (int i = 0; i < n; i++) {
+    results[i].data = Slice();
+    results[i].cachable = false;
+    results[i].heap_allocated = false;
+    reqs[i].offset = handles[i].offset();
+    reqs[i].n = static_cast<size_t>(handles[i].size()) + kBlockTrailerSize;
+    reqs[i].scratch = new char[reqs[i].n];
+    PerfCount(&PerfContext::block_read_byte, reqs[i].n);
+  }
+  PerfCount(&PerfContext::block_read_count, n);
+  PerfTimer timer(env, &PerfContext::block_read_nanos);
+  file->MultiRead(&reqs[0], n);
+  timer.Stop();
+  for (int i = 0; i < n; i++) {
+    if (reqs[i].status.ok()) {
+      statuses[i] = DecodeBlock(env, options, handles[i], dict,
+                                reqs[i].scratch, reqs[i].result, &results[i]);
+    } else {
+      delete[] reqs[i].scratch;
+      statuses[i] = reqs[i].status;
+    }
+  }
+}
+
 }  // namespace leveldb
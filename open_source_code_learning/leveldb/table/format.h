@@ -14,6 +14,8 @@
 namespace leveldb {
 
 class Block;
+class CompressionDict;
+class Env;
 class RandomAccessFile;
 struct ReadOptions;
 
@@ -83,19 +85,52 @@ static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
+// Blocks built with Options::data_block_hash_index set the top bit of
+// num_restarts and carry a hash index (see block_builder.cc).  Buckets
+// hold a restart index, or one of the two markers below; blocks with
+// more than kMaxHashIndexRestarts restart points have no index.
+static const uint32_t kBlockHashIndexFlag = 1u << 31;
+static const uint8_t kHashIndexNoEntry = 255;
+static const uint8_t kHashIndexCollision = 254;
+static const uint32_t kMaxHashIndexRestarts = 253;
+
+// Metaindex keys of tables with a partitioned index.  Both entries have
+// empty values.  If "index.partitioned" is present, every entry of the
+// index block is the handle of an index partition.  If in addition
+// "partitionedfilter.<policy name>" is present, the handle is followed by
+// the handle of the filter for the keys of that partition's data blocks.
+static const char kPartitionedIndexBlockName[] = "index.partitioned";
+static const char kPartitionedFilterBlockPrefix[] = "partitionedfilter.";
+
 struct BlockContents {
   Slice data;           // Actual contents of data
   bool cachable;        // True iff data can be cached
   bool heap_allocated;  // True iff caller should delete[] data.data()
 };
 
-// Read the block identified by "handle" from "file".  On failure
-// return non-OK.  On success fill *result and return OK.
+// Read the block identified by "handle" from "file".  If "dict" is
+// non-NULL it is used to uncompress the block if the block has the type
+// "dict" applies to.  "env" is the clock of the PerfContext timers.  On
+// failure return non-OK.  On success fill *result and return OK.
 extern Status ReadBlock(RandomAccessFile* file,
+                        Env* env,
                         const ReadOptions& options,
                         const BlockHandle& handle,
+                        const CompressionDict* dict,
                         BlockContents* result);
 
+// Like ReadBlock() for each of handles[0,n-1], setting results[i] and
+// statuses[i] for handles[i].  The blocks are read with a single call
+// to RandomAccessFile::MultiRead().
+extern void ReadBlocks(RandomAccessFile* file,
+                       Env* env,
+                       const ReadOptions& options,
+                       const BlockHandle* handles,
+                       int n,
+                       const CompressionDict* dict,
+                       BlockContents* results,
+                       Status* statuses);
+
 // Implementation details follow.  Clients should ignore,
 
 inline BlockHandle::BlockHandle()
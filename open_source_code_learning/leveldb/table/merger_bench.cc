@@ -0,0 +1,109 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Measures the cost per entry of a merging iterator over 2 to 64
+// children, scanning forward and in reverse.  Each child is an iterator
+// over an in-memory block and the children's keys are interleaved, so
+// that the child holding the current entry changes on every step, as it
+// does when merging overlapping level-0 files.
+//
+// Usage: merger_bench [--entries=N]
+//   --entries=N   total number of entries over all children
+//                 (default 1000000)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "leveldb/comparator.h"
+#include "leveldb/env.h"
+#include "leveldb/iterator.h"
+#include "leveldb/options.h"
+#include "table/block.h"
+#include "table/block_builder.h"
+#include "table/format.h"
+#include "table/merger.h"
+
+namespace leveldb {
+
+static void RunBenchmark(int num_children, int num_entries) {
+  Options options;
+  std::vector<std::string> contents(num_children);
+  std::vector<Block*> blocks(num_children);
+  for (int c = 0; c < num_children; c++) {
+    BlockBuilder builder(&options);
+    char key[100];
+    for (int i = c; i < num_entries; i += num_children) {
+      snprintf(key, sizeof(key), "%016d", i);
+      builder.Add(key, "value");
+    }
+    contents[c] = builder.Finish().ToString();
+    BlockContents block_contents;
+    block_contents.data = contents[c];
+    block_contents.cachable = false;
+    block_contents.heap_allocated = false;
+    blocks[c] = new Block(block_contents);
+  }
+
+  std::vector<Iterator*> children(num_children);
+  for (int c = 0; c < num_children; c++) {
+    children[c] = blocks[c]->NewIterator(options.comparator);
+  }
+  Iterator* iter = NewMergingIterator(options.comparator, &children[0],
+                                      num_children);
+
+  int forward = 0;
+  uint64_t start = Env::Default()->NowMicros();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    forward++;
+  }
+  const uint64_t forward_micros = Env::Default()->NowMicros() - start;
+
+  int reverse = 0;
+  start = Env::Default()->NowMicros();
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    reverse++;
+  }
+  const uint64_t reverse_micros = Env::Default()->NowMicros() - start;
+
+  if (forward != num_entries || reverse != num_entries) {
+    fprintf(stderr, "merged %d and %d entries, expected %d\n",
+            forward, reverse, num_entries);
+    exit(1);
+  }
+  fprintf(stdout, "children %3d : forward %7.2f ns/entry; "
+          "reverse %7.2f ns/entry\n",
+          num_children,
+          static_cast<double>(forward_micros) * 1e3 / num_entries,
+          static_cast<double>(reverse_micros) * 1e3 / num_entries);
+
+  delete iter;
+  for (int c = 0; c < num_children; c++) {
+    delete blocks[c];
+  }
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  int num_entries = 1000000;
+  for (int i = 1; i < argc; i++) {
+    int n;
+    char junk;
+    if (sscanf(argv[i], "--entries=%d%c", &n, &junk) == 1 && n > 0) {
+      num_entries = n;
+    } else {
+      fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+      exit(1);
+    }
+  }
+
+  fprintf(stdout, "Entries:       %d\n", num_entries);
+  fprintf(stdout, "------------------------------------------------\n");
+  static const int kChildren[] = { 2, 4, 8, 12, 16, 32, 64 };
+  for (size_t i = 0; i < sizeof(kChildren) / sizeof(kChildren[0]); i++) {
+    leveldb::RunBenchmark(kChildren[i], num_entries);
+  }
+  return 0;
+}
@@ -4,23 +4,33 @@
 
 #include "leveldb/table.h"
 
+#include <string.h>
+#include <algorithm>
+#include <vector>
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/persistent_cache.h"
 #include "table/block.h"
+#include "table/compression.h"
 #include "table/filter_block.h"
 #include "table/format.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
+#include "util/perf_context_imp.h"
+#include "util/statistics.h"
 
 namespace leveldb {
 
+static void DeleteCachedBlock(const Slice& key, void* value);
+
 struct Table::Rep {
   ~Rep() {
     delete filter;
     delete [] filter_data;
+    delete compression_dict;
     delete index_block;
   }
 
@@ -30,11 +40,35 @@ struct Table::Rep {
   uint64_t cache_id;
   FilterBlockReader* filter;
   const char* filter_data;
+  CompressionDict* compression_dict;  // Used to uncompress data blocks
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+
+  // If "partitioned_index", index_block is the top-level index of a
+  // partitioned index (see kPartitionedIndexBlockName).  Partitions are
+  // read through the block cache like data blocks.
+  bool partitioned_index;
+  bool partitioned_filter;
+
+  // If Options::cache_index_and_filter_blocks, index_block and filter are
+  // NULL, and the blocks at index_handle and, if "cached_filter",
+  // filter_handle are read through the block cache instead.
+  BlockHandle index_handle;
+  BlockHandle filter_handle;
+  bool cached_filter;
+
+  // Identifies the file to Options::persistent_cache, which is not used
+  // for the table if this is empty.
+  std::string persistent_id;
 };
 
+// Whether the index and filter blocks of tables opened with "options"
+// live in the block cache.
+static bool CacheIndexAndFilter(const Options& options) {
+  return options.cache_index_and_filter_blocks && options.block_cache != NULL;
+}
+
 Status Table::Open(const Options& options,
                    RandomAccessFile* file,
                    uint64_t size,
@@ -61,7 +95,8 @@ Status Table::Open(const Options& options,
     if (options.paranoid_checks) {
       opt.verify_checksums = true;
     }
-    s = ReadBlock(file, opt, footer.index_handle(), &index_block_contents);
+    s = ReadBlock(file, options.env, opt, footer.index_handle(), NULL,
+                  &index_block_contents);
   }
 
   if (s.ok()) {
@@ -76,6 +111,30 @@ Status Table::Open(const Options& options,
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
     rep->filter_data = NULL;
     rep->filter = NULL;
+    rep->compression_dict = NULL;
+    rep->partitioned_index = false;
+    rep->partitioned_filter = false;
+    rep->index_handle = footer.index_handle();
+    rep->cached_filter = false;
+    if (options.persistent_cache != NULL && options.block_cache != NULL) {
+      file->GetUniqueId(&rep->persistent_id);
+    }
+    if (CacheIndexAndFilter(options)) {
+      // Hand the index block over to the block cache.
+      if (index_block_contents.cachable) {
+        Cache* block_cache = options.block_cache;
+        char cache_key_buffer[16];
+        EncodeFixed64(cache_key_buffer, rep->cache_id);
+        EncodeFixed64(cache_key_buffer+8, footer.index_handle().offset());
+        Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+        block_cache->Release(block_cache->Insert(
+            key, index_block, index_block->size(), &DeleteCachedBlock,
+            Cache::kHighPriority));
+      } else {
+        delete index_block;
+      }
+      rep->index_block = NULL;
+    }
     *table = new Table(rep);
     (*table)->ReadMeta(footer);
   }
@@ -84,10 +143,6 @@ Status Table::Open(const Options& options,
 }
 
 void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == NULL) {
-    return;  // Do not need any metadata
-  }
-
   // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
   // it is an empty block.
   ReadOptions opt;
@@ -95,18 +150,35 @@ void Table::ReadMeta(const Footer& footer) {
     opt.verify_checksums = true;
   }
   BlockContents contents;
-  if (!ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents).ok()) {
+  if (!ReadBlock(rep_->file, rep_->options.env, opt,
+                 footer.metaindex_handle(), NULL, &contents).ok()) {
     // Do not propagate errors since meta info is not needed for operation
     return;
   }
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  iter->Seek(kCompressionDictBlockName);
+  if (iter->Valid() && iter->key() == Slice(kCompressionDictBlockName)) {
+    ReadCompressionDict(iter->value());
+  }
+  iter->Seek(kPartitionedIndexBlockName);
+  if (iter->Valid() && iter->key() == Slice(kPartitionedIndexBlockName)) {
+    rep_->partitioned_index = true;
+    if (rep_->options.filter_policy != NULL) {
+      std::string key = kPartitionedFilterBlockPrefix;
+      key.append(rep_->options.filter_policy->Name());
+      iter->Seek(key);
+      rep_->partitioned_filter = iter->Valid() && iter->key() == Slice(key);
+    }
+  }
+  if (rep_->options.filter_policy != NULL) {
+    std::string key = "filter.";
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFilter(iter->value());
+    }
   }
   delete iter;
   delete meta;
@@ -125,8 +197,21 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   if (rep_->options.paranoid_checks) {
     opt.verify_checksums = true;
   }
+  if (CacheIndexAndFilter(rep_->options)) {
+    rep_->filter_handle = filter_handle;
+    rep_->cached_filter = true;
+    Cache::Handle* cache_handle;
+    BlockContents* contents = GetFilterBlock(opt, filter_handle,
+                                             &cache_handle);
+    if (contents != NULL) {
+      ReleaseFilterBlock(contents, cache_handle);
+    }
+    return;
+  }
+
   BlockContents block;
-  if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
+  if (!ReadBlock(rep_->file, rep_->options.env, opt, filter_handle, NULL,
+                 &block).ok()) {
     return;
   }
   if (block.heap_allocated) {
@@ -135,6 +220,39 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
 }
 
+void Table::ReadCompressionDict(const Slice& dict_handle_value) {
+  Slice v = dict_handle_value;
+  BlockHandle dict_handle;
+  if (!dict_handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents block;
+  if (!ReadBlock(rep_->file, rep_->options.env, opt, dict_handle, NULL,
+                 &block).ok()) {
+    return;
+  }
+
+  // The block holds the type of the blocks that use the dictionary,
+  // followed by the dictionary itself.
+  Slice contents = block.data;
+  if (!contents.empty()) {
+    const Compressor* compressor =
+        GetCompressor(static_cast<unsigned char>(contents[0]));
+    contents.remove_prefix(1);
+    if (compressor != NULL) {
+      rep_->compression_dict = compressor->NewUncompressionDict(contents);
+    }
+  }
+  if (block.heap_allocated) {
+    delete[] block.data.data();
+  }
+}
+
 Table::~Table() {
   delete rep_;
 }
@@ -148,6 +266,31 @@ static void DeleteCachedBlock(const Slice& key, void* value) {
   delete block;
 }
 
+namespace {
+
+// A block that is handed to a PersistentCache when the block cache
+// evicts it.
+struct PersistableBlock : public Block {
+  PersistableBlock(const BlockContents& contents, PersistentCache* cache,
+                   const std::string& key)
+      : Block(contents), persistent_cache(cache), persistent_key(key) {
+  }
+
+  PersistentCache* persistent_cache;
+  std::string persistent_key;
+};
+
+}  // namespace
+
+static void DeletePersistableBlock(const Slice& key, void* value) {
+  PersistableBlock* block = static_cast<PersistableBlock*>(
+      reinterpret_cast<Block*>(value));
+  if (block->size() > 0) {
+    block->persistent_cache->Insert(block->persistent_key, block->contents());
+  }
+  delete block;
+}
+
 static void ReleaseBlock(void* arg, void* h) {
   Cache* cache = reinterpret_cast<Cache*>(arg);
   Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
@@ -159,100 +302,563 @@ static void ReleaseBlock(void* arg, void* h) {
 Iterator* Table::BlockReader(void* arg,
                              const ReadOptions& options,
                              const Slice& index_value) {
-  Table* table = reinterpret_cast<Table*>(arg);
-  Cache* block_cache = table->rep_->options.block_cache;
-  Block* block = NULL;
-  Cache::Handle* cache_handle = NULL;
+  return NewBlockIterator(reinterpret_cast<Table*>(arg), options,
+                          index_value, false);
+}
+
+// Return an iterator over "block", which is released to "block_cache"
+// through "cache_handle" if that is non-NULL and deleted otherwise.
+static Iterator* NewIteratorOverBlock(Block* block, const Comparator* cmp,
+                                      Cache* block_cache,
+                                      Cache::Handle* cache_handle,
+                                      bool point_lookup) {
+  Iterator* iter = block->NewIterator(cmp, point_lookup);
+  if (cache_handle == NULL) {
+    iter->RegisterCleanup(&DeleteBlock, block, NULL);
+  } else {
+    iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+  }
+  return iter;
+}
+
+// Blocks read with fill_cache unset are cached at low priority, or not
+// at all if the block cache does not support priorities.
+static Cache::Priority DataBlockPriority(const ReadOptions& options) {
+  return options.fill_cache ? Cache::kNormalPriority : Cache::kLowPriority;
+}
+
+// Index blocks and index partitions are the only blocks read at high
+// priority; data blocks are read at DataBlockPriority().
+static bool IsDataBlock(Cache::Priority priority) {
+  return priority != Cache::kHighPriority;
+}
+
+// Read the block at "handle", compressed with "dict", through the block
+// cache if there is one, inserting it with "priority" on a miss.  On
+// success sets *block, and *cache_handle to the handle that pins it in
+// the cache, or to NULL if the caller owns the block.
+Status Table::GetBlock(const ReadOptions& options, const BlockHandle& handle,
+                       const CompressionDict* dict, Cache::Priority priority,
+                       Block** block, Cache::Handle** cache_handle) const {
+  Cache* block_cache = rep_->options.block_cache;
+  *block = NULL;
+  *cache_handle = NULL;
+
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, rep_->cache_id);
+  EncodeFixed64(cache_key_buffer+8, handle.offset());
+  Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+  if (block_cache != NULL) {
+    *cache_handle = block_cache->Lookup(key);
+    if (*cache_handle != NULL) {
+      RecordTick(rep_->options.statistics, kBlockCacheHit);
+      PerfCount(&PerfContext::block_cache_hit_count);
+      *block = reinterpret_cast<Block*>(block_cache->Value(*cache_handle));
+      return Status::OK();
+    }
+    RecordTick(rep_->options.statistics, kBlockCacheMiss);
+  }
+
+  BlockContents contents;
+  Status s;
+  if (!IsDataBlock(priority) || !ReadPersistedBlock(handle, &contents)) {
+    s = ReadBlock(rep_->file, rep_->options.env, options, handle, dict,
+                  &contents);
+  }
+  if (s.ok()) {
+    *block = InsertBlock(key, handle, contents, priority, cache_handle);
+  }
+  return s;
+}
+
+// If the table uses a persistent cache and it holds the block at
+// "handle", store the block in *contents and return true.
+bool Table::ReadPersistedBlock(const BlockHandle& handle,
+                               BlockContents* contents) const {
+  if (rep_->persistent_id.empty()) {
+    return false;
+  }
+  std::string key = rep_->persistent_id;
+  PutFixed64(&key, handle.offset());
+  std::string data;
+  if (!rep_->options.persistent_cache->Lookup(key, &data)) {
+    RecordTick(rep_->options.statistics, kPersistentCacheMiss);
+    return false;
+  }
+  RecordTick(rep_->options.statistics, kPersistentCacheHit);
+  char* buf = new char[data.size()];
+  memcpy(buf, data.data(), data.size());
+  contents->data = Slice(buf, data.size());
+  contents->cachable = true;
+  contents->heap_allocated = true;
+  return true;
+}
+
+// Return a new Block holding "contents", the block at "handle", and
+// insert it in the block cache under "cache_key" if it may be cached.
+// Sets *cache_handle as GetBlock() does.  Data blocks inserted with
+// normal priority go to the persistent cache once the block cache evicts
+// them.
+Block* Table::InsertBlock(const Slice& cache_key, const BlockHandle& handle,
+                          const BlockContents& contents,
+                          Cache::Priority priority,
+                          Cache::Handle** cache_handle) const {
+  Cache* block_cache = rep_->options.block_cache;
+  *cache_handle = NULL;
+  if (block_cache == NULL || !contents.cachable ||
+      (priority == Cache::kLowPriority &&
+       !block_cache->SupportsPriorities())) {
+    return new Block(contents);
+  }
+  Block* block;
+  void (*deleter)(const Slice&, void*);
+  if (!rep_->persistent_id.empty() && IsDataBlock(priority) &&
+      priority != Cache::kLowPriority) {
+    std::string key = rep_->persistent_id;
+    PutFixed64(&key, handle.offset());
+    block = new PersistableBlock(contents, rep_->options.persistent_cache,
+                                 key);
+    deleter = &DeletePersistableBlock;
+  } else {
+    block = new Block(contents);
+    deleter = &DeleteCachedBlock;
+  }
+  *cache_handle = block_cache->Insert(cache_key, block, block->size(),
+                                      deleter, priority);
+  return block;
+}
 
+// Like BlockReader(), but the iterator may use the block's hash index
+// (see Block::NewIterator) if "point_lookup" is true.
+Iterator* Table::NewBlockIterator(Table* table,
+                                  const ReadOptions& options,
+                                  const Slice& index_value,
+                                  bool point_lookup) {
   BlockHandle handle;
   Slice input = index_value;
   Status s = handle.DecodeFrom(&input);
   // We intentionally allow extra stuff in index_value so that we
   // can add more features in the future.
 
+  Block* block = NULL;
+  Cache::Handle* cache_handle = NULL;
+  if (s.ok()) {
+    s = table->GetBlock(options, handle, table->rep_->compression_dict,
+                        DataBlockPriority(options), &block, &cache_handle);
+  }
+
+  if (block != NULL) {
+    return NewIteratorOverBlock(block, table->rep_->options.comparator,
+                                table->rep_->options.block_cache,
+                                cache_handle, point_lookup);
+  } else {
+    return NewErrorIterator(s);
+  }
+}
+
+// Like BlockReader(), for the partitions of a partitioned index, which
+// are cached at high priority.
+Iterator* Table::IndexPartitionReader(void* arg,
+                                      const ReadOptions& options,
+                                      const Slice& index_value) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  BlockHandle handle;
+  Slice input = index_value;
+  Status s = handle.DecodeFrom(&input);
+
+  Block* block = NULL;
+  Cache::Handle* cache_handle = NULL;
   if (s.ok()) {
-    BlockContents contents;
+    s = table->GetBlock(options, handle, table->rep_->compression_dict,
+                        Cache::kHighPriority, &block, &cache_handle);
+  }
+
+  if (block != NULL) {
+    return NewIteratorOverBlock(block, table->rep_->options.comparator,
+                                table->rep_->options.block_cache,
+                                cache_handle, false);
+  } else {
+    return NewErrorIterator(s);
+  }
+}
+
+void Table::NewBlockIterators(Table* table,
+                              const ReadOptions& options,
+                              int n,
+                              const Slice* index_values,
+                              Iterator** iters) {
+  if (n == 1) {
+    iters[0] = NewBlockIterator(table, options, index_values[0], true);
+    return;
+  }
+  Rep* r = table->rep_;
+  Cache* block_cache = r->options.block_cache;
+  std::vector<BlockHandle> handles;
+  std::vector<int> missing;  // iters[missing[j]] is for handles[j]
+  for (int i = 0; i < n; i++) {
+    iters[i] = NULL;
+    BlockHandle handle;
+    Slice input = index_values[i];
+    if (!handle.DecodeFrom(&input).ok()) {
+      continue;  // NewBlockIterator() reports the error below
+    }
     if (block_cache != NULL) {
       char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
+      EncodeFixed64(cache_key_buffer, r->cache_id);
       EncodeFixed64(cache_key_buffer+8, handle.offset());
       Slice key(cache_key_buffer, sizeof(cache_key_buffer));
-      cache_handle = block_cache->Lookup(key);
+      Cache::Handle* cache_handle = block_cache->Lookup(key);
       if (cache_handle != NULL) {
-        block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
-      } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
-        if (s.ok()) {
-          block = new Block(contents);
-          if (contents.cachable && options.fill_cache) {
-            cache_handle = block_cache->Insert(
-                key, block, block->size(), &DeleteCachedBlock);
-          }
-        }
+        RecordTick(r->options.statistics, kBlockCacheHit);
+        PerfCount(&PerfContext::block_cache_hit_count);
+        iters[i] = NewIteratorOverBlock(
+            reinterpret_cast<Block*>(block_cache->Value(cache_handle)),
+            r->options.comparator, block_cache, cache_handle, true);
+        continue;
       }
-    } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
-      if (s.ok()) {
-        block = new Block(contents);
+      RecordTick(r->options.statistics, kBlockCacheMiss);
+      BlockContents contents;
+      if (table->ReadPersistedBlock(handle, &contents)) {
+        Block* block = table->InsertBlock(key, handle, contents,
+                                          DataBlockPriority(options),
+                                          &cache_handle);
+        iters[i] = NewIteratorOverBlock(block, r->options.comparator,
+                                        block_cache, cache_handle, true);
+        continue;
       }
     }
+    handles.push_back(handle);
+    missing.push_back(i);
   }
 
-  Iterator* iter;
-  if (block != NULL) {
-    iter = block->NewIterator(table->rep_->options.comparator);
-    if (cache_handle == NULL) {
-      iter->RegisterCleanup(&DeleteBlock, block, NULL);
-    } else {
-      iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+  if (!missing.empty()) {
+    const int m = static_cast<int>(missing.size());
+    std::vector<BlockContents> contents(m);
+    std::vector<Status> statuses(m);
+    ReadBlocks(r->file, r->options.env, options, &handles[0], m,
+               r->compression_dict, &contents[0], &statuses[0]);
+    for (int j = 0; j < m; j++) {
+      if (!statuses[j].ok()) {
+        iters[missing[j]] = NewErrorIterator(statuses[j]);
+        continue;
+      }
+      char cache_key_buffer[16];
+      EncodeFixed64(cache_key_buffer, r->cache_id);
+      EncodeFixed64(cache_key_buffer+8, handles[j].offset());
+      Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+      Cache::Handle* cache_handle;
+      Block* block = table->InsertBlock(key, handles[j], contents[j],
+                                        DataBlockPriority(options),
+                                        &cache_handle);
+      iters[missing[j]] = NewIteratorOverBlock(
+          block, r->options.comparator, block_cache, cache_handle, true);
     }
-  } else {
-    iter = NewErrorIterator(s);
+  }
+
+  for (int i = 0; i < n; i++) {
+    if (iters[i] == NULL) {
+      iters[i] = NewBlockIterator(table, options, index_values[i], true);
+    }
+  }
+}
+
+static void DeleteCachedFilter(const Slice& key, void* value) {
+  BlockContents* contents = reinterpret_cast<BlockContents*>(value);
+  if (contents->heap_allocated) {
+    delete[] contents->data.data();
+  }
+  delete contents;
+}
+
+// Return an iterator over the index block: the whole index, or the
+// top level of a partitioned one.
+Iterator* Table::NewIndexBlockIterator(const ReadOptions& options) const {
+  if (rep_->index_block != NULL) {
+    return rep_->index_block->NewIterator(rep_->options.comparator);
+  }
+  Block* block;
+  Cache::Handle* cache_handle;
+  Status s = GetBlock(options, rep_->index_handle, NULL, Cache::kHighPriority,
+                      &block, &cache_handle);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  return NewIteratorOverBlock(block, rep_->options.comparator,
+                              rep_->options.block_cache, cache_handle, false);
+}
+
+// Return an iterator over the entries of the index, whose values are the
+// handles of data blocks.
+Iterator* Table::NewIndexIterator(const ReadOptions& options) const {
+  Iterator* iter = NewIndexBlockIterator(options);
+  if (rep_->partitioned_index) {
+    iter = NewTwoLevelIterator(iter, &Table::IndexPartitionReader,
+                               const_cast<Table*>(this), options);
   }
   return iter;
 }
 
+// Return the contents of the filter block at "handle" through the block
+// cache if there is one, inserting them at high priority on a miss, or
+// NULL if they can not be read.  Sets *cache_handle as GetBlock() does;
+// pass it to ReleaseFilterBlock() when done.
+BlockContents* Table::GetFilterBlock(const ReadOptions& options,
+                                     const BlockHandle& handle,
+                                     Cache::Handle** cache_handle) const {
+  Cache* block_cache = rep_->options.block_cache;
+  *cache_handle = NULL;
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, rep_->cache_id);
+  EncodeFixed64(cache_key_buffer+8, handle.offset());
+  Slice cache_key(cache_key_buffer, sizeof(cache_key_buffer));
+  if (block_cache != NULL) {
+    *cache_handle = block_cache->Lookup(cache_key);
+    if (*cache_handle != NULL) {
+      RecordTick(rep_->options.statistics, kBlockCacheHit);
+      PerfCount(&PerfContext::block_cache_hit_count);
+      return reinterpret_cast<BlockContents*>(
+          block_cache->Value(*cache_handle));
+    }
+    RecordTick(rep_->options.statistics, kBlockCacheMiss);
+  }
+
+  BlockContents* contents = new BlockContents;
+  if (!ReadBlock(rep_->file, rep_->options.env, options, handle, NULL,
+                 contents).ok()) {
+    delete contents;
+    return NULL;
+  }
+  if (block_cache != NULL && contents->cachable) {
+    *cache_handle = block_cache->Insert(cache_key, contents,
+                                        contents->data.size(),
+                                        &DeleteCachedFilter,
+                                        Cache::kHighPriority);
+  }
+  return contents;
+}
+
+void Table::ReleaseFilterBlock(BlockContents* contents,
+                               Cache::Handle* cache_handle) const {
+  if (cache_handle != NULL) {
+    rep_->options.block_cache->Release(cache_handle);
+  } else {
+    DeleteCachedFilter(Slice(), contents);
+  }
+}
+
+// "partition_value" is the value of an entry of the top-level index.
+// Returns false if the filter partition it refers to says that "key" is
+// not in the partition's data blocks.
+bool Table::PartitionMayMatch(const ReadOptions& options,
+                              const Slice& partition_value,
+                              const Slice& key) const {
+  Slice input = partition_value;
+  BlockHandle index_handle, filter_handle;
+  if (!index_handle.DecodeFrom(&input).ok() ||
+      !filter_handle.DecodeFrom(&input).ok()) {
+    return true;
+  }
+
+  Cache::Handle* cache_handle;
+  BlockContents* contents = GetFilterBlock(options, filter_handle,
+                                           &cache_handle);
+  if (contents == NULL) {
+    return true;
+  }
+  PerfTimer timer(rep_->options.env, &PerfContext::filter_probe_nanos);
+  bool result = rep_->options.filter_policy->KeyMayMatch(key, contents->data);
+  timer.Stop();
+  ReleaseFilterBlock(contents, cache_handle);
+  RecordTick(rep_->options.statistics,
+             result ? kBloomFilterPositive : kBloomFilterUseful);
+  PerfCount(result ? &PerfContext::filter_positive_count
+                   : &PerfContext::filter_useful_count);
+  return result;
+}
+
+// Readahead starts once this many blocks have been read in file order,
+// with a window of kInitialReadahead bytes that doubles on every prefetch
+// up to ReadOptions::readahead_size.
+static const int kReadaheadTrigger = 2;
+static const uint64_t kInitialReadahead = 16 << 10;
+
+namespace {
+struct Readahead {
+  Table* table;
+  uint64_t next_offset;   // End of the last block read
+  int sequential_reads;   // Blocks read in file order up to the last one
+  uint64_t window;        // Size of the next prefetch
+  uint64_t prefetched;    // End of the last prefetch
+};
+}  // namespace
+
+static void DeleteReadahead(void* arg, void* ignored) {
+  delete reinterpret_cast<Readahead*>(arg);
+}
+
+Iterator* Table::ReadaheadBlockReader(void* arg,
+                                      const ReadOptions& options,
+                                      const Slice& index_value) {
+  Readahead* ra = reinterpret_cast<Readahead*>(arg);
+  Slice input = index_value;
+  BlockHandle handle;
+  if (handle.DecodeFrom(&input).ok()) {
+    const uint64_t offset = handle.offset();
+    const uint64_t end = offset + handle.size() + kBlockTrailerSize;
+    // Blocks still count as sequential across a gap of up to a block,
+    // since partitioned tables store meta blocks between data blocks.
+    if (offset >= ra->next_offset &&
+        offset - ra->next_offset <= ra->table->rep_->options.block_size) {
+      ra->sequential_reads++;
+    } else {
+      ra->sequential_reads = 1;
+      ra->window = std::min<uint64_t>(kInitialReadahead,
+                                      options.readahead_size);
+      ra->prefetched = 0;
+    }
+    ra->next_offset = end;
+
+    // Stay at least half a window ahead of the blocks being read.
+    if (ra->sequential_reads >= kReadaheadTrigger &&
+        ra->prefetched < end + ra->window / 2) {
+      const uint64_t start = std::max(ra->prefetched, end);
+      ra->table->rep_->file->Prefetch(start, ra->window);
+      ra->prefetched = start + ra->window;
+      ra->window = std::min<uint64_t>(2 * ra->window,
+                                      options.readahead_size);
+    }
+  }
+  return NewBlockIterator(ra->table, options, index_value, false);
+}
+
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+  if (options.readahead_size == 0) {
+    return NewTwoLevelIterator(
+        NewIndexIterator(options),
+        &Table::BlockReader, const_cast<Table*>(this), options);
+  }
+  Readahead* ra = new Readahead;
+  ra->table = const_cast<Table*>(this);
+  ra->next_offset = ~static_cast<uint64_t>(0);
+  ra->sequential_reads = 0;
+  ra->window = 0;
+  ra->prefetched = 0;
+  Iterator* iter = NewTwoLevelIterator(
+      NewIndexIterator(options), &Table::ReadaheadBlockReader, ra, options);
+  iter->RegisterCleanup(&DeleteReadahead, ra, NULL);
+  return iter;
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k,
                           void* arg,
                           void (*saver)(void*, const Slice&, const Slice&)) {
+  return InternalMultiGet(options, 1, &k, &arg, saver);
+}
+
+Status Table::InternalMultiGet(
+    const ReadOptions& options, int n, const Slice* keys, void* const* args,
+    void (*saver)(void*, const Slice&, const Slice&)) {
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
-  iiter->Seek(k);
-  if (iiter->Valid()) {
+  // Find the data block each key may be in.  Keys are sorted, so keys in
+  // the same data block are adjacent and share a single block read.
+  // block_of[i] is -1 if the filter rules out keys[i].
+  std::vector<int> block_of(n, -1);
+  std::vector<std::string> block_values;  // Index entries of the blocks
+  // Consult the filter partition before reading the index partition.
+  Iterator* top = NULL;
+  if (rep_->partitioned_filter) {
+    top = NewIndexBlockIterator(options);
+  }
+  // Pin the filter of the whole table if it lives in the block cache.
+  FilterBlockReader* filter = rep_->filter;
+  BlockContents* filter_contents = NULL;
+  Cache::Handle* filter_cache_handle = NULL;
+  if (rep_->cached_filter) {
+    filter_contents = GetFilterBlock(options, rep_->filter_handle,
+                                     &filter_cache_handle);
+    if (filter_contents != NULL) {
+      filter = new FilterBlockReader(rep_->options.filter_policy,
+                                     filter_contents->data);
+    }
+  }
+  Iterator* iiter = NewIndexIterator(options);
+  for (int i = 0; i < n && s.ok(); i++) {
+    const Slice& k = keys[i];
+    if (top != NULL) {
+      top->Seek(k);
+      if (top->Valid() && !PartitionMayMatch(options, top->value(), k)) {
+        continue;
+      }
+      s = top->status();
+      if (!s.ok()) {
+        break;
+      }
+    }
+
+    iiter->Seek(k);
+    if (!iiter->Valid()) {
+      s = iiter->status();
+      continue;
+    }
     Slice handle_value = iiter->value();
-    FilterBlockReader* filter = rep_->filter;
     BlockHandle handle;
-    if (filter != NULL &&
-        handle.DecodeFrom(&handle_value).ok() &&
-        !filter->KeyMayMatch(handle.offset(), k)) {
-      // Not found
-    } else {
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
-      block_iter->Seek(k);
-      if (block_iter->Valid()) {
-        (*saver)(arg, block_iter->key(), block_iter->value());
+    if (filter != NULL && handle.DecodeFrom(&handle_value).ok()) {
+      PerfTimer timer(rep_->options.env, &PerfContext::filter_probe_nanos);
+      const bool may_match = filter->KeyMayMatch(handle.offset(), k);
+      timer.Stop();
+      if (!may_match) {
+        RecordTick(rep_->options.statistics, kBloomFilterUseful);
+        PerfCount(&PerfContext::filter_useful_count);
+        continue;
       }
-      s = block_iter->status();
-      delete block_iter;
+      RecordTick(rep_->options.statistics, kBloomFilterPositive);
+      PerfCount(&PerfContext::filter_positive_count);
     }
+
+    if (block_values.empty() || iiter->value() != Slice(block_values.back())) {
+      block_values.push_back(iiter->value().ToString());
+    }
+    block_of[i] = static_cast<int>(block_values.size()) - 1;
   }
   if (s.ok()) {
     s = iiter->status();
   }
   delete iiter;
+  delete top;
+  if (filter_contents != NULL) {
+    delete filter;
+    ReleaseFilterBlock(filter_contents, filter_cache_handle);
+  }
+  if (!s.ok() || block_values.empty()) {
+    return s;
+  }
+
+  // Read the blocks not in the cache with a single MultiRead(), which
+  // an Env may serve with parallel reads.
+  const int num_blocks = static_cast<int>(block_values.size());
+  std::vector<Slice> index_values(block_values.begin(), block_values.end());
+  std::vector<Iterator*> block_iters(num_blocks);
+  NewBlockIterators(this, options, num_blocks, &index_values[0],
+                    &block_iters[0]);
+  for (int i = 0; i < n && s.ok(); i++) {
+    if (block_of[i] < 0) {
+      continue;
+    }
+    Iterator* block_iter = block_iters[block_of[i]];
+    block_iter->Seek(keys[i]);
+    if (block_iter->Valid()) {
+      (*saver)(args[i], block_iter->key(), block_iter->value());
+    }
+    s = block_iter->status();
+  }
+  for (int b = 0; b < num_blocks; b++) {
+    delete block_iters[b];
+  }
   return s;
 }
 
-
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = NewIndexIterator(ReadOptions());
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
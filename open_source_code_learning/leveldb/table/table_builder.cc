@@ -5,11 +5,14 @@
 #include "leveldb/table_builder.h"
 
 #include <assert.h>
+#include <vector>
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "table/block.h"
 #include "table/block_builder.h"
+#include "table/compression.h"
 #include "table/filter_block.h"
 #include "table/format.h"
 #include "util/coding.h"
@@ -17,6 +20,16 @@
 
 namespace leveldb {
 
+// Options for blocks other than data blocks: index blocks use a restart
+// point per entry, and only data blocks get a hash index.
+static Options MetaBlockOptions(const Options& options,
+                                int block_restart_interval) {
+  Options result = options;
+  result.block_restart_interval = block_restart_interval;
+  result.data_block_hash_index = false;
+  return result;
+}
+
 struct TableBuilder::Rep {
   Options options;
   Options index_block_options;
@@ -30,6 +43,15 @@ struct TableBuilder::Rep {
   bool closed;          // Either Finish() or Abandon() has been called.
   FilterBlockBuilder* filter_block;
 
+  // If "partitioned", index_block holds the current index partition and
+  // filter_partition collects the keys of the data blocks it covers.
+  // Every finished partition gets an entry in top_index_block, which
+  // becomes the index block of the table.
+  const bool partitioned;
+  FilterPartitionBuilder* filter_partition;
+  BlockBuilder top_index_block;
+  std::string last_index_key;  // Key of the last entry in index_block
+
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
   // keys in the index block.  For example, consider a block boundary
@@ -44,19 +66,38 @@ struct TableBuilder::Rep {
 
   std::string compressed_output;
 
+  // While "buffering", finished data blocks are held in buffered_blocks
+  // instead of being written, so that a compression dictionary can be
+  // trained on them first.  The last key of each block is kept so that
+  // its index entry can be built once it is written.
+  bool buffering;
+  std::vector<std::string> buffered_blocks;
+  std::vector<std::string> buffered_last_keys;
+  uint64_t buffered_bytes;
+
+  std::string compression_dict_data;  // Empty if there is no dictionary
+  CompressionDict* compression_dict;
+
   Rep(const Options& opt, WritableFile* f)
       : options(opt),
-        index_block_options(opt),
+        index_block_options(MetaBlockOptions(opt, 1)),
         file(f),
         offset(0),
         data_block(&options),
         index_block(&index_block_options),
         num_entries(0),
         closed(false),
-        filter_block(opt.filter_policy == NULL ? NULL
-                     : new FilterBlockBuilder(opt.filter_policy)),
-        pending_index_entry(false) {
-    index_block_options.block_restart_interval = 1;
+        filter_block(opt.filter_policy == NULL || opt.partition_index_and_filters
+                     ? NULL : new FilterBlockBuilder(opt.filter_policy)),
+        partitioned(opt.partition_index_and_filters),
+        filter_partition(opt.filter_policy == NULL || !partitioned ? NULL
+                         : new FilterPartitionBuilder(opt.filter_policy)),
+        top_index_block(&index_block_options),
+        pending_index_entry(false),
+        buffering(opt.max_dictionary_bytes > 0 &&
+                  opt.compression != kNoCompression),
+        buffered_bytes(0),
+        compression_dict(NULL) {
   }
 };
 
@@ -70,6 +111,8 @@ TableBuilder::TableBuilder(const Options& options, WritableFile* file)
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
   delete rep_->filter_block;
+  delete rep_->filter_partition;
+  delete rep_->compression_dict;
   delete rep_;
 }
 
@@ -84,8 +127,7 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   // Note that any live BlockBuilders point to rep_->options and therefore
   // will automatically pick up the updated options.
   rep_->options = options;
-  rep_->index_block_options = options;
-  rep_->index_block_options.block_restart_interval = 1;
+  rep_->index_block_options = MetaBlockOptions(options, 1);
   return Status::OK();
 }
 
@@ -100,14 +142,18 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   if (r->pending_index_entry) {
     assert(r->data_block.empty());
     r->options.comparator->FindShortestSeparator(&r->last_key, key);
-    std::string handle_encoding;
-    r->pending_handle.EncodeTo(&handle_encoding);
-    r->index_block.Add(r->last_key, Slice(handle_encoding));
+    AddIndexEntry(r->last_key, r->pending_handle);
     r->pending_index_entry = false;
   }
 
-  if (r->filter_block != NULL) {
-    r->filter_block->AddKey(key);
+  // While buffering, keys are added to the filter when their block is
+  // written, since the offset of the block is not known yet.
+  if (!r->buffering) {
+    if (r->filter_block != NULL) {
+      r->filter_block->AddKey(key);
+    } else if (r->filter_partition != NULL) {
+      r->filter_partition->AddKey(key);
+    }
   }
 
   r->last_key.assign(key.data(), key.size());
@@ -126,7 +172,21 @@ void TableBuilder::Flush() {
   if (!ok()) return;
   if (r->data_block.empty()) return;
   assert(!r->pending_index_entry);
-  WriteBlock(&r->data_block, &r->pending_handle);
+  if (r->buffering) {
+    Slice raw = r->data_block.Finish();
+    r->buffered_blocks.push_back(raw.ToString());
+    r->buffered_last_keys.push_back(r->last_key);
+    r->buffered_bytes += raw.size();
+    r->data_block.Reset();
+    if (r->buffered_blocks.size() >=
+        static_cast<size_t>(r->options.dictionary_training_blocks)) {
+      WriteBufferedBlocks();
+    }
+    return;
+  }
+  CompressAndWriteBlock(r->data_block.Finish(), r->compression_dict,
+                        &r->pending_handle);
+  r->data_block.Reset();
   if (ok()) {
     r->pending_index_entry = true;
     r->status = r->file->Flush();
@@ -136,40 +196,159 @@ void TableBuilder::Flush() {
   }
 }
 
+void TableBuilder::WriteBufferedBlocks() {
+  Rep* r = rep_;
+  assert(r->buffering);
+  r->buffering = false;
+
+  const Compressor* compressor = GetCompressor(r->options.compression);
+  if (compressor != NULL) {
+    std::vector<Slice> samples(r->buffered_blocks.begin(),
+                               r->buffered_blocks.end());
+    if (compressor->TrainDictionary(samples, r->options.max_dictionary_bytes,
+                                    &r->compression_dict_data)) {
+      r->compression_dict =
+          compressor->NewCompressionDict(r->compression_dict_data);
+    }
+    if (r->compression_dict == NULL) {
+      r->compression_dict_data.clear();
+    }
+  }
+
+  // Write the blocks as Flush() would have, adding their keys to the
+  // filter and their entries to the index.  The index entry of the last
+  // block is left pending, as Flush() leaves it.
+  BlockContents contents;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  for (size_t i = 0; i < r->buffered_blocks.size() && ok(); i++) {
+    if (r->filter_block != NULL || r->filter_partition != NULL) {
+      if (r->filter_block != NULL) {
+        r->filter_block->StartBlock(r->offset);
+      }
+      contents.data = r->buffered_blocks[i];
+      Block block(contents);
+      Iterator* iter = block.NewIterator(r->options.comparator);
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        if (r->filter_block != NULL) {
+          r->filter_block->AddKey(iter->key());
+        } else {
+          r->filter_partition->AddKey(iter->key());
+        }
+      }
+      delete iter;
+    }
+
+    BlockHandle handle;
+    CompressAndWriteBlock(r->buffered_blocks[i], r->compression_dict,
+                          &handle);
+    if (!ok()) {
+      break;
+    }
+    std::string last_key = r->buffered_last_keys[i];
+    if (i + 1 < r->buffered_blocks.size()) {
+      contents.data = r->buffered_blocks[i + 1];
+      Block next(contents);
+      Iterator* iter = next.NewIterator(r->options.comparator);
+      iter->SeekToFirst();
+      assert(iter->Valid());
+      r->options.comparator->FindShortestSeparator(&last_key, iter->key());
+      delete iter;
+      AddIndexEntry(last_key, handle);
+    } else {
+      assert(last_key == r->last_key);
+      r->pending_handle = handle;
+      r->pending_index_entry = true;
+    }
+  }
+  if (ok()) {
+    r->status = r->file->Flush();
+  }
+  if (r->filter_block != NULL) {
+    r->filter_block->StartBlock(r->offset);
+  }
+  r->buffered_blocks.clear();
+  r->buffered_last_keys.clear();
+  r->buffered_bytes = 0;
+}
+
+void TableBuilder::AddIndexEntry(const std::string& key,
+                                 const BlockHandle& handle) {
+  Rep* r = rep_;
+  std::string handle_encoding;
+  handle.EncodeTo(&handle_encoding);
+  r->index_block.Add(key, Slice(handle_encoding));
+  if (r->partitioned) {
+    r->last_index_key = key;
+    if (r->index_block.CurrentSizeEstimate() >=
+        r->options.metadata_block_size) {
+      FlushIndexPartition();
+    }
+  }
+}
+
+// Write out the current index partition and the filter partition for the
+// same data blocks, and add an entry for them to the top-level index.
+// The entry's key is the last key of the index partition and its value
+// is the handle of the index partition, followed by the handle of the
+// filter partition if there is a filter.
+void TableBuilder::FlushIndexPartition() {
+  Rep* r = rep_;
+  assert(r->partitioned);
+  if (!ok() || r->index_block.empty()) return;
+  BlockHandle index_handle;
+  CompressAndWriteBlock(r->index_block.Finish(), r->compression_dict,
+                        &index_handle);
+  r->index_block.Reset();
+  std::string handle_encoding;
+  index_handle.EncodeTo(&handle_encoding);
+  if (ok() && r->filter_partition != NULL) {
+    BlockHandle filter_handle;
+    WriteRawBlock(r->filter_partition->Finish(), kNoCompression,
+                  &filter_handle);
+    filter_handle.EncodeTo(&handle_encoding);
+  }
+  if (ok()) {
+    r->top_index_block.Add(r->last_index_key, Slice(handle_encoding));
+  }
+}
+
 void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
+  CompressAndWriteBlock(block->Finish(), NULL, handle);
+  block->Reset();
+}
+
+void TableBuilder::CompressAndWriteBlock(const Slice& raw,
+                                         const CompressionDict* dict,
+                                         BlockHandle* handle) {
   // File format contains a sequence of blocks where each block has:
   //    block_data: uint8[n]
   //    type: uint8
   //    crc: uint32
   assert(ok());
   Rep* r = rep_;
-  Slice raw = block->Finish();
 
   Slice block_contents;
   CompressionType type = r->options.compression;
-  // TODO(postrelease): Support more compression options: zlib?
-  switch (type) {
-    case kNoCompression:
-      block_contents = raw;
-      break;
-
-    case kSnappyCompression: {
-      std::string* compressed = &r->compressed_output;
-      if (port::Snappy_Compress(raw.data(), raw.size(), compressed) &&
-          compressed->size() < raw.size() - (raw.size() / 8u)) {
-        block_contents = *compressed;
-      } else {
-        // Snappy not supported, or compressed less than 12.5%, so just
-        // store uncompressed form
-        block_contents = raw;
-        type = kNoCompression;
-      }
-      break;
-    }
+  const Compressor* compressor =
+      (type == kNoCompression) ? NULL : GetCompressor(type);
+  if (compressor != NULL && dict != NULL &&
+      dict->type() != compressor->type()) {
+    dict = NULL;  // The compression was changed by ChangeOptions()
+  }
+  std::string* compressed = &r->compressed_output;
+  if (compressor != NULL &&
+      compressor->CompressWithDict(raw, dict, compressed) &&
+      compressed->size() < raw.size() - (raw.size() / 8u)) {
+    block_contents = *compressed;
+  } else {
+    // Compression not requested or not supported, or compressed less
+    // than 12.5%, so just store uncompressed form
+    block_contents = raw;
+    type = kNoCompression;
   }
   WriteRawBlock(block_contents, type, handle);
   r->compressed_output.clear();
-  block->Reset();
 }
 
 void TableBuilder::WriteRawBlock(const Slice& block_contents,
@@ -199,10 +378,25 @@ Status TableBuilder::status() const {
 Status TableBuilder::Finish() {
   Rep* r = rep_;
   Flush();
+  if (r->buffering && ok()) {
+    WriteBufferedBlocks();
+  }
   assert(!r->closed);
   r->closed = true;
 
   BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle dict_block_handle;
+
+  // Complete the index.  With a partitioned index the last partition is
+  // written here, so that only the top-level index is left.
+  if (ok() && r->pending_index_entry) {
+    r->options.comparator->FindShortSuccessor(&r->last_key);
+    AddIndexEntry(r->last_key, r->pending_handle);
+    r->pending_index_entry = false;
+  }
+  if (ok() && r->partitioned) {
+    FlushIndexPartition();
+  }
 
   // Write filter block
   if (ok() && r->filter_block != NULL) {
@@ -210,9 +404,26 @@ Status TableBuilder::Finish() {
                   &filter_block_handle);
   }
 
+  // Write compression dictionary block
+  if (ok() && r->compression_dict != NULL) {
+    std::string contents;
+    contents.push_back(static_cast<char>(r->compression_dict->type()));
+    contents.append(r->compression_dict_data);
+    WriteRawBlock(contents, kNoCompression, &dict_block_handle);
+  }
+
   // Write metaindex block
   if (ok()) {
-    BlockBuilder meta_index_block(&r->options);
+    Options meta_index_options =
+        MetaBlockOptions(r->options, r->options.block_restart_interval);
+    BlockBuilder meta_index_block(&meta_index_options);
+    if (r->compression_dict != NULL) {
+      // Add mapping from kCompressionDictBlockName to location of the
+      // dictionary.  It sorts before the filter entry.
+      std::string handle_encoding;
+      dict_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(kCompressionDictBlockName, handle_encoding);
+    }
     if (r->filter_block != NULL) {
       // Add mapping from "filter.Name" to location of filter data
       std::string key = "filter.";
@@ -221,6 +432,17 @@ Status TableBuilder::Finish() {
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
     }
+    if (r->partitioned) {
+      // The entries of the top-level index point at index partitions,
+      // and also at filter partitions if "partitionedfilter.Name" is
+      // present.  Both entries have empty values.
+      meta_index_block.Add(kPartitionedIndexBlockName, Slice());
+      if (r->filter_partition != NULL) {
+        std::string key = kPartitionedFilterBlockPrefix;
+        key.append(r->options.filter_policy->Name());
+        meta_index_block.Add(key, Slice());
+      }
+    }
 
     // TODO(postrelease): Add stats and other meta blocks
     WriteBlock(&meta_index_block, &metaindex_block_handle);
@@ -228,14 +450,8 @@ Status TableBuilder::Finish() {
 
   // Write index block
   if (ok()) {
-    if (r->pending_index_entry) {
-      r->options.comparator->FindShortSuccessor(&r->last_key);
-      std::string handle_encoding;
-      r->pending_handle.EncodeTo(&handle_encoding);
-      r->index_block.Add(r->last_key, Slice(handle_encoding));
-      r->pending_index_entry = false;
-    }
-    WriteBlock(&r->index_block, &index_block_handle);
+    WriteBlock(r->partitioned ? &r->top_index_block : &r->index_block,
+               &index_block_handle);
   }
 
   // Write footer
@@ -264,7 +480,7 @@ uint64_t TableBuilder::NumEntries() const {
 }
 
 uint64_t TableBuilder::FileSize() const {
-  return rep_->offset;
+  return rep_->offset + rep_->buffered_bytes;
 }
 
 }  // namespace leveldb
@@ -9,13 +9,19 @@
 #include "db/dbformat.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/cache.h"
+#include "leveldb/compressor.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
 #include "leveldb/iterator.h"
+#include "leveldb/persistent_cache.h"
 #include "leveldb/table_builder.h"
 #include "table/block.h"
 #include "table/block_builder.h"
 #include "table/format.h"
+#include "table/merger.h"
+#include "util/coding.h"
 #include "util/random.h"
 #include "util/testharness.h"
 #include "util/testutil.h"
@@ -407,6 +413,8 @@ struct TestArgs {
   TestType type;
   bool reverse_compare;
   int restart_interval;
+  bool partitioned;  // Partition the index of tables
+  bool hash_index;   // Add a hash index to data blocks
 };
 
 static const TestArgs kTestArgList[] = {
@@ -416,6 +424,10 @@ static const TestArgs kTestArgList[] = {
   { TABLE_TEST, true, 16 },
   { TABLE_TEST, true, 1 },
   { TABLE_TEST, true, 1024 },
+  { TABLE_TEST, false, 16, true },
+  { TABLE_TEST, true, 1, true },
+  { TABLE_TEST, false, 16, false, true },
+  { TABLE_TEST, true, 1, false, true },
 
   { BLOCK_TEST, false, 16 },
   { BLOCK_TEST, false, 1 },
@@ -423,6 +435,8 @@ static const TestArgs kTestArgList[] = {
   { BLOCK_TEST, true, 16 },
   { BLOCK_TEST, true, 1 },
   { BLOCK_TEST, true, 1024 },
+  { BLOCK_TEST, false, 16, false, true },
+  { BLOCK_TEST, true, 1, false, true },
 
   // Restart interval does not matter for memtables
   { MEMTABLE_TEST, false, 16 },
@@ -447,6 +461,12 @@ class Harness {
     // Use shorter block size for tests to exercise block boundary
     // conditions more.
     options_.block_size = 256;
+    if (args.partitioned) {
+      // Small partitions, so that most tables have several of them.
+      options_.partition_index_and_filters = true;
+      options_.metadata_block_size = 64;
+    }
+    options_.data_block_hash_index = args.hash_index;
     if (args.reverse_compare) {
       options_.comparator = &reverse_key_comparator;
     }
@@ -784,6 +804,87 @@ TEST(MemTableTest, Simple) {
   memtable->Unref();
 }
 
+class MergerTest { };
+
+// Merges up to 64 blocks whose keys are spread over the children at
+// random, and checks a random walk of seeks and steps in both directions
+// against the sorted set of all keys.
+TEST(MergerTest, ManyChildren) {
+  Random rnd(test::RandomSeed());
+  const Comparator* cmp = BytewiseComparator();
+  Options options;
+  for (int num_children = 2; num_children <= 64; num_children *= 2) {
+    KVMap model((STLLessThan(cmp)));
+    std::vector<KVMap> child_data(num_children, KVMap(STLLessThan(cmp)));
+    for (int i = 0; i < 50 * num_children; i++) {
+      std::string v;
+      std::string k = test::RandomKey(&rnd, 1 + rnd.Uniform(6));
+      if (model.count(k) == 0) {
+        model[k] = test::RandomString(&rnd, rnd.Skewed(4), &v).ToString();
+        child_data[rnd.Uniform(num_children)][k] = model[k];
+      }
+    }
+    std::vector<std::string> contents(num_children);
+    std::vector<Block*> blocks(num_children);
+    std::vector<Iterator*> children(num_children);
+    for (int c = 0; c < num_children; c++) {
+      BlockBuilder builder(&options);
+      for (KVMap::const_iterator it = child_data[c].begin();
+           it != child_data[c].end(); ++it) {
+        builder.Add(it->first, it->second);
+      }
+      contents[c] = builder.Finish().ToString();
+      BlockContents block_contents;
+      block_contents.data = contents[c];
+      block_contents.cachable = false;
+      block_contents.heap_allocated = false;
+      blocks[c] = new Block(block_contents);
+      children[c] = blocks[c]->NewIterator(cmp);
+    }
+    Iterator* iter = NewMergingIterator(cmp, &children[0], num_children);
+
+    KVMap::const_iterator model_iter = model.end();
+    for (int i = 0; i < 2000; i++) {
+      const int op = rnd.Uniform(5);
+      if (op == 0) {
+        iter->SeekToFirst();
+        model_iter = model.begin();
+      } else if (op == 1) {
+        iter->SeekToLast();
+        model_iter = model.empty() ? model.end() : --model.end();
+      } else if (op == 2) {
+        std::string k = test::RandomKey(&rnd, 1 + rnd.Uniform(6));
+        iter->Seek(k);
+        model_iter = model.lower_bound(k);
+      } else if (!iter->Valid()) {
+        continue;
+      } else if (op == 3) {
+        iter->Next();
+        ++model_iter;
+      } else {
+        iter->Prev();
+        if (model_iter == model.begin()) {
+          model_iter = model.end();
+        } else {
+          --model_iter;
+        }
+      }
+      if (model_iter == model.end()) {
+        ASSERT_TRUE(!iter->Valid());
+      } else {
+        ASSERT_TRUE(iter->Valid());
+        ASSERT_EQ(model_iter->first, iter->key().ToString());
+        ASSERT_EQ(model_iter->second, iter->value().ToString());
+      }
+    }
+    ASSERT_OK(iter->status());
+    delete iter;
+    for (int c = 0; c < num_children; c++) {
+      delete blocks[c];
+    }
+  }
+}
+
 static bool Between(uint64_t val, uint64_t low, uint64_t high) {
   bool result = (val >= low) && (val <= high);
   if (!result) {
@@ -797,6 +898,353 @@ static bool Between(uint64_t val, uint64_t low, uint64_t high) {
 
 class TableTest { };
 
+class BlockHashIndexTest { };
+
+static std::string HashIndexKey(int i) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "key%06d", i);
+  return std::string(buf);
+}
+
+// Build a block holding the keys for the even numbers below 2*num_keys,
+// and check lookups through the hash index.  Returns true if the block
+// has a hash index.
+static bool CheckHashIndexBlock(int restart_interval, int num_keys) {
+  Options options;
+  options.block_restart_interval = restart_interval;
+  options.data_block_hash_index = true;
+  BlockBuilder builder(&options);
+  for (int i = 0; i < num_keys; i++) {
+    builder.Add(HashIndexKey(2 * i), HashIndexKey(i));
+  }
+  Slice raw = builder.Finish();
+  const bool indexed =
+      (DecodeFixed32(raw.data() + raw.size() - 4) & kBlockHashIndexFlag) != 0;
+
+  BlockContents contents;
+  contents.data = raw;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+
+  // Keys in the block are found exactly; absent keys are not.
+  Iterator* iter = block.NewIterator(options.comparator, true);
+  for (int i = 0; i < 2 * num_keys; i++) {
+    const std::string key = HashIndexKey(i);
+    iter->Seek(key);
+    if (i % 2 == 0) {
+      ASSERT_TRUE(iter->Valid()) << key;
+      ASSERT_EQ(key, iter->key().ToString());
+      ASSERT_EQ(HashIndexKey(i / 2), iter->value().ToString());
+    } else {
+      ASSERT_TRUE(!iter->Valid() || iter->key().ToString() != key) << key;
+    }
+  }
+  ASSERT_OK(iter->status());
+  delete iter;
+
+  // Other iterators ignore the index.
+  iter = block.NewIterator(options.comparator);
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(num_keys, count);
+  iter->Seek(HashIndexKey(2 * num_keys - 3));
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(HashIndexKey(2 * num_keys - 2), iter->key().ToString());
+  ASSERT_OK(iter->status());
+  delete iter;
+  return indexed;
+}
+
+TEST(BlockHashIndexTest, PointLookups) {
+  ASSERT_TRUE(CheckHashIndexBlock(16, 1000));
+  ASSERT_TRUE(CheckHashIndexBlock(1, 200));
+  ASSERT_TRUE(CheckHashIndexBlock(1024, 1));
+}
+
+TEST(BlockHashIndexTest, TooManyRestarts) {
+  // Restart indexes must fit in a byte, so there is no index and lookups
+  // binary search.
+  ASSERT_TRUE(!CheckHashIndexBlock(1, 300));
+}
+
+// A StringSource that records the ranges passed to Prefetch().
+class PrefetchRecordingSource : public StringSource {
+ public:
+  explicit PrefetchRecordingSource(const Slice& contents)
+      : StringSource(contents) { }
+
+  virtual void Prefetch(uint64_t offset, size_t n) const {
+    prefetches_.push_back(std::make_pair(offset, static_cast<uint64_t>(n)));
+  }
+
+  mutable std::vector<std::pair<uint64_t, uint64_t> > prefetches_;
+};
+
+TEST(TableTest, Readahead) {
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  const int kNum = 2000;
+  for (int i = 0; i < kNum; i++) {
+    char key[100];
+    snprintf(key, sizeof(key), "key%06d", i);
+    builder.Add(key, std::string(500, 'v'));
+  }
+  ASSERT_OK(builder.Finish());
+
+  PrefetchRecordingSource* source = new PrefetchRecordingSource(
+      sink.contents());
+  Table* table;
+  ASSERT_OK(Table::Open(options, source, source->Size(), &table));
+
+  // A full scan prefetches ahead of the blocks it reads in contiguous
+  // windows that grow up to readahead_size.
+  const uint64_t kReadahead = 64 << 10;
+  ReadOptions read_options;
+  read_options.readahead_size = kReadahead;
+  Iterator* iter = table->NewIterator(read_options);
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  delete iter;
+  ASSERT_EQ(kNum, count);
+  const std::vector<std::pair<uint64_t, uint64_t> >& p = source->prefetches_;
+  ASSERT_GT(p.size(), 10);
+  ASSERT_GT(p[0].first, 0);
+  for (size_t i = 0; i < p.size(); i++) {
+    ASSERT_LE(p[i].second, kReadahead);
+    if (i > 0) {
+      ASSERT_EQ(p[i - 1].first + p[i - 1].second, p[i].first);
+      ASSERT_GE(p[i].second, p[i - 1].second);
+    }
+  }
+  ASSERT_EQ(kReadahead, p.back().second);
+  ASSERT_GE(p.back().first + p.back().second,
+            table->ApproximateOffsetOf("key999999"));
+
+  // Reads out of file order and iterators without readahead do not
+  // prefetch.
+  source->prefetches_.clear();
+  iter = table->NewIterator(read_options);
+  for (int i = kNum - 1; i >= 0; i -= 50) {
+    char key[100];
+    snprintf(key, sizeof(key), "key%06d", i);
+    iter->Seek(key);
+    ASSERT_TRUE(iter->Valid());
+  }
+  delete iter;
+  read_options.readahead_size = 0;
+  iter = table->NewIterator(read_options);
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) { }
+  delete iter;
+  ASSERT_EQ(0, source->prefetches_.size());
+
+  delete table;
+  delete source;
+}
+
+// A StringSource that counts the calls to Read().
+class ReadCountingSource : public StringSource {
+ public:
+  explicit ReadCountingSource(const Slice& contents)
+      : StringSource(contents), reads_(0) { }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const {
+    reads_++;
+    return StringSource::Read(offset, n, result, scratch);
+  }
+
+  mutable int reads_;
+};
+
+static std::string BuildCacheTestTable(const Options& options) {
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  for (int i = 0; i < 2000; i++) {
+    char key[100];
+    snprintf(key, sizeof(key), "key%06d", i);
+    builder.Add(key, std::string(1000, 'a' + i % 26));
+  }
+  ASSERT_OK(builder.Finish());
+  return sink.contents();
+}
+
+// Return how many reads of "source" it takes to seek "table" to "key".
+static int ReadsToSeek(Table* table, ReadCountingSource* source,
+                       const ReadOptions& options, const char* key) {
+  const int before = source->reads_;
+  Iterator* iter = table->NewIterator(options);
+  iter->Seek(key);
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(key, iter->key().ToString());
+  delete iter;
+  return source->reads_ - before;
+}
+
+TEST(TableTest, CacheIndexAndFilterBlocks) {
+  for (int pool = 0; pool < 2; pool++) {
+    for (int partitioned = 0; partitioned < 2; partitioned++) {
+      Options options;
+      options.compression = kNoCompression;
+      options.filter_policy = NewBloomFilterPolicy(10);
+      options.partition_index_and_filters = partitioned;
+      // Two tables of 2MB each share a 1MB cache.
+      options.block_cache = NewLRUCache(1 << 20, pool ? 0.5 : 0.0);
+      options.cache_index_and_filter_blocks = true;
+      const std::string contents = BuildCacheTestTable(options);
+      ReadCountingSource* source[2];
+      Table* table[2];
+      for (int t = 0; t < 2; t++) {
+        source[t] = new ReadCountingSource(contents);
+        ASSERT_OK(Table::Open(options, source[t], source[t]->Size(),
+                              &table[t]));
+      }
+      ASSERT_GT(options.block_cache->TotalCharge(), 0);
+
+      // Blocks that are read with fill_cache unset are evicted before
+      // the others.
+      ReadOptions read_options;
+      ASSERT_GE(ReadsToSeek(table[0], source[0], read_options, "key000500"),
+                1);
+      read_options.fill_cache = false;
+      Iterator* iter = table[1]->NewIterator(read_options);
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) { }
+      ASSERT_OK(iter->status());
+      delete iter;
+      read_options.fill_cache = true;
+      ASSERT_EQ(0,
+                ReadsToSeek(table[0], source[0], read_options, "key000500"));
+
+      // A scan that fills the cache evicts the index of the other table,
+      // unless it is kept in the high priority pool.
+      iter = table[1]->NewIterator(read_options);
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) { }
+      ASSERT_OK(iter->status());
+      delete iter;
+      const int reads = ReadsToSeek(table[0], source[0], read_options,
+                                    "key001000");
+      ASSERT_EQ(pool ? 1 + partitioned : 2 + partitioned, reads);
+
+      // The blocks are read again if they are evicted.
+      options.block_cache->Prune();
+      ASSERT_EQ(0, options.block_cache->TotalCharge());
+      ASSERT_EQ(2 + partitioned,
+                ReadsToSeek(table[0], source[0], read_options, "key001500"));
+
+      for (int t = 0; t < 2; t++) {
+        delete table[t];
+        delete source[t];
+      }
+      delete options.block_cache;
+      delete options.filter_policy;
+    }
+  }
+}
+
+// A ReadCountingSource that a PersistentCache can key blocks by.
+class IdentifiedSource : public ReadCountingSource {
+ public:
+  explicit IdentifiedSource(const Slice& contents)
+      : ReadCountingSource(contents) { }
+
+  virtual bool GetUniqueId(std::string* id) const {
+    *id = "table_test";
+    return true;
+  }
+};
+
+TEST(TableTest, PersistentCache) {
+  Env* env = Env::Default();
+  const std::string dbname = test::TmpDir() + "/table_test_pcache";
+  std::vector<std::string> children;
+  env->GetChildren(dbname, &children);
+  for (size_t i = 0; i < children.size(); i++) {
+    env->DeleteFile(dbname + "/" + children[i]);
+  }
+
+  Options options;
+  options.compression = kNoCompression;
+  options.block_cache = NewLRUCache(64 << 10);
+  ASSERT_OK(NewPersistentCache(env, dbname, 16 << 20,
+                               &options.persistent_cache));
+  const std::string contents = BuildCacheTestTable(options);
+  IdentifiedSource* source = new IdentifiedSource(contents);
+  Table* table;
+  ASSERT_OK(Table::Open(options, source, source->Size(), &table));
+  ReadOptions read_options;
+  ASSERT_EQ(1, ReadsToSeek(table, source, read_options, "key000500"));
+
+  // Blocks evicted from the block cache go to the persistent cache, which
+  // writes them out before it is deleted and finds them when reopened.
+  Iterator* iter = table->NewIterator(read_options);
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) { }
+  ASSERT_OK(iter->status());
+  delete iter;
+  options.block_cache->Prune();
+  delete table;
+  delete options.persistent_cache;
+  ASSERT_OK(NewPersistentCache(env, dbname, 16 << 20,
+                               &options.persistent_cache));
+  ASSERT_OK(Table::Open(options, source, source->Size(), &table));
+  ASSERT_EQ(0, ReadsToSeek(table, source, read_options, "key000500"));
+  options.block_cache->Prune();
+  ASSERT_EQ(0, ReadsToSeek(table, source, read_options, "key001500"));
+
+  delete table;
+  delete source;
+  delete options.block_cache;
+  delete options.persistent_cache;
+}
+
+// Counts the blocks handed to it, and never finds any.
+class CountingPersistentCache : public PersistentCache {
+ public:
+  CountingPersistentCache() : inserts_(0) { }
+  virtual void Insert(const Slice& key, const Slice& block) { inserts_++; }
+  virtual bool Lookup(const Slice& key, std::string* block) { return false; }
+  int inserts_;
+};
+
+TEST(TableTest, PersistentCacheTakesOnlyDataBlocks) {
+  for (int partitioned = 0; partitioned < 2; partitioned++) {
+    Options options;
+    options.compression = kNoCompression;
+    options.filter_policy = NewBloomFilterPolicy(10);
+    options.partition_index_and_filters = partitioned;
+    options.block_cache = NewLRUCache(1 << 20);
+    options.cache_index_and_filter_blocks = true;
+    CountingPersistentCache persistent_cache;
+    options.persistent_cache = &persistent_cache;
+    const std::string contents = BuildCacheTestTable(options);
+    IdentifiedSource* source = new IdentifiedSource(contents);
+    Table* table;
+    ASSERT_OK(Table::Open(options, source, source->Size(), &table));
+    ReadOptions read_options;
+    options.block_cache->Prune();
+    ASSERT_EQ(0, persistent_cache.inserts_);
+    ASSERT_EQ(2 + partitioned,
+              ReadsToSeek(table, source, read_options, "key000500"));
+
+    // Of the index, its partition and the data block read, only the
+    // data block is persisted when they are evicted.
+    options.block_cache->Prune();
+    ASSERT_EQ(1, persistent_cache.inserts_);
+
+    delete table;
+    delete source;
+    delete options.block_cache;
+    delete options.filter_policy;
+  }
+}
+
 TEST(TableTest, ApproximateOffsetOfPlain) {
   TableConstructor c(BytewiseComparator());
   c.Add("k01", "hello");
@@ -869,6 +1317,355 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 2 * min_z, 2 * max_z));
 }
 
+// Run-length encodes its input as (count, byte) pairs.
+class RunLengthCompressor : public Compressor {
+ public:
+  explicit RunLengthCompressor(unsigned char type) : type_(type) { }
+
+  virtual unsigned char type() const { return type_; }
+
+  virtual const char* Name() const { return "test.RunLength"; }
+
+  virtual bool Compress(const Slice& input, std::string* output) const {
+    output->clear();
+    size_t i = 0;
+    while (i < input.size()) {
+      size_t run = 1;
+      while (run < 255 && i + run < input.size() &&
+             input[i + run] == input[i]) {
+        run++;
+      }
+      output->push_back(static_cast<char>(run));
+      output->push_back(input[i]);
+      i += run;
+    }
+    return true;
+  }
+
+  virtual bool GetUncompressedLength(const Slice& input,
+                                     size_t* result) const {
+    if (input.size() % 2 != 0) {
+      return false;
+    }
+    *result = 0;
+    for (size_t i = 0; i < input.size(); i += 2) {
+      *result += static_cast<unsigned char>(input[i]);
+    }
+    return true;
+  }
+
+  virtual bool Uncompress(const Slice& input, char* output,
+                          size_t length) const {
+    for (size_t i = 0; i < input.size(); i += 2) {
+      const size_t run = static_cast<unsigned char>(input[i]);
+      memset(output, input[i + 1], run);
+      output += run;
+    }
+    return true;
+  }
+
+ private:
+  unsigned char type_;
+};
+
+TEST(TableTest, CompressorRegistry) {
+  ASSERT_TRUE(GetCompressor(kNoCompression) == NULL);
+  ASSERT_TRUE(GetCompressor(0xff) == NULL);
+
+  const CompressionType kTypes[] = {
+    kSnappyCompression, kZstdCompression, kLZ4Compression
+  };
+  const std::string input(1000, 'x');
+  for (size_t i = 0; i < sizeof(kTypes) / sizeof(kTypes[0]); i++) {
+    const Compressor* compressor = GetCompressor(kTypes[i]);
+    ASSERT_TRUE(compressor != NULL);
+    ASSERT_EQ(kTypes[i], compressor->type());
+    std::string compressed;
+    if (!compressor->Compress(input, &compressed)) {
+      fprintf(stderr, "skipping %s round trip\n", compressor->Name());
+      continue;
+    }
+    size_t length;
+    ASSERT_TRUE(compressor->GetUncompressedLength(compressed, &length));
+    ASSERT_EQ(input.size(), length);
+    std::string output(length, '\0');
+    ASSERT_TRUE(compressor->Uncompress(compressed, &output[0], length));
+    ASSERT_EQ(input, output);
+  }
+}
+
+TEST(TableTest, RegisteredCompressor) {
+  // Temporarily replace the lz4 compressor so that the custom one is
+  // used to write and read the blocks of the table.
+  const Compressor* lz4 = GetCompressor(kLZ4Compression);
+  RunLengthCompressor rle(kLZ4Compression);
+  RegisterCompressor(&rle);
+
+  TableConstructor c(BytewiseComparator());
+  c.Add("k01", "hello");
+  c.Add("k02", std::string(10000, 'a'));
+  c.Add("k03", "hello3");
+  c.Add("k04", std::string(10000, 'b'));
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kLZ4Compression;
+  c.Finish(options, &keys, &kvmap);
+
+  // Every 10000 byte value compresses to about 80 bytes.
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 0, 1000));
+
+  Iterator* iter = c.NewIterator();
+  iter->SeekToFirst();
+  for (KVMap::const_iterator it = kvmap.begin(); it != kvmap.end(); ++it) {
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(it->first, iter->key().ToString());
+    ASSERT_EQ(it->second, iter->value().ToString());
+    iter->Next();
+  }
+  ASSERT_TRUE(!iter->Valid());
+  delete iter;
+
+  RegisterCompressor(lz4);
+}
+
+TEST(TableTest, CustomCompressionType) {
+  // A compressor of its own byte, selected through Options::compression.
+  static RunLengthCompressor rle(0x40);
+  RegisterCompressor(&rle);
+  ASSERT_EQ(&rle, GetCompressor(0x40));
+
+  TableConstructor c(BytewiseComparator());
+  c.Add("k01", std::string(10000, 'a'));
+  c.Add("k02", std::string(10000, 'b'));
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = static_cast<CompressionType>(0x40);
+  c.Finish(options, &keys, &kvmap);
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 0, 1000));
+
+  Iterator* iter = c.NewIterator();
+  iter->SeekToFirst();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(std::string(10000, 'a'), iter->value().ToString());
+  iter->Next();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(std::string(10000, 'b'), iter->value().ToString());
+  iter->Next();
+  ASSERT_TRUE(!iter->Valid());
+  delete iter;
+}
+
+// Its dictionary is the most common byte of the samples, which every byte
+// is xor-ed with before run-length encoding.  Blocks compressed with the
+// dictionary therefore only uncompress correctly with it.
+class XorDictCompressor : public RunLengthCompressor {
+ public:
+  explicit XorDictCompressor(unsigned char type)
+      : RunLengthCompressor(type), dict_blocks_(0) { }
+
+  virtual bool TrainDictionary(const std::vector<Slice>& samples,
+                               size_t max_bytes, std::string* dict) const {
+    int counts[256] = { 0 };
+    for (size_t i = 0; i < samples.size(); i++) {
+      for (size_t j = 0; j < samples[i].size(); j++) {
+        counts[static_cast<unsigned char>(samples[i][j])]++;
+      }
+    }
+    int best = 0;
+    for (int c = 1; c < 256; c++) {
+      if (counts[c] > counts[best]) best = c;
+    }
+    dict->assign(1, static_cast<char>(best));
+    return true;
+  }
+
+  virtual CompressionDict* NewCompressionDict(const Slice& dict) const {
+    return new Dict(type(), dict[0]);
+  }
+
+  virtual CompressionDict* NewUncompressionDict(const Slice& dict) const {
+    return new Dict(type(), dict[0]);
+  }
+
+  virtual bool CompressWithDict(const Slice& input,
+                                const CompressionDict* dict,
+                                std::string* output) const {
+    if (dict == NULL) {
+      return Compress(input, output);
+    }
+    std::string xored = input.ToString();
+    Xor(dict, &xored[0], xored.size());
+    dict_blocks_++;
+    return Compress(xored, output);
+  }
+
+  virtual bool UncompressWithDict(const Slice& input,
+                                  const CompressionDict* dict,
+                                  char* output, size_t length) const {
+    if (!Uncompress(input, output, length)) {
+      return false;
+    }
+    if (dict != NULL) {
+      Xor(dict, output, length);
+    }
+    return true;
+  }
+
+  int dict_blocks() const { return dict_blocks_; }
+
+ private:
+  struct Dict : public CompressionDict {
+    Dict(unsigned char type, char k) : CompressionDict(type), key(k) { }
+    char key;
+  };
+
+  static void Xor(const CompressionDict* dict, char* p, size_t n) {
+    const char key = static_cast<const Dict*>(dict)->key;
+    for (size_t i = 0; i < n; i++) {
+      p[i] ^= key;
+    }
+  }
+
+  mutable int dict_blocks_;
+};
+
+TEST(TableTest, CompressionDictionary) {
+  const Compressor* lz4 = GetCompressor(kLZ4Compression);
+  XorDictCompressor compressor(kLZ4Compression);
+  RegisterCompressor(&compressor);
+
+  std::string dbname = test::TmpDir() + "/table_dict_testdb";
+  Options options;
+  options.create_if_missing = true;
+  options.block_size = 256;
+  options.compression = kLZ4Compression;
+  options.max_dictionary_bytes = 1;
+  options.dictionary_training_blocks = 4;
+  options.filter_policy = NewBloomFilterPolicy(10);
+  DestroyDB(dbname, options);
+  DB* db = NULL;
+  ASSERT_OK(DB::Open(options, dbname, &db));
+
+  // Values are mostly one byte, so the dictionary turns them into runs
+  // of zeros.
+  const int kNum = 2000;
+  for (int i = 0; i < kNum; i++) {
+    char key[100];
+    snprintf(key, sizeof(key), "key%06d", i);
+    std::string value(100, 'v');
+    value[i % 100] = static_cast<char>('a' + i % 26);
+    ASSERT_OK(db->Put(WriteOptions(), key, value));
+  }
+  db->CompactRange(NULL, NULL);
+  ASSERT_GT(compressor.dict_blocks(), 0);
+
+  // Reopen so that tables are read back from scratch.
+  delete db;
+  db = NULL;
+  ASSERT_OK(DB::Open(options, dbname, &db));
+  for (int i = 0; i < kNum; i++) {
+    char key[100];
+    snprintf(key, sizeof(key), "key%06d", i);
+    std::string expected(100, 'v');
+    expected[i % 100] = static_cast<char>('a' + i % 26);
+    std::string value;
+    ASSERT_OK(db->Get(ReadOptions(), key, &value));
+    ASSERT_EQ(expected, value);
+  }
+  std::string value;
+  ASSERT_TRUE(db->Get(ReadOptions(), "key", &value).IsNotFound());
+  ASSERT_TRUE(db->Get(ReadOptions(), "key999999", &value).IsNotFound());
+
+  Iterator* iter = db->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  ASSERT_EQ(kNum, count);
+  delete iter;
+
+  delete db;
+  DestroyDB(dbname, options);
+  delete options.filter_policy;
+  RegisterCompressor(lz4);
+}
+
+TEST(TableTest, PartitionedIndexAndFilters) {
+  std::string dbname = test::TmpDir() + "/table_partition_testdb";
+  Options options;
+  options.create_if_missing = true;
+  options.block_size = 256;
+  options.partition_index_and_filters = true;
+  options.metadata_block_size = 1024;
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.block_cache = NewLRUCache(1 << 20);
+  DestroyDB(dbname, options);
+  DB* db = NULL;
+  ASSERT_OK(DB::Open(options, dbname, &db));
+
+  const int kNum = 10000;
+  for (int i = 0; i < kNum; i += 2) {
+    char key[100];
+    snprintf(key, sizeof(key), "key%06d", i);
+    ASSERT_OK(db->Put(WriteOptions(), key, std::string(100, 'a' + i % 26)));
+  }
+  db->CompactRange(NULL, NULL);
+
+  // Reopen so that tables are read back from scratch, and read twice so
+  // that partitions come from the block cache the second time.
+  delete db;
+  db = NULL;
+  ASSERT_OK(DB::Open(options, dbname, &db));
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < kNum; i++) {
+      char key[100];
+      snprintf(key, sizeof(key), "key%06d", i);
+      std::string value;
+      Status s = db->Get(ReadOptions(), key, &value);
+      if (i % 2 == 0) {
+        ASSERT_OK(s);
+        ASSERT_EQ(std::string(100, 'a' + i % 26), value);
+      } else {
+        ASSERT_TRUE(s.IsNotFound());
+      }
+    }
+  }
+  std::string value;
+  ASSERT_TRUE(db->Get(ReadOptions(), "key", &value).IsNotFound());
+  ASSERT_TRUE(db->Get(ReadOptions(), "key999999", &value).IsNotFound());
+
+  Iterator* iter = db->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  ASSERT_EQ(kNum / 2, count);
+  iter->Seek("key005001");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("key005002", iter->key().ToString());
+  delete iter;
+
+  // Tables must still be readable without the filter policy.
+  delete db;
+  db = NULL;
+  const FilterPolicy* policy = options.filter_policy;
+  options.filter_policy = NULL;
+  ASSERT_OK(DB::Open(options, dbname, &db));
+  ASSERT_OK(db->Get(ReadOptions(), "key000042", &value));
+  ASSERT_TRUE(db->Get(ReadOptions(), "key000043", &value).IsNotFound());
+
+  delete db;
+  DestroyDB(dbname, options);
+  delete options.block_cache;
+  delete policy;
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
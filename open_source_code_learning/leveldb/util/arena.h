@@ -9,20 +9,28 @@
 #include <assert.h>
 #include <stddef.h>
 #include <stdint.h>
+#include "leveldb/memtablerep.h"
 #include "port/port.h"
 
 namespace leveldb {
 
-class Arena {
+// The memtable's allocator, handed to its MemTableRep.
+class Arena : public MemTableAllocator {
  public:
   Arena();
-  ~Arena();
+  virtual ~Arena();
 
   // Return a pointer to a newly allocated memory block of "bytes" bytes.
   char* Allocate(size_t bytes);
 
   // Allocate memory with the normal alignment guarantees provided by malloc
-  char* AllocateAligned(size_t bytes);
+  virtual char* AllocateAligned(size_t bytes);
+
+  // Thread-safe variants of Allocate() and AllocateAligned().  They may
+  // be called from several threads at once, but not concurrently with
+  // the unsynchronized variants above.
+  char* AllocateConcurrently(size_t bytes);
+  virtual char* AllocateAlignedConcurrently(size_t bytes);
 
   // Returns an estimate of the total memory usage of data allocated
   // by the arena.
@@ -44,6 +52,9 @@ class Arena {
   // Total memory usage of the arena.
   port::AtomicPointer memory_usage_;  //总的已用内存大小
 
+  // Serializes the *Concurrently() allocations
+  port::Mutex mu_;
+
   // No copying allowed
   Arena(const Arena&);
   void operator=(const Arena&);
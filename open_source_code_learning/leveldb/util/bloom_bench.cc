@@ -0,0 +1,127 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Compares the builtin bloom filter with the blocked bloom filter: the
+// time to probe keys that are in the filter and keys that are not, and
+// the false positive rate.  The filters are sized for the given number of
+// keys, so large counts measure filters that do not fit in the CPU caches.
+//
+// Usage: bloom_bench [--keys=N] [--bits_per_key=N] [--probes=N]
+//   --keys=N          number of keys in each filter (default 1000000)
+//   --bits_per_key=N  bits per key of both policies (default 10)
+//   --probes=N        number of present and of absent keys probed
+//                     (default 4000000)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+#include "port/port.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+static std::string MakeKey(uint64_t i) {
+  char buf[8];
+  EncodeFixed64(buf, i);
+  return std::string(buf, sizeof(buf));
+}
+
+// Probes "count" keys, cycling through "keys", and returns the average
+// time per probe in nanoseconds.  *matches is set to the number of
+// probes the filter reported as a possible match.  Keys are read in
+// order so that the filter accesses, which are random since keys are
+// hashed, dominate the cache misses.
+static double Probe(const FilterPolicy* policy, const Slice& filter,
+                    const std::vector<std::string>& keys, int count,
+                    int* matches) {
+  int found = 0;
+  const uint64_t start = Env::Default()->NowMicros();
+  for (int i = 0, k = 0; i < count; i++) {
+    if (policy->KeyMayMatch(keys[k], filter)) {
+      found++;
+    }
+    if (++k == static_cast<int>(keys.size())) {
+      k = 0;
+    }
+  }
+  const uint64_t micros = Env::Default()->NowMicros() - start;
+  *matches = found;
+  return static_cast<double>(micros) * 1e3 / count;
+}
+
+static void RunBenchmark(const FilterPolicy* policy, int num_keys,
+                         int num_probes) {
+  std::vector<std::string> present, absent;
+  for (int i = 0; i < num_keys; i++) {
+    present.push_back(MakeKey(i));
+    absent.push_back(MakeKey(i + (1ull << 40)));
+  }
+  std::vector<Slice> slices(present.begin(), present.end());
+  std::string filter;
+  const uint64_t start = Env::Default()->NowMicros();
+  policy->CreateFilter(&slices[0], num_keys, &filter);
+  const uint64_t build_micros = Env::Default()->NowMicros() - start;
+
+  int hits, false_positives;
+  const double hit_nanos = Probe(policy, filter, present, num_probes, &hits);
+  const double miss_nanos = Probe(policy, filter, absent, num_probes,
+                                  &false_positives);
+  if (hits != num_probes) {
+    fprintf(stderr, "%s: %d of %d present keys not found\n",
+            policy->Name(), num_probes - hits, num_probes);
+    exit(1);
+  }
+  fprintf(stdout,
+          "%-28s : build %7.2f ns/key; hit %7.2f ns/key; "
+          "miss %7.2f ns/key; fp rate %6.3f%%; %.2f bits/key\n",
+          policy->Name(), static_cast<double>(build_micros) * 1e3 / num_keys,
+          hit_nanos, miss_nanos, 100.0 * false_positives / num_probes,
+          8.0 * filter.size() / num_keys);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  int num_keys = 1000000;
+  int bits_per_key = 10;
+  int num_probes = 4000000;
+  for (int i = 1; i < argc; i++) {
+    int n;
+    char junk;
+    if (sscanf(argv[i], "--keys=%d%c", &n, &junk) == 1 && n > 0) {
+      num_keys = n;
+    } else if (sscanf(argv[i], "--bits_per_key=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      bits_per_key = n;
+    } else if (sscanf(argv[i], "--probes=%d%c", &n, &junk) == 1 && n > 0) {
+      num_probes = n;
+    } else {
+      fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+      exit(1);
+    }
+  }
+
+  static const char kProbeBlock[64] = { 0 };
+  const bool accelerated =
+      leveldb::port::AcceleratedBloomProbe(kProbeBlock, 0, 1) >= 0;
+  fprintf(stdout, "Keys:          %d\n", num_keys);
+  fprintf(stdout, "Bits per key:  %d\n", bits_per_key);
+  fprintf(stdout, "Blocked probe: %s\n",
+          accelerated ? "AVX2" : "portable");
+  fprintf(stdout, "------------------------------------------------\n");
+
+  const leveldb::FilterPolicy* policies[] = {
+    leveldb::NewBloomFilterPolicy(bits_per_key),
+    leveldb::NewBlockedBloomFilterPolicy(bits_per_key),
+  };
+  for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+    leveldb::RunBenchmark(policies[i], num_keys, num_probes);
+    delete policies[i];
+  }
+  return 0;
+}
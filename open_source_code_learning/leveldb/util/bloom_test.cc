@@ -26,6 +26,7 @@ class BloomTest {
 
  public:
   BloomTest() : policy_(NewBloomFilterPolicy(10)) { }
+  explicit BloomTest(const FilterPolicy* policy) : policy_(policy) { }
 
   ~BloomTest() {
     delete policy_;
@@ -113,7 +114,7 @@ static int NextLength(int length) {
   return length;
 }
 
-TEST(BloomTest, VaryingLengths) {
+static void CheckVaryingLengths(BloomTest* t, size_t min_size) {
   char buffer[sizeof(int)];
 
   // Count number of filters that significantly exceed the false positive rate
@@ -121,26 +122,27 @@ TEST(BloomTest, VaryingLengths) {
   int good_filters = 0;
 
   for (int length = 1; length <= 10000; length = NextLength(length)) {
-    Reset();
+    t->Reset();
     for (int i = 0; i < length; i++) {
-      Add(Key(i, buffer));
+      t->Add(Key(i, buffer));
     }
-    Build();
+    t->Build();
 
-    ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + 40))
+    ASSERT_LE(t->FilterSize(),
+              static_cast<size_t>((length * 10 / 8) + min_size))
         << length;
 
     // All added keys must match
     for (int i = 0; i < length; i++) {
-      ASSERT_TRUE(Matches(Key(i, buffer)))
+      ASSERT_TRUE(t->Matches(Key(i, buffer)))
           << "Length " << length << "; key " << i;
     }
 
     // Check false positive rate
-    double rate = FalsePositiveRate();
+    double rate = t->FalsePositiveRate();
     if (kVerbose >= 1) {
       fprintf(stderr, "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
-              rate*100.0, length, static_cast<int>(FilterSize()));
+              rate*100.0, length, static_cast<int>(t->FilterSize()));
     }
     ASSERT_LE(rate, 0.02);   // Must not be over 2%
     if (rate > 0.0125) mediocre_filters++;  // Allowed, but not too often
@@ -153,6 +155,34 @@ TEST(BloomTest, VaryingLengths) {
   ASSERT_LE(mediocre_filters, good_filters/5);
 }
 
+TEST(BloomTest, VaryingLengths) {
+  CheckVaryingLengths(this, 40);
+}
+
+class BlockedBloomTest : public BloomTest {
+ public:
+  BlockedBloomTest() : BloomTest(NewBlockedBloomFilterPolicy(10)) { }
+};
+
+TEST(BlockedBloomTest, BlockedEmptyFilter) {
+  ASSERT_TRUE(! Matches("hello"));
+  ASSERT_TRUE(! Matches("world"));
+}
+
+TEST(BlockedBloomTest, BlockedSmall) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(! Matches("x"));
+  ASSERT_TRUE(! Matches("foo"));
+}
+
+TEST(BlockedBloomTest, BlockedVaryingLengths) {
+  // Filters are a whole number of 64-byte blocks, plus the probe count.
+  CheckVaryingLengths(this, 65);
+}
+
 // Different bits-per-byte
 
 }  // namespace leveldb
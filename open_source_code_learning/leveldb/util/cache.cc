@@ -48,6 +48,13 @@ namespace {
 // Elements are moved between these lists by the Ref() and Unref() methods,
 // when they detect an element in the cache acquiring or losing its only
 // external reference.
+//
+// The LRU list is really three lists, one per Cache::Priority, and eviction
+// takes the oldest entry of the low priority list, then of the normal one,
+// then of the high priority one.  Low priority entries that are looked up
+// again become normal, so the blocks of a scan only displace each other
+// unless they are read twice.  High priority entries beyond the capacity
+// of the high priority pool become normal, oldest first.
 
 // An entry is a variable length heap-allocated structure.  Entries
 // are kept in a circular doubly linked list ordered by access time.
@@ -60,6 +67,7 @@ struct LRUHandle {
   size_t charge;  //这个节点占用的内存      // TODO(opt): Only allow uint32_t?
   size_t key_length;  //这个节点键值得长度
   bool in_cache;  //判断cache是否包括一个入口引用      // Whether entry is in the cache.
+  Cache::Priority priority;  // Which LRU list the entry goes on when unused
   uint32_t refs;  //这个节点引用次数，当次数为0时，即可删除      // References, including cache reference, if present.
   uint32_t hash;  //这个键值得哈希值      // Hash of key(); used for fast sharding and comparisons
   //C++柔性数组。 GCC 由于对 C99 的支持，允许定义 char key_data[] 这样的柔性数组（Flexible Array)。
@@ -191,12 +199,16 @@ class LRUCache {
   ~LRUCache();
 
   // Separate from constructor so caller can easily make an array of LRUCache
-  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+  void SetCapacity(size_t capacity, size_t high_pri_capacity) {
+    capacity_ = capacity;
+    high_pri_capacity_ = high_pri_capacity;
+  }
 
   // Like Cache methods, but with an extra "hash" parameter.
   Cache::Handle* Insert(const Slice& key, uint32_t hash,
                         void* value, size_t charge,
-                        void (*deleter)(const Slice& key, void* value));
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
   Cache::Handle* Lookup(const Slice& key, uint32_t hash);
   void Release(Cache::Handle* handle);
   void Erase(const Slice& key, uint32_t hash);
@@ -212,16 +224,21 @@ class LRUCache {
   void Ref(LRUHandle* e);
   void Unref(LRUHandle* e);
   bool FinishErase(LRUHandle* e);
+  LRUHandle* ListFor(LRUHandle* e);
+  LRUHandle* OldestUnused();
+  void MaintainHighPriPool();
 
   // Initialized before use.
   // 缓存数据的总容量，这个双向链表的存储容量，由每个节点的charge累加和
   size_t capacity_;
+  size_t high_pri_capacity_;
 
   // mutex_ protects the following state.
   // 这个链表的互斥量
   mutable port::Mutex mutex_;
   //缓存数据的总大小
   size_t usage_;
+  size_t high_pri_usage_;  // Charge of the kHighPriority entries in the cache
 
   // Dummy head of LRU list.
   // lru.prev is newest entry, lru.next is oldest entry.
@@ -229,6 +246,10 @@ class LRUCache {
   //双向循环链表，有大小限制，当缓存不够时，保证先清除旧的数据 
   LRUHandle lru_;
 
+  // Dummy heads of the LRU lists of kLowPriority and kHighPriority entries.
+  LRUHandle lru_low_;
+  LRUHandle lru_high_;
+
   // Dummy head of in-use list.
   // Entries are in use by clients, and have refs >= 2 and in_cache==true.
   // 已使用链表的傀儡节点
@@ -240,24 +261,31 @@ class LRUCache {
 };
 
 LRUCache::LRUCache()
-    : usage_(0) {
+    : usage_(0), high_pri_usage_(0) {
   // Make empty circular linked lists.
   // 初始为空的循环链表，前后指针都指向自己
   lru_.next = &lru_;
   lru_.prev = &lru_;
+  lru_low_.next = &lru_low_;
+  lru_low_.prev = &lru_low_;
+  lru_high_.next = &lru_high_;
+  lru_high_.prev = &lru_high_;
   in_use_.next = &in_use_;
   in_use_.prev = &in_use_;
 }
 
 LRUCache::~LRUCache() {
   assert(in_use_.next == &in_use_);  // Error if caller has an unreleased handle
-  for (LRUHandle* e = lru_.next; e != &lru_; ) {
-    LRUHandle* next = e->next;
-    assert(e->in_cache);
-    e->in_cache = false;
-    assert(e->refs == 1);  // Invariant of lru_ list.
-    Unref(e);
-    e = next;
+  LRUHandle* lists[3] = { &lru_low_, &lru_, &lru_high_ };
+  for (int i = 0; i < 3; i++) {
+    for (LRUHandle* e = lists[i]->next; e != lists[i]; ) {
+      LRUHandle* next = e->next;
+      assert(e->in_cache);
+      e->in_cache = false;
+      assert(e->refs == 1);  // Invariant of lru_ list.
+      Unref(e);
+      e = next;
+    }
   }
 }
 
@@ -280,6 +308,44 @@ void LRUCache::Unref(LRUHandle* e) {
     free(e);
   } else if (e->in_cache && e->refs == 1) {  // No longer in use; move to lru_ list.
     LRU_Remove(e);
+    LRU_Append(ListFor(e), e);
+    if (e->priority == Cache::kHighPriority) {
+      MaintainHighPriPool();
+    }
+  }
+}
+
+LRUHandle* LRUCache::ListFor(LRUHandle* e) {
+  switch (e->priority) {
+    case Cache::kLowPriority:
+      return &lru_low_;
+    case Cache::kHighPriority:
+      return &lru_high_;
+    default:
+      return &lru_;
+  }
+}
+
+// Return the unused entry to evict next, or NULL if there is none.
+LRUHandle* LRUCache::OldestUnused() {
+  if (lru_low_.next != &lru_low_) {
+    return lru_low_.next;
+  } else if (lru_.next != &lru_) {
+    return lru_.next;
+  } else if (lru_high_.next != &lru_high_) {
+    return lru_high_.next;
+  }
+  return NULL;
+}
+
+// Demote the oldest unused high priority entries to normal priority
+// until the rest fit in the high priority pool.
+void LRUCache::MaintainHighPriPool() {
+  while (high_pri_usage_ > high_pri_capacity_ && lru_high_.next != &lru_high_) {
+    LRUHandle* e = lru_high_.next;
+    LRU_Remove(e);
+    e->priority = Cache::kNormalPriority;
+    high_pri_usage_ -= e->charge;
     LRU_Append(&lru_, e);
   }
 }
@@ -302,6 +368,9 @@ Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
   MutexLock l(&mutex_);
   LRUHandle* e = table_.Lookup(key, hash);
   if (e != NULL) {
+    if (e->priority == Cache::kLowPriority) {
+      e->priority = Cache::kNormalPriority;  // Read again, so not just a scan
+    }
     Ref(e);
   }
   return reinterpret_cast<Cache::Handle*>(e);
@@ -314,7 +383,8 @@ void LRUCache::Release(Cache::Handle* handle) {
 
 Cache::Handle* LRUCache::Insert(
     const Slice& key, uint32_t hash, void* value, size_t charge,
-    void (*deleter)(const Slice& key, void* value)) {
+    void (*deleter)(const Slice& key, void* value),
+    Cache::Priority priority) {
   MutexLock l(&mutex_);  //多线程使用，添加删除均需要锁住
 
   //给插入的节点分配空间
@@ -327,6 +397,10 @@ Cache::Handle* LRUCache::Insert(
   e->key_length = key.size();
   e->hash = hash;
   e->in_cache = false;
+  e->priority = priority;
+  if (priority == Cache::kHighPriority && high_pri_capacity_ == 0) {
+    e->priority = Cache::kNormalPriority;
+  }
   e->refs = 1;  //返回值引用一次 // for the returned handle.
   memcpy(e->key_data, key.data(), key.size());
 
@@ -335,6 +409,9 @@ Cache::Handle* LRUCache::Insert(
     e->in_cache = true;
     LRU_Append(&in_use_, e);  //添加进循环链表
     usage_ += charge;  //链表空间使用量更新
+    if (e->priority == Cache::kHighPriority) {
+      high_pri_usage_ += charge;
+    }
     FinishErase(table_.Insert(e));
   } else {  // don't cache. (capacity_==0 is supported and turns off caching.)
     // next is read by key() in an assert, so it must be initialized
@@ -342,8 +419,8 @@ Cache::Handle* LRUCache::Insert(
   }
   //缓存不够用时，从循环链表的lru_next开始删除节点，同时要把哈希表的节点删除
   //缓存不够，清除比较旧的数据
-  while (usage_ > capacity_ && lru_.next != &lru_) {
-    LRUHandle* old = lru_.next;
+  LRUHandle* old;
+  while (usage_ > capacity_ && (old = OldestUnused()) != NULL) {
     assert(old->refs == 1);
     bool erased = FinishErase(table_.Remove(old->key(), old->hash));
     if (!erased) {  // to avoid unused variable when compiled NDEBUG
@@ -364,6 +441,9 @@ bool LRUCache::FinishErase(LRUHandle* e) {
     LRU_Remove(e);
     e->in_cache = false;
     usage_ -= e->charge;
+    if (e->priority == Cache::kHighPriority) {
+      high_pri_usage_ -= e->charge;
+    }
     Unref(e);
   }
   return e != NULL;
@@ -376,8 +456,8 @@ void LRUCache::Erase(const Slice& key, uint32_t hash) {
 
 void LRUCache::Prune() {
   MutexLock l(&mutex_);
-  while (lru_.next != &lru_) {
-    LRUHandle* e = lru_.next;
+  LRUHandle* e;
+  while ((e = OldestUnused()) != NULL) {
     assert(e->refs == 1);
     bool erased = FinishErase(table_.Remove(e->key(), e->hash));
     if (!erased) {  // to avoid unused variable when compiled NDEBUG
@@ -410,21 +490,30 @@ class ShardedLRUCache : public Cache {
   }
 
  public:
-  explicit ShardedLRUCache(size_t capacity)
+  ShardedLRUCache(size_t capacity, double high_pri_pool_ratio)
       : last_id_(0) {
        //将容量平均分成16份，如果有剩余，将剩余补全	      
     const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
     for (int s = 0; s < kNumShards; s++) {
-      shard_[s].SetCapacity(per_shard);
+      shard_[s].SetCapacity(per_shard,
+                            static_cast<size_t>(per_shard *
+                                                high_pri_pool_ratio));
     }
   }
   virtual ~ShardedLRUCache() { }
   // charge 数据大小
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) {
+    return Insert(key, value, charge, deleter, kNormalPriority);
+  }
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         Priority priority) {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      priority);
   }
+  virtual bool SupportsPriorities() const { return true; }
   virtual Handle* Lookup(const Slice& key) {
     const uint32_t hash = HashSlice(key);
     return shard_[Shard(hash)].Lookup(key, hash);
@@ -460,8 +549,19 @@ class ShardedLRUCache : public Cache {
 
 }  // end anonymous namespace
 
+Cache::Handle* Cache::Insert(const Slice& key, void* value, size_t charge,
+                             void (*deleter)(const Slice& key, void* value),
+                             Priority priority) {
+  return Insert(key, value, charge, deleter);
+}
+
 Cache* NewLRUCache(size_t capacity) {
-  return new ShardedLRUCache(capacity);
+  return new ShardedLRUCache(capacity, 0.0);
+}
+
+Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio) {
+  assert(high_pri_pool_ratio >= 0.0 && high_pri_pool_ratio <= 1.0);
+  return new ShardedLRUCache(capacity, high_pri_pool_ratio);
 }
 
 }  // namespace leveldb
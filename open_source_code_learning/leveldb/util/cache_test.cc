@@ -5,7 +5,11 @@
 #include "leveldb/cache.h"
 
 #include <vector>
+#include "leveldb/env.h"
+#include "port/port.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
 #include "util/testharness.h"
 
 namespace leveldb {
@@ -27,6 +31,13 @@ class CacheTest {
  public:
   static CacheTest* current_;
 
+  // Every test runs once against each cache implementation.
+  static bool use_clock_;
+
+  static Cache* NewCache(size_t capacity) {
+    return use_clock_ ? NewClockCache(capacity, 4) : NewLRUCache(capacity);
+  }
+
   static void Deleter(const Slice& key, void* v) {
     current_->deleted_keys_.push_back(DecodeKey(key));
     current_->deleted_values_.push_back(DecodeValue(v));
@@ -37,7 +48,7 @@ class CacheTest {
   std::vector<int> deleted_values_;
   Cache* cache_;
 
-  CacheTest() : cache_(NewLRUCache(kCacheSize)) {
+  CacheTest() : cache_(NewCache(kCacheSize)) {
     current_ = this;
   }
 
@@ -59,6 +70,11 @@ class CacheTest {
                                    &CacheTest::Deleter));
   }
 
+  void InsertWithPriority(int key, int value, Cache::Priority priority) {
+    cache_->Release(cache_->Insert(EncodeKey(key), EncodeValue(value), 1,
+                                   &CacheTest::Deleter, priority));
+  }
+
   Cache::Handle* InsertAndReturnHandle(int key, int value, int charge = 1) {
     return cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
                           &CacheTest::Deleter);
@@ -69,6 +85,7 @@ class CacheTest {
   }
 };
 CacheTest* CacheTest::current_;
+bool CacheTest::use_clock_;
 
 TEST(CacheTest, HitAndMiss) {
   ASSERT_EQ(-1, Lookup(100));
@@ -221,14 +238,155 @@ TEST(CacheTest, Prune) {
 
 TEST(CacheTest, ZeroSizeCache) {
   delete cache_;
-  cache_ = NewLRUCache(0);
+  cache_ = NewCache(0);
 
   Insert(1, 100);
   ASSERT_EQ(-1, Lookup(1));
 }
 
+TEST(CacheTest, HighPriorityPool) {
+  // Only the LRU cache has a high priority pool.
+  for (int pool = 0; pool < 2; pool++) {
+    delete cache_;
+    cache_ = NewLRUCache(kCacheSize, pool ? 0.5 : 0.0);
+    for (int i = 0; i < kCacheSize / 4; i++) {
+      InsertWithPriority(i, 1000 + i, Cache::kHighPriority);
+    }
+    for (int i = 0; i < 2 * kCacheSize; i++) {
+      Insert(kCacheSize + i, i);
+    }
+    int found = 0;
+    for (int i = 0; i < kCacheSize / 4; i++) {
+      if (Lookup(i) == 1000 + i) {
+        found++;
+      }
+    }
+    ASSERT_EQ(pool ? kCacheSize / 4 : 0, found);
+  }
+}
+
+TEST(CacheTest, LowPriorityEntries) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize);
+  for (int i = 0; i < kCacheSize / 4; i++) {
+    Insert(i, 1000 + i);
+  }
+  // Low priority entries only displace each other, unless they are
+  // looked up again.
+  InsertWithPriority(kCacheSize, 1, Cache::kLowPriority);
+  ASSERT_EQ(1, Lookup(kCacheSize));
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    InsertWithPriority(kCacheSize + 1 + i, i, Cache::kLowPriority);
+  }
+  for (int i = 0; i < kCacheSize / 4; i++) {
+    ASSERT_EQ(1000 + i, Lookup(i));
+  }
+  ASSERT_EQ(1, Lookup(kCacheSize));
+  ASSERT_EQ(-1, Lookup(kCacheSize + 1));
+}
+
+TEST(CacheTest, ClockLowPriorityEntries) {
+  // A single shard, so that the sweep order is the insertion order.
+  delete cache_;
+  cache_ = NewClockCache(kCacheSize, 0);
+  ASSERT_TRUE(cache_->SupportsPriorities());
+  for (int i = 0; i < kCacheSize / 2; i++) {
+    Insert(i, 1000 + i);
+  }
+  for (int i = 0; i < kCacheSize / 2; i++) {
+    InsertWithPriority(kCacheSize + i, i, Cache::kLowPriority);
+  }
+  // The sweep passes every normal entry before it reaches the first low
+  // priority one, and evicts that.
+  Insert(2 * kCacheSize, 1);
+  for (int i = 0; i < kCacheSize / 2; i++) {
+    ASSERT_EQ(1000 + i, Lookup(i));
+  }
+  ASSERT_EQ(-1, Lookup(kCacheSize));
+  ASSERT_EQ(1, Lookup(kCacheSize + 1));
+  ASSERT_EQ(1, Lookup(2 * kCacheSize));
+}
+
+// Entries of the concurrent test hold their key as value, and the
+// deleter counts them so that the test can check none leaks or is
+// deleted twice.
+static port::Mutex concurrent_mu;
+static int concurrent_live = 0;
+
+static void ConcurrentDeleter(const Slice& key, void* v) {
+  ASSERT_EQ(DecodeKey(key), DecodeValue(v));
+  MutexLock l(&concurrent_mu);
+  concurrent_live--;
+}
+
+struct ConcurrentState {
+  Cache* cache;
+  int id;
+  port::AtomicPointer done;
+};
+
+static void ConcurrentBody(void* arg) {
+  ConcurrentState* state = reinterpret_cast<ConcurrentState*>(arg);
+  Cache* cache = state->cache;
+  Random rnd(1000 + state->id);
+  for (int i = 0; i < 100000; i++) {
+    const int k = rnd.Uniform(200);
+    const std::string key = EncodeKey(k);
+    const int op = rnd.Uniform(10);
+    if (op < 6) {
+      Cache::Handle* h = cache->Lookup(key);
+      if (h != NULL) {
+        ASSERT_EQ(k, DecodeValue(cache->Value(h)));
+        cache->Release(h);
+      }
+    } else if (op < 9) {
+      {
+        MutexLock l(&concurrent_mu);
+        concurrent_live++;
+      }
+      cache->Release(cache->Insert(key, EncodeValue(k), 1 + rnd.Uniform(3),
+                                   &ConcurrentDeleter));
+    } else {
+      cache->Erase(key);
+    }
+  }
+  state->done.Release_Store(state);
+}
+
+TEST(CacheTest, Concurrent) {
+  // Small enough that the threads keep evicting each other's entries.
+  delete cache_;
+  cache_ = NewCache(100);
+
+  const int kNumThreads = 4;
+  ConcurrentState state[kNumThreads];
+  for (int id = 0; id < kNumThreads; id++) {
+    state[id].cache = cache_;
+    state[id].id = id;
+    state[id].done.Release_Store(NULL);
+    Env::Default()->StartThread(ConcurrentBody, &state[id]);
+  }
+  for (int id = 0; id < kNumThreads; id++) {
+    while (state[id].done.Acquire_Load() == NULL) {
+      Env::Default()->SleepForMicroseconds(10000);
+    }
+  }
+  ASSERT_LE(cache_->TotalCharge(), 100 + 3);
+
+  delete cache_;
+  cache_ = NULL;
+  MutexLock l(&concurrent_mu);
+  ASSERT_EQ(0, concurrent_live);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
-  return leveldb::test::RunAllTests();
+  leveldb::CacheTest::use_clock_ = false;
+  int result = leveldb::test::RunAllTests();
+  if (result == 0) {
+    leveldb::CacheTest::use_clock_ = true;
+    result = leveldb::test::RunAllTests();
+  }
+  return result;
 }
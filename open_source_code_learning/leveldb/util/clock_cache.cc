@@ -0,0 +1,491 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A Cache that approximates LRU with the CLOCK algorithm so that hits
+// need no mutex.  Each entry has a small usage count that Lookup() raises;
+// when the cache is full a clock hand sweeps the entries, lowering usage
+// counts and evicting the first unreferenced entry whose count was
+// already zero.  A count rather than a single bit keeps entries that are
+// hit over and over apart from ones looked up once since the last sweep.
+//
+// Insert() starts the count at 0, 1 or 2 for Cache::kLowPriority,
+// kNormalPriority and kHighPriority, so the hand evicts a low priority
+// entry that was never looked up before the others it passes.
+//
+// Lookup() walks the hash chains without locking and pins an entry by
+// compare-and-swapping a single state word:
+//
+//   bits 63..32  hash of the key
+//   bits 31..3   number of handles the clients hold
+//   bits  2..1   usage count, saturating at 3
+//   bit   0      visible: the entry is in the cache and may be returned
+//
+// Insert(), Erase(), Prune() and eviction hold the shard mutex, as does
+// the final Release() of an entry that was removed while in use.
+// Handles are never freed while the cache lives; removed ones go on a
+// free list and are reused for later insertions.  A concurrent Lookup()
+// may therefore reach a handle that has since been reused for another
+// key, or follow a chain that is being changed; it re-checks the key
+// after pinning and at worst reports a miss.
+
+#include <assert.h>
+#include <string>
+#include <vector>
+
+#include "leveldb/cache.h"
+#include "port/port.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+static const uint64_t kVisible = 1;
+static const uint64_t kOneUsage = 2;
+static const uint64_t kUsageMask = 6;
+static const uint64_t kOneRef = 8;
+static const uint64_t kRefMask = 0xfffffff8u;
+
+static inline uint32_t StateHash(uint64_t s) {
+  return static_cast<uint32_t>(s >> 32);
+}
+
+static inline uint64_t StateRefs(uint64_t s) {
+  return (s & kRefMask) / kOneRef;
+}
+
+// The state word lives in an AtomicPointer, which on the 64-bit
+// platforms NewClockCache() accepts is wide enough to hold it.
+static inline uint64_t Load(const port::AtomicPointer* p) {
+  return reinterpret_cast<uintptr_t>(p->Acquire_Load());
+}
+
+static inline void Store(port::AtomicPointer* p, uint64_t s) {
+  p->Release_Store(reinterpret_cast<void*>(static_cast<uintptr_t>(s)));
+}
+
+static inline bool CompareAndSwap(port::AtomicPointer* p, uint64_t expected,
+                                  uint64_t s) {
+  return p->CompareAndSwap(
+      reinterpret_cast<void*>(static_cast<uintptr_t>(expected)),
+      reinterpret_cast<void*>(static_cast<uintptr_t>(s)));
+}
+
+struct ClockHandle {
+  port::AtomicPointer state;
+  port::AtomicPointer next_hash;  // Next ClockHandle in the hash chain
+
+  // Written under the shard mutex before the entry becomes visible and
+  // left alone while any client holds a handle to it.
+  void* value;
+  void (*deleter)(const Slice&, void* value);
+  size_t charge;
+  std::string key_data;
+
+  ClockHandle* next_free;  // Protected by the shard mutex
+
+  Slice key() const { return Slice(key_data); }
+  uint32_t hash() const { return StateHash(Load(&state)); }
+  ClockHandle* next() const {
+    return reinterpret_cast<ClockHandle*>(next_hash.Acquire_Load());
+  }
+};
+
+// A power-of-two array of hash chains.  Tables replaced by a bigger one
+// are kept until the cache is destroyed since Lookup() may still be
+// reading them; together they are smaller than the current table.
+struct ClockTable {
+  uint32_t length;
+  port::AtomicPointer* list;
+};
+
+// A single shard of sharded cache.
+class ClockCache {
+ public:
+  ClockCache();
+  ~ClockCache();
+
+  // Separate from constructor so caller can easily make an array of ClockCache
+  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+
+  Cache::Handle* Insert(const Slice& key, uint32_t hash,
+                        void* value, size_t charge,
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(Cache::Handle* handle);
+  void Erase(const Slice& key, uint32_t hash);
+  void Prune();
+  size_t TotalCharge() const {
+    MutexLock l(&mutex_);
+    return usage_;
+  }
+
+ private:
+  bool Ref(ClockHandle* h, uint32_t hash);
+  port::AtomicPointer* FindPointer(const Slice& key, uint32_t hash);
+  void Unlink(ClockHandle* h);
+  bool Hide(ClockHandle* h);
+  void Recycle(ClockHandle* h);
+  void EvictToCapacity();
+  void Resize();
+
+  // Initialized before use.
+  size_t capacity_;
+
+  // mutex_ protects the following state.
+  mutable port::Mutex mutex_;
+  size_t usage_;
+  uint32_t elems_;
+  port::AtomicPointer table_;          // Current ClockTable, read lock-free
+  std::vector<ClockTable*> tables_;    // Every table, for the destructor
+  std::vector<ClockHandle*> handles_;  // Every handle, in clock order
+  size_t clock_hand_;                  // Next index into handles_ to sweep
+  ClockHandle* free_;                  // Handles not in use
+};
+
+ClockCache::ClockCache()
+    : usage_(0), elems_(0), clock_hand_(0), free_(NULL) {
+  ClockTable* t = new ClockTable;
+  t->length = 4;
+  t->list = new port::AtomicPointer[t->length];
+  for (uint32_t i = 0; i < t->length; i++) {
+    t->list[i].NoBarrier_Store(NULL);
+  }
+  tables_.push_back(t);
+  table_.NoBarrier_Store(t);
+}
+
+ClockCache::~ClockCache() {
+  for (size_t i = 0; i < handles_.size(); i++) {
+    ClockHandle* h = handles_[i];
+    const uint64_t s = Load(&h->state);
+    assert(StateRefs(s) == 0);  // Error if caller has an unreleased handle
+    if (s & kVisible) {
+      (*h->deleter)(h->key(), h->value);
+    }
+    delete h;
+  }
+  for (size_t i = 0; i < tables_.size(); i++) {
+    delete[] tables_[i]->list;
+    delete tables_[i];
+  }
+}
+
+// Pin "h" if it is visible and was inserted with "hash".
+bool ClockCache::Ref(ClockHandle* h, uint32_t hash) {
+  uint64_t s = Load(&h->state);
+  while (StateHash(s) == hash && (s & kVisible)) {
+    uint64_t pinned = s + kOneRef;
+    if ((s & kUsageMask) != kUsageMask) {
+      pinned += kOneUsage;
+    }
+    if (CompareAndSwap(&h->state, s, pinned)) {
+      return true;
+    }
+    s = Load(&h->state);
+  }
+  return false;
+}
+
+Cache::Handle* ClockCache::Lookup(const Slice& key, uint32_t hash) {
+  ClockTable* t = reinterpret_cast<ClockTable*>(table_.Acquire_Load());
+  ClockHandle* h = reinterpret_cast<ClockHandle*>(
+      t->list[hash & (t->length - 1)].Acquire_Load());
+  for (; h != NULL; h = h->next()) {
+    if (Ref(h, hash)) {
+      if (h->key() == key) {
+        return reinterpret_cast<Cache::Handle*>(h);
+      }
+      // Another key with the same hash, or a handle reused since we
+      // reached it.
+      Release(reinterpret_cast<Cache::Handle*>(h));
+    }
+  }
+  return NULL;
+}
+
+void ClockCache::Release(Cache::Handle* handle) {
+  ClockHandle* h = reinterpret_cast<ClockHandle*>(handle);
+  uint64_t s = Load(&h->state);
+  while (!CompareAndSwap(&h->state, s, s - kOneRef)) {
+    s = Load(&h->state);
+  }
+  s -= kOneRef;
+  if (StateRefs(s) == 0 && !(s & kVisible)) {
+    // Removed from the cache while we held it and nobody can pin it again.
+    (*h->deleter)(h->key(), h->value);
+    MutexLock l(&mutex_);
+    Recycle(h);
+  }
+}
+
+// Return a pointer to the link that points to the visible entry for
+// key/hash, or to the trailing NULL link if there is none.
+// REQUIRES: mutex_ held.
+port::AtomicPointer* ClockCache::FindPointer(const Slice& key, uint32_t hash) {
+  ClockTable* t = reinterpret_cast<ClockTable*>(table_.NoBarrier_Load());
+  port::AtomicPointer* ptr = &t->list[hash & (t->length - 1)];
+  ClockHandle* h;
+  while ((h = reinterpret_cast<ClockHandle*>(ptr->NoBarrier_Load())) != NULL &&
+         (h->hash() != hash || h->key() != key)) {
+    ptr = &h->next_hash;
+  }
+  return ptr;
+}
+
+// Remove "h" from its hash chain.  h->next_hash is left as it is so
+// that a concurrent Lookup() standing on "h" can carry on down the chain.
+// REQUIRES: mutex_ held.
+void ClockCache::Unlink(ClockHandle* h) {
+  port::AtomicPointer* ptr = FindPointer(h->key(), h->hash());
+  assert(ptr->NoBarrier_Load() == h);
+  ptr->Release_Store(h->next_hash.NoBarrier_Load());
+  elems_--;
+}
+
+// Clear the visible bit of "h", which must already be out of its hash
+// chain, so that no further Lookup() can pin it.  Returns true iff
+// nobody holds it, in which case the caller must free it; otherwise the
+// last Release() will.
+// REQUIRES: mutex_ held.
+bool ClockCache::Hide(ClockHandle* h) {
+  usage_ -= h->charge;
+  uint64_t s = Load(&h->state);
+  while (!CompareAndSwap(&h->state, s, s & ~(kVisible | kUsageMask))) {
+    s = Load(&h->state);
+  }
+  return StateRefs(s) == 0;
+}
+
+// REQUIRES: mutex_ held and the deleter already called.
+void ClockCache::Recycle(ClockHandle* h) {
+  h->value = NULL;
+  h->next_free = free_;
+  free_ = h;
+}
+
+Cache::Handle* ClockCache::Insert(
+    const Slice& key, uint32_t hash, void* value, size_t charge,
+    void (*deleter)(const Slice& key, void* value),
+    Cache::Priority priority) {
+  MutexLock l(&mutex_);
+
+  ClockHandle* h = free_;
+  if (h != NULL) {
+    free_ = h->next_free;
+  } else {
+    h = new ClockHandle;
+    handles_.push_back(h);
+  }
+  h->value = value;
+  h->deleter = deleter;
+  h->charge = charge;
+  h->key_data.assign(key.data(), key.size());
+
+  const uint64_t hashed = static_cast<uint64_t>(hash) << 32;
+  if (capacity_ > 0) {
+    port::AtomicPointer* ptr = FindPointer(key, hash);
+    ClockHandle* old = reinterpret_cast<ClockHandle*>(ptr->NoBarrier_Load());
+    h->next_hash.NoBarrier_Store(
+        old == NULL ? NULL : old->next_hash.NoBarrier_Load());
+    uint64_t usage = 0;
+    switch (priority) {
+      case Cache::kHighPriority:   usage = 2 * kOneUsage; break;
+      case Cache::kNormalPriority: usage = kOneUsage;     break;
+      case Cache::kLowPriority:    usage = 0;             break;
+    }
+    Store(&h->state, hashed | usage | kOneRef | kVisible);
+    ptr->Release_Store(h);
+    usage_ += charge;
+    if (old != NULL) {
+      if (Hide(old)) {
+        (*old->deleter)(old->key(), old->value);
+        Recycle(old);
+      }
+    } else {
+      ++elems_;
+      if (elems_ > tables_.back()->length) {
+        // Since each cache entry is fairly large, we aim for a small
+        // average linked list length (<= 1).
+        Resize();
+      }
+    }
+    EvictToCapacity();
+  } else {  // don't cache. (capacity_==0 is supported and turns off caching.)
+    Store(&h->state, hashed | kOneRef);
+  }
+  return reinterpret_cast<Cache::Handle*>(h);
+}
+
+// Sweep the clock hand until usage_ fits in capacity_, lowering the
+// usage count of each entry passed and evicting those already at zero.
+// Entries in use are skipped.
+// REQUIRES: mutex_ held.
+void ClockCache::EvictToCapacity() {
+  const size_t n = handles_.size();
+  for (size_t steps = 0; usage_ > capacity_ && steps < 4 * n; steps++) {
+    ClockHandle* h = handles_[clock_hand_];
+    if (++clock_hand_ == n) {
+      clock_hand_ = 0;
+    }
+    const uint64_t s = Load(&h->state);
+    if (!(s & kVisible) || StateRefs(s) > 0) {
+      continue;
+    }
+    if (s & kUsageMask) {
+      // Losing the race to a Lookup() just leaves the entry for later.
+      CompareAndSwap(&h->state, s, s - kOneUsage);
+    } else if (CompareAndSwap(&h->state, s, s & ~kVisible)) {
+      Unlink(h);
+      usage_ -= h->charge;
+      (*h->deleter)(h->key(), h->value);
+      Recycle(h);
+    }
+  }
+}
+
+// Double the number of chains.  Relinking is not atomic, so Lookup()s
+// running meanwhile may miss entries, but every chain stays acyclic.
+// REQUIRES: mutex_ held.
+void ClockCache::Resize() {
+  ClockTable* old = tables_.back();
+  ClockTable* t = new ClockTable;
+  t->length = old->length * 2;
+  t->list = new port::AtomicPointer[t->length];
+  for (uint32_t i = 0; i < t->length; i++) {
+    t->list[i].NoBarrier_Store(NULL);
+  }
+  for (uint32_t i = 0; i < old->length; i++) {
+    ClockHandle* h =
+        reinterpret_cast<ClockHandle*>(old->list[i].NoBarrier_Load());
+    while (h != NULL) {
+      ClockHandle* next =
+          reinterpret_cast<ClockHandle*>(h->next_hash.NoBarrier_Load());
+      port::AtomicPointer* ptr = &t->list[h->hash() & (t->length - 1)];
+      h->next_hash.Release_Store(ptr->NoBarrier_Load());
+      ptr->Release_Store(h);
+      h = next;
+    }
+  }
+  tables_.push_back(t);
+  table_.Release_Store(t);
+}
+
+void ClockCache::Erase(const Slice& key, uint32_t hash) {
+  MutexLock l(&mutex_);
+  port::AtomicPointer* ptr = FindPointer(key, hash);
+  ClockHandle* h = reinterpret_cast<ClockHandle*>(ptr->NoBarrier_Load());
+  if (h != NULL) {
+    Unlink(h);
+    if (Hide(h)) {
+      (*h->deleter)(h->key(), h->value);
+      Recycle(h);
+    }
+  }
+}
+
+void ClockCache::Prune() {
+  MutexLock l(&mutex_);
+  for (size_t i = 0; i < handles_.size(); i++) {
+    ClockHandle* h = handles_[i];
+    const uint64_t s = Load(&h->state);
+    if ((s & kVisible) && StateRefs(s) == 0 &&
+        CompareAndSwap(&h->state, s, s & ~(kVisible | kUsageMask))) {
+      Unlink(h);
+      usage_ -= h->charge;
+      (*h->deleter)(h->key(), h->value);
+      Recycle(h);
+    }
+  }
+}
+
+class ShardedClockCache : public Cache {
+ private:
+  const int num_shard_bits_;
+  ClockCache* shard_;
+  port::Mutex id_mutex_;
+  uint64_t last_id_;
+
+  static inline uint32_t HashSlice(const Slice& s) {
+    return Hash(s.data(), s.size(), 0);
+  }
+
+  uint32_t Shard(uint32_t hash) const {
+    return num_shard_bits_ == 0 ? 0 : hash >> (32 - num_shard_bits_);
+  }
+
+  int NumShards() const { return 1 << num_shard_bits_; }
+
+ public:
+  ShardedClockCache(size_t capacity, int num_shard_bits)
+      : num_shard_bits_(num_shard_bits),
+        shard_(new ClockCache[1 << num_shard_bits]),
+        last_id_(0) {
+    const size_t per_shard = (capacity + (NumShards() - 1)) / NumShards();
+    for (int s = 0; s < NumShards(); s++) {
+      shard_[s].SetCapacity(per_shard);
+    }
+  }
+  virtual ~ShardedClockCache() {
+    delete[] shard_;
+  }
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value)) {
+    return Insert(key, value, charge, deleter, kNormalPriority);
+  }
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         Priority priority) {
+    const uint32_t hash = HashSlice(key);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      priority);
+  }
+  virtual bool SupportsPriorities() const { return true; }
+  virtual Handle* Lookup(const Slice& key) {
+    const uint32_t hash = HashSlice(key);
+    return shard_[Shard(hash)].Lookup(key, hash);
+  }
+  virtual void Release(Handle* handle) {
+    ClockHandle* h = reinterpret_cast<ClockHandle*>(handle);
+    shard_[Shard(h->hash())].Release(handle);
+  }
+  virtual void Erase(const Slice& key) {
+    const uint32_t hash = HashSlice(key);
+    shard_[Shard(hash)].Erase(key, hash);
+  }
+  virtual void* Value(Handle* handle) {
+    return reinterpret_cast<ClockHandle*>(handle)->value;
+  }
+  virtual uint64_t NewId() {
+    MutexLock l(&id_mutex_);
+    return ++(last_id_);
+  }
+  virtual void Prune() {
+    for (int s = 0; s < NumShards(); s++) {
+      shard_[s].Prune();
+    }
+  }
+  virtual size_t TotalCharge() const {
+    size_t total = 0;
+    for (int s = 0; s < NumShards(); s++) {
+      total += shard_[s].TotalCharge();
+    }
+    return total;
+  }
+};
+
+}  // end anonymous namespace
+
+Cache* NewClockCache(size_t capacity, int num_shard_bits) {
+  assert(num_shard_bits >= 0 && num_shard_bits < 20);
+  if (sizeof(void*) < sizeof(uint64_t)) {
+    // The state word does not fit in an AtomicPointer.
+    return NewLRUCache(capacity);
+  }
+  return new ShardedClockCache(capacity, num_shard_bits);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,79 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Measures crc32c::Value() throughput on buffers of the sizes leveldb
+// typically checksums: table blocks (4KB), large log records (64KB) and
+// big values (1MB).
+//
+// Usage: crc32c_bench [--bytes=N]
+//   --bytes=N   total number of bytes to checksum per buffer size
+//               (default 1GB)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/crc32c.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+static void RunBenchmark(size_t size, uint64_t total_bytes) {
+  std::string buf(size, '\0');
+  Random rnd(301);
+  for (size_t i = 0; i < size; i++) {
+    buf[i] = static_cast<char>(rnd.Uniform(256));
+  }
+
+  uint64_t iterations = total_bytes / size;
+  if (iterations == 0) {
+    iterations = 1;
+  }
+
+  Env* env = Env::Default();
+  uint32_t crc = 0;
+  const uint64_t start = env->NowMicros();
+  for (uint64_t i = 0; i < iterations; i++) {
+    crc = crc32c::Extend(crc, buf.data(), size);
+  }
+  const uint64_t micros = env->NowMicros() - start;
+
+  const double bytes = static_cast<double>(iterations) * size;
+  const double seconds = (micros > 0 ? micros : 1) * 1e-6;
+  fprintf(stdout, "crc32c %8lluB : %8.3f micros/op; %7.2f GB/s (crc %08x)\n",
+          static_cast<unsigned long long>(size),
+          static_cast<double>(micros) / iterations,
+          bytes / seconds / 1e9, crc);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  uint64_t total_bytes = 1ull << 30;
+  for (int i = 1; i < argc; i++) {
+    unsigned long long n;
+    char junk;
+    if (sscanf(argv[i], "--bytes=%llu%c", &n, &junk) == 1) {
+      total_bytes = n;
+    } else {
+      fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+      exit(1);
+    }
+  }
+
+  static const char kProbe[] = "TestCRCBuffer";
+  const bool accelerated =
+      leveldb::port::AcceleratedCRC32C(0, kProbe, sizeof(kProbe) - 1) != 0;
+  fprintf(stdout, "CRC32C:     %s\n",
+          accelerated ? "hardware accelerated" : "table driven");
+  fprintf(stdout, "------------------------------------------------\n");
+
+  static const size_t kSizes[] = { 4 << 10, 64 << 10, 1 << 20 };
+  for (size_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); i++) {
+    leveldb::RunBenchmark(kSizes[i], total_bytes);
+  }
+  return 0;
+}
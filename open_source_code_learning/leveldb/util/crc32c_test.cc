@@ -3,6 +3,9 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "util/crc32c.h"
+
+#include <algorithm>
+#include <string>
 #include "util/testharness.h"
 
 namespace leveldb {
@@ -56,6 +59,28 @@ TEST(CRC, Extend) {
             Extend(Value("hello ", 6), "world", 5));
 }
 
+TEST(CRC, LargeBuffers) {
+  // Large buffers take the multi-stream path of the accelerated
+  // implementation while small pieces do not, so the results must agree
+  // however the buffer is split up and wherever it starts.
+  std::string data(3 * 3 * 8192 + 1000, '\0');
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<char>(i * 7 + (i >> 8));
+  }
+  for (size_t offset = 0; offset < 8; offset++) {
+    const char* p = data.data() + offset;
+    const size_t n = data.size() - offset;
+    const uint32_t whole = Value(p, n);
+    for (size_t piece = 1; piece <= 4096; piece *= 4) {
+      uint32_t crc = 0;
+      for (size_t done = 0; done < n; done += piece) {
+        crc = Extend(crc, p + done, std::min(piece, n - done));
+      }
+      ASSERT_EQ(whole, crc);
+    }
+  }
+}
+
 TEST(CRC, Mask) {
   uint32_t crc = Value("foo", 3);
   ASSERT_NE(crc, Mask(crc));
@@ -13,12 +13,43 @@ Status Env::NewAppendableFile(const std::string& fname, WritableFile** result) {
   return Status::NotSupported("NewAppendableFile", fname);
 }
 
+Status Env::NewDirectRandomAccessFile(const std::string& fname,
+                                      RandomAccessFile** result) {
+  return NewRandomAccessFile(fname, result);
+}
+
+Status Env::NewDirectWritableFile(const std::string& fname,
+                                  WritableFile** result) {
+  return NewWritableFile(fname, result);
+}
+
+void Env::SetBackgroundThreads(int number) {
+}
+
+uint64_t Env::NowNanos() {
+  return NowMicros() * 1000;
+}
+
 SequentialFile::~SequentialFile() {
 }
 
 RandomAccessFile::~RandomAccessFile() {
 }
 
+void RandomAccessFile::Prefetch(uint64_t offset, size_t n) const {
+}
+
+void RandomAccessFile::MultiRead(ReadRequest* reqs, int n) const {
+  for (int i = 0; i < n; i++) {
+    reqs[i].status = Read(reqs[i].offset, reqs[i].n, &reqs[i].result,
+                          reqs[i].scratch);
+  }
+}
+
+bool RandomAccessFile::GetUniqueId(std::string* id) const {
+  return false;
+}
+
 WritableFile::~WritableFile() {
 }
 
@@ -19,13 +19,16 @@
 #include <deque>
 #include <limits>
 #include <set>
+#include <vector>
 #include "leveldb/env.h"
 #include "leveldb/slice.h"
 #include "port/port.h"
+#include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
 #include "util/posix_logger.h"
 #include "util/env_posix_test_helper.h"
+#include "util/io_uring.h"
 
 namespace leveldb {
 
@@ -132,15 +135,28 @@ class PosixSequentialFile: public SequentialFile {
 
 // pread() based random-access
 class PosixRandomAccessFile: public RandomAccessFile {
- private:
+ protected:
   std::string filename_;
   bool temporary_fd_;  // If true, fd_ is -1 and we open on every read.
   int fd_;
   Limiter* limiter_;
+  std::string unique_id_;  // Empty if the file could not be stat'ed
 
  public:
   PosixRandomAccessFile(const std::string& fname, int fd, Limiter* limiter)
       : filename_(fname), fd_(fd), limiter_(limiter) {
+    struct stat sbuf;
+    if (fstat(fd_, &sbuf) == 0) {
+      // An inode number may be reused once its file is deleted, but the
+      // new file will not have been modified at the same moment.
+      PutFixed64(&unique_id_, static_cast<uint64_t>(sbuf.st_dev));
+      PutFixed64(&unique_id_, static_cast<uint64_t>(sbuf.st_ino));
+      PutFixed64(&unique_id_, static_cast<uint64_t>(sbuf.st_size));
+      PutFixed64(&unique_id_, static_cast<uint64_t>(sbuf.st_mtime));
+#if defined(OS_LINUX)
+      PutFixed32(&unique_id_, static_cast<uint32_t>(sbuf.st_mtim.tv_nsec));
+#endif
+    }
     temporary_fd_ = !limiter->Acquire();
     if (temporary_fd_) {
       // Open file on every access.
@@ -179,6 +195,25 @@ class PosixRandomAccessFile: public RandomAccessFile {
     }
     return s;
   }
+
+  virtual bool GetUniqueId(std::string* id) const {
+    if (unique_id_.empty()) {
+      return false;
+    }
+    *id = unique_id_;
+    return true;
+  }
+
+  virtual void Prefetch(uint64_t offset, size_t n) const {
+#if defined(POSIX_FADV_WILLNEED)
+    // Starts reading the range into the page cache without waiting for
+    // it.  Not worth opening a temporary descriptor for.
+    if (!temporary_fd_) {
+      posix_fadvise(fd_, static_cast<off_t>(offset), static_cast<off_t>(n),
+                    POSIX_FADV_WILLNEED);
+    }
+#endif
+  }
 };
 
 // mmap() based random-access
@@ -213,10 +248,26 @@ class PosixMmapReadableFile: public RandomAccessFile {
     }
     return s;
   }
+
+  virtual void Prefetch(uint64_t offset, size_t n) const {
+#if defined(MADV_WILLNEED)
+    if (offset >= length_) {
+      return;
+    }
+    if (n > length_ - offset) {
+      n = length_ - offset;
+    }
+    // madvise() needs a page-aligned start; the mapping itself is.
+    static const uint64_t page_size = sysconf(_SC_PAGESIZE);
+    const uint64_t start = offset - offset % page_size;
+    madvise(reinterpret_cast<char*>(mmapped_region_) + start,
+            offset + n - start, MADV_WILLNEED);
+#endif
+  }
 };
 
 class PosixWritableFile : public WritableFile {
- private:
+ protected:
   // buf_[0, pos_-1] contains data to be written to fd_.
   std::string filename_;
   int fd_;
@@ -319,7 +370,7 @@ class PosixWritableFile : public WritableFile {
     return s;
   }
 
- private:
+ protected:
   Status FlushBuffered() {
     Status s = WriteRaw(buf_, pos_);
     pos_ = 0;
@@ -342,6 +393,339 @@ class PosixWritableFile : public WritableFile {
   }
 };
 
+// A PosixRandomAccessFile whose MultiRead() submits the whole batch to
+// the calling thread's io_uring.  Single reads stay with pread(), which
+// costs the same one system call.
+class IoUringRandomAccessFile : public PosixRandomAccessFile {
+ public:
+  IoUringRandomAccessFile(const std::string& fname, int fd, Limiter* limiter)
+      : PosixRandomAccessFile(fname, fd, limiter) {
+  }
+
+  virtual void MultiRead(ReadRequest* reqs, int n) const {
+    IoUring* ring = NULL;
+    if (n > 1 && !temporary_fd_) {
+      ring = IoUring::ForCurrentThread();
+    }
+    if (ring == NULL) {
+      RandomAccessFile::MultiRead(reqs, n);
+      return;
+    }
+    for (int start = 0; start < n; ) {
+      const int batch = std::min<int>(n - start, ring->capacity());
+      for (int i = start; i < start + batch; i++) {
+        ring->PrepareRead(fd_, reqs[i].scratch, reqs[i].n, reqs[i].offset, i);
+      }
+      const int submitted = ring->SubmitAndWait();
+      uint64_t tag;
+      int32_t r;
+      while (ring->Reap(&tag, &r)) {
+        ReadRequest* req = &reqs[tag];
+        if (r == -EINTR || r == -EAGAIN) {
+          req->status = Read(req->offset, req->n, &req->result, req->scratch);
+        } else if (r < 0) {
+          req->result = Slice(req->scratch, 0);
+          req->status = PosixError(filename_, -r);
+        } else if (r == 0 || static_cast<size_t>(r) == req->n) {
+          req->result = Slice(req->scratch, r);
+          req->status = Status::OK();
+        } else {
+          // Short read: read the rest the way Read() would have.
+          Slice rest;
+          req->status = Read(req->offset + r, req->n - r, &rest,
+                             req->scratch + r);
+          req->result = Slice(req->scratch, r + rest.size());
+        }
+      }
+      // Requests the kernel did not accept.
+      for (int i = start + submitted; i < start + batch; i++) {
+        reqs[i].status = Read(reqs[i].offset, reqs[i].n, &reqs[i].result,
+                              reqs[i].scratch);
+      }
+      start += batch;
+    }
+  }
+};
+
+// A PosixWritableFile whose Sync() submits the buffered data and the
+// fdatasync() as one linked io_uring batch, so that a sync with data
+// still buffered takes one system call instead of two.
+class IoUringWritableFile : public PosixWritableFile {
+ public:
+  IoUringWritableFile(const std::string& fname, int fd)
+      : PosixWritableFile(fname, fd) {
+  }
+
+  virtual Status Sync() {
+    IoUring* ring = NULL;
+    if (pos_ > 0) {
+      ring = IoUring::ForCurrentThread();
+    }
+    if (ring == NULL) {
+      return PosixWritableFile::Sync();
+    }
+    Status s = SyncDirIfManifest();
+    if (!s.ok()) {
+      return s;
+    }
+
+    // The fdatasync only runs if the write completed in full, and is
+    // cancelled otherwise.
+    static const int32_t kNotRun = 1;
+    int32_t written = 0;
+    int32_t synced = kNotRun;
+    ring->PrepareWrite(fd_, buf_, pos_, IoUring::kCurrentPosition, 0, true);
+    ring->PrepareDataSync(fd_, 1);
+    ring->SubmitAndWait();
+    uint64_t tag;
+    int32_t r;
+    while (ring->Reap(&tag, &r)) {
+      if (tag == 0) {
+        written = r;
+      } else {
+        synced = r;
+      }
+    }
+    if (written < 0 && written != -EINTR && written != -EAGAIN) {
+      pos_ = 0;
+      return PosixError(filename_, -written);
+    }
+    if (written < 0) {
+      written = 0;
+    }
+    s = WriteRaw(buf_ + written, pos_ - written);
+    pos_ = 0;
+    if (s.ok() && synced != 0) {
+      if (synced != kNotRun && synced != -ECANCELED) {
+        s = PosixError(filename_, -synced);
+      } else if (fdatasync(fd_) != 0) {
+        s = PosixError(filename_, errno);
+      }
+    }
+    return s;
+  }
+};
+
+#if defined(O_DIRECT)
+
+// Alignment that the offsets, lengths and buffers of O_DIRECT transfers
+// must have.  Devices with larger logical blocks are rare enough not to
+// be worth querying for.
+static const size_t kDirectIOAlignment = 4096;
+
+// Size of the buffer a PosixDirectWritableFile fills before each write.
+static const size_t kDirectBufSize = 1 << 20;
+
+static uint64_t AlignDown(uint64_t x) {
+  return x - x % kDirectIOAlignment;
+}
+
+static uint64_t AlignUp(uint64_t x) {
+  return AlignDown(x + kDirectIOAlignment - 1);
+}
+
+// Returns NULL if out of memory.  The result must be passed to free().
+static char* NewAlignedBuffer(size_t n) {
+  void* p = NULL;
+  if (posix_memalign(&p, kDirectIOAlignment, n) != 0) {
+    return NULL;
+  }
+  return reinterpret_cast<char*>(p);
+}
+
+// pread() based random-access to a file opened with O_DIRECT.  Every
+// read goes through an aligned buffer.  Prefetch() cannot start a read
+// without blocking, so it widens the next read that reaches the hinted
+// range to cover all of it, and keeps that read's buffer for the reads
+// that follow.
+class PosixDirectRandomAccessFile : public PosixRandomAccessFile {
+ private:
+  mutable port::Mutex mu_;
+  // Aligned copy of [buf_offset_, buf_offset_+buf_len_) or NULL
+  mutable char* buf_;
+  mutable uint64_t buf_offset_;
+  mutable size_t buf_len_;
+  // Range of the last Prefetch(), until a read reaches it
+  mutable uint64_t hint_offset_;
+  mutable uint64_t hint_end_;
+
+ public:
+  PosixDirectRandomAccessFile(const std::string& fname, int fd,
+                              Limiter* limiter)
+      : PosixRandomAccessFile(fname, fd, limiter),
+        buf_(NULL), buf_offset_(0), buf_len_(0),
+        hint_offset_(0), hint_end_(0) {
+  }
+
+  virtual ~PosixDirectRandomAccessFile() {
+    free(buf_);
+  }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const {
+    uint64_t end = offset + n;
+    {
+      MutexLock l(&mu_);
+      if (buf_ != NULL && offset >= buf_offset_ &&
+          end <= buf_offset_ + buf_len_) {
+        memcpy(scratch, buf_ + (offset - buf_offset_), n);
+        *result = Slice(scratch, n);
+        return Status::OK();
+      }
+      if (offset <= hint_end_ && end >= hint_offset_) {
+        end = std::max(end, hint_end_);
+        hint_offset_ = hint_end_ = 0;
+      }
+    }
+
+    const uint64_t start = AlignDown(offset);
+    const size_t len = AlignUp(end) - start;
+    char* buf = NewAlignedBuffer(len);
+    if (buf == NULL) {
+      *result = Slice(scratch, 0);
+      return PosixError(filename_, ENOMEM);
+    }
+    int fd = fd_;
+    if (temporary_fd_) {
+      fd = open(filename_.c_str(), O_RDONLY | O_DIRECT);
+    }
+
+    Status s;
+    ssize_t r = -1;
+    if (fd < 0) {
+      s = PosixError(filename_, errno);
+    } else {
+      r = pread(fd, buf, len, static_cast<off_t>(start));
+      if (r < 0) {
+        s = PosixError(filename_, errno);
+      }
+    }
+    // The aligned read may start before "offset" and end past EOF.
+    size_t got = 0;
+    if (r > 0 && static_cast<uint64_t>(r) > offset - start) {
+      got = std::min<uint64_t>(n, r - (offset - start));
+      memcpy(scratch, buf + (offset - start), got);
+    }
+    *result = Slice(scratch, got);
+    if (temporary_fd_ && fd >= 0) {
+      close(fd);
+    }
+
+    if (s.ok() && end > offset + n) {
+      MutexLock l(&mu_);
+      std::swap(buf_, buf);
+      buf_offset_ = start;
+      buf_len_ = r;
+    }
+    free(buf);
+    return s;
+  }
+
+  virtual void Prefetch(uint64_t offset, size_t n) const {
+    MutexLock l(&mu_);
+    hint_offset_ = offset;
+    hint_end_ = offset + n;
+  }
+};
+
+// Writes a file opened with O_DIRECT from an aligned buffer of
+// kDirectBufSize bytes.  Flush() leaves the data buffered.  Sync() and
+// Close() write the buffered data padded to the alignment and truncate
+// the file back to its real size; the partial block at the end stays
+// buffered and is written again once more data follows.
+class PosixDirectWritableFile : public WritableFile {
+ private:
+  std::string filename_;
+  int fd_;
+  char* buf_;             // Aligned, kDirectBufSize bytes
+  size_t pos_;            // buf_[0, pos_-1] is not fully written yet
+  uint64_t file_offset_;  // File offset of buf_[0]; always aligned
+
+ public:
+  PosixDirectWritableFile(const std::string& fname, int fd, char* buf)
+      : filename_(fname), fd_(fd), buf_(buf), pos_(0), file_offset_(0) { }
+
+  ~PosixDirectWritableFile() {
+    if (fd_ >= 0) {
+      // Ignoring any potential errors
+      Close();
+    }
+    free(buf_);
+  }
+
+  virtual Status Append(const Slice& data) {
+    const char* p = data.data();
+    size_t n = data.size();
+    while (n > 0) {
+      const size_t copy = std::min(n, kDirectBufSize - pos_);
+      memcpy(buf_ + pos_, p, copy);
+      p += copy;
+      n -= copy;
+      pos_ += copy;
+      if (pos_ == kDirectBufSize) {
+        Status s = WriteBuffered();
+        if (!s.ok()) {
+          return s;
+        }
+      }
+    }
+    return Status::OK();
+  }
+
+  virtual Status Close() {
+    Status result = WriteBuffered();
+    const int r = close(fd_);
+    if (r < 0 && result.ok()) {
+      result = PosixError(filename_, errno);
+    }
+    fd_ = -1;
+    return result;
+  }
+
+  virtual Status Flush() {
+    return Status::OK();
+  }
+
+  virtual Status Sync() {
+    Status s = WriteBuffered();
+    if (s.ok() && fdatasync(fd_) != 0) {
+      s = PosixError(filename_, errno);
+    }
+    return s;
+  }
+
+ private:
+  Status WriteBuffered() {
+    const size_t len = AlignUp(pos_);
+    memset(buf_ + pos_, 0, len - pos_);
+    const char* p = buf_;
+    size_t left = len;
+    uint64_t offset = file_offset_;
+    while (left > 0) {
+      ssize_t r = pwrite(fd_, p, left, static_cast<off_t>(offset));
+      if (r < 0) {
+        if (errno == EINTR) {
+          continue;  // Retry
+        }
+        return PosixError(filename_, errno);
+      }
+      p += r;
+      left -= r;
+      offset += r;
+    }
+    if (len != pos_ && ftruncate(fd_, file_offset_ + pos_) != 0) {
+      return PosixError(filename_, errno);
+    }
+    const size_t full = AlignDown(pos_);
+    memmove(buf_, buf_ + full, pos_ - full);
+    file_offset_ += full;
+    pos_ -= full;
+    return Status::OK();
+  }
+};
+
+#endif  // defined(O_DIRECT)
+
 static int LockOrUnlock(int fd, bool lock) {
   errno = 0;
   struct flock f;
@@ -452,6 +836,75 @@ class PosixEnv : public Env {
     return s;
   }
 
+  // Like NewRandomAccessFile(), NewWritableFile() and NewAppendableFile(),
+  // but for the Env returned by NewIoUringEnv().  Reads are never served
+  // from mmap, so that MultiRead() can batch them.
+  Status NewIoUringRandomAccessFile(const std::string& fname,
+                                    RandomAccessFile** result) {
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0) {
+      *result = NULL;
+      return PosixError(fname, errno);
+    }
+    *result = new IoUringRandomAccessFile(fname, fd, &fd_limit_);
+    return Status::OK();
+  }
+
+  Status NewIoUringWritableFile(const std::string& fname, bool append,
+                                WritableFile** result) {
+    const int flags = append ? O_APPEND : O_TRUNC;
+    int fd = open(fname.c_str(), flags | O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) {
+      *result = NULL;
+      return PosixError(fname, errno);
+    }
+    *result = new IoUringWritableFile(fname, fd);
+    return Status::OK();
+  }
+
+  // Files on file systems that reject O_DIRECT, such as tmpfs, are opened
+  // as by NewRandomAccessFile() without mmap and by NewWritableFile().
+  virtual Status NewDirectRandomAccessFile(const std::string& fname,
+                                           RandomAccessFile** result) {
+    *result = NULL;
+    int fd;
+#if defined(O_DIRECT)
+    fd = open(fname.c_str(), O_RDONLY | O_DIRECT);
+    if (fd >= 0) {
+      *result = new PosixDirectRandomAccessFile(fname, fd, &fd_limit_);
+      return Status::OK();
+    } else if (errno != EINVAL) {
+      return PosixError(fname, errno);
+    }
+#endif
+    fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return PosixError(fname, errno);
+    }
+    *result = new PosixRandomAccessFile(fname, fd, &fd_limit_);
+    return Status::OK();
+  }
+
+  virtual Status NewDirectWritableFile(const std::string& fname,
+                                       WritableFile** result) {
+    *result = NULL;
+#if defined(O_DIRECT)
+    int fd = open(fname.c_str(), O_TRUNC | O_WRONLY | O_CREAT | O_DIRECT, 0644);
+    if (fd >= 0) {
+      char* buf = NewAlignedBuffer(kDirectBufSize);
+      if (buf == NULL) {
+        close(fd);
+        return PosixError(fname, ENOMEM);
+      }
+      *result = new PosixDirectWritableFile(fname, fd, buf);
+      return Status::OK();
+    } else if (errno != EINVAL) {
+      return PosixError(fname, errno);
+    }
+#endif
+    return NewWritableFile(fname, result);
+  }
+
   virtual bool FileExists(const std::string& fname) {
     return access(fname.c_str(), F_OK) == 0;
   }
@@ -551,6 +1004,8 @@ class PosixEnv : public Env {
 
   virtual void Schedule(void (*function)(void*), void* arg);
 
+  virtual void SetBackgroundThreads(int number);
+
   virtual void StartThread(void (*function)(void* arg), void* arg);
 
   virtual Status GetTestDirectory(std::string* result) {
@@ -591,6 +1046,12 @@ class PosixEnv : public Env {
     return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
   }
 
+  virtual uint64_t NowNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+
   virtual void SleepForMicroseconds(int micros) {
     usleep(micros);
   }
@@ -603,7 +1064,7 @@ class PosixEnv : public Env {
     }
   }
 
-  // BGThread() is the body of the background thread
+  // BGThread() is the body of each background thread
   void BGThread();
   static void* BGThreadWrapper(void* arg) {
     reinterpret_cast<PosixEnv*>(arg)->BGThread();
@@ -612,8 +1073,9 @@ class PosixEnv : public Env {
 
   pthread_mutex_t mu_;
   pthread_cond_t bgsignal_;
-  pthread_t bgthread_;
-  bool started_bgthread_;
+  std::vector<pthread_t> bgthreads_;  // Started lazily by Schedule()
+  int max_bgthreads_;                 // Size the pool may grow to
+  size_t active_bgthreads_;           // Threads currently running an item
 
   // Entry per Schedule() call
   struct BGItem { void* arg; void (*function)(void*); };
@@ -654,7 +1116,8 @@ static intptr_t MaxOpenFiles() {
 }
 
 PosixEnv::PosixEnv()
-    : started_bgthread_(false),
+    : max_bgthreads_(1),
+      active_bgthreads_(0),
       mmap_limit_(MaxMmaps()),
       fd_limit_(MaxOpenFiles()) {
   PthreadCall("mutex_init", pthread_mutex_init(&mu_, NULL));
@@ -664,18 +1127,15 @@ PosixEnv::PosixEnv()
 void PosixEnv::Schedule(void (*function)(void*), void* arg) {
   PthreadCall("lock", pthread_mutex_lock(&mu_));
 
-  // Start background thread if necessary
-  if (!started_bgthread_) {
-    started_bgthread_ = true;
+  // Start another background thread if every existing one may be busy
+  // and the pool has not reached its limit yet.
+  if (bgthreads_.size() < static_cast<size_t>(max_bgthreads_) &&
+      bgthreads_.size() <= queue_.size() + active_bgthreads_) {
+    pthread_t t;
     PthreadCall(
         "create thread",
-        pthread_create(&bgthread_, NULL,  &PosixEnv::BGThreadWrapper, this));
-  }
-
-  // If the queue is currently empty, the background thread may currently be
-  // waiting.
-  if (queue_.empty()) {
-    PthreadCall("signal", pthread_cond_signal(&bgsignal_));
+        pthread_create(&t, NULL,  &PosixEnv::BGThreadWrapper, this));
+    bgthreads_.push_back(t);
   }
 
   // Add to priority queue
@@ -683,6 +1143,17 @@ void PosixEnv::Schedule(void (*function)(void*), void* arg) {
   queue_.back().function = function;
   queue_.back().arg = arg;
 
+  // Wake up one idle background thread (if any) to run the new item.
+  PthreadCall("signal", pthread_cond_signal(&bgsignal_));
+
+  PthreadCall("unlock", pthread_mutex_unlock(&mu_));
+}
+
+void PosixEnv::SetBackgroundThreads(int number) {
+  PthreadCall("lock", pthread_mutex_lock(&mu_));
+  if (number > max_bgthreads_) {
+    max_bgthreads_ = number;
+  }
   PthreadCall("unlock", pthread_mutex_unlock(&mu_));
 }
 
@@ -697,9 +1168,14 @@ void PosixEnv::BGThread() {
     void (*function)(void*) = queue_.front().function;
     void* arg = queue_.front().arg;
     queue_.pop_front();
+    active_bgthreads_++;
 
     PthreadCall("unlock", pthread_mutex_unlock(&mu_));
     (*function)(arg);
+
+    PthreadCall("lock", pthread_mutex_lock(&mu_));
+    active_bgthreads_--;
+    PthreadCall("unlock", pthread_mutex_unlock(&mu_));
   }
 }
 
@@ -725,6 +1201,41 @@ void PosixEnv::StartThread(void (*function)(void* arg), void* arg) {
               pthread_create(&t, NULL,  &StartThreadWrapper, state));
 }
 
+// Reads and writes files through io_uring; everything else, including
+// the background threads, is the default PosixEnv's.
+class IoUringEnv : public EnvWrapper {
+ public:
+  explicit IoUringEnv(PosixEnv* posix) : EnvWrapper(posix), posix_(posix) { }
+
+  virtual Status NewRandomAccessFile(const std::string& fname,
+                                     RandomAccessFile** result) {
+    return posix_->NewIoUringRandomAccessFile(fname, result);
+  }
+
+  virtual Status NewWritableFile(const std::string& fname,
+                                 WritableFile** result) {
+    return posix_->NewIoUringWritableFile(fname, false, result);
+  }
+
+  virtual Status NewAppendableFile(const std::string& fname,
+                                   WritableFile** result) {
+    return posix_->NewIoUringWritableFile(fname, true, result);
+  }
+
+  virtual Status NewDirectRandomAccessFile(const std::string& fname,
+                                           RandomAccessFile** result) {
+    return posix_->NewDirectRandomAccessFile(fname, result);
+  }
+
+  virtual Status NewDirectWritableFile(const std::string& fname,
+                                       WritableFile** result) {
+    return posix_->NewDirectWritableFile(fname, result);
+  }
+
+ private:
+  PosixEnv* posix_;
+};
+
 }  // namespace
 
 static pthread_once_t once = PTHREAD_ONCE_INIT;
@@ -746,4 +1257,12 @@ Env* Env::Default() {
   return default_env;
 }
 
+Env* NewIoUringEnv() {
+  PosixEnv* posix = static_cast<PosixEnv*>(Env::Default());
+  if (!IoUring::Supported()) {
+    return new EnvWrapper(posix);
+  }
+  return new IoUringEnv(posix);
+}
+
 }  // namespace leveldb
@@ -7,6 +7,9 @@
 #include "port/port.h"
 #include "util/testharness.h"
 #include "util/env_posix_test_helper.h"
+#include "util/io_uring.h"
+#include "util/random.h"
+#include "util/testutil.h"
 
 namespace leveldb {
 
@@ -56,11 +59,160 @@ TEST(EnvPosixTest, TestOpenOnRead) {
   ASSERT_OK(env_->DeleteFile(test_file));
 }
 
+// The io_uring Env behaves like the default one, whether or not the
+// kernel supports io_uring.
+TEST(EnvPosixTest, IoUringMultiRead) {
+  std::string test_dir;
+  ASSERT_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/io_uring_multi_read.txt";
+  Random rnd(301);
+  std::string data;
+  for (int i = 0; i < 1 << 20; i++) {
+    data.push_back(static_cast<char>(' ' + rnd.Uniform(95)));
+  }
+  ASSERT_OK(WriteStringToFile(env_, data, test_file));
+
+  Env* env = NewIoUringEnv();
+  RandomAccessFile* file;
+  ASSERT_OK(env->NewRandomAccessFile(test_file, &file));
+
+  // More requests than fit in one ring, including one that crosses the
+  // end of the file and one past it.
+  const int kNumReqs = 150;
+  std::vector<RandomAccessFile::ReadRequest> reqs(kNumReqs);
+  std::vector<std::string> scratch(kNumReqs);
+  for (int i = 0; i < kNumReqs; i++) {
+    reqs[i].offset = rnd.Uniform(data.size());
+    reqs[i].n = 1 + rnd.Uniform(10000);
+    if (i == 10) {
+      reqs[i].offset = data.size() - 100;
+    } else if (i == 20) {
+      reqs[i].offset = data.size() + 100;
+    }
+    scratch[i].resize(reqs[i].n);
+    reqs[i].scratch = &scratch[i][0];
+  }
+  file->MultiRead(&reqs[0], kNumReqs);
+  for (int i = 0; i < kNumReqs; i++) {
+    ASSERT_OK(reqs[i].status);
+    std::string expected;
+    if (reqs[i].offset < data.size()) {
+      expected = data.substr(reqs[i].offset, reqs[i].n);
+    }
+    ASSERT_EQ(expected, reqs[i].result.ToString());
+  }
+  Slice result;
+  ASSERT_OK(file->Read(5, 10, &result, &scratch[0][0]));
+  ASSERT_EQ(data.substr(5, 10), result.ToString());
+
+  delete file;
+  delete env;
+  ASSERT_OK(env_->DeleteFile(test_file));
+}
+
+TEST(EnvPosixTest, IoUringWriteAndSync) {
+  std::string test_dir;
+  ASSERT_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/io_uring_sync.txt";
+  Random rnd(301);
+  Env* env = NewIoUringEnv();
+
+  // Sync with nothing buffered, a little, and more than the buffer holds.
+  std::string expected;
+  WritableFile* file;
+  ASSERT_OK(env->NewWritableFile(test_file, &file));
+  ASSERT_OK(file->Sync());
+  static const int kSizes[] = { 10, 1000, 100000, 0, 65536 };
+  for (size_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); i++) {
+    std::string piece(kSizes[i], static_cast<char>('a' + i));
+    ASSERT_OK(file->Append(piece));
+    ASSERT_OK(file->Sync());
+    expected += piece;
+  }
+  ASSERT_OK(file->Close());
+  delete file;
+
+  ASSERT_OK(env->NewAppendableFile(test_file, &file));
+  ASSERT_OK(file->Append("tail"));
+  ASSERT_OK(file->Sync());
+  ASSERT_OK(file->Close());
+  delete file;
+  expected += "tail";
+
+  std::string contents;
+  ASSERT_OK(ReadFileToString(env, test_file, &contents));
+  ASSERT_EQ(expected, contents);
+
+  delete env;
+  ASSERT_OK(env_->DeleteFile(test_file));
+}
+
+// Direct files behave like the others, whether or not the file system
+// supports O_DIRECT.
+TEST(EnvPosixTest, DirectIO) {
+  std::string test_dir;
+  ASSERT_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/direct_io.txt";
+  Random rnd(301);
+
+  // Unaligned appends, syncs that leave a partial block to be written
+  // again, and more than the write buffer holds.
+  std::string expected;
+  WritableFile* wfile;
+  ASSERT_OK(env_->NewDirectWritableFile(test_file, &wfile));
+  static const int kSizes[] = { 10, 5000, 0, 4096, 1 << 20, 3, 300000 };
+  for (size_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); i++) {
+    std::string piece;
+    test::RandomString(&rnd, kSizes[i], &piece);
+    ASSERT_OK(wfile->Append(piece));
+    ASSERT_OK(wfile->Flush());
+    if (i % 2 == 0) {
+      ASSERT_OK(wfile->Sync());
+    }
+    expected += piece;
+  }
+  ASSERT_OK(wfile->Close());
+  delete wfile;
+  uint64_t size;
+  ASSERT_OK(env_->GetFileSize(test_file, &size));
+  ASSERT_EQ(expected.size(), size);
+
+  RandomAccessFile* rfile;
+  ASSERT_OK(env_->NewDirectRandomAccessFile(test_file, &rfile));
+  std::string scratch(100000, ' ');
+  Slice result;
+  for (int i = 0; i < 200; i++) {
+    const uint64_t offset = rnd.Uniform(expected.size() + 10);
+    const size_t n = rnd.Uniform(scratch.size());
+    if (i % 10 == 0) {
+      rfile->Prefetch(offset, n + rnd.Uniform(1 << 20));
+    }
+    ASSERT_OK(rfile->Read(offset, n, &result, &scratch[0]));
+    const size_t available =
+        offset < expected.size() ? expected.size() - offset : 0;
+    ASSERT_EQ(std::min(n, available), result.size());
+    ASSERT_TRUE(result == Slice(expected.data() + offset, result.size()));
+  }
+
+  // A sequential scan that prefetches ahead, as table iterators do.
+  for (uint64_t offset = 0; offset < expected.size(); offset += 4000) {
+    if (offset % 64000 == 0) {
+      rfile->Prefetch(offset + 4000, 64000);
+    }
+    ASSERT_OK(rfile->Read(offset, 4000, &result, &scratch[0]));
+    ASSERT_TRUE(result == Slice(expected.data() + offset, result.size()));
+  }
+  delete rfile;
+  ASSERT_OK(env_->DeleteFile(test_file));
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
   // All tests currently run with the same read-only file limits.
   leveldb::EnvPosixTest::SetFileLimits(leveldb::kReadOnlyFileLimit,
                                        leveldb::kMMapLimit);
+  fprintf(stderr, "io_uring %s\n",
+          leveldb::IoUring::Supported() ? "supported" : "not supported");
   return leveldb::test::RunAllTests();
 }
@@ -117,6 +117,43 @@ TEST(EnvTest, RunMany) {
   ASSERT_EQ(4, reinterpret_cast<uintptr_t>(cur));
 }
 
+TEST(EnvTest, RunConcurrently) {
+  // Each callback waits until the other one has started, which can only
+  // happen if they run on different background threads.
+  struct CB {
+    port::AtomicPointer* started;
+    port::AtomicPointer* other_started;
+    port::AtomicPointer* met;
+
+    static void Run(void* v) {
+      CB* cb = reinterpret_cast<CB*>(v);
+      cb->started->Release_Store(cb);
+      for (int i = 0; i < 1000; i++) {
+        if (cb->other_started->Acquire_Load() != NULL) {
+          cb->met->Release_Store(cb);
+          return;
+        }
+        Env::Default()->SleepForMicroseconds(1000);
+      }
+    }
+  };
+
+  env_->SetBackgroundThreads(2);
+  port::AtomicPointer started1(NULL), started2(NULL), met1(NULL), met2(NULL);
+  CB cb1 = { &started1, &started2, &met1 };
+  CB cb2 = { &started2, &started1, &met2 };
+  env_->Schedule(&CB::Run, &cb1);
+  env_->Schedule(&CB::Run, &cb2);
+  for (int i = 0; i < 2000; i++) {
+    if (met1.Acquire_Load() != NULL && met2.Acquire_Load() != NULL) {
+      break;
+    }
+    env_->SleepForMicroseconds(1000);
+  }
+  ASSERT_TRUE(met1.Acquire_Load() != NULL);
+  ASSERT_TRUE(met2.Acquire_Load() != NULL);
+}
+
 struct State {
   port::Mutex mu;
   int val;
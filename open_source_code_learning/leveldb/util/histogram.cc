@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
+#include <algorithm>
 #include <math.h>
 #include <stdio.h>
 #include "port/port.h"
@@ -42,11 +43,10 @@ void Histogram::Clear() {
 }
 
 void Histogram::Add(double value) {
-  // Linear search is fast enough for our usage in db_bench
-  int b = 0;
-  while (b < kNumBuckets - 1 && kBucketLimit[b] <= value) {
-    b++;
-  }
+  // Binary search for the first bucket whose limit is above "value":
+  // Statistics adds to histograms on the hot paths of a DB.
+  const int b = std::upper_bound(kBucketLimit, kBucketLimit + kNumBuckets - 1,
+                                 value) - kBucketLimit;
   buckets_[b] += 1.0;
   if (min_ > value) min_ = value;
   if (max_ < value) max_ = value;
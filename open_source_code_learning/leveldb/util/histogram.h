@@ -20,6 +20,14 @@ class Histogram {
 
   std::string ToString() const;
 
+  double Count() const { return num_; }
+  double Sum() const { return sum_; }
+  double Max() const { return max_; }
+  double Median() const;
+  double Percentile(double p) const;
+  double Average() const;
+  double StandardDeviation() const;
+
  private:
   double min_;
   double max_;
@@ -30,11 +38,6 @@ class Histogram {
   enum { kNumBuckets = 154 };
   static const double kBucketLimit[kNumBuckets];
   double buckets_[kNumBuckets];
-
-  double Median() const;
-  double Percentile(double p) const;
-  double Average() const;
-  double StandardDeviation() const;
 };
 
 }  // namespace leveldb
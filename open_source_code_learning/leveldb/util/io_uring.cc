@@ -0,0 +1,259 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/io_uring.h"
+
+#if defined(HAVE_IO_URING)
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace leveldb {
+
+#if defined(HAVE_IO_URING)
+
+namespace {
+
+// Small enough to keep the per-thread rings cheap; larger batches are
+// submitted in several rounds.
+static const unsigned kRingEntries = 64;
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static bool supported = false;
+static pthread_key_t ring_key;
+
+template <typename T>
+static T* At(void* base, uint32_t offset) {
+  return reinterpret_cast<T*>(reinterpret_cast<char*>(base) + offset);
+}
+
+static unsigned LoadAcquire(const unsigned* p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void StoreRelease(unsigned* p, unsigned v) {
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+}  // namespace
+
+void IoUring::DeleteRing(void* ring) {
+  delete reinterpret_cast<IoUring*>(ring);
+}
+
+void IoUring::InitOnce() {
+  // IORING_FEAT_RW_CUR_POS arrived together with IORING_OP_READ and
+  // IORING_OP_WRITE (Linux 5.6), which older kernels reject.
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  const int fd = syscall(__NR_io_uring_setup, 1, &p);
+  if (fd >= 0) {
+    supported = (p.features & IORING_FEAT_RW_CUR_POS) != 0;
+    close(fd);
+  }
+  if (supported && pthread_key_create(&ring_key, &IoUring::DeleteRing) != 0) {
+    supported = false;
+  }
+}
+
+bool IoUring::Supported() {
+  pthread_once(&once, &IoUring::InitOnce);
+  return supported;
+}
+
+IoUring* IoUring::ForCurrentThread() {
+  if (!Supported()) {
+    return NULL;
+  }
+  IoUring* ring = reinterpret_cast<IoUring*>(pthread_getspecific(ring_key));
+  if (ring == NULL) {
+    ring = new IoUring;
+    if (!ring->Init(kRingEntries)) {
+      // Most likely out of locked memory; the caller falls back to
+      // plain system calls, and the next call tries again.
+      delete ring;
+      return NULL;
+    }
+    pthread_setspecific(ring_key, ring);
+  }
+  return ring;
+}
+
+IoUring::IoUring()
+    : fd_(-1), entries_(0), queued_(0),
+      sq_ring_(NULL), sq_ring_size_(0), sqes_(NULL), sqes_size_(0),
+      cq_ring_(NULL), cq_ring_size_(0) {
+}
+
+IoUring::~IoUring() {
+  if (sqes_ != NULL) {
+    munmap(sqes_, sqes_size_);
+  }
+  if (cq_ring_ != NULL) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  if (sq_ring_ != NULL) {
+    munmap(sq_ring_, sq_ring_size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool IoUring::Init(unsigned entries) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  fd_ = syscall(__NR_io_uring_setup, entries, &p);
+  if (fd_ < 0) {
+    return false;
+  }
+  entries_ = p.sq_entries;
+
+  sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  const bool single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mmap && cq_ring_size_ > sq_ring_size_) {
+    sq_ring_size_ = cq_ring_size_;
+  }
+  void* sq = mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+  if (sq == MAP_FAILED) {
+    return false;
+  }
+  sq_ring_ = sq;
+  void* cq = sq;
+  if (!single_mmap) {
+    cq = mmap(NULL, cq_ring_size_, PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    if (cq == MAP_FAILED) {
+      return false;
+    }
+    cq_ring_ = cq;
+  }
+  sqes_size_ = p.sq_entries * sizeof(struct io_uring_sqe);
+  void* sqes = mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    return false;
+  }
+  sqes_ = sqes;
+
+  sq_head_ = At<unsigned>(sq, p.sq_off.head);
+  sq_tail_ = At<unsigned>(sq, p.sq_off.tail);
+  sq_mask_ = At<unsigned>(sq, p.sq_off.ring_mask);
+  sq_array_ = At<unsigned>(sq, p.sq_off.array);
+  cq_head_ = At<unsigned>(cq, p.cq_off.head);
+  cq_tail_ = At<unsigned>(cq, p.cq_off.tail);
+  cq_mask_ = At<unsigned>(cq, p.cq_off.ring_mask);
+  cqes_ = At<void>(cq, p.cq_off.cqes);
+  return true;
+}
+
+// Return a cleared submission queue entry for the next request.  It is
+// published to the kernel by SubmitAndWait().
+void* IoUring::NextEntry() {
+  const unsigned index = (*sq_tail_ + queued_) & *sq_mask_;
+  struct io_uring_sqe* sqe =
+      reinterpret_cast<struct io_uring_sqe*>(sqes_) + index;
+  memset(sqe, 0, sizeof(*sqe));
+  sq_array_[index] = index;
+  queued_++;
+  return sqe;
+}
+
+void IoUring::PrepareRead(int fd, char* buf, size_t n, uint64_t offset,
+                          uint64_t tag) {
+  struct io_uring_sqe* sqe =
+      reinterpret_cast<struct io_uring_sqe*>(NextEntry());
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uintptr_t>(buf);
+  sqe->len = static_cast<uint32_t>(n);
+  sqe->off = offset;
+  sqe->user_data = tag;
+}
+
+void IoUring::PrepareWrite(int fd, const char* buf, size_t n,
+                           uint64_t offset, uint64_t tag, bool link) {
+  struct io_uring_sqe* sqe =
+      reinterpret_cast<struct io_uring_sqe*>(NextEntry());
+  sqe->opcode = IORING_OP_WRITE;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uintptr_t>(buf);
+  sqe->len = static_cast<uint32_t>(n);
+  sqe->off = offset;
+  sqe->user_data = tag;
+  if (link) {
+    sqe->flags = IOSQE_IO_LINK;
+  }
+}
+
+void IoUring::PrepareDataSync(int fd, uint64_t tag) {
+  struct io_uring_sqe* sqe =
+      reinterpret_cast<struct io_uring_sqe*>(NextEntry());
+  sqe->opcode = IORING_OP_FSYNC;
+  sqe->fd = fd;
+  sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+  sqe->user_data = tag;
+}
+
+unsigned IoUring::SubmitAndWait() {
+  unsigned queued = queued_;
+  unsigned submitted = 0;
+  queued_ = 0;
+  StoreRelease(sq_tail_, *sq_tail_ + queued);
+  // Callers reap every completion, so the completion queue holds only
+  // the completions of this batch.
+  while (true) {
+    const unsigned to_submit = queued - submitted;
+    const unsigned ready = LoadAcquire(cq_tail_) - *cq_head_;
+    if (to_submit == 0 && ready >= submitted) {
+      return submitted;
+    }
+    const int r = syscall(__NR_io_uring_enter, fd_, to_submit,
+                          queued - ready, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (r > 0) {
+      submitted += r;
+    } else if (to_submit > 0 && !(r < 0 && errno == EINTR)) {
+      // The kernel refused the rest of the batch.  It only looks at the
+      // submission queue inside io_uring_enter(), so the requests can be
+      // taken back.
+      StoreRelease(sq_tail_, *sq_tail_ - to_submit);
+      queued = submitted;
+    }
+  }
+}
+
+bool IoUring::Reap(uint64_t* tag, int32_t* result) {
+  const unsigned head = *cq_head_;
+  if (head == LoadAcquire(cq_tail_)) {
+    return false;
+  }
+  const struct io_uring_cqe* cqe =
+      reinterpret_cast<const struct io_uring_cqe*>(cqes_) +
+      (head & *cq_mask_);
+  *tag = cqe->user_data;
+  *result = cqe->res;
+  StoreRelease(cq_head_, head + 1);
+  return true;
+}
+
+#else  // !defined(HAVE_IO_URING)
+
+bool IoUring::Supported() {
+  return false;
+}
+
+IoUring* IoUring::ForCurrentThread() {
+  return NULL;
+}
+
+#endif  // defined(HAVE_IO_URING)
+
+}  // namespace leveldb
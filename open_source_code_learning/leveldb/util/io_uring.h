@@ -0,0 +1,92 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A minimal io_uring submission/completion ring, driven with the raw
+// system calls so that no liburing is needed.  Only built into a working
+// ring when HAVE_IO_URING is defined (see build_detect_platform);
+// elsewhere IoUring::ForCurrentThread() always returns NULL.
+
+#ifndef STORAGE_LEVELDB_UTIL_IO_URING_H_
+#define STORAGE_LEVELDB_UTIL_IO_URING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace leveldb {
+
+class IoUring {
+ public:
+  // Return true iff the kernel supports io_uring and every operation
+  // used below.  The answer is computed once per process.
+  static bool Supported();
+
+  // Return the calling thread's ring, creating it on first use, or NULL
+  // if io_uring is not supported or the ring could not be set up.  The
+  // ring is destroyed when the thread exits.
+  static IoUring* ForCurrentThread();
+
+  // Maximum number of requests that can be queued before SubmitAndWait().
+  unsigned capacity() const { return entries_; }
+
+  // Queue a request whose completion is tagged with "tag".  An offset of
+  // kCurrentPosition reads or writes at the file position, as read(2)
+  // and write(2) do.  If "link" is true the next queued request only
+  // starts once this one completed in full; otherwise it is cancelled.
+  // REQUIRES: fewer than capacity() requests are queued.
+  static const uint64_t kCurrentPosition = ~static_cast<uint64_t>(0);
+  void PrepareRead(int fd, char* buf, size_t n, uint64_t offset,
+                   uint64_t tag);
+  void PrepareWrite(int fd, const char* buf, size_t n, uint64_t offset,
+                    uint64_t tag, bool link);
+  void PrepareDataSync(int fd, uint64_t tag);
+
+  // Submit the queued requests and wait until every request the kernel
+  // accepted has completed.  Returns the number accepted: requests are
+  // accepted in the order they were queued, and any beyond that number
+  // were dropped and will not complete.
+  unsigned SubmitAndWait();
+
+  // Pop the next completion: its tag and its result, which is a byte
+  // count or a negated errno value.  Returns false if there is none.
+  bool Reap(uint64_t* tag, int32_t* result);
+
+ private:
+  IoUring();
+  ~IoUring();
+  bool Init(unsigned entries);
+  void* NextEntry();
+
+  static void InitOnce();
+  static void DeleteRing(void* ring);
+
+  int fd_;
+  unsigned entries_;
+  unsigned queued_;     // Requests prepared since the last SubmitAndWait()
+
+  // Submission queue
+  void* sq_ring_;
+  size_t sq_ring_size_;
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned* sq_mask_;
+  unsigned* sq_array_;
+  void* sqes_;
+  size_t sqes_size_;
+
+  // Completion queue; shares sq_ring_ if cq_ring_ is NULL
+  void* cq_ring_;
+  size_t cq_ring_size_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned* cq_mask_;
+  void* cqes_;
+
+  // No copying allowed
+  IoUring(const IoUring&);
+  void operator=(const IoUring&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_IO_URING_H_
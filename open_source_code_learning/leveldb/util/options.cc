@@ -17,14 +17,34 @@ Options::Options()
       env(Env::Default()),
       info_log(NULL),
       write_buffer_size(4<<20),
+      max_write_buffer_number(2),
+      memtable_factory(NULL),
       max_open_files(1000),
       block_cache(NULL),
+      cache_index_and_filter_blocks(false),
+      persistent_cache(NULL),
+      row_cache(NULL),
       block_size(4096),
       block_restart_interval(16),
+      data_block_hash_index(false),
       max_file_size(2<<20),
       compression(kSnappyCompression),
+      max_dictionary_bytes(0),
+      dictionary_training_blocks(32),
       reuse_logs(false),
-      filter_policy(NULL) {
+      filter_policy(NULL),
+      partition_index_and_filters(false),
+      metadata_block_size(4096),
+      max_background_compactions(1),
+      max_subcompactions(1),
+      enable_pipelined_write(false),
+      allow_concurrent_memtable_write(false),
+      max_multiget_parallelism(1),
+      compaction_readahead_size(2 << 20),
+      use_direct_reads(false),
+      use_direct_io_for_compaction(false),
+      rate_limiter(NULL),
+      statistics(NULL) {
 }
 
 }  // namespace leveldb
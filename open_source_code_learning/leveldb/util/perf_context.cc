@@ -0,0 +1,89 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/perf_context.h"
+
+#include <stdio.h>
+#include "util/perf_context_imp.h"
+
+namespace leveldb {
+
+LEVELDB_THREAD_LOCAL PerfLevel perf_level = kDisable;
+LEVELDB_THREAD_LOCAL PerfContext perf_context;
+
+void SetPerfLevel(PerfLevel level) {
+  perf_level = level;
+}
+
+PerfLevel GetPerfLevel() {
+  return perf_level;
+}
+
+PerfContext* GetPerfContext() {
+  return &perf_context;
+}
+
+namespace {
+struct Field {
+  const char* name;
+  uint64_t PerfContext::*value;
+};
+}  // namespace
+
+static const Field kFields[] = {
+  { "db_mutex_lock_nanos", &PerfContext::db_mutex_lock_nanos },
+  { "get_from_memtable_count", &PerfContext::get_from_memtable_count },
+  { "get_from_memtable_nanos", &PerfContext::get_from_memtable_nanos },
+  { "get_from_output_files_nanos", &PerfContext::get_from_output_files_nanos },
+  { "find_table_nanos", &PerfContext::find_table_nanos },
+  { "table_open_count", &PerfContext::table_open_count },
+  { "filter_probe_nanos", &PerfContext::filter_probe_nanos },
+  { "filter_useful_count", &PerfContext::filter_useful_count },
+  { "filter_positive_count", &PerfContext::filter_positive_count },
+  { "block_cache_hit_count", &PerfContext::block_cache_hit_count },
+  { "block_read_count", &PerfContext::block_read_count },
+  { "block_read_byte", &PerfContext::block_read_byte },
+  { "block_read_nanos", &PerfContext::block_read_nanos },
+  { "block_decompress_count", &PerfContext::block_decompress_count },
+  { "block_decompress_nanos", &PerfContext::block_decompress_nanos },
+  { "seek_on_memtable_count", &PerfContext::seek_on_memtable_count },
+  { "seek_on_memtable_nanos", &PerfContext::seek_on_memtable_nanos },
+  { "seek_internal_seek_nanos", &PerfContext::seek_internal_seek_nanos },
+  { "find_next_user_entry_nanos", &PerfContext::find_next_user_entry_nanos },
+  { "internal_key_skipped_count", &PerfContext::internal_key_skipped_count },
+  { "internal_delete_skipped_count",
+    &PerfContext::internal_delete_skipped_count },
+};
+
+static const int kNumFields = sizeof(kFields) / sizeof(kFields[0]);
+
+void PerfContext::Reset() {
+  for (int i = 0; i < kNumFields; i++) {
+    this->*kFields[i].value = 0;
+  }
+}
+
+void PerfContext::Add(const PerfContext& other) {
+  for (int i = 0; i < kNumFields; i++) {
+    this->*kFields[i].value += other.*kFields[i].value;
+  }
+}
+
+std::string PerfContext::ToString(bool exclude_zero) const {
+  std::string result;
+  char buf[100];
+  for (int i = 0; i < kNumFields; i++) {
+    const uint64_t value = this->*kFields[i].value;
+    if (exclude_zero && value == 0) {
+      continue;
+    }
+    snprintf(buf, sizeof(buf), "%s%s = %llu",
+             result.empty() ? "" : ", ", kFields[i].name,
+             static_cast<unsigned long long>(value));
+    result.append(buf);
+  }
+  return result;
+}
+
+}  // namespace leveldb
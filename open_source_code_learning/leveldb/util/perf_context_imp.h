@@ -0,0 +1,59 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Helpers to record into the PerfContext of the calling thread.
+
+#ifndef STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
+#define STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "leveldb/env.h"
+#include "leveldb/perf_context.h"
+#include "port/port.h"
+
+namespace leveldb {
+
+extern LEVELDB_THREAD_LOCAL PerfLevel perf_level;
+extern LEVELDB_THREAD_LOCAL PerfContext perf_context;
+
+inline void PerfCount(uint64_t PerfContext::*counter, uint64_t n = 1) {
+  if (perf_level >= kEnableCount) {
+    perf_context.*counter += n;
+  }
+}
+
+// Adds the nanoseconds from its construction to Stop(), or to its
+// destruction, as told by env->NowNanos(), to "timer" of the calling
+// thread's PerfContext if the thread's level is kEnableTime.
+class PerfTimer {
+ public:
+  PerfTimer(Env* env, uint64_t PerfContext::*timer)
+      : env_(env),
+        timer_(perf_level >= kEnableTime ? timer : NULL),
+        start_nanos_(timer_ != NULL ? env->NowNanos() : 0) {
+  }
+
+  ~PerfTimer() { Stop(); }
+
+  void Stop() {
+    if (timer_ != NULL) {
+      perf_context.*timer_ += env_->NowNanos() - start_nanos_;
+      timer_ = NULL;
+    }
+  }
+
+ private:
+  Env* const env_;
+  uint64_t PerfContext::*timer_;
+  const uint64_t start_nanos_;
+
+  // No copying allowed
+  PerfTimer(const PerfTimer&);
+  void operator=(const PerfTimer&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
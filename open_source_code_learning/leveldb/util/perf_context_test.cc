@@ -0,0 +1,238 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/perf_context.h"
+
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
+#include "leveldb/iterator.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class PerfContextTest {
+ public:
+  std::string dbname_;
+  const FilterPolicy* filter_policy_;
+  Options options_;
+  DB* db_;
+
+  PerfContextTest() {
+    dbname_ = test::TmpDir() + "/perf_context_test";
+    filter_policy_ = NewBloomFilterPolicy(10);
+    options_.create_if_missing = true;
+    options_.filter_policy = filter_policy_;
+    DestroyDB(dbname_, options_);
+    ASSERT_OK(DB::Open(options_, dbname_, &db_));
+  }
+
+  ~PerfContextTest() {
+    SetPerfLevel(kDisable);
+    delete db_;
+    DestroyDB(dbname_, Options());
+    delete filter_policy_;
+  }
+
+  std::string Get(const std::string& k) {
+    std::string result;
+    Status s = db_->Get(ReadOptions(), k, &result);
+    if (s.IsNotFound()) {
+      result = "NOT_FOUND";
+    } else if (!s.ok()) {
+      result = s.ToString();
+    }
+    return result;
+  }
+};
+
+TEST(PerfContextTest, Disabled) {
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "va"));
+  SetPerfLevel(kDisable);
+  GetPerfContext()->Reset();
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("", GetPerfContext()->ToString());
+}
+
+TEST(PerfContextTest, CountsOnly) {
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "va"));
+  SetPerfLevel(kEnableCount);
+  ASSERT_EQ(kEnableCount, GetPerfLevel());
+  GetPerfContext()->Reset();
+  ASSERT_EQ("va", Get("a"));
+  const PerfContext* perf = GetPerfContext();
+  ASSERT_EQ(1, perf->get_from_memtable_count);
+  ASSERT_EQ(0, perf->get_from_memtable_nanos);
+  ASSERT_EQ(0, perf->db_mutex_lock_nanos);
+  ASSERT_EQ(0, perf->find_table_nanos);
+}
+
+TEST(PerfContextTest, GetFromTable) {
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "va"));
+  ASSERT_OK(db_->Put(WriteOptions(), "c", "vc"));
+  db_->CompactRange(NULL, NULL);
+
+  SetPerfLevel(kEnableTime);
+  GetPerfContext()->Reset();
+  ASSERT_EQ("va", Get("a"));
+  const PerfContext* perf = GetPerfContext();
+  ASSERT_GE(perf->get_from_memtable_count, 1);
+  ASSERT_GT(perf->get_from_output_files_nanos, 0);
+  ASSERT_GT(perf->find_table_nanos, 0);
+  ASSERT_EQ(1, perf->filter_positive_count);
+  ASSERT_EQ(1, perf->block_read_count);
+  ASSERT_GT(perf->block_read_byte, 0);
+
+  // The table is open now.  Whether the block comes from the block cache
+  // depends on the Env, and "b" may pass the filter as a false positive.
+  GetPerfContext()->Reset();
+  ASSERT_EQ("vc", Get("c"));
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ(0, perf->table_open_count);
+  ASSERT_GE(perf->block_read_count + perf->block_cache_hit_count, 1);
+  ASSERT_EQ(2, perf->filter_useful_count + perf->filter_positive_count);
+  ASSERT_GT(perf->filter_probe_nanos, 0);
+}
+
+TEST(PerfContextTest, Seek) {
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "va"));
+  ASSERT_OK(db_->Put(WriteOptions(), "b", "vb"));
+  ASSERT_OK(db_->Delete(WriteOptions(), "b"));
+  ASSERT_OK(db_->Put(WriteOptions(), "c", "vc"));
+
+  // Seek("b") passes the deletion of "b" and the value it hides.
+  SetPerfLevel(kEnableTime);
+  GetPerfContext()->Reset();
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->Seek("b");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("c", iter->key().ToString());
+  delete iter;
+
+  const PerfContext* perf = GetPerfContext();
+  ASSERT_EQ(1, perf->seek_on_memtable_count);
+  ASSERT_GT(perf->seek_internal_seek_nanos, 0);
+  ASSERT_GT(perf->find_next_user_entry_nanos, 0);
+  ASSERT_EQ(1, perf->internal_key_skipped_count);
+  ASSERT_EQ(1, perf->internal_delete_skipped_count);
+}
+
+namespace {
+// Counts the clock reads of the timers.
+class NanosCountingEnv : public EnvWrapper {
+ public:
+  port::AtomicPointer calls;
+
+  NanosCountingEnv() : EnvWrapper(Env::Default()) {
+    calls.NoBarrier_Store(NULL);
+  }
+
+  virtual uint64_t NowNanos() {
+    uintptr_t n = reinterpret_cast<uintptr_t>(calls.NoBarrier_Load());
+    calls.NoBarrier_Store(reinterpret_cast<void*>(n + 1));
+    return target()->NowNanos();
+  }
+
+  uintptr_t Calls() const {
+    return reinterpret_cast<uintptr_t>(calls.NoBarrier_Load());
+  }
+};
+}
+
+TEST(PerfContextTest, TimersUseOptionsEnv) {
+  NanosCountingEnv env;
+  delete db_;
+  DestroyDB(dbname_, options_);
+  options_.env = &env;
+  ASSERT_OK(DB::Open(options_, dbname_, &db_));
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "va"));
+
+  SetPerfLevel(kEnableCount);
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ(0, env.Calls());
+
+  SetPerfLevel(kEnableTime);
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_GT(env.Calls(), 0);
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  const uintptr_t before_seek = env.Calls();
+  iter->Seek("a");
+  ASSERT_TRUE(iter->Valid());
+  delete iter;
+  ASSERT_GT(env.Calls(), before_seek);
+
+  SetPerfLevel(kDisable);
+  delete db_;
+  db_ = NULL;
+  DestroyDB(dbname_, options_);
+  options_.env = Env::Default();
+  ASSERT_OK(DB::Open(options_, dbname_, &db_));
+}
+
+TEST(PerfContextTest, AddAndToString) {
+  PerfContext a, b;
+  a.Reset();
+  b.Reset();
+  a.block_read_count = 2;
+  b.block_read_count = 3;
+  b.table_open_count = 1;
+  a.Add(b);
+  ASSERT_EQ(5, a.block_read_count);
+  ASSERT_EQ("table_open_count = 1, block_read_count = 5", a.ToString());
+  ASSERT_TRUE(a.ToString(false).find("db_mutex_lock_nanos = 0") !=
+              std::string::npos);
+}
+
+namespace {
+struct ThreadState {
+  port::Mutex mu;
+  port::CondVar cv;
+  bool done;
+  PerfLevel level;
+  uint64_t count;
+
+  ThreadState() : cv(&mu), done(false), level(kEnableTime), count(1) { }
+};
+}
+
+static void CountFromThread(void* arg) {
+  ThreadState* state = reinterpret_cast<ThreadState*>(arg);
+  // A new thread starts disabled with a zeroed context.
+  const PerfLevel level = GetPerfLevel();
+  const uint64_t count = GetPerfContext()->block_read_count;
+  SetPerfLevel(kEnableCount);
+  GetPerfContext()->block_read_count = 100;
+  MutexLock l(&state->mu);
+  state->level = level;
+  state->count = count;
+  state->done = true;
+  state->cv.SignalAll();
+}
+
+TEST(PerfContextTest, ThreadLocal) {
+  SetPerfLevel(kEnableTime);
+  GetPerfContext()->Reset();
+  GetPerfContext()->block_read_count = 7;
+
+  ThreadState state;
+  Env::Default()->StartThread(CountFromThread, &state);
+  {
+    MutexLock l(&state.mu);
+    while (!state.done) {
+      state.cv.Wait();
+    }
+  }
+  ASSERT_EQ(kDisable, state.level);
+  ASSERT_EQ(0, state.count);
+  ASSERT_EQ(kEnableTime, GetPerfLevel());
+  ASSERT_EQ(7, GetPerfContext()->block_read_count);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
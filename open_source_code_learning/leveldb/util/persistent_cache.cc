@@ -0,0 +1,524 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/persistent_cache.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/logging.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+PersistentCache::~PersistentCache() {
+}
+
+namespace {
+
+// The cache is kept in numbered log files ("segments").  Each is written
+// once, from start to end, and deleted as a whole when the segments
+// written after it hold "capacity" bytes.  A segment holds a sequence of
+// records:
+//    block crc: fixed32     masked crc32c of the block
+//    key length: fixed32
+//    block length: fixed32
+//    header crc: fixed32    masked crc32c of the 12 bytes above and the key
+//    key: char[key length]
+//    block: char[block length]
+// Opening the cache reads the headers and keys back into the index; a
+// header that does not verify ends its segment, as it is most likely a
+// record torn by a crash.  Blocks are only verified when they are read.
+static const size_t kHeaderSize = 16;
+
+// The capacity is split into this many segments, so that dropping the
+// oldest one frees about this fraction of it.
+static const int kNumSegments = 16;
+
+// Inserts are dropped while this many bytes of earlier ones are waiting
+// to be written.
+static const size_t kMaxPendingBytes = 8 << 20;
+
+// Keys longer than this are taken for garbage when the cache is opened.
+static const uint32_t kMaxKeyLength = 1 << 16;
+
+static std::string SegmentFileName(const std::string& dirname,
+                                   uint64_t number) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "/%06llu.pcache",
+           static_cast<unsigned long long>(number));
+  return dirname + buf;
+}
+
+static bool ParseSegmentFileName(const std::string& fname, uint64_t* number) {
+  Slice rest(fname);
+  uint64_t num;
+  if (!ConsumeDecimalNumber(&rest, &num) || rest != Slice(".pcache")) {
+    return false;
+  }
+  *number = num;
+  return true;
+}
+
+static void EncodeRecord(const Slice& key, const Slice& block,
+                         std::string* dst) {
+  char header[kHeaderSize];
+  EncodeFixed32(header, crc32c::Mask(crc32c::Value(block.data(),
+                                                   block.size())));
+  EncodeFixed32(header + 4, static_cast<uint32_t>(key.size()));
+  EncodeFixed32(header + 8, static_cast<uint32_t>(block.size()));
+  uint32_t crc = crc32c::Value(header, 12);
+  crc = crc32c::Extend(crc, key.data(), key.size());
+  EncodeFixed32(header + 12, crc32c::Mask(crc));
+  dst->reserve(kHeaderSize + key.size() + block.size());
+  dst->append(header, kHeaderSize);
+  dst->append(key.data(), key.size());
+  dst->append(block.data(), block.size());
+}
+
+// Decode the lengths in "header" and check them against its checksum
+// and "key".
+static bool DecodeHeader(const char* header, const Slice& key,
+                         uint32_t* block_length) {
+  if (DecodeFixed32(header + 4) != key.size()) {
+    return false;
+  }
+  uint32_t crc = crc32c::Value(header, 12);
+  crc = crc32c::Extend(crc, key.data(), key.size());
+  if (crc32c::Unmask(DecodeFixed32(header + 12)) != crc) {
+    return false;
+  }
+  *block_length = DecodeFixed32(header + 8);
+  return true;
+}
+
+class LogPersistentCache : public PersistentCache {
+ public:
+  LogPersistentCache(Env* env, const std::string& dirname, uint64_t capacity);
+  virtual ~LogPersistentCache();
+
+  // Index the segments left by an earlier instance and start writing.
+  Status Open();
+
+  virtual void Insert(const Slice& key, const Slice& block);
+  virtual bool Lookup(const Slice& key, std::string* block);
+
+ private:
+  // Where a record is.
+  struct Location {
+    uint64_t segment;
+    uint64_t offset;
+    uint64_t length;
+  };
+
+  // A segment is reopened after each batch written to it, since a file
+  // need not show data appended after it was opened.  Readers are
+  // counted so that lookups may keep using the one they started with.
+  struct Reader {
+    RandomAccessFile* file;
+    int refs;
+  };
+
+  struct Segment {
+    uint64_t size;   // Bytes of its records that are in the index
+    Reader* reader;
+  };
+
+  struct PendingRecord {
+    std::string key;
+    std::string record;
+  };
+
+  typedef std::vector<std::pair<std::string, Location> > WrittenList;
+
+  static void BGWork(void* cache);
+  void BackgroundWrite();
+
+  // Write "batch" out.  Called by the writer thread without mutex_ held.
+  void WriteBatch(std::deque<PendingRecord>* batch);
+
+  // Make the records in *written, which are in the segment being written,
+  // visible to lookups, and clear *written.
+  void InstallWritten(WrittenList* written);
+
+  Status IndexSegment(uint64_t number, uint64_t* size);
+  void AddSegment(uint64_t number, uint64_t size, RandomAccessFile* file);
+  void DeleteOldSegments();
+  void Unref(Reader* reader);
+
+  Env* const env_;
+  const std::string dirname_;
+  const uint64_t capacity_;
+  const uint64_t segment_size_;
+
+  // Only used by the writer thread once Open() has started it.
+  WritableFile* file_;     // Segment being written, or NULL
+  uint64_t file_number_;
+  uint64_t file_size_;
+  uint64_t next_segment_;
+
+  port::Mutex mutex_;
+  port::CondVar cv_;
+  std::map<std::string, Location> index_;
+  std::map<uint64_t, Segment> segments_;
+  uint64_t total_size_;    // Sum of the sizes of segments_
+  std::deque<PendingRecord> pending_;
+  size_t pending_bytes_;
+  bool started_;
+  bool shutting_down_;
+  bool writer_done_;
+};
+
+LogPersistentCache::LogPersistentCache(Env* env, const std::string& dirname,
+                                       uint64_t capacity)
+    : env_(env),
+      dirname_(dirname),
+      capacity_(capacity),
+      segment_size_(std::max<uint64_t>(capacity / kNumSegments, 1)),
+      file_(NULL),
+      file_number_(0),
+      file_size_(0),
+      next_segment_(1),
+      cv_(&mutex_),
+      total_size_(0),
+      pending_bytes_(0),
+      started_(false),
+      shutting_down_(false),
+      writer_done_(false) {
+}
+
+LogPersistentCache::~LogPersistentCache() {
+  mutex_.Lock();
+  shutting_down_ = true;
+  cv_.SignalAll();
+  while (started_ && !writer_done_) {
+    cv_.Wait();
+  }
+  mutex_.Unlock();
+
+  delete file_;
+  for (std::map<uint64_t, Segment>::iterator it = segments_.begin();
+       it != segments_.end(); ++it) {
+    Unref(it->second.reader);
+  }
+}
+
+Status LogPersistentCache::Open() {
+  env_->CreateDir(dirname_);  // Ignore error; it may already exist
+  std::vector<std::string> children;
+  Status s = env_->GetChildren(dirname_, &children);
+  if (!s.ok()) {
+    return s;
+  }
+  std::vector<uint64_t> numbers;
+  for (size_t i = 0; i < children.size(); i++) {
+    uint64_t number;
+    if (ParseSegmentFileName(children[i], &number)) {
+      numbers.push_back(number);
+    }
+  }
+  // Later segments overwrite the index entries of earlier ones.
+  std::sort(numbers.begin(), numbers.end());
+  for (size_t i = 0; i < numbers.size(); i++) {
+    uint64_t size = 0;
+    IndexSegment(numbers[i], &size);
+    RandomAccessFile* file = NULL;
+    const std::string fname = SegmentFileName(dirname_, numbers[i]);
+    if (size == 0 || !env_->NewRandomAccessFile(fname, &file).ok()) {
+      env_->DeleteFile(fname);
+    } else {
+      MutexLock l(&mutex_);
+      AddSegment(numbers[i], size, file);
+    }
+    next_segment_ = numbers[i] + 1;
+  }
+
+  MutexLock l(&mutex_);
+  // The index may refer to segments that could not be reopened.
+  for (std::map<std::string, Location>::iterator it = index_.begin();
+       it != index_.end(); ) {
+    if (segments_.count(it->second.segment) == 0) {
+      index_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+  DeleteOldSegments();
+  started_ = true;
+  env_->StartThread(&LogPersistentCache::BGWork, this);
+  return Status::OK();
+}
+
+Status LogPersistentCache::IndexSegment(uint64_t number, uint64_t* size) {
+  const std::string fname = SegmentFileName(dirname_, number);
+  uint64_t file_size;
+  Status s = env_->GetFileSize(fname, &file_size);
+  SequentialFile* file;
+  if (s.ok()) {
+    s = env_->NewSequentialFile(fname, &file);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+
+  uint64_t offset = 0;
+  char header[kHeaderSize];
+  std::string key;
+  while (offset + kHeaderSize <= file_size) {
+    Slice result;
+    s = file->Read(kHeaderSize, &result, header);
+    if (!s.ok() || result.size() != kHeaderSize) {
+      break;
+    }
+    const uint32_t key_length = DecodeFixed32(result.data() + 4);
+    if (key_length > kMaxKeyLength) {
+      break;
+    }
+    key.resize(key_length);
+    s = file->Read(key_length, &result, &key[0]);
+    if (!s.ok() || result.size() != key_length) {
+      break;
+    }
+    uint32_t block_length;
+    if (!DecodeHeader(header, result, &block_length)) {
+      break;
+    }
+    const uint64_t length = kHeaderSize + key_length + block_length;
+    if (offset + length > file_size || !file->Skip(block_length).ok()) {
+      break;
+    }
+    Location loc;
+    loc.segment = number;
+    loc.offset = offset;
+    loc.length = length;
+    index_[result.ToString()] = loc;
+    offset += length;
+  }
+  delete file;
+  *size = offset;
+  return s;
+}
+
+void LogPersistentCache::Insert(const Slice& key, const Slice& block) {
+  PendingRecord pending;
+  {
+    MutexLock l(&mutex_);
+    if (shutting_down_ || pending_bytes_ >= kMaxPendingBytes ||
+        index_.count(key.ToString()) != 0) {
+      return;
+    }
+  }
+  pending.key = key.ToString();
+  EncodeRecord(key, block, &pending.record);
+
+  MutexLock l(&mutex_);
+  if (!shutting_down_) {
+    pending_bytes_ += pending.record.size();
+    pending_.push_back(PendingRecord());
+    pending_.back().key.swap(pending.key);
+    pending_.back().record.swap(pending.record);
+    cv_.SignalAll();
+  }
+}
+
+bool LogPersistentCache::Lookup(const Slice& key, std::string* block) {
+  Location loc;
+  Reader* reader;
+  {
+    MutexLock l(&mutex_);
+    std::map<std::string, Location>::const_iterator it =
+        index_.find(key.ToString());
+    if (it == index_.end()) {
+      return false;
+    }
+    loc = it->second;
+    reader = segments_[loc.segment].reader;
+    reader->refs++;
+  }
+
+  std::string scratch;
+  scratch.resize(loc.length);
+  Slice result;
+  Status s = reader->file->Read(loc.offset, loc.length, &result, &scratch[0]);
+  bool ok = false;
+  uint32_t block_length;
+  if (s.ok() && result.size() == loc.length &&
+      DecodeHeader(result.data(), key, &block_length) &&
+      kHeaderSize + key.size() + block_length == loc.length &&
+      Slice(result.data() + kHeaderSize, key.size()) == key) {
+    const char* data = result.data() + kHeaderSize + key.size();
+    const uint32_t crc = crc32c::Unmask(DecodeFixed32(result.data()));
+    if (crc32c::Value(data, block_length) == crc) {
+      block->assign(data, block_length);
+      ok = true;
+    }
+  }
+
+  MutexLock l(&mutex_);
+  Unref(reader);
+  if (!ok) {
+    // Do not read the bad record again.
+    std::map<std::string, Location>::iterator it = index_.find(key.ToString());
+    if (it != index_.end() && it->second.segment == loc.segment &&
+        it->second.offset == loc.offset) {
+      index_.erase(it);
+    }
+  }
+  return ok;
+}
+
+void LogPersistentCache::BGWork(void* cache) {
+  reinterpret_cast<LogPersistentCache*>(cache)->BackgroundWrite();
+}
+
+void LogPersistentCache::BackgroundWrite() {
+  MutexLock l(&mutex_);
+  while (true) {
+    while (pending_.empty() && !shutting_down_) {
+      cv_.Wait();
+    }
+    if (pending_.empty()) {
+      break;
+    }
+    std::deque<PendingRecord> batch;
+    batch.swap(pending_);
+    pending_bytes_ = 0;
+    mutex_.Unlock();
+    WriteBatch(&batch);
+    mutex_.Lock();
+  }
+  writer_done_ = true;
+  cv_.SignalAll();
+}
+
+void LogPersistentCache::WriteBatch(std::deque<PendingRecord>* batch) {
+  WrittenList written;
+  for (size_t i = 0; i < batch->size(); i++) {
+    const PendingRecord& pending = (*batch)[i];
+    if (file_ != NULL && file_size_ > 0 &&
+        file_size_ + pending.record.size() > segment_size_) {
+      InstallWritten(&written);
+      file_->Close();
+      delete file_;
+      file_ = NULL;
+    }
+    if (file_ == NULL) {
+      file_number_ = next_segment_++;
+      file_size_ = 0;
+      if (!env_->NewWritableFile(SegmentFileName(dirname_, file_number_),
+                                 &file_).ok()) {
+        file_ = NULL;
+        return;
+      }
+    }
+    if (!file_->Append(pending.record).ok()) {
+      // Give up on the segment; what was installed stays readable.
+      written.clear();
+      delete file_;
+      file_ = NULL;
+      return;
+    }
+    Location loc;
+    loc.segment = file_number_;
+    loc.offset = file_size_;
+    loc.length = pending.record.size();
+    written.push_back(std::make_pair(pending.key, loc));
+    file_size_ += loc.length;
+  }
+  InstallWritten(&written);
+}
+
+void LogPersistentCache::InstallWritten(WrittenList* written) {
+  if (written->empty()) {
+    return;
+  }
+  RandomAccessFile* file = NULL;
+  if (!file_->Flush().ok() ||
+      !env_->NewRandomAccessFile(SegmentFileName(dirname_, file_number_),
+                                 &file).ok()) {
+    written->clear();
+    return;
+  }
+
+  MutexLock l(&mutex_);
+  AddSegment(file_number_, file_size_, file);
+  for (size_t i = 0; i < written->size(); i++) {
+    index_[(*written)[i].first] = (*written)[i].second;
+  }
+  written->clear();
+  DeleteOldSegments();
+}
+
+// REQUIRES: mutex_ held
+void LogPersistentCache::AddSegment(uint64_t number, uint64_t size,
+                                    RandomAccessFile* file) {
+  Reader* reader = new Reader;
+  reader->file = file;
+  reader->refs = 1;
+  std::map<uint64_t, Segment>::iterator it = segments_.find(number);
+  if (it == segments_.end()) {
+    Segment segment;
+    segment.size = size;
+    segment.reader = reader;
+    segments_[number] = segment;
+    total_size_ += size;
+  } else {
+    total_size_ += size - it->second.size;
+    it->second.size = size;
+    Unref(it->second.reader);
+    it->second.reader = reader;
+  }
+}
+
+// REQUIRES: mutex_ held
+void LogPersistentCache::DeleteOldSegments() {
+  while (total_size_ > capacity_ && segments_.size() > 1) {
+    std::map<uint64_t, Segment>::iterator oldest = segments_.begin();
+    const uint64_t number = oldest->first;
+    for (std::map<std::string, Location>::iterator it = index_.begin();
+         it != index_.end(); ) {
+      if (it->second.segment == number) {
+        index_.erase(it++);
+      } else {
+        ++it;
+      }
+    }
+    total_size_ -= oldest->second.size;
+    Unref(oldest->second.reader);
+    segments_.erase(oldest);
+    env_->DeleteFile(SegmentFileName(dirname_, number));
+  }
+}
+
+// REQUIRES: mutex_ held, or no other thread using the cache
+void LogPersistentCache::Unref(Reader* reader) {
+  reader->refs--;
+  if (reader->refs == 0) {
+    delete reader->file;
+    delete reader;
+  }
+}
+
+}  // namespace
+
+Status NewPersistentCache(Env* env, const std::string& dirname,
+                          uint64_t capacity, PersistentCache** result) {
+  *result = NULL;
+  LogPersistentCache* cache = new LogPersistentCache(env, dirname, capacity);
+  Status s = cache->Open();
+  if (s.ok()) {
+    *result = cache;
+  } else {
+    delete cache;
+  }
+  return s;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,210 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/persistent_cache.h"
+
+#include <vector>
+#include "leveldb/env.h"
+#include "util/testharness.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+static std::string Key(int i) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "block%06d", i);
+  return buf;
+}
+
+static std::string Block(int i, size_t size) {
+  return std::string(size, static_cast<char>('a' + i % 26));
+}
+
+class PersistentCacheTest {
+ public:
+  Env* env_;
+  std::string dirname_;
+  PersistentCache* cache_;
+
+  PersistentCacheTest() : env_(Env::Default()), cache_(NULL) {
+    dirname_ = test::TmpDir() + "/persistent_cache_test";
+    std::vector<std::string> children;
+    env_->GetChildren(dirname_, &children);
+    for (size_t i = 0; i < children.size(); i++) {
+      env_->DeleteFile(dirname_ + "/" + children[i]);
+    }
+  }
+
+  ~PersistentCacheTest() {
+    delete cache_;
+  }
+
+  // Delete the cache, which writes out the blocks inserted so far, and
+  // open it again.
+  void Reopen(uint64_t capacity) {
+    delete cache_;
+    cache_ = NULL;
+    ASSERT_OK(NewPersistentCache(env_, dirname_, capacity, &cache_));
+  }
+
+  std::string Lookup(const std::string& key) {
+    std::string block;
+    if (!cache_->Lookup(key, &block)) {
+      return "NOT_FOUND";
+    }
+    return block;
+  }
+
+  // Wait for the block under "key" to be written.
+  bool WaitFor(const std::string& key) {
+    std::string block;
+    for (int i = 0; i < 5000; i++) {
+      if (cache_->Lookup(key, &block)) {
+        return true;
+      }
+      env_->SleepForMicroseconds(1000);
+    }
+    return false;
+  }
+
+  uint64_t TotalFileSize() {
+    std::vector<std::string> children;
+    env_->GetChildren(dirname_, &children);
+    uint64_t total = 0;
+    for (size_t i = 0; i < children.size(); i++) {
+      uint64_t size;
+      if (env_->GetFileSize(dirname_ + "/" + children[i], &size).ok()) {
+        total += size;
+      }
+    }
+    return total;
+  }
+
+  // Flip a byte "offset" bytes from the end of each cache file.
+  void CorruptFilesAt(int offset) {
+    std::vector<std::string> children;
+    env_->GetChildren(dirname_, &children);
+    for (size_t i = 0; i < children.size(); i++) {
+      const std::string fname = dirname_ + "/" + children[i];
+      std::string contents;
+      if (!ReadFileToString(env_, fname, &contents).ok() ||
+          contents.size() < static_cast<size_t>(offset)) {
+        continue;
+      }
+      contents[contents.size() - offset] ^= 0x80;
+      ASSERT_OK(WriteStringToFile(env_, contents, fname));
+    }
+  }
+};
+
+TEST(PersistentCacheTest, InsertAndLookup) {
+  Reopen(1 << 20);
+  ASSERT_EQ("NOT_FOUND", Lookup(Key(1)));
+  cache_->Insert(Key(1), Block(1, 100));
+  ASSERT_TRUE(WaitFor(Key(1)));
+  ASSERT_EQ(Block(1, 100), Lookup(Key(1)));
+  ASSERT_EQ("NOT_FOUND", Lookup(Key(2)));
+
+  // A key that is already stored keeps its block.
+  cache_->Insert(Key(1), Block(2, 100));
+  cache_->Insert(Key(2), Block(2, 200));
+  ASSERT_TRUE(WaitFor(Key(2)));
+  ASSERT_EQ(Block(1, 100), Lookup(Key(1)));
+  ASSERT_EQ(Block(2, 200), Lookup(Key(2)));
+}
+
+TEST(PersistentCacheTest, Reopen) {
+  Reopen(1 << 20);
+  for (int i = 0; i < 100; i++) {
+    cache_->Insert(Key(i), Block(i, 1000));
+  }
+  Reopen(1 << 20);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(Block(i, 1000), Lookup(Key(i)));
+  }
+
+  // Blocks written after reopening go to a new file.
+  cache_->Insert(Key(100), Block(100, 1000));
+  Reopen(1 << 20);
+  ASSERT_EQ(Block(0, 1000), Lookup(Key(0)));
+  ASSERT_EQ(Block(100, 1000), Lookup(Key(100)));
+}
+
+TEST(PersistentCacheTest, CorruptBlock) {
+  Reopen(1 << 20);
+  cache_->Insert(Key(1), Block(1, 100));
+  cache_->Insert(Key(2), Block(2, 100));
+  delete cache_;
+  cache_ = NULL;
+  CorruptFilesAt(10);  // In the block of Key(2)
+  Reopen(1 << 20);
+  ASSERT_EQ(Block(1, 100), Lookup(Key(1)));
+  ASSERT_EQ("NOT_FOUND", Lookup(Key(2)));
+  // The bad block stays out of the cache once it has been noticed.
+  ASSERT_EQ("NOT_FOUND", Lookup(Key(2)));
+}
+
+TEST(PersistentCacheTest, CorruptHeader) {
+  Reopen(1 << 20);
+  cache_->Insert(Key(1), Block(1, 100));
+  cache_->Insert(Key(2), Block(2, 100));
+  delete cache_;
+  cache_ = NULL;
+  // The key of the last record, which is checked when the cache is
+  // opened.
+  CorruptFilesAt(101);
+  Reopen(1 << 20);
+  ASSERT_EQ(Block(1, 100), Lookup(Key(1)));
+  ASSERT_EQ("NOT_FOUND", Lookup(Key(2)));
+}
+
+TEST(PersistentCacheTest, TornRecord) {
+  Reopen(1 << 20);
+  cache_->Insert(Key(1), Block(1, 100));
+  cache_->Insert(Key(2), Block(2, 100));
+  delete cache_;
+  cache_ = NULL;
+  std::vector<std::string> children;
+  env_->GetChildren(dirname_, &children);
+  for (size_t i = 0; i < children.size(); i++) {
+    const std::string fname = dirname_ + "/" + children[i];
+    std::string contents;
+    if (ReadFileToString(env_, fname, &contents).ok() && !contents.empty()) {
+      contents.resize(contents.size() - 1);
+      ASSERT_OK(WriteStringToFile(env_, contents, fname));
+    }
+  }
+  Reopen(1 << 20);
+  ASSERT_EQ(Block(1, 100), Lookup(Key(1)));
+  ASSERT_EQ("NOT_FOUND", Lookup(Key(2)));
+}
+
+TEST(PersistentCacheTest, Capacity) {
+  const uint64_t kCapacity = 256 << 10;
+  Reopen(kCapacity);
+  for (int i = 0; i < 1000; i++) {
+    cache_->Insert(Key(i), Block(i, 4000));
+    ASSERT_TRUE(WaitFor(Key(i)));
+  }
+  // The oldest blocks were dropped to make room for the latest.
+  ASSERT_EQ("NOT_FOUND", Lookup(Key(0)));
+  ASSERT_EQ(Block(999, 4000), Lookup(Key(999)));
+  ASSERT_LE(TotalFileSize(), kCapacity + kCapacity / 8);
+  int found = 0;
+  for (int i = 0; i < 1000; i++) {
+    found += (Lookup(Key(i)) != "NOT_FOUND");
+  }
+  ASSERT_GT(found, 40);
+  ASSERT_LE(found, 70);
+
+  Reopen(kCapacity);
+  ASSERT_EQ(Block(999, 4000), Lookup(Key(999)));
+  ASSERT_LE(TotalFileSize(), kCapacity + kCapacity / 8);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
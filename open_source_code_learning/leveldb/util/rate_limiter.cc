@@ -0,0 +1,94 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/rate_limiter.h"
+
+#include <algorithm>
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+RateLimiter::~RateLimiter() {
+}
+
+namespace {
+
+// An auto-tuned limiter's rate at a debt just below 1, as a multiple of
+// its rate without debt.
+static const double kAutoTuneMaxFactor = 8;
+
+// Tokens left unused accumulate for at most this long, which bounds the
+// burst that may follow a quiet period.
+static const double kMaxBurstSeconds = 0.1;
+
+// Tokens are handed out as they are requested, and the balance may go
+// negative: each Request() reserves its bytes and then sleeps until the
+// balance it left behind has been refilled.  Requests are thus served
+// in order without any of them holding the mutex while it waits.
+class TokenBucketRateLimiter : public RateLimiter {
+ public:
+  TokenBucketRateLimiter(int64_t bytes_per_second, bool auto_tune)
+      : env_(Env::Default()),
+        auto_tune_(auto_tune),
+        bytes_per_second_(std::max<int64_t>(bytes_per_second, 1)),
+        available_(0),
+        last_refill_micros_(env_->NowMicros()) {
+  }
+
+  virtual void Request(int64_t bytes, double debt) {
+    double wait_seconds = 0;
+    {
+      MutexLock l(&mu_);
+      double rate = bytes_per_second_;
+      if (auto_tune_) {
+        if (debt >= 1) {
+          return;
+        }
+        rate *= 1 + (kAutoTuneMaxFactor - 1) * std::max(debt, 0.0);
+      }
+      const uint64_t now = env_->NowMicros();
+      if (now > last_refill_micros_) {
+        available_ += rate * (now - last_refill_micros_) / 1e6;
+        available_ = std::min(available_, rate * kMaxBurstSeconds);
+        last_refill_micros_ = now;
+      }
+      available_ -= bytes;
+      if (available_ < 0) {
+        wait_seconds = -available_ / rate;
+      }
+    }
+    if (wait_seconds > 0) {
+      env_->SleepForMicroseconds(static_cast<int>(wait_seconds * 1e6));
+    }
+  }
+
+  virtual int64_t GetBytesPerSecond() const {
+    MutexLock l(&mu_);
+    return bytes_per_second_;
+  }
+
+  virtual void SetBytesPerSecond(int64_t bytes_per_second) {
+    MutexLock l(&mu_);
+    bytes_per_second_ = std::max<int64_t>(bytes_per_second, 1);
+  }
+
+ private:
+  Env* const env_;
+  const bool auto_tune_;
+
+  mutable port::Mutex mu_;
+  int64_t bytes_per_second_;
+  double available_;            // Bytes that may be written without waiting
+  uint64_t last_refill_micros_;
+};
+
+}  // namespace
+
+RateLimiter* NewRateLimiter(int64_t bytes_per_second, bool auto_tune) {
+  return new TokenBucketRateLimiter(bytes_per_second, auto_tune);
+}
+
+}  // namespace leveldb
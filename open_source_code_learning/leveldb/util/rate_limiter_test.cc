@@ -0,0 +1,61 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/rate_limiter.h"
+
+#include "leveldb/env.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class RateLimiterTest {
+ public:
+  // Return the seconds it takes "limiter" to let through "n" requests
+  // of "bytes" bytes each at the given debt.
+  static double TimeRequests(RateLimiter* limiter, int n, int64_t bytes,
+                             double debt) {
+    Env* env = Env::Default();
+    const uint64_t start = env->NowMicros();
+    for (int i = 0; i < n; i++) {
+      limiter->Request(bytes, debt);
+    }
+    return (env->NowMicros() - start) / 1e6;
+  }
+};
+
+TEST(RateLimiterTest, Limit) {
+  RateLimiter* limiter = NewRateLimiter(1 << 20, false);
+  ASSERT_EQ(1 << 20, limiter->GetBytesPerSecond());
+  // 256KB at 1MB/s.  The debt is ignored without auto-tuning.
+  const double seconds = TimeRequests(limiter, 64, 4096, 1);
+  ASSERT_GE(seconds, 0.2);
+  ASSERT_LT(seconds, 2);
+
+  limiter->SetBytesPerSecond(64 << 20);
+  ASSERT_EQ(64 << 20, limiter->GetBytesPerSecond());
+  ASSERT_LT(TimeRequests(limiter, 64, 4096, 0), 0.2);
+  delete limiter;
+}
+
+TEST(RateLimiterTest, AutoTune) {
+  RateLimiter* limiter = NewRateLimiter(1 << 20, true);
+  // Without debt: 256KB at 1MB/s.
+  double seconds = TimeRequests(limiter, 64, 4096, 0);
+  ASSERT_GE(seconds, 0.2);
+
+  // Half way to the limit the rate is 4.5MB/s: 1MB in about 0.22s.
+  seconds = TimeRequests(limiter, 256, 4096, 0.5);
+  ASSERT_GE(seconds, 0.15);
+  ASSERT_LT(seconds, 0.8);
+
+  // At the limit writes go through without waiting.
+  ASSERT_LT(TimeRequests(limiter, 1000, 1 << 20, 1), 0.2);
+  delete limiter;
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
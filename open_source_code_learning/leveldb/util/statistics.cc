@@ -0,0 +1,189 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/statistics.h"
+
+#include <stdio.h>
+#include "port/port.h"
+#include "util/histogram.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+static const char* kTickerNames[kTickerCount] = {
+  "leveldb.block.cache.hit",
+  "leveldb.block.cache.miss",
+  "leveldb.persistent.cache.hit",
+  "leveldb.persistent.cache.miss",
+  "leveldb.bloom.filter.useful",
+  "leveldb.bloom.filter.positive",
+  "leveldb.bloom.filter.true.positive",
+  "leveldb.row.cache.hit",
+  "leveldb.row.cache.miss",
+  "leveldb.table.cache.hit",
+  "leveldb.table.cache.miss",
+  "leveldb.memtable.hit",
+  "leveldb.memtable.miss",
+  "leveldb.get.hit.l0",
+  "leveldb.get.hit.l1",
+  "leveldb.get.hit.l2andup",
+  "leveldb.number.keys.read",
+  "leveldb.bytes.read",
+  "leveldb.number.keys.written",
+  "leveldb.bytes.written",
+  "leveldb.number.db.seek",
+  "leveldb.flush.write.bytes",
+  "leveldb.compact.read.bytes",
+  "leveldb.compact.write.bytes",
+  "leveldb.stall.micros",
+};
+
+static const char* kHistogramNames[kHistogramCount] = {
+  "leveldb.db.get.micros",
+  "leveldb.db.multiget.micros",
+  "leveldb.db.write.micros",
+  "leveldb.db.seek.micros",
+  "leveldb.table.open.micros",
+  "leveldb.flush.micros",
+  "leveldb.compaction.micros",
+};
+
+Statistics::~Statistics() { }
+
+const char* Statistics::TickerName(Tickers ticker) {
+  return kTickerNames[ticker];
+}
+
+const char* Statistics::HistogramName(Histograms histogram) {
+  return kHistogramNames[histogram];
+}
+
+namespace {
+
+// Threads are assigned shards round-robin when they first record.
+static const unsigned int kNumShards = 16;
+static port::AtomicCounter next_shard(0);
+static LEVELDB_THREAD_LOCAL int thread_shard = -1;
+
+static unsigned int CurrentShard() {
+  int shard = thread_shard;
+  if (shard < 0) {
+    shard = next_shard.NoBarrier_FetchAdd(1) % kNumShards;
+    thread_shard = shard;
+  }
+  return shard;
+}
+
+// The histograms of a shard keep its tickers on other cache lines than
+// those of its neighbours.
+struct Shard {
+  port::AtomicCounter tickers[kTickerCount];
+  port::Mutex mu;
+  Histogram histograms[kHistogramCount];  // Protected by mu
+};
+
+class StatisticsImpl : public Statistics {
+ public:
+  explicit StatisticsImpl(StatsLevel level) : level_(level) {
+    Reset();
+  }
+
+  virtual void RecordTick(Tickers ticker, uint64_t count) {
+    shards_[CurrentShard()].tickers[ticker].NoBarrier_FetchAdd(count);
+  }
+
+  virtual uint64_t GetTickerCount(Tickers ticker) const {
+    uint64_t sum = 0;
+    for (unsigned int i = 0; i < kNumShards; i++) {
+      sum += shards_[i].tickers[ticker].NoBarrier_Load();
+    }
+    return sum;
+  }
+
+  virtual void MeasureTime(Histograms histogram, uint64_t micros) {
+    Shard* shard = &shards_[CurrentShard()];
+    MutexLock l(&shard->mu);
+    shard->histograms[histogram].Add(static_cast<double>(micros));
+  }
+
+  virtual void GetHistogramData(Histograms histogram,
+                                HistogramData* data) const {
+    Histogram merged;
+    merged.Clear();
+    for (unsigned int i = 0; i < kNumShards; i++) {
+      MutexLock l(&shards_[i].mu);
+      merged.Merge(shards_[i].histograms[histogram]);
+    }
+    data->count = static_cast<uint64_t>(merged.Count());
+    if (data->count == 0) {
+      data->sum = data->average = data->median = 0;
+      data->percentile95 = data->percentile99 = data->max = 0;
+    } else {
+      data->sum = merged.Sum();
+      data->average = merged.Average();
+      data->median = merged.Median();
+      data->percentile95 = merged.Percentile(95);
+      data->percentile99 = merged.Percentile(99);
+      data->max = merged.Max();
+    }
+  }
+
+  virtual StatsLevel GetStatsLevel() const {
+    return static_cast<StatsLevel>(level_.NoBarrier_Load());
+  }
+
+  virtual void SetStatsLevel(StatsLevel level) {
+    level_.NoBarrier_Store(level);
+  }
+
+  virtual void Reset() {
+    for (unsigned int i = 0; i < kNumShards; i++) {
+      for (int t = 0; t < kTickerCount; t++) {
+        shards_[i].tickers[t].NoBarrier_Store(0);
+      }
+      MutexLock l(&shards_[i].mu);
+      for (int h = 0; h < kHistogramCount; h++) {
+        shards_[i].histograms[h].Clear();
+      }
+    }
+  }
+
+  virtual std::string ToString() const {
+    std::string result;
+    char buf[200];
+    for (int t = 0; t < kTickerCount; t++) {
+      snprintf(buf, sizeof(buf), "%s COUNT : %llu\n", kTickerNames[t],
+               static_cast<unsigned long long>(
+                   GetTickerCount(static_cast<Tickers>(t))));
+      result.append(buf);
+    }
+    for (int h = 0; h < kHistogramCount; h++) {
+      HistogramData data;
+      GetHistogramData(static_cast<Histograms>(h), &data);
+      if (data.count == 0) {
+        continue;
+      }
+      snprintf(buf, sizeof(buf),
+               "%s P50 : %.2f P95 : %.2f P99 : %.2f MAX : %.0f "
+               "COUNT : %llu SUM : %.0f\n",
+               kHistogramNames[h], data.median, data.percentile95,
+               data.percentile99, data.max,
+               static_cast<unsigned long long>(data.count), data.sum);
+      result.append(buf);
+    }
+    return result;
+  }
+
+ private:
+  port::AtomicCounter level_;  // A StatsLevel
+  mutable Shard shards_[kNumShards];
+};
+
+}  // namespace
+
+Statistics* NewStatistics(StatsLevel level) {
+  return new StatisticsImpl(level);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,62 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Helpers to record into an optional Options::statistics.
+
+#ifndef STORAGE_LEVELDB_UTIL_STATISTICS_H_
+#define STORAGE_LEVELDB_UTIL_STATISTICS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "leveldb/env.h"
+#include "leveldb/statistics.h"
+
+namespace leveldb {
+
+inline void RecordTick(Statistics* stats, Tickers ticker, uint64_t count = 1) {
+  if (stats != NULL) {
+    stats->RecordTick(ticker, count);
+  }
+}
+
+// For times measured anyway; does not read the clock.
+inline void MeasureTime(Statistics* stats, Histograms histogram,
+                        uint64_t micros) {
+  if (stats != NULL && stats->GetStatsLevel() == kAll) {
+    stats->MeasureTime(histogram, micros);
+  }
+}
+
+// Adds the microseconds from its construction to its destruction to
+// "histogram" of "stats", unless "stats" is NULL or does not measure time.
+class StopWatch {
+ public:
+  StopWatch(Env* env, Statistics* stats, Histograms histogram)
+      : env_(env),
+        stats_((stats != NULL && stats->GetStatsLevel() == kAll) ? stats
+                                                                   : NULL),
+        histogram_(histogram),
+        start_micros_(stats_ != NULL ? env->NowMicros() : 0) {
+  }
+
+  ~StopWatch() {
+    if (stats_ != NULL) {
+      stats_->MeasureTime(histogram_, env_->NowMicros() - start_micros_);
+    }
+  }
+
+ private:
+  Env* const env_;
+  Statistics* const stats_;
+  const Histograms histogram_;
+  const uint64_t start_micros_;
+
+  // No copying allowed
+  StopWatch(const StopWatch&);
+  void operator=(const StopWatch&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_STATISTICS_H_
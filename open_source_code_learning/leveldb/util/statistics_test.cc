@@ -0,0 +1,140 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/statistics.h"
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
+#include "util/statistics.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class StatisticsTest { };
+
+namespace {
+struct ThreadState {
+  Statistics* stats;
+  port::Mutex* mu;
+  port::CondVar* cv;
+  int* running;
+};
+}
+
+static const int kNumThreads = 8;
+static const int kTicksPerThread = 100000;
+
+static void RecordFromThread(void* arg) {
+  ThreadState* state = reinterpret_cast<ThreadState*>(arg);
+  for (int i = 0; i < kTicksPerThread; i++) {
+    state->stats->RecordTick(kBlockCacheHit, 1);
+    state->stats->RecordTick(kBytesRead, 3);
+    state->stats->MeasureTime(kDBGetMicros, i % 100);
+  }
+  MutexLock l(state->mu);
+  (*state->running)--;
+  state->cv->SignalAll();
+}
+
+TEST(StatisticsTest, Tickers) {
+  Statistics* stats = NewStatistics();
+  ASSERT_EQ(kExceptTimers, stats->GetStatsLevel());
+  ASSERT_EQ(0, stats->GetTickerCount(kBlockCacheHit));
+  stats->RecordTick(kBlockCacheHit, 5);
+  stats->RecordTick(kBlockCacheMiss, 1);
+  ASSERT_EQ(5, stats->GetTickerCount(kBlockCacheHit));
+  ASSERT_EQ(1, stats->GetTickerCount(kBlockCacheMiss));
+  ASSERT_EQ(0, stats->GetTickerCount(kStallMicros));
+
+  // The helpers accept a missing Statistics object
+  RecordTick(NULL, kBlockCacheHit);
+  RecordTick(stats, kBlockCacheHit);
+  ASSERT_EQ(6, stats->GetTickerCount(kBlockCacheHit));
+
+  std::string s = stats->ToString();
+  ASSERT_NE(std::string::npos, s.find("leveldb.block.cache.hit COUNT : 6\n"));
+  ASSERT_NE(std::string::npos, s.find("leveldb.stall.micros COUNT : 0\n"));
+  ASSERT_EQ(std::string::npos, s.find("micros P50"));
+
+  stats->Reset();
+  ASSERT_EQ(0, stats->GetTickerCount(kBlockCacheHit));
+  delete stats;
+}
+
+TEST(StatisticsTest, Histograms) {
+  Env* env = Env::Default();
+  Statistics* stats = NewStatistics();
+  {
+    StopWatch watch(env, stats, kDBWriteMicros);
+  }
+  MeasureTime(stats, kFlushMicros, 10);
+  HistogramData data;
+  stats->GetHistogramData(kDBWriteMicros, &data);
+  ASSERT_EQ(0, data.count);
+  stats->GetHistogramData(kFlushMicros, &data);
+  ASSERT_EQ(0, data.count);
+
+  stats->SetStatsLevel(kAll);
+  {
+    StopWatch watch(env, stats, kDBWriteMicros);
+    env->SleepForMicroseconds(1000);
+  }
+  stats->GetHistogramData(kDBWriteMicros, &data);
+  ASSERT_EQ(1, data.count);
+  ASSERT_GE(data.max, 1000);
+  for (int i = 1; i <= 100; i++) {
+    MeasureTime(stats, kFlushMicros, i);
+  }
+  stats->GetHistogramData(kFlushMicros, &data);
+  ASSERT_EQ(100, data.count);
+  ASSERT_EQ(5050, data.sum);
+  ASSERT_EQ(100, data.max);
+  ASSERT_GE(data.median, 40);
+  ASSERT_LE(data.median, 60);
+  ASSERT_GE(data.percentile99, 90);
+
+  std::string s = stats->ToString();
+  ASSERT_NE(std::string::npos, s.find("leveldb.flush.micros P50 : "));
+  ASSERT_EQ(std::string::npos, s.find("leveldb.compaction.micros"));
+
+  stats->Reset();
+  stats->GetHistogramData(kFlushMicros, &data);
+  ASSERT_EQ(0, data.count);
+  delete stats;
+}
+
+TEST(StatisticsTest, ManyThreads) {
+  Statistics* stats = NewStatistics(kAll);
+  port::Mutex mu;
+  port::CondVar cv(&mu);
+  int running = kNumThreads;
+  ThreadState state;
+  state.stats = stats;
+  state.mu = &mu;
+  state.cv = &cv;
+  state.running = &running;
+  for (int i = 0; i < kNumThreads; i++) {
+    Env::Default()->StartThread(&RecordFromThread, &state);
+  }
+  {
+    MutexLock l(&mu);
+    while (running > 0) {
+      cv.Wait();
+    }
+  }
+  const uint64_t total = static_cast<uint64_t>(kNumThreads) * kTicksPerThread;
+  ASSERT_EQ(total, stats->GetTickerCount(kBlockCacheHit));
+  ASSERT_EQ(3 * total, stats->GetTickerCount(kBytesRead));
+  HistogramData data;
+  stats->GetHistogramData(kDBGetMicros, &data);
+  ASSERT_EQ(total, data.count);
+  delete stats;
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}